@@ -137,6 +137,8 @@ Expression *FNCall_init(char *name, LinkedList *args) {
  	FNCall *fncall_expr = safe_alloc(sizeof(FNCall));
  	fncall_expr->name = name;
  	fncall_expr->args = args;
+ 	fncall_expr->call_index = -1;
+ 	fncall_expr->exec_count = 0;
  	
 	// Create a union object to point at the FNCall struct
 	u_expr *u_fncall = safe_alloc(sizeof(u_expr));
@@ -268,8 +270,7 @@ char *Expression_str(Expression *expr) {
 				char *temp = str_concat_2(str_builder, first_arg);
 				free(str_builder);
 				free(first_arg);
-				str_builder = str_concat_2(temp, first_arg);
-				free(temp);
+				str_builder = temp;
 
 				// Then repeatedly add the ', ' and the next arg name, if any
 				int i;
@@ -280,13 +281,12 @@ char *Expression_str(Expression *expr) {
 					free(str_builder);
 					free(next_arg);
 					str_builder = temp;
-					free(temp);
 				}
 
 				// Then add the ')'
 				expr_str = str_concat_2(str_builder, ")");
 			}
-			
+
 			free(str_builder);
 
 			break;
@@ -428,6 +428,67 @@ bool Expression_equals(Expression *expr1, Expression *expr2) {
 	return same;
 }
 
+/*
+ * Creates a deep copy of an expression. The copy shares no memory with the
+ * original, so either can be freed without affecting the other.
+ */
+Expression *Expression_copy(Expression *expr) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr:
+			return BooleanExpr_init(
+				Expression_copy(expr->expr->blean->lhs),
+				expr->expr->blean->op,
+				Expression_copy(expr->expr->blean->rhs));
+
+		case expr_ArithmeticExpr:
+			return ArithmeticExpr_init(
+				Expression_copy(expr->expr->arith->lhs),
+				expr->expr->arith->op,
+				Expression_copy(expr->expr->arith->rhs));
+
+		case expr_Identifier: {
+			// Copy the stack offset along with the name, so that a copy of an
+			// expression that has had its offsets generated can be compiled
+			// without generating them again
+			Expression *copy =
+				Identifier_init(safe_strdup(expr->expr->ident->name));
+			copy->expr->ident->stack_offset = expr->expr->ident->stack_offset;
+			return copy;
+		}
+
+		case expr_IntegerLiteral:
+			return IntegerLiteral_init(expr->expr->intgr);
+
+		case expr_FNCall: {
+			// Copy each argument into a new list
+			LinkedList *args = LinkedList_init();
+			LLIterator *args_iter = LLIterator_init(expr->expr->fncall->args);
+			while(!LLIterator_ended(args_iter)) {
+				LinkedList_append(args, Expression_copy(
+					(Expression *)LLIterator_get_current(args_iter)));
+				LLIterator_advance(args_iter);
+			}
+			free(args_iter);
+
+			Expression *copy =
+				FNCall_init(safe_strdup(expr->expr->fncall->name), args);
+			copy->expr->fncall->call_index = expr->expr->fncall->call_index;
+			return copy;
+		}
+
+		case expr_Ternary:
+			return Ternary_init(
+				Expression_copy(expr->expr->trnry->bool_expr),
+				Expression_copy(expr->expr->trnry->true_expr),
+				Expression_copy(expr->expr->trnry->false_expr));
+	}
+	printf("Invalid expression type given to Expression_copy()\n");
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
 /*
  * Walks over an expression and sets the stack offsets for every identifier
  * found in that expression
@@ -636,6 +697,9 @@ Statement *For_init(Statement *assignment, Expression *bool_expr,
 	the_stmt->type = stmt_For;
 	the_stmt->stmt = u_for;
 	the_stmt->exec_count = 0;
+	the_stmt->taken_count = 0;
+	the_stmt->line = 0;
+	the_stmt->trace = NULL;
 
 	return the_stmt;
 }
@@ -656,6 +720,9 @@ Statement *While_init(Expression *bool_expr, LinkedList *stmts) {
 	the_stmt->type = stmt_While;
 	the_stmt->stmt = u_while;
 	the_stmt->exec_count = 0;
+	the_stmt->taken_count = 0;
+	the_stmt->line = 0;
+	the_stmt->trace = NULL;
 
 	return the_stmt;
 }
@@ -678,6 +745,9 @@ Statement *If_init(Expression *bool_expr,
 	the_stmt->type = stmt_If;
 	the_stmt->stmt = u_if;
 	the_stmt->exec_count = 0;
+	the_stmt->taken_count = 0;
+	the_stmt->line = 0;
+	the_stmt->trace = NULL;
 
 	return the_stmt;
 }
@@ -697,6 +767,9 @@ Statement *Print_init(Expression *expr) {
 	the_stmt->type = stmt_Print;
 	the_stmt->stmt = u_print;
 	the_stmt->exec_count = 0;
+	the_stmt->taken_count = 0;
+	the_stmt->line = 0;
+	the_stmt->trace = NULL;
 
 	return the_stmt;
 }
@@ -717,6 +790,9 @@ Statement *Assignment_init(char *name, Expression *expr) {
 	the_stmt->type = stmt_Assignment;
 	the_stmt->stmt = u_assignment;
 	the_stmt->exec_count = 0;
+	the_stmt->taken_count = 0;
+	the_stmt->line = 0;
+	the_stmt->trace = NULL;
 
 	return the_stmt;
 }
@@ -736,6 +812,9 @@ Statement *Return_init(Expression *expr) {
 	the_stmt->type = stmt_Return;
 	the_stmt->stmt = u_return;
 	the_stmt->exec_count = 0;
+	the_stmt->taken_count = 0;
+	the_stmt->line = 0;
+	the_stmt->trace = NULL;
 	return the_stmt;
 }
 
@@ -841,6 +920,82 @@ bool Statement_equals(Statement *stmt1, Statement *stmt2) {
 	return (bool) NULL;
 }
 
+/*
+ * Creates a deep copy of a list of statements
+ */
+LinkedList *stmt_list_copy(LinkedList *stmts) {
+	LinkedList *copy = LinkedList_init();
+
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter)) {
+		LinkedList_append(copy, Statement_copy(
+			(Statement *)LLIterator_get_current(stmts_iter)));
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+
+	return copy;
+}
+
+/*
+ * Creates a deep copy of a statement. Execution counts are not copied - the
+ * copy starts with an execution count of zero.
+ */
+Statement *Statement_copy(Statement *stmt) {
+	Statement *copy = NULL;
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			copy = For_init(
+				Statement_copy(stmt->stmt->_for->assignment),
+				Expression_copy(stmt->stmt->_for->bool_expr),
+				Statement_copy(stmt->stmt->_for->incrementor),
+				stmt_list_copy(stmt->stmt->_for->stmts));
+			break;
+
+		case stmt_While:
+			copy = While_init(
+				Expression_copy(stmt->stmt->_while->bool_expr),
+				stmt_list_copy(stmt->stmt->_while->stmts));
+			break;
+
+		case stmt_If:
+			copy = If_init(
+				Expression_copy(stmt->stmt->_if->bool_expr),
+				stmt_list_copy(stmt->stmt->_if->true_stmts),
+				stmt_list_copy(stmt->stmt->_if->false_stmts));
+			break;
+
+		case stmt_Print:
+			copy = Print_init(Expression_copy(stmt->stmt->_print->expr));
+			break;
+
+		case stmt_Assignment:
+			// Assignment_init creates the Identifier itself, so copy the stack
+			// offset across afterwards
+			copy = Assignment_init(
+				safe_strdup(
+					stmt->stmt->_assignment->ident->expr->ident->name),
+				Expression_copy(stmt->stmt->_assignment->expr));
+			copy->stmt->_assignment->ident->expr->ident->stack_offset =
+				stmt->stmt->_assignment->ident->expr->ident->stack_offset;
+			break;
+
+		case stmt_Return:
+			copy = Return_init(Expression_copy(stmt->stmt->_return->expr));
+			break;
+	}
+
+	if(!copy) {
+		printf("Invalid statement type given to Statement_copy()\n");
+		exit(EXIT_FAILURE);
+	}
+
+	copy->line = stmt->line;
+	return copy;
+}
+
 /*
  * Walks over the AST and sets the stack offsets for every identifier found in
  * the AST
@@ -1035,6 +1190,29 @@ FNDecl *FNDecl_init(char *name, LinkedList *args, LinkedList *stmts) {
 	// It is assumed that if the variable count has been calculated, then each
 	// identifier in the function has also been assigned its stack offset.
 	func->variable_count = -1;
+
+	// The parser sets the line once it knows it
+	func->line = 0;
+
+	// The function has not been called or compiled yet
+	func->exec_count = 0;
+	func->evicted_at = 0;
+	func->compiling = false;
+	func->pure = false;
+	func->baseline = NULL;
+	func->compiled = NULL;
+	func->specialised = NULL;
+	func->native = NULL;
+
+	// Create an empty profile for each argument
+	int arg_count = LinkedList_length(args);
+	func->arg_profile = safe_alloc(sizeof(ArgProfile) * (arg_count + 1));
+	int i;
+	for(i = 0; i < arg_count; i++) {
+		func->arg_profile[i].state = arg_Unseen;
+		func->arg_profile[i].value = 0;
+	}
+
 	return func;
 }
 
@@ -1075,6 +1253,121 @@ bool FNDecl_equals(FNDecl *f1, FNDecl *f2) {
 	}
 }
 
+/*
+ * Creates a deep copy of a function. The copy has the same stack offsets as the
+ * original, but none of its execution counts, profiles or compiled code.
+ */
+FNDecl *FNDecl_copy(FNDecl *func) {
+	LinkedList *args = LinkedList_init();
+	LLIterator *args_iter = LLIterator_init(func->args);
+	while(!LLIterator_ended(args_iter)) {
+		LinkedList_append(args, Expression_copy(
+			(Expression *)LLIterator_get_current(args_iter)));
+		LLIterator_advance(args_iter);
+	}
+	free(args_iter);
+
+	FNDecl *copy = FNDecl_init(
+		safe_strdup(func->name), args, stmt_list_copy(func->stmts));
+	copy->variable_count = func->variable_count;
+	copy->line = func->line;
+	copy->pure = func->pure;
+	return copy;
+}
+
+/*
+ * Walks over an expression, appending every FNCall found in it to the given
+ * list. A call is appended before the calls in its arguments.
+ */
+static void Expression_call_sites(Expression *expr, LinkedList *sites) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr:
+			Expression_call_sites(expr->expr->blean->lhs, sites);
+			Expression_call_sites(expr->expr->blean->rhs, sites);
+			break;
+
+		case expr_ArithmeticExpr:
+			Expression_call_sites(expr->expr->arith->lhs, sites);
+			Expression_call_sites(expr->expr->arith->rhs, sites);
+			break;
+
+		case expr_Identifier:
+		case expr_IntegerLiteral:
+			break;
+
+		case expr_FNCall:
+			LinkedList_append(sites, expr->expr->fncall);
+			LLMAP_PARAM(
+				expr->expr->fncall->args,
+				Expression *,
+				Expression_call_sites,
+				sites);
+			break;
+
+		case expr_Ternary:
+			Expression_call_sites(expr->expr->trnry->bool_expr, sites);
+			Expression_call_sites(expr->expr->trnry->true_expr, sites);
+			Expression_call_sites(expr->expr->trnry->false_expr, sites);
+			break;
+	}
+}
+
+/*
+ * Walks over a statement, appending every FNCall found in it to the given list
+ */
+static void Statement_call_sites(Statement *stmt, LinkedList *sites) {
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			Statement_call_sites(stmt->stmt->_for->assignment, sites);
+			Expression_call_sites(stmt->stmt->_for->bool_expr, sites);
+			Statement_call_sites(stmt->stmt->_for->incrementor, sites);
+			LLMAP_PARAM(stmt->stmt->_for->stmts,
+				Statement *, Statement_call_sites, sites);
+			break;
+
+		case stmt_While:
+			Expression_call_sites(stmt->stmt->_while->bool_expr, sites);
+			LLMAP_PARAM(stmt->stmt->_while->stmts,
+				Statement *, Statement_call_sites, sites);
+			break;
+
+		case stmt_If:
+			Expression_call_sites(stmt->stmt->_if->bool_expr, sites);
+			LLMAP_PARAM(stmt->stmt->_if->true_stmts,
+				Statement *, Statement_call_sites, sites);
+			LLMAP_PARAM(stmt->stmt->_if->false_stmts,
+				Statement *, Statement_call_sites, sites);
+			break;
+
+		case stmt_Print:
+			Expression_call_sites(stmt->stmt->_print->expr, sites);
+			break;
+
+		case stmt_Assignment:
+			Expression_call_sites(stmt->stmt->_assignment->expr, sites);
+			break;
+
+		case stmt_Return:
+			Expression_call_sites(stmt->stmt->_return->expr, sites);
+			break;
+	}
+}
+
+/*
+ * Returns a list of the FNCall objects in a function, in a fixed order. The
+ * list should be freed with LinkedList_free() - the FNCalls belong to the
+ * function.
+ */
+LinkedList *FNDecl_call_sites(FNDecl *func) {
+	LinkedList *sites = LinkedList_init();
+	LLMAP_PARAM(func->stmts, Statement *, Statement_call_sites, sites);
+	return sites;
+}
+
 /*
  * Calculates the number of variables that this function requires space for in
  * its stack frame when compiled, and records it in the variable_count field of
@@ -1105,6 +1398,17 @@ void FNDecl_generate_offsets(FNDecl *func) {
 	// were created
 	func->variable_count = LinkedList_length(mappings);
 
+	// Number the calls made by the function
+	LinkedList *sites = FNDecl_call_sites(func);
+	LLIterator *sites_iter = LLIterator_init(sites);
+	while(!LLIterator_ended(sites_iter)) {
+		((FNCall *)LLIterator_get_current(sites_iter))->call_index =
+			LLIterator_current_index(sites_iter);
+		LLIterator_advance(sites_iter);
+	}
+	free(sites_iter);
+	LinkedList_free(sites);
+
 	// Free things
 	LLMAP(mappings, NameToOffsetMapping *, NameToOffsetMapping_free);
 	LinkedList_free(mappings);
@@ -1129,6 +1433,10 @@ void FNDecl_free(FNDecl *func) {
 	// Free the list itself
 	LinkedList_free(func->stmts);
 
+	// Free the argument profiles. Compiled code is not owned by the FNDecl,
+	// it is released by jitcode_release().
+	free(func->arg_profile);
+
 	// Free the FNDecl object
 	free(func);
 }
@@ -1139,46 +1447,55 @@ void FNDecl_free(FNDecl *func) {
 Program *Program_init(LinkedList *function_list) {
 	Program *prog = safe_alloc(sizeof(Program));
 	prog->function_list = function_list;
+	prog->optimised = false;
+	prog->library = false;
 	return prog;
 }
 
 /*
- * Retrieves a function declaration from a Program object
+ * Returns the index in a program's function list of the function with the
+ * given name, or -1 if there is no such function
  */
-FNDecl *Program_get_FNDecl(Program *prog, char *name) {
-
-	// Sequential-search the program's functions for a function with the given
-	// name
-	bool found = false;
-	int list_size = LinkedList_length(prog->function_list);
-	int i = 0;
-	
-	while((!found) && i < list_size) {
+int Program_FNDecl_index(Program *prog, char *name) {
+	int found = -1;
+
+	LLIterator *fn_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(fn_iter) && found == -1) {
+		FNDecl *func = (FNDecl *)LLIterator_get_current(fn_iter);
+		if(str_equal(func->name, name)) {
+			found = LLIterator_current_index(fn_iter);
+		}
+		LLIterator_advance(fn_iter);
+	}
+	free(fn_iter);
 
-		// If we find the variable, stop searching - i now has the index of the
-		// variable
-		if(str_equal(name,
-			((FNDecl *)LinkedList_get(prog->function_list, i))->name)) {
+	return found;
+}
 
-			found = true;
-		}
+/*
+ * Retrieves a function declaration from a Program object, returning NULL if
+ * there is no function with the given name
+ */
+FNDecl *Program_find_FNDecl(Program *prog, char *name) {
+	int index = Program_FNDecl_index(prog, name);
+	if(index == -1) return NULL;
+	return (FNDecl *)LinkedList_get(prog->function_list, index);
+}
 
-		else {
-			i++;
-		}
-	}
+/*
+ * Retrieves a function declaration from a Program object, exiting with an
+ * error if there is no function with the given name
+ */
+FNDecl *Program_get_FNDecl(Program *prog, char *name) {
+	FNDecl *func = Program_find_FNDecl(prog, name);
 
-	// If we never found the variable, an error has occurred, so print an error
+	// If we never found the function, an error has occurred, so print an error
 	// message and exit
-	if(!found) {
+	if(!func) {
 		printf("No function named '%s' in program\n", name);
 		exit(EXIT_FAILURE);
 	}
-
-	// Otherwise return the variable's value
-	else {
-		return (FNDecl *)LinkedList_get(prog->function_list, i);
-	}
+	return func;
 }
 
 /*
@@ -106,12 +106,18 @@ struct Identifier {
 
 /*
  * FNCall expressions have a name, and a list of arguments, which are
- * expressions themselves.
+ * expressions themselves. Like stack offsets, call indexes are not generated by
+ * the constructor - each call in a function is numbered, in the order returned
+ * by FNDecl_call_sites(), when the function's stack offsets are generated.
+ * The exec_count field is the number of times the interpreter has made the
+ * call, which is recorded in profiles (see profile.h).
  */
 typedef struct FNCall FNCall;
 struct FNCall {
 	char *name;
 	LinkedList *args;
+	int call_index;
+	int exec_count;
 };
 
 /*
@@ -167,12 +173,22 @@ typedef union {
  * The Statement struct has a type field, so that any code handling it can find
  * out what value the u_stmt field has, without segfaulting due to null
  * pointers. The exec_count field is used by the interpreter/JIT compiler to
- * determine whether or not the statement should be compiled
+ * determine whether or not the statement should be compiled. For if statements,
+ * taken_count is the number of times the condition was true, and for loops the
+ * number of times the body was run; the ahead-of-time compilers use both counts
+ * from a profile (see profile.h) to lay out their code. The line field is
+ * the source line the statement starts on, or 0 if it is not known, and is used
+ * to map compiled code back to the source. Loop statements keep the state of
+ * the tracing JIT compiler (see trace.h) in trace, which is NULL until the loop
+ * has been interpreted.
  */
 typedef struct {
 	stmt_type type;
 	u_stmt *stmt;
 	int exec_count;
+	int taken_count;
+	int line;
+	struct Trace *trace;
 } Statement;
 
 /*
@@ -236,6 +252,26 @@ struct Return {
 	Expression *expr;
 };
 
+/*
+ * The states an argument position of a function can be in when profiling the
+ * values that the function is called with: no calls seen yet, every call so far
+ * has passed the same value, or calls have passed differing values
+ */
+typedef enum {
+	arg_Unseen,
+	arg_Constant,
+	arg_Varying
+} arg_state;
+
+/*
+ * Records the state of an argument position, and the value passed in that
+ * position if the state is arg_Constant
+ */
+typedef struct {
+	arg_state state;
+	int value;
+} ArgProfile;
+
 /*
  * FNDecl type - contains the function name, a list of argument names, and a
  * list of statements, and a variable count. The variable count is the maximum
@@ -249,13 +285,55 @@ typedef struct {
 	LinkedList *args;
 	LinkedList *stmts;
 	int variable_count;
+
+	// The source line that the function is declared on, or 0 if not known
+	int line;
+
+	// The number of times the function has been called, used by the
+	// interpreter/JIT compiler to determine whether or not the function should
+	// be compiled
+	int exec_count;
+
+	// The value of exec_count when the function's compiled code was last
+	// evicted to keep within the JIT's code budget (see jitcode_evict()), so
+	// that the function has to become hot again before it is recompiled
+	int evicted_at;
+
+	// Whether the function is waiting for the JIT compiler's worker threads
+	// to compile it (see jitcompile())
+	bool compiling;
+
+	// Whether the function is pure, as last found by
+	// Program_find_pure_functions()
+	bool pure;
+
+	// One ArgProfile per argument, recording the values the function has been
+	// called with
+	ArgProfile *arg_profile;
+
+	// The machine code versions of the function, NULL until the JIT compiler
+	// has produced them: the baseline code, which the function is compiled to
+	// first, then the optimised code. The specialised version is only valid
+	// for calls that pass its guard.
+	struct JITFunction *baseline;
+	struct JITFunction *compiled;
+	struct JITFunction *specialised;
+
+	// The function's code from the C tier (see ccode.h), called with the
+	// argument values in an array, or NULL if it has not been compiled
+	int (*native)(int *args);
 } FNDecl;
 
 /*
- * Program type - just a LinkedList of functions
+ * Program type - just a LinkedList of functions, whether they have been
+ * optimised by Program_optimise() yet, and whether the program is a library.
+ * Any function of a library may be called from outside the program, so each
+ * must be kept, with the arguments it is declared with.
  */
  typedef struct {
  	LinkedList *function_list;
+ 	bool optimised;
+ 	bool library;
  } Program;
 
 /*
@@ -278,6 +356,8 @@ Expression *Ternary_init(Expression *bool_expr,
 
 char *Expression_str(Expression *expr);
 
+Expression *Expression_copy(Expression *expr);
+
 bool Expression_equals(Expression *expr1, Expression *expr2);
 
 void Expression_free(Expression *expr);
@@ -298,18 +378,30 @@ Statement *Return_init(Expression *expr);
 
 bool Statement_equals(Statement *stmt1, Statement *stmt2);
 
+Statement *Statement_copy(Statement *stmt);
+
+LinkedList *stmt_list_copy(LinkedList *stmts);
+
 void Statement_free(Statement *stmt);
 
 FNDecl *FNDecl_init(char *name, LinkedList *args, LinkedList *stmts);
 
 bool FNDecl_equals(FNDecl *f1, FNDecl *f2);
 
+FNDecl *FNDecl_copy(FNDecl *func);
+
+LinkedList *FNDecl_call_sites(FNDecl *func);
+
 void FNDecl_generate_offsets(FNDecl *func);
 
 void FNDecl_free(FNDecl *func);
 
 Program *Program_init(LinkedList *function_list);
 
+int Program_FNDecl_index(Program *prog, char *name);
+
+FNDecl *Program_find_FNDecl(Program *prog, char *name);
+
 FNDecl *Program_get_FNDecl(Program *prog, char *name);
 
 bool Program_equals(Program *p1, Program *p2);
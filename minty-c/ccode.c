@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "ir.h"
+#include "ccode.h"
+
+/*
+ * The helpers that the generated C code calls. Division and modulo raise
+ * SIGFPE where the interpreter's would, as the C compiler may assume that they
+ * never happen, and the errors are reported in the same way as by the
+ * interpreter.
+ */
+static char *ccode_prelude =
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <signal.h>\n"
+	"#include <limits.h>\n"
+	"\n"
+	"static int minty_divide(int lhs, int rhs) {\n"
+	"\tif(rhs == 0 || (lhs == INT_MIN && rhs == -1)) raise(SIGFPE);\n"
+	"\treturn lhs / rhs;\n"
+	"}\n"
+	"\n"
+	"static int minty_modulo(int lhs, int rhs) {\n"
+	"\tif(rhs == 0 || (lhs == INT_MIN && rhs == -1)) raise(SIGFPE);\n"
+	"\treturn lhs % rhs;\n"
+	"}\n"
+	"\n"
+	"static int minty_missing_return(const char *name) {\n"
+	"\tprintf(\"Reached end of function '%s' without return statement\\n\",\n"
+	"\t\tname);\n"
+	"\texit(EXIT_FAILURE);\n"
+	"}\n"
+	"\n"
+	"static int minty_no_function(const char *name) {\n"
+	"\tprintf(\"No function named '%s' in program\\n\", name);\n"
+	"\texit(EXIT_FAILURE);\n"
+	"}\n"
+	"\n"
+	"static int minty_wrong_arity(const char *name, int takes, int given) {\n"
+	"\tprintf(\"Function: '%s' takes %d arguments, %d given\",\n"
+	"\t\tname, takes, given);\n"
+	"\texit(EXIT_FAILURE);\n"
+	"}\n";
+
+/*
+ * Writes a value as an operand of a C expression. Constants are written out,
+ * and undefined values, which no other compiler gives any particular value
+ * either, are written as 0.
+ */
+static void ccode_operand(FILE *out, IRValue *value) {
+	if(value->op == ir_Undefined) fprintf(out, "0");
+	else if(value->op != ir_Constant) fprintf(out, "v%d", value->id);
+	else if(value->value == INT_MIN) fprintf(out, "(-2147483647 - 1)");
+	else if(value->value < 0) fprintf(out, "(%d)", value->value);
+	else fprintf(out, "%d", value->value);
+}
+
+/*
+ * Writes the C operator for a comparison
+ */
+static char *ccode_compare_operator(token_type op) {
+	switch(op) {
+		case EQUAL: return "==";
+		case NOT_EQUAL: return "!=";
+		case LESS_THAN: return "<";
+		case GREATER_THAN: return ">";
+		case LESS_OR_EQUAL: return "<=";
+		default: return ">=";
+	}
+}
+
+/*
+ * Writes the statement computing a value, if it needs one
+ */
+static void ccode_value(FILE *out, IRValue *value, Program *prog) {
+	int i;
+
+	switch(value->op) {
+		case ir_Argument:
+			fprintf(out, "\tv%d = a%d;\n", value->id, value->value);
+			break;
+
+		case ir_Arithmetic:
+			fprintf(out, "\tv%d = ", value->id);
+			if(value->operator == DIVIDE) fprintf(out, "minty_divide(");
+			else if(value->operator == MODULO) fprintf(out, "minty_modulo(");
+			ccode_operand(out, value->args[0]);
+			if(value->operator == PLUS) fprintf(out, " + ");
+			else if(value->operator == MINUS) fprintf(out, " - ");
+			else if(value->operator == MULTIPLY) fprintf(out, " * ");
+			else fprintf(out, ", ");
+			ccode_operand(out, value->args[1]);
+			if(value->operator == DIVIDE || value->operator == MODULO) {
+				fprintf(out, ")");
+			}
+			fprintf(out, ";\n");
+			break;
+
+		case ir_Compare:
+			fprintf(out, "\tv%d = ", value->id);
+			ccode_operand(out, value->args[0]);
+			fprintf(out, " %s ", ccode_compare_operator(value->operator));
+			ccode_operand(out, value->args[1]);
+			fprintf(out, ";\n");
+			break;
+
+		case ir_Call: {
+			// A call that the interpreter would refuse is reported in the same
+			// way when it is reached
+			int index = Program_FNDecl_index(prog, value->call->name);
+			if(index == -1) {
+				fprintf(out, "\tv%d = minty_no_function(\"%s\");\n", value->id,
+					value->call->name);
+				break;
+			}
+			FNDecl *callee = (FNDecl *)LinkedList_get(prog->function_list,
+				index);
+			if(LinkedList_length(callee->args) != value->arg_count) {
+				fprintf(out, "\tv%d = minty_wrong_arity(\"%s\", %d, %d);\n",
+					value->id, callee->name, LinkedList_length(callee->args),
+					value->arg_count);
+				break;
+			}
+
+			fprintf(out, "\tv%d = f%d(", value->id, index);
+			for(i = 0; i < value->arg_count; i++) {
+				if(i > 0) fprintf(out, ", ");
+				ccode_operand(out, value->args[i]);
+			}
+			fprintf(out, ");\n");
+			break;
+		}
+
+		case ir_Print:
+			fprintf(out, "\tprintf(\"%%d\\n\", ");
+			ccode_operand(out, value->args[0]);
+			fprintf(out, ");\n");
+			break;
+
+		default:
+			break;
+	}
+}
+
+/*
+ * Writes the assignments that give a block's phis their values on entry from
+ * pred. Each phi is written to its shadow variable, which is copied into the
+ * phi at the start of the block, as one phi may be the value that another
+ * takes.
+ */
+static void ccode_phi_moves(FILE *out, IRBlock *pred, IRBlock *block) {
+	int index = IRBlock_pred_index(block, pred);
+
+	int i;
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *phi = block->values[i];
+		if(phi->op != ir_Phi || phi->args[index] == phi) continue;
+		fprintf(out, "\tp%d = ", phi->id);
+		ccode_operand(out, phi->args[index]);
+		fprintf(out, ";\n");
+	}
+}
+
+/*
+ * Writes the statements that leave a block
+ */
+static void ccode_exit(FILE *out, IRBlock *block, FNDecl *func) {
+	switch(block->exit) {
+		case ir_Jump:
+			ccode_phi_moves(out, block, block->succs[0]);
+			fprintf(out, "\tgoto b%d;\n", block->succs[0]->id);
+			break;
+
+		case ir_Branch:
+			fprintf(out, "\tif(");
+			ccode_operand(out, block->exit_value);
+			fprintf(out, ") {\n");
+			ccode_phi_moves(out, block, block->succs[0]);
+			fprintf(out, "\tgoto b%d;\n\t}\n", block->succs[0]->id);
+			ccode_phi_moves(out, block, block->succs[1]);
+			fprintf(out, "\tgoto b%d;\n", block->succs[1]->id);
+			break;
+
+		case ir_Return:
+			fprintf(out, "\treturn ");
+			ccode_operand(out, block->exit_value);
+			fprintf(out, ";\n");
+			break;
+
+		case ir_MissingReturn:
+			fprintf(out, "\treturn minty_missing_return(\"%s\");\n",
+				func->name);
+			break;
+	}
+}
+
+/*
+ * Writes the C function for the function at the given index in the program's
+ * function list. Every value, and the shadow variable of every phi, is a local
+ * variable, and every block is a label.
+ */
+static void ccode_function(FILE *out, int index, Program *prog) {
+	FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, index);
+	IRFunction *ir = IRFunction_build(func, false);
+	ir_sccp(ir);
+	ir_gvn(ir);
+	ir_dce(ir);
+
+	fprintf(out, "\n/* %s */\nstatic int f%d(", func->name, index);
+	int i, j;
+	for(i = 0; i < LinkedList_length(func->args); i++) {
+		fprintf(out, i > 0 ? ", int a%d" : "int a%d", i);
+	}
+	fprintf(out, ") {\n");
+
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			if(value->op == ir_Print || value->op == ir_Undefined) continue;
+			fprintf(out, "\tint v%d;\n", value->id);
+			if(value->op == ir_Phi) fprintf(out, "\tint p%d;\n", value->id);
+		}
+	}
+
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		fprintf(out, "b%d:;\n", block->id);
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			if(value->op == ir_Phi) {
+				fprintf(out, "\tv%d = p%d;\n", value->id, value->id);
+			}
+			else ccode_value(out, value, prog);
+		}
+		ccode_exit(out, block, func);
+	}
+	fprintf(out, "}\n");
+
+	IRFunction_free(ir);
+}
+
+/*
+ * Writes a program as C source code. Each function is given a static C
+ * function named by its index in the program's function list, taking and
+ * returning ints, and an exported entry point (see CCODE_ENTRY_PREFIX).
+ */
+void ccode_write(FILE *out, Program *prog) {
+	fprintf(out, "%s", ccode_prelude);
+
+	int count = LinkedList_length(prog->function_list);
+	int i, j;
+	fprintf(out, "\n");
+	for(i = 0; i < count; i++) {
+		FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, i);
+		int arg_count = LinkedList_length(func->args);
+		fprintf(out, "static int f%d(", i);
+		for(j = 0; j < arg_count; j++) fprintf(out, j > 0 ? ", int" : "int");
+		fprintf(out, arg_count > 0 ? ");\n" : "void);\n");
+	}
+
+	for(i = 0; i < count; i++) ccode_function(out, i, prog);
+
+	for(i = 0; i < count; i++) {
+		FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, i);
+		fprintf(out, "\nint " CCODE_ENTRY_PREFIX "%d(int *args) {\n"
+			"\treturn f%d(", i, i);
+		for(j = 0; j < LinkedList_length(func->args); j++) {
+			fprintf(out, j > 0 ? ", args[%d]" : "args[%d]", j);
+		}
+		fprintf(out, ");\n}\n");
+	}
+}
+
+// Whether the C tier is enabled (see ccode_set_enabled()), and the limit on
+// direct calls between compiled functions (see ccode_call_limit())
+static bool tier_enabled = false;
+static int call_limit = INT_MAX;
+
+// The program that has been compiled, or is being compiled, by the C tier,
+// the directory its C code was written to, and the thread compiling it
+static Program *compiled_prog = NULL;
+static char directory[] = "/tmp/minty-ccode-XXXXXX";
+static pthread_t compiler;
+static bool compiling = false;
+
+// Set by the compiling thread once it has finished, and the shared object it
+// loaded, or NULL if the program could not be compiled
+static int compile_finished = 0;
+static void *shared_object = NULL;
+
+/*
+ * Enables or disables the C tier
+ */
+void ccode_set_enabled(bool enabled) {
+	tier_enabled = enabled;
+	if(!compiled_prog) call_limit = enabled ? CCODE_THRESHOLD : INT_MAX;
+}
+
+/*
+ * Returns a pointer to the limit on the number of calls to a function that
+ * compiled code may make directly (see ccode.h)
+ */
+int *ccode_call_limit() {
+	return &call_limit;
+}
+
+/*
+ * Returns a newly allocated string holding the path of a file in the directory
+ * the C code is compiled in
+ */
+static char *ccode_path(char *name) {
+	char *path = safe_alloc(strlen(directory) + strlen(name) + 2);
+	sprintf(path, "%s/%s", directory, name);
+	return path;
+}
+
+/*
+ * Runs on the compiling thread: compiles the C code in the directory and loads
+ * the result, then removes the directory
+ */
+static void *ccode_compiler(void *unused) {
+	char *source = ccode_path("minty.c");
+	char *object = ccode_path("minty.so");
+	char *command = safe_alloc(strlen(CCODE_COMPILER) + strlen(source)
+		+ strlen(object) + 32);
+	sprintf(command, CCODE_COMPILER " -o %s %s >/dev/null 2>&1", object,
+		source);
+
+	void *handle = NULL;
+	if(system(command) == 0) handle = dlopen(object, RTLD_NOW | RTLD_LOCAL);
+
+	unlink(source);
+	unlink(object);
+	rmdir(directory);
+	free(source);
+	free(object);
+	free(command);
+
+	shared_object = handle;
+	__atomic_store_n(&compile_finished, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/*
+ * Starts compiling a program with the C tier, if it is enabled and has not
+ * been asked to compile a program yet. The C code is written on the calling
+ * thread, as it reads the program's AST, and compiled on another.
+ */
+void ccode_compile(Program *prog) {
+	if(!tier_enabled || compiled_prog) return;
+	compiled_prog = prog;
+
+	strcpy(directory, "/tmp/minty-ccode-XXXXXX");
+	if(!mkdtemp(directory)) {
+		call_limit = INT_MAX;
+		return;
+	}
+
+	char *source = ccode_path("minty.c");
+	FILE *file = fopen(source, "w");
+	if(file) {
+		ccode_write(file, prog);
+		if(fclose(file)) file = NULL;
+	}
+	if(!file) {
+		unlink(source);
+		rmdir(directory);
+		free(source);
+		call_limit = INT_MAX;
+		return;
+	}
+	free(source);
+
+	if(pthread_create(&compiler, NULL, ccode_compiler, NULL) != 0) {
+		printf("Could not start C compiler thread\n");
+		exit(EXIT_FAILURE);
+	}
+	compiling = true;
+}
+
+/*
+ * Waits for the compiling thread, and points each function of the compiled
+ * program at its C compiler's code
+ */
+static void ccode_install() {
+	pthread_join(compiler, NULL);
+	compiling = false;
+	compile_finished = 0;
+
+	// If the program could not be compiled, there is no code to wait for
+	call_limit = shared_object ? 0 : INT_MAX;
+	if(!shared_object) return;
+
+	LLIterator *function_iter = LLIterator_init(compiled_prog->function_list);
+	while(!LLIterator_ended(function_iter)) {
+		FNDecl *func = (FNDecl *)LLIterator_get_current(function_iter);
+		char symbol[sizeof(CCODE_ENTRY_PREFIX) + 16];
+		sprintf(symbol, CCODE_ENTRY_PREFIX "%d",
+			LLIterator_current_index(function_iter));
+		func->native = (int (*)(int *))dlsym(shared_object, symbol);
+		LLIterator_advance(function_iter);
+	}
+	free(function_iter);
+}
+
+/*
+ * Installs the C compiler's code if it has finished compiling. Should be called
+ * regularly by the interpreter's thread.
+ */
+void ccode_install_finished() {
+	if(__atomic_load_n(&compile_finished, __ATOMIC_ACQUIRE)) ccode_install();
+}
+
+/*
+ * Waits for the C compiler to finish compiling, if it is, and installs its code
+ */
+void ccode_wait() {
+	if(compiling) ccode_install();
+}
+
+/*
+ * Runs the C compiler's code for a function with the given argument values
+ */
+int ccode_run(FNDecl *func, LinkedList *arg_vals) {
+	int *args = safe_alloc(sizeof(int) * (LinkedList_length(arg_vals) + 1));
+	LLIterator *args_iter = LLIterator_init(arg_vals);
+	while(!LLIterator_ended(args_iter)) {
+		args[LLIterator_current_index(args_iter)] =
+			(int)(long)LLIterator_get_current(args_iter);
+		LLIterator_advance(args_iter);
+	}
+	free(args_iter);
+
+	int result = func->native(args);
+	free(args);
+	return result;
+}
+
+/*
+ * Unloads the C compiler's code for a program, once it has finished compiling,
+ * so that another program can be compiled. Should be called before
+ * Program_free() on any program that has been interpreted.
+ */
+void ccode_release(Program *prog) {
+	if(compiled_prog != prog) return;
+	ccode_wait();
+
+	LLIterator *function_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(function_iter)) {
+		((FNDecl *)LLIterator_get_current(function_iter))->native = NULL;
+		LLIterator_advance(function_iter);
+	}
+	free(function_iter);
+
+	if(shared_object) dlclose(shared_object);
+	shared_object = NULL;
+	compiled_prog = NULL;
+	call_limit = tier_enabled ? CCODE_THRESHOLD : INT_MAX;
+}
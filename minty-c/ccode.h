@@ -0,0 +1,65 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef CCODE
+#define CCODE
+
+#include <stdio.h>
+
+/*
+ * The C tier, an optional tier above the JIT compiler for programs that run
+ * for long enough to repay a slow compiler. Once any function in a program has
+ * been called CCODE_THRESHOLD times, the whole program is translated into C,
+ * from the same IR as the other compilers (see ir.h), and compiled by the
+ * system's C compiler (CCODE_COMPILER) into a shared object on a background
+ * thread. The shared object is loaded with dlopen(), and from then on every
+ * call that the interpreter or the JIT compiler's code makes to a function in
+ * it runs the C compiler's code instead (see the native field of FNDecl).
+ *
+ * The C tier is disabled by default. Nothing else waits for it, and if the C
+ * compiler cannot be run or fails, the program just carries on without it.
+ */
+#define CCODE_THRESHOLD 10000
+#define CCODE_COMPILER "cc -O2 -fwrapv -shared -fPIC"
+
+/*
+ * The C function generated for the function at a given index in the program's
+ * function list is exported as a symbol of that index prefixed with
+ * CCODE_ENTRY_PREFIX, taking its arguments in an array and returning its result
+ */
+#define CCODE_ENTRY_PREFIX "minty_entry_"
+
+/*
+ * Code compiled by the JIT compiler calls other compiled code directly (see
+ * jitcode.h), without the interpreter, only while the callee has been called
+ * fewer times than the limit that ccode_call_limit() points to. Calls beyond
+ * it go through the interpreter, so that the C tier is started and its code
+ * run. The limit is CCODE_THRESHOLD while the C tier is enabled and waiting to
+ * compile a program, 0 once its code is loaded, and INT_MAX otherwise.
+ */
+void ccode_set_enabled(bool enabled);
+
+int *ccode_call_limit();
+
+void ccode_write(FILE *out, Program *prog);
+
+void ccode_compile(Program *prog);
+
+void ccode_install_finished();
+
+void ccode_wait();
+
+int ccode_run(FNDecl *func, LinkedList *arg_vals);
+
+void ccode_release(Program *prog);
+
+#endif // CCODE
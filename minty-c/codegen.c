@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <malloc.h>
+#include <string.h>
+#include <pthread.h>
 #include "minty_util.h"
 #include "token.h"
 #include "AST.h"
+#include "optimiser.h"
+#include "ir.h"
+#include "regalloc.h"
 #include "codegen.h"
 
 /*
@@ -53,62 +59,110 @@ idivl %ebx\n\
 movl %edx, %eax\n\
 "
 
+
 /*
- * The following code provides a solution to the problem of naming labels
- * without duplicate names. To use, call label_number() with the ADDRESS OF one
- * of the global variables below. If it is passed by value, not by reference, it
- * will not be incremented and label clashes will occur.
+ * The registers that the first REGISTER_ARGS arguments are passed in (see
+ * codegen.h)
  */
+static char *arg_registers[REGISTER_ARGS] = {
+	"%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d"
+};
+static char *arg_registers_64[REGISTER_ARGS] = {
+	"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"
+};
 
 /*
- * Given a label type, returns a string that can be used with a label to keep
- * labels used more than once unique
+ * Code is written to an Emitter as it is generated, so that every instruction
+ * is copied once, rather than each piece of code being copied again every time
+ * it is joined onto a larger one.
  */
-static char *label_number(int *label) {
-	// Allocate space for the number string
-	char *str = safe_alloc(sizeof(char) * 20);
 
-	// Generate the number string from the current number
-	sprintf(str, "%d", *label);
+/*
+ * Creates an Emitter that writes code to the given stream, or that collects it
+ * in a buffer if the stream is NULL
+ */
+Emitter *Emitter_init(FILE *stream) {
+	Emitter *out = safe_alloc(sizeof(Emitter));
+	out->stream = stream;
+	out->len = 0;
+	out->capacity = stream ? 0 : 4096;
+	memset(&(out->labels), 0, sizeof(Labels));
+	out->buffer = stream ? NULL : safe_alloc(sizeof(char) * out->capacity);
+	if(out->buffer) out->buffer[0] = '\0';
+	return out;
+}
 
-	// Increment the label number to prevent clashes
-	(*label)++;
+/*
+ * Writes len characters of code to an Emitter, doubling the size of its buffer
+ * whenever the code does not fit
+ */
+static void emit_chars(Emitter *out, char *code, int len) {
+	if(out->stream) {
+		if(fwrite(code, sizeof(char), len, out->stream) != len) {
+			printf("Could not write assembly code\n");
+			exit(EXIT_FAILURE);
+		}
+		return;
+	}
 
-	// Return the generated string
-	return str;
+	if(out->len + len + 1 > out->capacity) {
+		while(out->len + len + 1 > out->capacity) out->capacity *= 2;
+		out->buffer = realloc(out->buffer, sizeof(char) * out->capacity);
+		if(!out->buffer) {
+			printf("Could not allocate memory for assembly code\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(out->buffer + out->len, code, len);
+	out->len += len;
+	out->buffer[out->len] = '\0';
 }
 
-static int label_boolean    = 0;
-static int label_arithmetic = 0;
-static int label_fncall     = 0;
-static int label_ternary    = 0;
-static int label_for        = 0;
-static int label_while      = 0;
-static int label_if         = 0;
-static int label_print      = 0;
-static int label_assignment = 0;
-static int label_return     = 0;
+/*
+ * Writes a string of code to an Emitter
+ */
+void emit(Emitter *out, char *code) {
+	emit_chars(out, code, strlen(code));
+}
 
 /*
- * Sets all the label numbers back to zero
+ * Writes code to an Emitter, formatted in the same way as by printf()
  */
-static void reset_labels() {
-	label_boolean    = 0;
-	label_arithmetic = 0;
-	label_fncall     = 0;
-	label_ternary    = 0;
-	label_for        = 0;
-	label_while      = 0;
-	label_if         = 0;
-	label_print      = 0;
-	label_assignment = 0;
-	label_return     = 0;
+void emitf(Emitter *out, char *format, ...) {
+	char small[128];
+	va_list args;
+
+	va_start(args, format);
+	int len = vsnprintf(small, sizeof(small), format, args);
+	va_end(args);
+
+	if(len < sizeof(small)) {
+		emit_chars(out, small, len);
+		return;
+	}
+
+	char *large = safe_alloc(sizeof(char) * (len + 1));
+	va_start(args, format);
+	vsnprintf(large, len + 1, format, args);
+	va_end(args);
+	emit_chars(out, large, len);
+	free(large);
+}
+
+/*
+ * Frees an Emitter, returning the code collected in its buffer, or NULL if it
+ * wrote to a stream. The stream is not closed.
+ */
+char *Emitter_finish(Emitter *out) {
+	char *code = out->buffer;
+	free(out);
+	return code;
 }
 
 /*
  * Generate code for a given expression
  */
-char *codegen_expression(Expression *expr, Program *prog) {
+void emit_expression(Emitter *out, Expression *expr, Program *prog) {
 
 	switch(expr->type) {
 
@@ -116,18 +170,11 @@ char *codegen_expression(Expression *expr, Program *prog) {
 
 			// Get the label number for this boolean expression (only used in
 			// generated comments, there are no jumps in boolean expressions)
-			char *label_no = label_number(&label_boolean);
-
-			// Generate strings for the left & right hand sides
-			char *lhs = codegen_expression(expr->expr->blean->lhs, prog);
-			char *rhs = codegen_expression(expr->expr->blean->rhs, prog);
+			int label_no = out->labels.boolean++;
 
 			// opcode will store the operation specified by the AST
 			char *opcode;
 
-			// out is the return variable to point to out output string
-			char *out;
-
 			// Store the appropriate opcode - see the #defined macros for each
 			// at the top of this file
 			     if(expr->expr->arith->op ==            EQUAL) opcode = EQU;
@@ -141,28 +188,19 @@ char *codegen_expression(Expression *expr, Program *prog) {
 				exit(EXIT_FAILURE);
 			}
 
-			// Concatenate everything together to get the compiled AST
-			out = str_concat(15,
-				"# BEGIN BOOLEAN EXPRESSION ", label_no, "\n",
-				rhs,
-				"pushl %eax\n",
-				lhs,
-				"popl %ebx\n",
-				"movl $0, %ecx\n",
-				"movl $1, %edx\n",
-				"cmpl %ebx, %eax\n",
-				opcode,
-				"movl %ecx, %eax\n",
-				"# END BOOLEAN EXPRESSION ", label_no, "\n");
-
-			// We can free lhs and rhs as their contents are copied into out by
-			// str_concat
-			free(lhs);
-			free(rhs);
-			free(label_no);
-
-			// Return the generated string
-			return out;
+			emitf(out, "# BEGIN BOOLEAN EXPRESSION %d\n", label_no);
+			emit_expression(out, expr->expr->blean->rhs, prog);
+			emit(out, "pushq %rax\n");
+			emit_expression(out, expr->expr->blean->lhs, prog);
+			emit(out,
+				"popq %rbx\n"
+				"movl $0, %ecx\n"
+				"movl $1, %edx\n"
+				"cmpl %ebx, %eax\n");
+			emit(out, opcode);
+			emit(out, "movl %ecx, %eax\n");
+			emitf(out, "# END BOOLEAN EXPRESSION %d\n", label_no);
+			return;
 		}
 
 		case expr_ArithmeticExpr: {
@@ -176,18 +214,11 @@ char *codegen_expression(Expression *expr, Program *prog) {
 
 			// Get the label number for this arithmetic expression (only used in
 			// generated comments, there are no jumps in arithmetic expressions)
-			char *label_no = label_number(&label_arithmetic);
-
-			// Generate strings for the left & right hand sides
-			char *lhs = codegen_expression(expr->expr->arith->lhs, prog);
-			char *rhs = codegen_expression(expr->expr->arith->rhs, prog);
+			int label_no = out->labels.arithmetic++;
 
 			// opcode will store the operation specified by the AST
 			char *opcode;
 
-			// out is the return variable to point to out output string
-			char *out;
-
 			// Store the appropriate opcode - see the #defined macros for each
 			// at the top of this file
 			     if(expr->expr->arith->op ==     PLUS) opcode = ADD;
@@ -200,504 +231,1002 @@ char *codegen_expression(Expression *expr, Program *prog) {
 				exit(EXIT_FAILURE);
 			}
 
-			// Concatenate everything together to get the compiled AST
-			out = str_concat(11,
-				"# BEGIN ARITHMETIC EXPRESSION ", label_no, "\n",
-				rhs,
-				"pushl %eax\n",
-				lhs,
-				"popl %ebx\n",
-				opcode,
-				"# END ARITHMETIC EXPRESSION ", label_no, "\n");
-
-			// We can free lhs and rhs as their contents are copied into the out
-			// string by str_concat
-			free(lhs);
-			free(rhs);
-			free(label_no);
-
-			// Return the generated string
-			return out;
+			emitf(out, "# BEGIN ARITHMETIC EXPRESSION %d\n", label_no);
+			emit_expression(out, expr->expr->arith->rhs, prog);
+			emit(out, "pushq %rax\n");
+			emit_expression(out, expr->expr->arith->lhs, prog);
+			emit(out, "popq %rbx\n");
+			emit(out, opcode);
+			emitf(out, "# END ARITHMETIC EXPRESSION %d\n", label_no);
+			return;
 		}
 
-		case expr_Identifier: {
-
-			// Allocate a new character buffer on the heap
-			char *buffer = safe_alloc(sizeof(char) * 60);
-
-			// Generate the correct string in the buffer
-			sprintf(buffer, "movl %d(%%ebp), %%eax    # IDENTIFIER\n",
+		case expr_Identifier:
+			emitf(out, "movl %d(%%rbp), %%eax    # IDENTIFIER\n",
 				expr->expr->ident->stack_offset);
+			return;
 
-			return buffer;
-		}
-
-		case expr_IntegerLiteral: {
-
-			// Allocate a new character buffer on the heap
-			char *buffer = safe_alloc(sizeof(char) * 60);
-
-			// Generate the correct string in the buffer
-			sprintf(buffer, "movl $%d, %%eax    # INTEGER LITERAL\n",
+		case expr_IntegerLiteral:
+			emitf(out, "movl $%d, %%eax    # INTEGER LITERAL\n",
 				expr->expr->intgr);
-
-			return buffer;
-		}
+			return;
 
 		case expr_FNCall: {
 
 			// Get the label number for this function call
-			char *label_no = label_number(&label_fncall);
+			int label_no = out->labels.fncall++;
 
-			// Obtain a string that represents an integer which is the amount of
-			// space which the arguments being passed to the function will
-			// occupy on the stack
-			char *stack_space = safe_alloc(sizeof(char) * 12);
-			
 			// Create a pointer to the callee function's name
 			char *fn_name = expr->expr->fncall->name;
 
-			sprintf(stack_space, "%d", 4 * (Program_get_FNDecl(
-				prog, fn_name))->variable_count);
-
-			char *str_builder_args = safe_strdup("");
-
-			LLIterator *args_iter = LLIterator_init(expr->expr->fncall->args);
-			while(!LLIterator_ended(args_iter)) {
-				
-				// Generate the code for this argument
-				char *next_arg = codegen_expression(
-					(Expression *)LLIterator_get_current(args_iter),
-					prog);
-
-				// Append to the current string next_the compilation of the
-				// argument, followed by storing that argument at the
-				// appropriate position on the stack
-				char *temp = str_concat(3,
-					str_builder_args,
-					next_arg,
-					"pushl %eax\n");
-
-				free(str_builder_args);
-				str_builder_args = temp;
-				free(next_arg);
-
-				LLIterator_advance(args_iter);
-
-			} free(args_iter);
-
-			char *out = str_concat(21,
-				"# BEGIN CALL ", label_no, " TO '", fn_name, "'\n",
-
-				// Save our stack base pointer for restoration later
-				"pushl %ebp\n",
-				str_builder_args,
-
-				// Subtract from OUR stack pointer the size that the arguments
-				// occupy, thereby putting them into the callee's frame
-				"addl $", stack_space, ", %esp\n",
-
-				// Set our stack pointer as the callee's base pointer - the
-				// callee's frame has the arguments
-				"movl %esp, %ebp\n",
-
-				// Call the function
-				"call ", fn_name, "\n",
-
-				// Now the function has run, set out stack pointer as the
-				// callee's base pointer (this pops off all the arguments we
-				// pushed)
-				"movl %ebp, %esp\n",
-				
-				// Finally restore our base pointer
-				"popl %ebp\n",
+			emitf(out, "# BEGIN CALL %d TO '%s'\n", label_no, fn_name);
+
+			// Any number of values may have been pushed by the surrounding
+			// code, so save the stack pointer in %r12, which the callee
+			// preserves, and align it. An odd number of arguments on the stack
+			// needs 8 bytes of padding to keep it aligned.
+			LinkedList *args = expr->expr->fncall->args;
+			int arg_count = LinkedList_length(args);
+			emit(out,
+				"pushq %r12\n"
+				"movq %rsp, %r12\n"
+				"andq $-16, %rsp\n");
+			if(arg_count > REGISTER_ARGS && (arg_count - REGISTER_ARGS) % 2) {
+				emit(out, "subq $8, %rsp\n");
+			}
 
-				"# END CALL ", label_no, " TO '", fn_name, "'\n");
+			// Evaluate each argument from last to first, pushing it on the
+			// stack, then pop the first arguments into their registers
+			int i;
+			for(i = arg_count - 1; i >= 0; i--) {
+				emit_expression(out,
+					(Expression *)LinkedList_get(args, i), prog);
+				emit(out, "pushq %rax\n");
+			}
+			for(i = 0; i < arg_count && i < REGISTER_ARGS; i++) {
+				emitf(out, "popq %s\n", arg_registers_64[i]);
+			}
 
-			free(str_builder_args);
-			free(stack_space);
-			free(label_no);
+			// Call the function, then restore the stack pointer, which pops
+			// any arguments left on the stack
+			emitf(out, "call " SYMBOL_PREFIX "%s\n", fn_name);
+			emit(out,
+				"movq %r12, %rsp\n"
+				"popq %r12\n");
 
-			return out;
+			emitf(out, "# END CALL %d TO '%s'\n", label_no, fn_name);
+			return;
 		}
 
 		case expr_Ternary: {
 			
 			// Generate a label number for the jumps and comments
-			char *label_no = label_number(&label_ternary);
-
-			// Codegen each sub-expression
-			char *b_exp = codegen_expression(
-				expr->expr->trnry->bool_expr, prog);
-			char *t_exp = codegen_expression(
-				expr->expr->trnry->true_expr, prog);
-			char *f_exp = codegen_expression(
-				expr->expr->trnry->false_expr, prog);
-
-			char *out = str_concat(22,
-				"# BEGIN TERNARY EXPRESSION ", label_no, "\n",
-				b_exp,
-				"cmpl $0, %eax\n",
-				"je ternary_false_", label_no, "\n",
-				t_exp,
-				"jmp ternary_end_", label_no, "\n",
-				"ternary_false_", label_no, ":\n",
-				f_exp,
-				"ternary_end_", label_no, ":\n",
-				"# END TERNARY EXPRESSION ", label_no, "\n");
-
-			free(b_exp);
-			free(t_exp);
-			free(f_exp);
-			free(label_no);
-
-			return out;
+			int label_no = out->labels.ternary++;
+
+			emitf(out, "# BEGIN TERNARY EXPRESSION %d\n", label_no);
+			emit_expression(out, expr->expr->trnry->bool_expr, prog);
+			emitf(out, "cmpl $0, %%eax\nje ternary_false_%d\n", label_no);
+			emit_expression(out, expr->expr->trnry->true_expr, prog);
+			emitf(out, "jmp ternary_end_%d\nternary_false_%d:\n",
+				label_no, label_no);
+			emit_expression(out, expr->expr->trnry->false_expr, prog);
+			emitf(out, "ternary_end_%d:\n# END TERNARY EXPRESSION %d\n",
+				label_no, label_no);
+			return;
 		}
 	}
 	printf("Invalid expression type in AST\n");
 	exit(EXIT_FAILURE);
-	return NULL;
 }
 
 /*
  * Generate code for a given list of statements
  */
-char *codegen_statement_list(LinkedList *stmts, Program *prog) {
-
-	// If the list is empty, this is valid, but produces no output, so return
-	// the empty string, rather than null
-	if(LinkedList_length(stmts) == 0) {
-		return safe_strdup("");
+void emit_statement_list(Emitter *out, LinkedList *stmts, Program *prog) {
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter)) {
+		emit_statement(out,
+			(Statement *)LLIterator_get_current(stmts_iter), prog);
+		LLIterator_advance(stmts_iter);
 	}
-
-	// Generate the code for the first statement
-	char *out = codegen_statement((Statement *)LinkedList_get(stmts, 0), prog);
-
-	// Append the code for any subsequent expressions
-	int i;
-	for(i = 1; i < LinkedList_length(stmts); i++) {
-		char *temp =
-			codegen_statement((Statement *)LinkedList_get(stmts, i), prog);
-		char *temp2 = str_concat_2(out, temp);
-
-		free(out);
-		free(temp);
-
-		out = temp2;
-	}
-
-	return out;
+	free(stmts_iter);
 }
 
 /*
  * Generate code for a given statement
  */
-char *codegen_statement(Statement *stmt, Program *prog) {
+void emit_statement(Emitter *out, Statement *stmt, Program *prog) {
 	
 	switch(stmt->type) {
 		
 		case stmt_For: {
-			printf("FOR LOOP COMPILATION NOT YET IMPLEMENTED\n");
-			exit(EXIT_FAILURE);
-			return (char *) NULL;
+
+			// Get the label number for this for-statement
+			int label_no = out->labels.for_stmt++;
+
+			emitf(out, "# BEGIN FOR STATEMENT %d\n", label_no);
+
+			// Initialise the loop control variable
+			emit_statement(out, stmt->stmt->_for->assignment, prog);
+
+			emitf(out, "for_begin_%d:\n", label_no);
+
+			// Check the loop condition, jumping out of the loop if it does not
+			// hold. A counted loop (see For_is_counted()) compares its counter
+			// with the limit directly, and adds the step to the counter in
+			// place, rather than evaluating the condition and incrementor in
+			// %eax.
+			int step;
+			bool counted = For_is_counted(stmt->stmt->_for, &step);
+			int counter = stmt->stmt->_for->assignment->stmt->_assignment
+				->ident->expr->ident->stack_offset;
+			if(counted) {
+				BooleanExpr *cond = stmt->stmt->_for->bool_expr->expr->blean;
+
+				emitf(out, "movl %d(%%rbp), %%eax\n", counter);
+				if(cond->rhs->type == expr_IntegerLiteral) {
+					emitf(out, "cmpl $%d, %%eax\n", cond->rhs->expr->intgr);
+				}
+				else {
+					emitf(out, "cmpl %d(%%rbp), %%eax\n",
+						cond->rhs->expr->ident->stack_offset);
+				}
+				emit(out, cond->op == LESS_THAN ? "jge " : "jg ");
+			}
+			else {
+				emit_expression(out, stmt->stmt->_for->bool_expr, prog);
+				emit(out, "cmpl $0, %eax\nje ");
+			}
+			emitf(out, "for_end_%d\n", label_no);
+
+			// Execute the statement block, then move the loop control variable
+			// on and jump back to the condition
+			emit_statement_list(out, stmt->stmt->_for->stmts, prog);
+			if(counted) emitf(out, "addl $%d, %d(%%rbp)\n", step, counter);
+			else emit_statement(out, stmt->stmt->_for->incrementor, prog);
+			emitf(out, "jmp for_begin_%d\n", label_no);
+
+			emitf(out, "for_end_%d:\n# END FOR STATEMENT %d\n",
+				label_no, label_no);
+			return;
 		}
 		
 		case stmt_While: {
 
-			// Get the label number for this if-statement
-			char *label_no = label_number(&label_while);
+			// Get the label number for this while-statement
+			int label_no = out->labels.while_stmt++;
 
-			// Genrate code for the boolean expression, and the true & false
-			// statement lists
-			char *b_exp =
-				codegen_expression(stmt->stmt->_while->bool_expr, prog);
-			char *stmts =
-				codegen_statement_list(stmt->stmt->_while->stmts, prog);
+			emitf(out, "# BEGIN WHILE STATEMENT %d\n", label_no);
+			emitf(out, "while_begin_%d:\n", label_no);
 
-			char *out = str_concat(21,
-				"# BEGIN WHILE STATEMENT ", label_no, "\n",
+			// Evaluate the boolean expression and put the result in %eax
+			emit_expression(out, stmt->stmt->_while->bool_expr, prog);
 
-				"while_begin_", label_no, ":\n",
+			// Compare the boolean expression with 0. If the boolean is 0, i.e.
+			// if the statement is false, jump out of the loop
+			emitf(out, "cmpl $0, %%eax\nje while_end_%d\n", label_no);
 
-				// Evaluate the boolean expression and put the result in %eax
-				b_exp,
+			// If the jump to the end of the loop was not taken, the boolean
+			// expression was true, so execute the statement block
+			emit_statement_list(out, stmt->stmt->_while->stmts, prog);
 
-				// Compare the boolean expression with 0
-				"cmpl $0, %eax\n",
+			// Then jump unconditionally back to the comparison. Jump to the
+			// end label when the boolean evaluates to false, exiting the loop.
+			emitf(out, "jmp while_begin_%d\nwhile_end_%d:\n",
+				label_no, label_no);
 
-				// If the boolean is 0, i.e. if the statement is false, jump out
-				// of the loop
-				"je while_end_", label_no, "\n",
+			emitf(out, "# END WHILE STATEMENT %d\n", label_no);
+			return;
+		}
+		
+		case stmt_If: {
+
+			// Get the label number for this if-statement
+			int label_no = out->labels.if_stmt++;
 
-				// If the jump to the end of the loop was not taken, the boolean
-				// expression was true, so execute the statement block
-				stmts,
+			emitf(out, "# BEGIN IF STATEMENT %d\n", label_no);
 
-				// Then jump unconditionally back to the comparison
-				"jmp while_begin", label_no, "\n",
+			// Evaluate the boolean expression and put the result in %eax
+			emit_expression(out, stmt->stmt->_if->bool_expr, prog);
 
-				// Jump here after when the boolean evaluates to true, exiting
-				// the loop
-				"while_end_", label_no, ":\n",
+			// Compare the boolean expression with 0. If the boolean is 0, i.e.
+			// if the expression is false, jump to the else statement label
+			emitf(out, "cmpl $0, %%eax\nje else_branch_%d\n", label_no);
 
-				"# END WHILE STATEMENT ", label_no, "\n");
+			// If the jump to the else label was not taken, the expression was
+			// true, so execute the true statement block
+			emit_statement_list(out, stmt->stmt->_if->true_stmts, prog);
 
-			free(b_exp);
-			free(stmts);
-			free(label_no);
+			// Then jump unconditionally over the else statements to the end of
+			// the else statements
+			emitf(out, "jmp if_end_%d\n", label_no);
 
-			return out;
+			// Jump here when the statement is false, and evaluate the false
+			// statement list
+			emitf(out, "else_branch_%d:\n", label_no);
+			emit_statement_list(out, stmt->stmt->_if->false_stmts, prog);
+
+			// Jump here after executing the true statements list, skipping the
+			// false statement list
+			emitf(out, "if_end_%d:\n", label_no);
+
+			emitf(out, "# END IF STATEMENT %d\n", label_no);
+			return;
 		}
 		
-		case stmt_If: {
-
-			// Get the label number for this if-statement
-			char *label_no = label_number(&label_if);
+		case stmt_Print: {
+			
+			// Get the label number for this print statement (only used in
+			// generated comments, there are no jumps in print statements)
+			int label_no = out->labels.print++;
 
-			// Genrate code for the boolean expression, and the true & false
-			// statement lists
-			char *b_exp = codegen_expression(stmt->stmt->_if->bool_expr, prog);
-			char *t_stmts = codegen_statement_list(
-				stmt->stmt->_if->true_stmts, prog);
-			char *f_stmts = codegen_statement_list(
-				stmt->stmt->_if->false_stmts, prog);
+			emitf(out, "# BEGIN PRINT STATEMENT %d\n", label_no);
 
-			char *out = str_concat(22,
-				"# BEGIN IF STATEMENT ", label_no, "\n",
+			// Evaluate the expression and put is value in %eax
+			emit_expression(out, stmt->stmt->_print->expr, prog);
 
-				// Evaluate the boolean expression and put the result in %eax
-				b_exp,
+			// codegen_program() declares printf_str as "%d\n", which can be
+			// used to print any integer in the manner below
+			emit(out,
+				// The value is printf()'s second argument
+				"movl %eax, %esi\n"
+
+				// The address of the format string is its first argument
+				"leaq printf_str(%rip), %rdi\n"
+
+				// Align the stack, as for a function call, and call printf
+				// with no vector registers used
+				"pushq %r12\n"
+				"movq %rsp, %r12\n"
+				"andq $-16, %rsp\n"
+				"xorl %eax, %eax\n"
+				"call printf@PLT\n"
+				"movq %r12, %rsp\n"
+				"popq %r12\n");
+
+			emitf(out, "# END PRINT STATEMENT %d\n", label_no);
+			return;
+		}
+		
+		case stmt_Assignment: {
 
-				// Compare the boolean expression with 0
-				"cmpl $0, %eax\n",
+			// Get the label number for this assignment statement (only used in
+			// generated comments, there are no jumps in assignment statements)
+			int label_no = out->labels.assignment++;
 
-				// If the boolean is 0, i.e. if the expression is false, jump to
-				// the else statement label
-				"je else_branch_", label_no, "\n",
+			emitf(out, "# BEGIN ASSIGNMENT STATEMENT %d\n", label_no);
 
-				// If the jump to the else label was not taken, the expression
-				// was true, so execute the true statement block
-				t_stmts,
+			// Evaluate the expression and put is value in %eax
+			emit_expression(out, stmt->stmt->_assignment->expr, prog);
 
-				// Then jump unconditionally over the else statements to the end
-				// of the else statements
-				"jmp if_end_", label_no, "\n",
+			// Store the expression's value at the appropriate location on the
+			// stack
+			emitf(out, "movl %%eax, %d(%%rbp)\n",
+				stmt->stmt->_assignment->ident->expr->ident->stack_offset);
 
-				// Jump here when the statement is false
-				"else_branch_", label_no, ":\n",
+			emitf(out, "# END ASSIGNMENT STATEMENT %d\n", label_no);
+			return;
+		}
+		
+		case stmt_Return: {
 
-				// Evaluate the false statement list
-				f_stmts,
+			// Get the label number for this return statement (only used in
+			// generated comments, return statements do not generate labels)
+			int label_no = out->labels.return_stmt++;
 
-				// Jump here after executing the true statements list, skipping
-				// the false statement list
-				"if_end_", label_no, ":\n",
+			emitf(out, "# BEGIN RETURN STATEMENT %d\n", label_no);
 
-				"# END IF STATEMENT ", label_no, "\n");
+			// Evaluate the expression and put is value in %eax
+			emit_expression(out, stmt->stmt->_return->expr, prog);
 
-			free(b_exp);
-			free(t_stmts);
-			free(f_stmts);
-			free(label_no);
+			// Jump back to the caller
+			emit(out, "ret\n");
 
-			return out;
+			emitf(out, "# END RETURN STATEMENT %d\n", label_no);
+			return;
 		}
-		
-		case stmt_Print: {
-			
-			// Get the label number for this print statement (only used in
-			// generated comments, there are no jumps in print statements)
-			char *label_no = label_number(&label_print);
+	}
+	printf("Invalid statement type in AST\n");
+	exit(EXIT_FAILURE);
+}
 
-			// Generate the code for the expression being printed
-			char *expr = codegen_expression(stmt->stmt->_print->expr, prog);
+/*
+ * The following functions generate the assembly code for a function from its
+ * SSA form (see ir.h). Each value is kept where the register allocator puts it
+ * (see regalloc.h): in one of the registers it allocates, or in a slot in the
+ * stack frame. Constants are used as immediates, and %eax, %ecx and %edx hold
+ * intermediate results. Labels within a function start with .L, so that they
+ * are local to the object file, and contain dots, which can not appear in
+ * minty names.
+ */
 
-			// codegen_program() declares printf_str as "%d\n", which can be
-			// used to print any integer in the manner below
-			char *out = str_concat(10,
-				"# BEGIN PRINT STATEMENT ", label_no, "\n",
-				
-				// Evaluate the expression and put is value in %eax
-				expr,
+/*
+ * The names of the registers, numbered as in machine code (see regalloc.h)
+ */
+static char *register_names[16] = {
+	"%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi",
+	"%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"
+};
+static char *register_names_64[16] = {
+	"%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+	"%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"
+};
+
+/*
+ * Writes a value as an operand: an immediate, a register or a stack slot
+ */
+static void emit_operand(Emitter *out, RegAllocation *ra, IRValue *value) {
+	if(value->op == ir_Constant) emitf(out, "$%d", value->value);
+	else if(ra->registers[value->id] >= 0) {
+		emit(out, register_names[ra->registers[value->id]]);
+	}
+	else emitf(out, "%d(%%rbp)", RegAllocation_slot_offset(ra, value));
+}
+
+/*
+ * Writes a single instruction with one value as an operand, which is placed
+ * between before and after
+ */
+static void emit_instruction(Emitter *out, RegAllocation *ra, char *before,
+	IRValue *value, char *after) {
+
+	emit(out, before);
+	emit_operand(out, ra, value);
+	emit(out, after);
+	emit(out, "\n");
+}
+
+/*
+ * Writes an instruction with two values as operands
+ */
+static void emit_instruction2(Emitter *out, RegAllocation *ra, char *opcode,
+	IRValue *source, IRValue *dest) {
+
+	emit(out, opcode);
+	emit_operand(out, ra, source);
+	emit(out, ", ");
+	emit_operand(out, ra, dest);
+	emit(out, "\n");
+}
 
-				// Push %eax on the stack (second argument to printf())
-				"pushl %eax\n",
+/*
+ * Writes a move between two values, through %eax if both are in memory
+ */
+static void emit_move(Emitter *out, RegAllocation *ra, IRValue *source,
+	IRValue *dest) {
 
-				// Push the address of the format string on the stack(first
-				// argument to printf())
-				"pushl $printf_str\n",
+	if(RegAllocation_same(ra, source, dest)) return;
+	if(ra->registers[dest->id] < 0 && source->op != ir_Constant &&
+		ra->registers[source->id] < 0) {
 
-				// And call printf
-				"call printf\n",
+		emit_instruction(out, ra, "movl ", source, ", %eax");
+		emit_instruction(out, ra, "movl %eax, ", dest, "");
+	}
+	else emit_instruction2(out, ra, "movl ", source, dest);
+}
 
-				"# END PRINT STATEMENT ", label_no, "\n");
+/*
+ * Generates the code for a value. Phis are given their values by the blocks
+ * that jump to them (see emit_phi_moves()), so they have no code of their own,
+ * and neither do constants or undefined values. Arguments are put where they
+ * belong on entry to the function.
+ */
+static void emit_value(Emitter *out, RegAllocation *ra, IRValue *value) {
+	int i;
+
+	switch(value->op) {
+		case ir_Arithmetic: {
+			IRValue *lhs = value->args[0];
+			IRValue *rhs = value->args[1];
+
+			// Division needs the sign of %eax extended into %edx first, and
+			// leaves the remainder in %edx
+			if(value->operator == DIVIDE || value->operator == MODULO) {
+				emit_instruction(out, ra, "movl ", rhs, ", %ecx");
+				emit_instruction(out, ra, "movl ", lhs, ", %eax");
+				emit(out, "cltd\nidivl %ecx\n");
+				emit_instruction(out, ra, value->operator == DIVIDE ?
+					"movl %eax, " : "movl %edx, ", value, "");
+				break;
+			}
+
+			char *opcode;
+			     if(value->operator ==     PLUS) opcode = "addl ";
+			else if(value->operator ==    MINUS) opcode = "subl ";
+			else                                 opcode = "imull ";
+
+			// The result is worked out where it is kept, unless that would
+			// overwrite the right-hand side before it is used, which the
+			// operands of an addition or multiplication are swapped to avoid
+			if((value->operator == PLUS || value->operator == MULTIPLY) &&
+				rhs->op != ir_Constant && RegAllocation_same(ra, value, rhs)) {
+
+				rhs = lhs;
+				lhs = value->args[1];
+			}
+			if(ra->registers[value->id] >= 0 && (rhs->op == ir_Constant ||
+				!RegAllocation_same(ra, value, rhs))) {
 
-			free(expr);
+				emit_move(out, ra, lhs, value);
+				emit_instruction2(out, ra, opcode, rhs, value);
+			}
+			else {
+				emit_instruction(out, ra, "movl ", lhs, ", %eax");
+				emit_instruction(out, ra, opcode, rhs, ", %eax");
+				emit_instruction(out, ra, "movl %eax, ", value, "");
+			}
+			break;
+		}
 
-			return out;
+		case ir_Compare: {
+			char *opcode;
+			     if(value->operator ==            EQUAL) opcode = "sete";
+			else if(value->operator ==        NOT_EQUAL) opcode = "setne";
+			else if(value->operator ==        LESS_THAN) opcode = "setl";
+			else if(value->operator ==    LESS_OR_EQUAL) opcode = "setle";
+			else if(value->operator ==     GREATER_THAN) opcode = "setg";
+			else                                         opcode = "setge";
+
+			// The left-hand side is compared where it is if it is in a
+			// register
+			IRValue *lhs = value->args[0];
+			if(lhs->op != ir_Constant && ra->registers[lhs->id] >= 0) {
+				emit_instruction2(out, ra, "cmpl ", value->args[1], lhs);
+			}
+			else {
+				emit_instruction(out, ra, "movl ", lhs, ", %eax");
+				emit_instruction(out, ra, "cmpl ", value->args[1], ", %eax");
+			}
+			emitf(out, "%s %%al\n", opcode);
+			if(ra->registers[value->id] >= 0) {
+				emit_instruction(out, ra, "movzbl %al, ", value, "");
+			}
+			else {
+				emit(out, "movzbl %al, %eax\n");
+				emit_instruction(out, ra, "movl %eax, ", value, "");
+			}
+			break;
 		}
-		
-		case stmt_Assignment: {
 
-			// Get the label number for this assignment statement (only used in
-			// generated comments, there are no jumps in assignment statements)
-			char *label_no = label_number(&label_assignment);
+		case ir_Call: {
+
+			// Arguments after the sixth are pushed from last to first, so
+			// that the callee finds them in order above its return address.
+			// The frame is aligned, so an odd number of them needs 8 bytes of
+			// padding to keep the stack aligned for the call. None of the
+			// registers that values are kept in are used to pass arguments.
+			int stack_args = value->arg_count > REGISTER_ARGS ?
+				value->arg_count - REGISTER_ARGS : 0;
+			int padding = 8 * (stack_args % 2);
+
+			if(padding) emit(out, "subq $8, %rsp\n");
+			for(i = value->arg_count - 1; i >= REGISTER_ARGS; i--) {
+				emit_instruction(out, ra, "movl ", value->args[i], ", %eax");
+				emit(out, "pushq %rax\n");
+			}
+			for(i = 0; i < value->arg_count && i < REGISTER_ARGS; i++) {
+				char after[8];
+				sprintf(after, ", %s", arg_registers[i]);
+				emit_instruction(out, ra, "movl ", value->args[i], after);
+			}
+
+			emitf(out, "call " SYMBOL_PREFIX "%s\n", value->call->name);
+			if(stack_args) {
+				emitf(out, "addq $%d, %%rsp\n", (8 * stack_args) + padding);
+			}
+			emit_instruction(out, ra, "movl %eax, ", value, "");
+			break;
+		}
 
-			// Generate the code for the expression being assigned
-			char *expr = codegen_expression(
-				stmt->stmt->_assignment->expr, prog);
+		case ir_Print: {
 
 			// codegen_program() declares printf_str as "%d\n", which can be
-			// used to print any integer in the manner below
-			char *out = str_concat(10,
-				"# BEGIN ASSIGNMENT STATEMENT ", label_no, "\n",
-				
-				// Evaluate the expression and put is value in %eax
-				expr,
+			// used to print any integer in the manner below. printf() takes
+			// a variable number of arguments, so %al holds the number of
+			// vector registers used.
+			emit_instruction(out, ra, "movl ", value->args[0], ", %esi");
+			emit(out,
+				"leaq printf_str(%rip), %rdi\n"
+				"xorl %eax, %eax\n"
+				"call printf@PLT\n");
+			break;
+		}
 
-				// Store the expression's value at the appropriate location on
-				// the stack
-				"movl %eax, ",
-					stmt->stmt->_assignment->ident->expr->ident->stack_offset,
-					"(%ebp)\n",
+		case ir_Argument: {
+			if(value->value < REGISTER_ARGS) {
+				char before[16];
+				sprintf(before, "movl %s, ", arg_registers[value->value]);
+				emit_instruction(out, ra, before, value, "");
+			}
+			else {
+				emitf(out, "movl %d(%%rbp), %%eax\n",
+					16 + (8 * (value->value - REGISTER_ARGS)));
+				emit_instruction(out, ra, "movl %eax, ", value, "");
+			}
+			break;
+		}
 
-				"# END ASSIGNMENT STATEMENT ", label_no, "\n");
+		default:
+			break;
+	}
+}
 
-			free(expr);
+/*
+ * Generates the code that gives a block's phis their values on entry from
+ * pred. If one phi is kept where another's value is, all the values are
+ * pushed before any phi is written.
+ */
+static void emit_phi_moves(Emitter *out, RegAllocation *ra, IRBlock *pred,
+	IRBlock *block) {
+
+	int index = IRBlock_pred_index(block, pred);
 
-			return out;
+	int i;
+	if(!RegAllocation_phi_moves_overlap(ra, block, index)) {
+		for(i = 0; i < block->value_count; i++) {
+			IRValue *phi = block->values[i];
+			if(phi->op == ir_Phi) emit_move(out, ra, phi->args[index], phi);
 		}
-		
-		case stmt_Return: {
+		return;
+	}
 
-			// Get the label number for this return statement (only used in
-			// generated comments, return statements do not generate labels)
-			char *label_no = label_number(&label_return);
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *phi = block->values[i];
+		if(phi->op != ir_Phi || RegAllocation_same(ra, phi->args[index], phi)) {
+			continue;
+		}
+		emit_instruction(out, ra, "movl ", phi->args[index], ", %eax");
+		emit(out, "pushq %rax\n");
+	}
+
+	for(i = block->value_count - 1; i >= 0; i--) {
+		IRValue *phi = block->values[i];
+		if(phi->op != ir_Phi || RegAllocation_same(ra, phi->args[index], phi)) {
+			continue;
+		}
+		emit(out, "popq %rax\n");
+		emit_instruction(out, ra, "movl %eax, ", phi, "");
+	}
+}
+
+/*
+ * Generates the code that leaves a block, where next is the block placed after
+ * it (or NULL if it is the last block). Block labels are .L, the function's
+ * name, .b and the block's number.
+ */
+static void emit_exit(Emitter *out, RegAllocation *ra, FNDecl *func,
+	IRBlock *block, IRBlock *next) {
 
-			// Generate the code for the expression being returned
-			char *expr = codegen_expression(stmt->stmt->_return->expr, prog);
+	int i;
 
-			char *out = str_concat(8,
-				"# BEGIN RETURN STATEMENT ", label_no, "\n",
-				
-				// Evaluate the expression and put is value in %eax
-				expr,
+	switch(block->exit) {
+		case ir_Jump: {
+			emit_phi_moves(out, ra, block, block->succs[0]);
+			if(block->succs[0] != next) {
+				emitf(out, "jmp .L%s.b%d\n", func->name, block->succs[0]->id);
+			}
+			break;
+		}
 
-				// Jump back to the caller
-				"ret\n",
+		case ir_Branch: {
+			IRBlock *if_true = block->succs[0];
+			IRBlock *if_false = block->succs[1];
+			bool has_false_moves =
+				RegAllocation_has_phi_moves(ra, block, if_false);
 
-				"# END RETURN STATEMENT ", label_no, "\n");
+			// If phis must be given values on the way to if_false, the je lands
+			// on code after the jump to if_true that does so
+			IRValue *condition = block->exit_value;
+			if(condition->op != ir_Constant &&
+				ra->registers[condition->id] >= 0) {
 
-			free(label_no);
-			free(expr);
+				char *name = register_names[ra->registers[condition->id]];
+				emitf(out, "testl %s, %s\n", name, name);
+			}
+			else {
+				emit_instruction(out, ra, "movl ", condition, ", %eax");
+				emit(out, "testl %eax, %eax\n");
+			}
+
+			// If if_false comes next, and if_true needs no phi moves, the
+			// branch can go the other way and fall through to if_false
+			if(if_false == next &&
+				!RegAllocation_has_phi_moves(ra, block, if_true)) {
 
-			return out;
+				emitf(out, "jne .L%s.b%d\n", func->name, if_true->id);
+				emit_phi_moves(out, ra, block, if_false);
+				break;
+			}
+			if(has_false_moves) {
+				emitf(out, "je .L%s.b%d.from.b%d\n",
+					func->name, if_false->id, block->id);
+			}
+			else emitf(out, "je .L%s.b%d\n", func->name, if_false->id);
+
+			emit_phi_moves(out, ra, block, if_true);
+			if(if_true != next || has_false_moves) {
+				emitf(out, "jmp .L%s.b%d\n", func->name, if_true->id);
+			}
+			if(has_false_moves) {
+				emitf(out, ".L%s.b%d.from.b%d:\n",
+					func->name, if_false->id, block->id);
+				emit_phi_moves(out, ra, block, if_false);
+				emitf(out, "jmp .L%s.b%d\n", func->name, if_false->id);
+			}
+			break;
 		}
+
+		case ir_Return:
+			emit_instruction(out, ra, "movl ", block->exit_value, ", %eax");
+			for(i = 0; i < ra->saved_count; i++) {
+				emitf(out, "movq %d(%%rbp), %s\n", -8 * (i + 1),
+					register_names_64[ra->saved[i]]);
+			}
+			emit(out,
+				"leave\n"
+				"ret\n");
+			break;
+
+		case ir_MissingReturn:
+			// If we reach the end of a function without returning to the
+			// caller, report it in the same way as the interpreter, and exit
+			emitf(out,
+				"# END OF FUNCTION ERROR CODE\n"
+				"leaq missing_return_str(%%rip), %%rdi\n"
+				"leaq .L%s.name(%%rip), %%rsi\n"
+				"xorl %%eax, %%eax\n"
+				"call printf@PLT\n"
+				"movl $1, %%edi\n"
+				"call exit@PLT\n", func->name);
+			break;
 	}
-	printf("Invalid statement type in AST\n");
-	exit(EXIT_FAILURE);
-	return NULL;
 }
 
 /*
- * Generate and return the code for a given function. Use caution if calling
+ * Generate the code for a given function, by building its SSA form,
+ * optimising it (see ir.h) and allocating registers for its values (see
+ * regalloc.h). If the program has a profile (see profile.h), hot calls are
+ * inlined and rarely run blocks are moved to the end. Use caution if calling
  * this function as code generated by this function depends on code generated
- * in the generate_program() function, specifically the format strings used for
+ * in the codegen_program() function, specifically the format strings used for
  * error messages and print statements. These must be included by any caller to
  * this function in order to obtain valid code.
+ *
+ * The code follows the System V AMD64 calling convention (see SYMBOL_PREFIX),
+ * so the stack frame looks like this (offsets from %rbp):
+ *     +16 + 8n     argument number 6 + n, if there are more than 6
+ *     +8           return address
+ *      0           caller's %rbp
+ *     -8 - 8n      the nth register calls preserve that the function uses
+ *     -4 - 4n      stack slot number n, after the saved registers
+ * The frame is padded to keep the stack pointer 16-byte aligned within the
+ * function, so that calls can be made without adjusting it.
  */
-char *codegen_function(FNDecl *func, Program *prog) {
+void emit_function(Emitter *out, FNDecl *func, Program *prog) {
+	IRFunction *ir = IRFunction_build(func, true);
+	ir_sccp(ir);
+	ir_gvn(ir);
+	ir_dce(ir);
+	ir_inline_calls(ir, prog);
+	RegAllocation *ra = regalloc_function(ir);
+	ir_layout(ir);
+
+	int frame_size = RegAllocation_frame_size(ra);
+
+	// The function's name is used in the error reported if it reaches its
+	// end without returning
+	emitf(out,
+		"\n.section .rodata\n"
+		".L%s.name: .asciz \"%s\"\n"
+		".text\n", func->name, func->name);
+
+	// Declare the function as global, add the function label, and set up the
+	// stack frame
+	emitf(out,
+		".globl " SYMBOL_PREFIX "%s\n"
+		".type " SYMBOL_PREFIX "%s, @function\n"
+		SYMBOL_PREFIX "%s:\n", func->name, func->name, func->name);
+	emit(out,
+		"pushq %rbp\n"
+		"movq %rsp, %rbp\n");
+
+	int i, j;
+	for(i = 0; i < ra->saved_count; i++) {
+		emitf(out, "pushq %s\n", register_names_64[ra->saved[i]]);
+	}
+	if(frame_size) emitf(out, "subq $%d, %%rsp\n", frame_size);
 
-	char *stmts_code = codegen_statement_list(func->stmts, prog);
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		IRBlock *next = i + 1 < ir->block_count ? ir->blocks[i + 1] : NULL;
 
-	char *out = str_concat(13,
-		// Declare the function as global
-		"\n.globl ", func->name, "\n",
+		emitf(out, ".L%s.b%d:\n", func->name, block->id);
+		for(j = 0; j < block->value_count; j++) {
+			emit_value(out, ra, block->values[j]);
+		}
+		emit_exit(out, ra, func, block, next);
+	}
 
-		// Add the function label
-		func->name, ":\n\n",
+	emitf(out, ".size " SYMBOL_PREFIX "%s, .-" SYMBOL_PREFIX "%s\n",
+		func->name, func->name);
 
-		// Add the code
-		stmts_code, "\n",
+	RegAllocation_free(ra);
+	IRFunction_free(ir);
+}
 
-		// If we reach the end of a function without returning to the caller,
-		// print an error message and exit:
-		"# END OF FUNCTION ERROR CODE |\n",
-		"pushl $error_str           # |\n",
-		"call printf                # |\n",
-		"movl $0, %ebx              # |\n",
-		"movl $1, %eax              # |\n",
-		"int $0x80                  # |\n");
+/*
+ * Generates the program's entry point, the C main() function. This converts
+ * the command-line arguments to integers with atoi(), passes them to the minty
+ * main function, and prints the value that it returns, in the same way as the
+ * interpreter, which also reports being given the wrong number of arguments.
+ * The stack frame holds argc in %rbx and argv in %r12, which are saved at -8
+ * and -16 from %rbp, followed by a slot for each argument.
+ */
+static void emit_entry(Emitter *out, FNDecl *main_func) {
+	int arg_count = LinkedList_length(main_func->args);
+	int stack_args = arg_count > REGISTER_ARGS ? arg_count - REGISTER_ARGS : 0;
+
+	emitf(out,
+		"\n.section .rodata\n"
+		".Lentry.arg_count_str: .asciz \"Function: 'main' takes %%d "
+			"arguments, %%d given\"\n"
+		".text\n"
+		".globl main\n"
+		".type main, @function\n"
+		"main:\n"
+		"pushq %%rbp\n"
+		"movq %%rsp, %%rbp\n"
+		"pushq %%rbx\n"
+		"pushq %%r12\n"
+		"subq $%d, %%rsp\n"
+		"movl %%edi, %%ebx\n"
+		"movq %%rsi, %%r12\n", ((4 * arg_count) + 15) & ~15);
+
+	// argv[0] is the name of the executable, so there should be one more
+	// string in argv than there are arguments
+	emitf(out,
+		"leal -1(%%rbx), %%edx\n"
+		"cmpl $%d, %%edx\n"
+		"je .Lentry.args\n"
+		"leaq .Lentry.arg_count_str(%%rip), %%rdi\n"
+		"movl $%d, %%esi\n"
+		"xorl %%eax, %%eax\n"
+		"call printf@PLT\n"
+		"movl $1, %%edi\n"
+		"call exit@PLT\n"
+		".Lentry.args:\n", arg_count, arg_count);
+
+	// Argument i is argv[i + 1]
+	int i;
+	for(i = 0; i < arg_count; i++) {
+		emitf(out,
+			"movq %d(%%r12), %%rdi\n"
+			"call atoi@PLT\n"
+			"movl %%eax, %d(%%rbp)\n", 8 * (i + 1), -(20 + (4 * i)));
+	}
 
+	// Pass the arguments in the same way as a call from a minty function
+	if(stack_args % 2) emit(out, "subq $8, %rsp\n");
+	for(i = arg_count - 1; i >= REGISTER_ARGS; i--) {
+		emitf(out, "movl %d(%%rbp), %%eax\npushq %%rax\n", -(20 + (4 * i)));
+	}
+	for(i = 0; i < arg_count && i < REGISTER_ARGS; i++) {
+		emitf(out, "movl %d(%%rbp), %s\n", -(20 + (4 * i)), arg_registers[i]);
+	}
+	emit(out,
+		"call " SYMBOL_PREFIX "main\n"
+
+		// Print the result and exit successfully
+		"movl %eax, %esi\n"
+		"leaq printf_str(%rip), %rdi\n"
+		"xorl %eax, %eax\n"
+		"call printf@PLT\n"
+		"xorl %eax, %eax\n"
+		"movq -8(%rbp), %rbx\n"
+		"movq -16(%rbp), %r12\n"
+		"leave\n"
+		"ret\n"
+		".size main, .-main\n");
+}
 
-	free(stmts_code);
-	return out;
+/*
+ * Functions are compiled independently of each other, so the ahead-of-time
+ * compilers spread them across a number of threads, which each take the next
+ * function that no thread has started until there are none left
+ */
+static int codegen_threads = 1;
+
+typedef struct {
+	void (*work)(int index, void *data);
+	void *data;
+	int count;
+	int next;
+	pthread_mutex_t lock;
+} CodegenJobs;
+
+/*
+ * Sets the number of threads that codegen_parallel() uses, including the
+ * calling thread
+ */
+void codegen_set_threads(int count) {
+	codegen_threads = count > 1 ? count : 1;
+}
+
+static void *codegen_worker(void *arg) {
+	CodegenJobs *jobs = (CodegenJobs *)arg;
+
+	while(true) {
+		pthread_mutex_lock(&(jobs->lock));
+		int index = jobs->next++;
+		pthread_mutex_unlock(&(jobs->lock));
+
+		if(index >= jobs->count) return NULL;
+		jobs->work(index, jobs->data);
+	}
 }
 
 /*
- * Generate & return the assembly code representing an entire program
+ * Calls work(index, data) for every index from 0 to count - 1, on as many
+ * threads as codegen_set_threads() allows, and returns once every call has
+ * returned. The calls may be made in any order, and at the same time, so each
+ * should only write to results of its own.
  */
-char *codegen_program(Program *prog) {
-	// Calculate (and record in AST) the stack sizes for all functions and the
-	// stack base offsets for all the variables in the program
-	Program_generate_offsets(prog);
+void codegen_parallel(int count, void (*work)(int index, void *data),
+	void *data) {
 
+	int thread_count = codegen_threads < count ? codegen_threads : count;
+	int i;
+	if(thread_count <= 1) {
+		for(i = 0; i < count; i++) work(i, data);
+		return;
+	}
+
+	CodegenJobs jobs;
+	jobs.work = work;
+	jobs.data = data;
+	jobs.count = count;
+	jobs.next = 0;
+	pthread_mutex_init(&(jobs.lock), NULL);
+
+	// The calling thread works alongside the others
+	pthread_t *threads = safe_alloc(sizeof(pthread_t) * (thread_count - 1));
+	for(i = 0; i < thread_count - 1; i++) {
+		if(pthread_create(&threads[i], NULL, codegen_worker, &jobs) != 0) {
+			printf("Could not start code generation thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	codegen_worker(&jobs);
+	for(i = 0; i < thread_count - 1; i++) pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&(jobs.lock));
+	free(threads);
+}
+
+/*
+ * Puts a program's functions in the order their code is generated: the most
+ * often called first according to the program's profile (see profile.h), so
+ * that hot code is kept together, and otherwise in the order they appear in
+ * the program
+ */
+void codegen_order_functions(FNDecl **funcs, int count) {
+	int i, j;
+	for(i = 1; i < count; i++) {
+		FNDecl *func = funcs[i];
+		for(j = i; j > 0 && funcs[j - 1]->exec_count < func->exec_count; j--) {
+			funcs[j] = funcs[j - 1];
+		}
+		funcs[j] = func;
+	}
+}
+
+/*
+ * The functions of a program, and the code generated for each of them
+ */
+typedef struct {
+	FNDecl **funcs;
+	char **code;
+	Program *prog;
+} ProgramCode;
+
+static void emit_function_job(int index, void *data) {
+	ProgramCode *program_code = (ProgramCode *)data;
+	Emitter *out = Emitter_init(NULL);
+	emit_function(out, program_code->funcs[index], program_code->prog);
+	program_code->code[index] = Emitter_finish(out);
+}
+
+/*
+ * Generate the assembly code representing an entire program. The code can be
+ * assembled and linked into an executable by the system's C compiler, which
+ * runs the program with its command-line arguments (see emit_entry()). The
+ * functions are generated in parallel (see codegen_parallel()), each into a
+ * buffer of its own, and written out in the order given by
+ * codegen_order_functions().
+ */
+void emit_program(Emitter *out, Program *prog) {
 	// If there are no functions, print an error message and return
 	if(LinkedList_length(prog->function_list) < 1) {
 		printf("Error: empty program object given to codegen_program()\n");
 		exit(EXIT_FAILURE);
 	}
 
-	// Generate the code for the first function
-	LLIterator *function_iter = LLIterator_init(prog->function_list);
-	char *function_code = codegen_function(
-		(FNDecl *)LLIterator_get_current(function_iter), prog);
-	LLIterator_advance(function_iter);
+	// Optimise the program's loops in the same way as before interpreting it,
+	// then calculate (and record in AST) the stack sizes for all functions
+	// and the stack base offsets for all the variables in the program
+	Program_optimise(prog);
+	Program_generate_offsets(prog);
 
-	// Generate the code for each subsequent function
+	// Strings used by implementation
+	emit(out,
+		".section .rodata\n"
+		"printf_str: .asciz \"%d\\n\"\n"
+		"missing_return_str: .asciz \"Reached end of function '%s' without "
+			"return statement\\n\"\n"
+		".text\n");
+
+	emit_entry(out, Program_get_FNDecl(prog, "main"));
+
+	// Generate the code for each function
+	ProgramCode program_code;
+	int count = LinkedList_length(prog->function_list);
+	program_code.funcs = safe_alloc(sizeof(FNDecl *) * count);
+	program_code.code = safe_alloc(sizeof(char *) * count);
+	program_code.prog = prog;
+
+	int i = 0;
+	LLIterator *function_iter = LLIterator_init(prog->function_list);
 	while(!LLIterator_ended(function_iter)) {
-		char *next_fn = codegen_function(
-			(FNDecl *)LLIterator_get_current(function_iter), prog);
-		char *temp = str_concat_2(function_code, next_fn);
-		free(next_fn);
-		free(function_code);
-		function_code = temp;
+		program_code.funcs[i++] =
+			(FNDecl *)LLIterator_get_current(function_iter);
 		LLIterator_advance(function_iter);
 	}
 	free(function_iter);
+	codegen_order_functions(program_code.funcs, count);
 
-	// NOT FULLY IMPLEMENTED WARNING (BUT STUFF LEFT IS NOT REQUIRED FOR JIT)
-	printf("Warning: codegen_program() does not call the main function "
-		"correctly yet\n");
+	codegen_parallel(count, emit_function_job, &program_code);
+	for(i = 0; i < count; i++) {
+		emit(out, program_code.code[i]);
+		free(program_code.code[i]);
+	}
+	free(program_code.funcs);
+	free(program_code.code);
 
-	char *out = str_concat_2(
-		// Strings used by implementation
-		"# WARNING: COMMAND-LINE ARGUMENTS NOT YET SUPPORTED\n"
-		".text\n"
-		"printf_str: .asciz \"%d\"\n"
-		"error_str: .asciz \"Error: reached end of function without return\"\n"
-		
-		// Actual entry point is not main, but STARTPROG
-		".globl STARTPROG\n"
-		"STARTPROG:\n"
-		
-			// STARTPROG calls the main function and returns its result as the
-			// exit code of the function
-			"movl $6, %eax\n"
-			"pushl %eax\n"
-			"addl $4, %esp\n"
-			"movl %esp, %ebp\n"
-
-			"call fibonacci\n"
-			
-			// Exit system call with result as exit status
-			"movl %eax, %ebx\n"
-			"movl $1, %eax\n"
-			"int $0x80\n",
-		
-		function_code);
+	// The code does not need an executable stack
+	emit(out, "\n.section .note.GNU-stack,\"\",@progbits\n");
+}
 
-	free(function_code);
-	reset_labels();
-	return out;
-}
\ No newline at end of file
+/*
+ * The following functions return the code generated by the functions above as
+ * a newly allocated string
+ */
+
+char *codegen_expression(Expression *expr, Program *prog) {
+	Emitter *out = Emitter_init(NULL);
+	emit_expression(out, expr, prog);
+	return Emitter_finish(out);
+}
+
+char *codegen_statement_list(LinkedList *stmts, Program *prog) {
+	Emitter *out = Emitter_init(NULL);
+	emit_statement_list(out, stmts, prog);
+	return Emitter_finish(out);
+}
+
+char *codegen_statement(Statement *stmt, Program *prog) {
+	Emitter *out = Emitter_init(NULL);
+	emit_statement(out, stmt, prog);
+	return Emitter_finish(out);
+}
+
+char *codegen_function(FNDecl *func, Program *prog) {
+	Emitter *out = Emitter_init(NULL);
+	emit_function(out, func, prog);
+	return Emitter_finish(out);
+}
+
+char *codegen_program(Program *prog) {
+	Emitter *out = Emitter_init(NULL);
+	emit_program(out, prog);
+	return Emitter_finish(out);
+}
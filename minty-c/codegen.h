@@ -13,6 +13,76 @@
 #ifndef CODEGEN
 #define CODEGEN
 
+#include <stdio.h>
+
+/*
+ * Functions are compiled for the System V AMD64 calling convention, under which
+ * the first six arguments are passed in registers, and any further arguments
+ * are passed on the stack, 8 bytes each, the first at the lowest address. The
+ * stack pointer must be 16-byte aligned at every call. Each minty function is
+ * given the symbol of its name prefixed with SYMBOL_PREFIX, so that it can not
+ * clash with the C library, or with the program's entry point, which is the C
+ * main() function.
+ */
+#define REGISTER_ARGS 6
+#define SYMBOL_PREFIX "minty_"
+
+/*
+ * The counters that the code generated from the AST numbers its labels with,
+ * one for each kind of expression or statement, which are incremented every
+ * time a number is taken
+ */
+typedef struct {
+	int boolean;
+	int arithmetic;
+	int fncall;
+	int ternary;
+	int for_stmt;
+	int while_stmt;
+	int if_stmt;
+	int print;
+	int assignment;
+	int return_stmt;
+} Labels;
+
+/*
+ * Assembly code is written to an Emitter as it is generated, in a single pass.
+ * An Emitter either writes the code to a stream, or collects it in a buffer
+ * that grows as needed, which is returned by Emitter_finish(). Each Emitter
+ * numbers labels from zero, so that nothing is shared between code generated
+ * into different Emitters, which can be written on different threads.
+ */
+typedef struct {
+	FILE *stream;
+	char *buffer;
+	int len;
+	int capacity;
+	Labels labels;
+} Emitter;
+
+Emitter *Emitter_init(FILE *stream);
+
+void emit(Emitter *out, char *code);
+
+void emitf(Emitter *out, char *format, ...);
+
+char *Emitter_finish(Emitter *out);
+
+/*
+ * Code generation functions, which write the code for part of a program to an
+ * Emitter, or return it as a newly allocated string
+ */
+
+void emit_expression(Emitter *out, Expression *expr, Program *prog);
+
+void emit_statement_list(Emitter *out, LinkedList *stmts, Program *prog);
+
+void emit_statement(Emitter *out, Statement *stmt, Program *prog);
+
+void emit_function(Emitter *out, FNDecl *func, Program *prog);
+
+void emit_program(Emitter *out, Program *prog);
+
 char *codegen_expression(Expression *expr, Program *prog);
 
 char *codegen_statement_list(LinkedList *stmts, Program *prog);
@@ -23,4 +93,11 @@ char *codegen_function(FNDecl *func, Program *prog);
 
 char *codegen_program(Program *prog);
 
+void codegen_order_functions(FNDecl **funcs, int count);
+
+void codegen_set_threads(int count);
+
+void codegen_parallel(int count, void (*work)(int index, void *data),
+	void *data);
+
 #endif // CODEGEN
\ No newline at end of file
@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "minty_util.h"
+#include "execmem.h"
+
+/*
+ * A run of free bytes in a chunk, in the list of a chunk's free extents, which
+ * is ordered by offset
+ */
+typedef struct ExecExtent ExecExtent;
+struct ExecExtent {
+	long offset;
+	long len;
+	ExecExtent *next;
+};
+
+/*
+ * A region of memory that code is allocated from, with its two views
+ */
+typedef struct ExecChunk ExecChunk;
+struct ExecChunk {
+	char *writable;
+	char *executable;
+	long size;
+	bool cold;
+	ExecExtent *free;
+	ExecChunk *next;
+};
+
+/*
+ * All the chunks that have been mapped, oldest first
+ */
+static ExecChunk *chunks = NULL;
+
+/*
+ * Maps a view of a file at an address aligned to EXECMEM_CHUNK_SIZE, which
+ * transparent huge pages require, and asks for it to be backed by them. The
+ * address is found by reserving more address space than needed, then mapping
+ * the file over the aligned part of it and releasing the rest.
+ */
+static char *map_aligned(int fd, long size, int prot) {
+	char *reserved = mmap(NULL, size + EXECMEM_CHUNK_SIZE, PROT_NONE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(reserved == MAP_FAILED) return MAP_FAILED;
+
+	char *aligned = (char *)(((unsigned long)reserved + EXECMEM_CHUNK_SIZE - 1)
+		& ~((unsigned long)EXECMEM_CHUNK_SIZE - 1));
+	if(aligned > reserved) munmap(reserved, aligned - reserved);
+	munmap(aligned + size, (reserved + EXECMEM_CHUNK_SIZE) - aligned);
+
+	char *view = mmap(aligned, size, prot, MAP_SHARED | MAP_FIXED, fd, 0);
+	if(view == MAP_FAILED) return MAP_FAILED;
+
+	// Huge pages may not be available for memfds, which is not an error
+	madvise(view, size, MADV_HUGEPAGE);
+
+	return view;
+}
+
+/*
+ * Maps a new chunk of at least the given size, and adds it to the end of the
+ * list of chunks
+ */
+static ExecChunk *ExecChunk_init(long size, bool cold) {
+	size = ((size + EXECMEM_CHUNK_SIZE - 1) / EXECMEM_CHUNK_SIZE)
+		* EXECMEM_CHUNK_SIZE;
+
+	int fd = memfd_create("minty-jit", MFD_CLOEXEC);
+	if(fd == -1 || ftruncate(fd, size) == -1) {
+		printf("Could not create memory for compiled code\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ExecChunk *chunk = safe_alloc(sizeof(ExecChunk));
+	chunk->writable = map_aligned(fd, size, PROT_READ | PROT_WRITE);
+	chunk->executable = map_aligned(fd, size, PROT_READ | PROT_EXEC);
+	if(chunk->writable == MAP_FAILED || chunk->executable == MAP_FAILED) {
+		printf("Could not map memory for compiled code\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// The mappings keep the memory alive without the file descriptor
+	close(fd);
+
+	chunk->size = size;
+	chunk->cold = cold;
+	chunk->free = safe_alloc(sizeof(ExecExtent));
+	chunk->free->offset = 0;
+	chunk->free->len = size;
+	chunk->free->next = NULL;
+	chunk->next = NULL;
+
+	ExecChunk **last = &chunks;
+	while(*last) last = &((*last)->next);
+	*last = chunk;
+
+	return chunk;
+}
+
+/*
+ * Returns the number of bytes between an address and a free extent, 0 if the
+ * address is at the start or end of the extent
+ */
+static long extent_distance(ExecChunk *chunk, ExecExtent *extent, char *near) {
+	char *start = chunk->executable + extent->offset;
+	char *end = start + extent->len;
+	if(near < start) return start - near;
+	if(near > end) return near - end;
+	return 0;
+}
+
+/*
+ * Returns the number of bytes that an allocation of len bytes of code takes up
+ */
+long execmem_size(int len) {
+	if(len < 1) len = 1;
+	return (len + EXECMEM_ALIGNMENT - 1) & ~(EXECMEM_ALIGNMENT - 1);
+}
+
+/*
+ * Allocates memory for len bytes of code, returning its executable view and
+ * setting writable to its writable view. Hot code is placed as close as
+ * possible to the address near, which should be the end of the code that it
+ * calls or is called by the most, so that the two share cache lines and pages.
+ * If near is NULL, the code goes in the first gap that it fits in, which packs
+ * code together. Cold code is allocated in the same way, from separate chunks.
+ */
+void *execmem_alloc(int len, bool cold, void *near, void **writable) {
+	long size = execmem_size(len);
+
+	// Find the free extent closest to near that the code fits in
+	ExecChunk *best_chunk = NULL;
+	ExecExtent *best = NULL;
+	long best_distance = 0;
+	ExecChunk *chunk;
+	for(chunk = chunks; chunk && !(best && !near); chunk = chunk->next) {
+		if(chunk->cold != cold) continue;
+
+		ExecExtent *extent;
+		for(extent = chunk->free; extent; extent = extent->next) {
+			if(extent->len < size) continue;
+
+			long distance = near ? extent_distance(chunk, extent, near) : 0;
+			if(!best || distance < best_distance) {
+				best_chunk = chunk;
+				best = extent;
+				best_distance = distance;
+			}
+			if(!near) break;
+		}
+	}
+	if(!best) {
+		best_chunk = ExecChunk_init(size, cold);
+		best = best_chunk->free;
+	}
+
+	// Take the code's space from the end of the extent nearest to near
+	long offset = best->offset;
+	if(near && (char *)near > best_chunk->executable + best->offset) {
+		offset = best->offset + best->len - size;
+	}
+	else best->offset += size;
+	best->len -= size;
+
+	if(best->len == 0) {
+		ExecExtent **link = &(best_chunk->free);
+		while(*link != best) link = &((*link)->next);
+		*link = best->next;
+		free(best);
+	}
+
+	*writable = best_chunk->writable + offset;
+	return best_chunk->executable + offset;
+}
+
+/*
+ * Allocates memory holding a copy of the given code, returning its executable
+ * view
+ */
+void *execmem_copy(void *code, int len) {
+	void *writable;
+	void *executable = execmem_alloc(len, false, NULL, &writable);
+	memcpy(writable, code, len);
+	return executable;
+}
+
+/*
+ * Frees the memory allocated for len bytes of code, given its executable view.
+ * A chunk that becomes completely free is unmapped, unless it is the only one
+ * of its kind.
+ */
+void execmem_free(void *executable, int len) {
+	ExecChunk **chunk_link = &chunks;
+	while(*chunk_link && !((char *)executable >= (*chunk_link)->executable &&
+		(char *)executable < (*chunk_link)->executable + (*chunk_link)->size)) {
+
+		chunk_link = &((*chunk_link)->next);
+	}
+	ExecChunk *chunk = *chunk_link;
+	if(!chunk) {
+		printf("Freed memory that was not allocated for compiled code\n");
+		exit(EXIT_FAILURE);
+	}
+
+	long offset = (char *)executable - chunk->executable;
+	long size = execmem_size(len);
+
+	// Insert the extent in order, merging it with its neighbours
+	ExecExtent *prev = NULL;
+	ExecExtent *next = chunk->free;
+	while(next && next->offset < offset) {
+		prev = next;
+		next = next->next;
+	}
+
+	ExecExtent *extent;
+	if(prev && prev->offset + prev->len == offset) {
+		extent = prev;
+		extent->len += size;
+	}
+	else {
+		extent = safe_alloc(sizeof(ExecExtent));
+		extent->offset = offset;
+		extent->len = size;
+		extent->next = next;
+		if(prev) prev->next = extent;
+		else chunk->free = extent;
+	}
+	if(next && extent->offset + extent->len == next->offset) {
+		extent->len += next->len;
+		extent->next = next->next;
+		free(next);
+	}
+
+	// Release the chunk if nothing is left in it and another can be used
+	if(chunk->free->len < chunk->size) return;
+	ExecChunk *other = chunks;
+	while(other && (other == chunk || other->cold != chunk->cold)) {
+		other = other->next;
+	}
+	if(!other) return;
+
+	*chunk_link = chunk->next;
+	munmap(chunk->writable, chunk->size);
+	munmap(chunk->executable, chunk->size);
+	free(chunk->free);
+	free(chunk);
+}
@@ -0,0 +1,35 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef EXECMEM
+#define EXECMEM
+
+/*
+ * Executable memory for the code produced by the JIT compiler, which is never
+ * writable and executable at the same time. Code is allocated from chunks, each
+ * of which is a memfd (an anonymous in-memory file) that is mapped twice: once
+ * writable, for code to be written into, and once executable, for it to be run
+ * from. Code can therefore be emitted and run on hosts that forbid memory that
+ * is both writable and executable, without changing the protection of any
+ * mapping with mprotect().
+ *
+ * Chunks are aligned to, and a multiple of, EXECMEM_CHUNK_SIZE, and are backed
+ * by transparent huge pages where the system allows it, so that a program's
+ * compiled code is spread across as few TLB entries as possible. Allocations
+ * are only rounded up to EXECMEM_ALIGNMENT bytes, so that small functions can
+ * share cache lines. Cold code, which is not expected to run, is kept in its
+ * own chunks, away from the hot code.
+ */
+#define EXECMEM_CHUNK_SIZE (2 * 1024 * 1024)
+#define EXECMEM_ALIGNMENT 16
+
+void *execmem_alloc(int len, bool cold, void *near, void **writable);
+
+void *execmem_copy(void *code, int len);
+
+long execmem_size(int len);
+
+void execmem_free(void *executable, int len);
+
+#endif // EXECMEM
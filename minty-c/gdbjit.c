@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <elf.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "jitcode.h"
+#include "gdbjit.h"
+
+/*
+ * The DWARF constants used to describe compiled code
+ */
+#define DW_TAG_compile_unit 0x11
+#define DW_TAG_subprogram 0x2E
+#define DW_CHILDREN_no 0x00
+#define DW_CHILDREN_yes 0x01
+#define DW_AT_name 0x03
+#define DW_AT_stmt_list 0x10
+#define DW_AT_low_pc 0x11
+#define DW_AT_high_pc 0x12
+#define DW_AT_producer 0x25
+#define DW_AT_decl_file 0x3A
+#define DW_AT_decl_line 0x3B
+#define DW_AT_external 0x3F
+#define DW_FORM_addr 0x01
+#define DW_FORM_data4 0x06
+#define DW_FORM_string 0x08
+#define DW_FORM_data1 0x0B
+#define DW_FORM_flag 0x0C
+#define DW_LNS_copy 0x01
+#define DW_LNS_advance_pc 0x02
+#define DW_LNS_advance_line 0x03
+#define DW_LNE_end_sequence 0x01
+#define DW_LNE_set_address 0x02
+
+/*
+ * The parameters of the line number program. Only standard opcodes are used,
+ * so the special opcode parameters only need to be valid.
+ */
+#define LINE_BASE -5
+#define LINE_RANGE 14
+#define OPCODE_BASE 13
+
+/*
+ * The sections of the ELF objects, in order
+ */
+#define SECTION_NULL 0
+#define SECTION_TEXT 1
+#define SECTION_SYMTAB 2
+#define SECTION_STRTAB 3
+#define SECTION_DEBUG_ABBREV 4
+#define SECTION_DEBUG_INFO 5
+#define SECTION_DEBUG_LINE 6
+#define SECTION_SHSTRTAB 7
+#define SECTION_COUNT 8
+
+/*
+ * gdb sets a breakpoint in this function, and reads __jit_debug_descriptor
+ * whenever it is called. It must not be inlined or optimised away.
+ */
+void __attribute__((noinline)) __jit_debug_register_code() {
+	__asm__ __volatile__("");
+}
+
+struct jit_descriptor __jit_debug_descriptor = { 1, JIT_NOACTION, NULL, NULL };
+
+/*
+ * Whether compiled code is registered with gdb, and the name of the source file
+ * that the line information refers to
+ */
+static bool gdbjit_enabled = true;
+static char *source_filename = NULL;
+
+/*
+ * Turns registration of compiled code with gdb on or off. It is on by default
+ * so that JIT frames can be symbolised in core dumps.
+ */
+void gdbjit_set_enabled(bool enabled) {
+	gdbjit_enabled = enabled;
+}
+
+/*
+ * Sets the name of the source file that compiled code is described as coming
+ * from. Passing NULL frees the stored name.
+ */
+void gdbjit_set_source(char *filename) {
+	free(source_filename);
+	source_filename = filename ? safe_strdup(filename) : NULL;
+}
+
+/*
+ * Appends bytes to a buffer that is being built up, returning the offset in the
+ * buffer that they were written at
+ */
+static int buffer_append(ArrLen *buf, void *data, int len) {
+	int offset = buf->len;
+	buf->arr = realloc(buf->arr, buf->len + len);
+	if(!buf->arr) {
+		printf("Could not allocate memory for debug information\n");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(buf->arr + buf->len, data, len);
+	buf->len += len;
+	return offset;
+}
+
+static void buffer_append_byte(ArrLen *buf, uint8_t value) {
+	buffer_append(buf, &value, 1);
+}
+
+static void buffer_append_string(ArrLen *buf, char *str) {
+	buffer_append(buf, str, strlen(str) + 1);
+}
+
+/*
+ * Appends a value in the unsigned and signed LEB128 encodings used by DWARF
+ */
+static void buffer_append_uleb(ArrLen *buf, unsigned long value) {
+	do {
+		uint8_t next = value & 0x7F;
+		value >>= 7;
+		if(value) next |= 0x80;
+		buffer_append_byte(buf, next);
+	} while(value);
+}
+
+static void buffer_append_sleb(ArrLen *buf, long value) {
+	bool more = true;
+	while(more) {
+		uint8_t next = value & 0x7F;
+		value >>= 7;
+		if((value == 0 && !(next & 0x40)) || (value == -1 && (next & 0x40))) {
+			more = false;
+		}
+		else next |= 0x80;
+		buffer_append_byte(buf, next);
+	}
+}
+
+/*
+ * Returns the source line for the code at the given offset: the line of the
+ * innermost statement whose code contains it, or the line of the function if
+ * it is outside every statement (in the prologue, for example)
+ */
+static int line_at(int offset, FNDecl *func, LinkedList *marks) {
+	int line = func->line;
+	int innermost_len = -1;
+
+	LLIterator *marks_iter = LLIterator_init(marks);
+	while(!LLIterator_ended(marks_iter)) {
+		CodeMark *mark = (CodeMark *)LLIterator_get_current(marks_iter);
+
+		if(mark->stmt && mark->stmt->line > 0 &&
+			mark->offset <= offset && offset < mark->offset + mark->len &&
+			(innermost_len == -1 || mark->len <= innermost_len)) {
+
+			line = mark->stmt->line;
+			innermost_len = mark->len;
+		}
+
+		LLIterator_advance(marks_iter);
+	}
+	free(marks_iter);
+
+	return line;
+}
+
+/*
+ * Writes the line number program for a function into the .debug_line section.
+ * A row is added wherever the line changes, which can only happen where a
+ * statement's code starts or ends.
+ */
+static void write_debug_line(ArrLen *buf, void *code, int len, FNDecl *func,
+	LinkedList *marks) {
+
+	// Header - the lengths are filled in once they are known
+	uint32_t unit_length = 0;
+	uint16_t version = 2;
+	uint32_t header_length = 0;
+	buffer_append(buf, &unit_length, 4);
+	buffer_append(buf, &version, 2);
+	int header_length_offset = buffer_append(buf, &header_length, 4);
+
+	buffer_append_byte(buf, 1);             // minimum_instruction_length
+	buffer_append_byte(buf, 1);             // default_is_stmt
+	buffer_append_byte(buf, (uint8_t)LINE_BASE);
+	buffer_append_byte(buf, LINE_RANGE);
+	buffer_append_byte(buf, OPCODE_BASE);
+
+	uint8_t standard_opcode_lengths[OPCODE_BASE - 1] =
+		{ 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 };
+	buffer_append(buf, standard_opcode_lengths, OPCODE_BASE - 1);
+
+	// No include directories, and a single file
+	buffer_append_byte(buf, 0);
+	buffer_append_string(buf,
+		source_filename ? source_filename : "<minty>");
+	buffer_append_uleb(buf, 0);             // directory
+	buffer_append_uleb(buf, 0);             // modification time
+	buffer_append_uleb(buf, 0);             // length
+	buffer_append_byte(buf, 0);
+
+	header_length = buf->len - (header_length_offset + 4);
+	memcpy(buf->arr + header_length_offset, &header_length, 4);
+
+	// DW_LNE_set_address <code>
+	uint64_t address = (uint64_t)code;
+	buffer_append_byte(buf, 0);
+	buffer_append_uleb(buf, 9);
+	buffer_append_byte(buf, DW_LNE_set_address);
+	buffer_append(buf, &address, 8);
+
+	// Add a row at each offset where the line changes
+	int current_offset = 0;
+	int current_line = 1;
+	int offset;
+	for(offset = 0; offset < len; offset++) {
+
+		// The line can only change where a statement's code starts or ends
+		bool boundary = offset == 0;
+		LLIterator *marks_iter = LLIterator_init(marks);
+		while(!LLIterator_ended(marks_iter) && !boundary) {
+			CodeMark *mark = (CodeMark *)LLIterator_get_current(marks_iter);
+			boundary = mark->stmt && (mark->offset == offset ||
+				mark->offset + mark->len == offset);
+			LLIterator_advance(marks_iter);
+		}
+		free(marks_iter);
+
+		int line = boundary ? line_at(offset, func, marks) : current_line;
+		if(offset > 0 && line == current_line) continue;
+
+		if(offset > current_offset) {
+			buffer_append_byte(buf, DW_LNS_advance_pc);
+			buffer_append_uleb(buf, offset - current_offset);
+		}
+		if(line != current_line) {
+			buffer_append_byte(buf, DW_LNS_advance_line);
+			buffer_append_sleb(buf, line - current_line);
+		}
+		buffer_append_byte(buf, DW_LNS_copy);
+
+		current_offset = offset;
+		current_line = line;
+	}
+
+	// End the sequence after the last byte of code
+	buffer_append_byte(buf, DW_LNS_advance_pc);
+	buffer_append_uleb(buf, len - current_offset);
+	buffer_append_byte(buf, 0);
+	buffer_append_uleb(buf, 1);
+	buffer_append_byte(buf, DW_LNE_end_sequence);
+
+	unit_length = buf->len - 4;
+	memcpy(buf->arr, &unit_length, 4);
+}
+
+/*
+ * Writes the .debug_abbrev section, which describes the layout of the entries
+ * in .debug_info: a compile unit containing one subprogram
+ */
+static void write_debug_abbrev(ArrLen *buf) {
+	buffer_append_uleb(buf, 1);
+	buffer_append_uleb(buf, DW_TAG_compile_unit);
+	buffer_append_byte(buf, DW_CHILDREN_yes);
+	buffer_append_uleb(buf, DW_AT_producer);
+	buffer_append_uleb(buf, DW_FORM_string);
+	buffer_append_uleb(buf, DW_AT_name);
+	buffer_append_uleb(buf, DW_FORM_string);
+	buffer_append_uleb(buf, DW_AT_stmt_list);
+	buffer_append_uleb(buf, DW_FORM_data4);
+	buffer_append_uleb(buf, DW_AT_low_pc);
+	buffer_append_uleb(buf, DW_FORM_addr);
+	buffer_append_uleb(buf, DW_AT_high_pc);
+	buffer_append_uleb(buf, DW_FORM_addr);
+	buffer_append_uleb(buf, 0);
+	buffer_append_uleb(buf, 0);
+
+	buffer_append_uleb(buf, 2);
+	buffer_append_uleb(buf, DW_TAG_subprogram);
+	buffer_append_byte(buf, DW_CHILDREN_no);
+	buffer_append_uleb(buf, DW_AT_name);
+	buffer_append_uleb(buf, DW_FORM_string);
+	buffer_append_uleb(buf, DW_AT_decl_file);
+	buffer_append_uleb(buf, DW_FORM_data1);
+	buffer_append_uleb(buf, DW_AT_decl_line);
+	buffer_append_uleb(buf, DW_FORM_data4);
+	buffer_append_uleb(buf, DW_AT_low_pc);
+	buffer_append_uleb(buf, DW_FORM_addr);
+	buffer_append_uleb(buf, DW_AT_high_pc);
+	buffer_append_uleb(buf, DW_FORM_addr);
+	buffer_append_uleb(buf, DW_AT_external);
+	buffer_append_uleb(buf, DW_FORM_flag);
+	buffer_append_uleb(buf, 0);
+	buffer_append_uleb(buf, 0);
+
+	buffer_append_uleb(buf, 0);
+}
+
+/*
+ * Writes the .debug_info section, following the layout in .debug_abbrev
+ */
+static void write_debug_info(ArrLen *buf, void *code, int len, char *name,
+	FNDecl *func) {
+
+	uint64_t low_pc = (uint64_t)code;
+	uint64_t high_pc = (uint64_t)code + len;
+
+	// Compile unit header, with the length filled in at the end
+	uint32_t unit_length = 0;
+	uint16_t version = 2;
+	uint32_t abbrev_offset = 0;
+	buffer_append(buf, &unit_length, 4);
+	buffer_append(buf, &version, 2);
+	buffer_append(buf, &abbrev_offset, 4);
+	buffer_append_byte(buf, 8);
+
+	// The compile unit
+	uint32_t stmt_list = 0;
+	buffer_append_uleb(buf, 1);
+	buffer_append_string(buf, "minty " JIT_VERSION);
+	buffer_append_string(buf,
+		source_filename ? source_filename : "<minty>");
+	buffer_append(buf, &stmt_list, 4);
+	buffer_append(buf, &low_pc, 8);
+	buffer_append(buf, &high_pc, 8);
+
+	// The function
+	uint32_t decl_line = func->line;
+	buffer_append_uleb(buf, 2);
+	buffer_append_string(buf, name);
+	buffer_append_byte(buf, 1);
+	buffer_append(buf, &decl_line, 4);
+	buffer_append(buf, &low_pc, 8);
+	buffer_append(buf, &high_pc, 8);
+	buffer_append_byte(buf, 1);
+
+	// End of the compile unit's children
+	buffer_append_uleb(buf, 0);
+
+	unit_length = buf->len - 4;
+	memcpy(buf->arr, &unit_length, 4);
+}
+
+/*
+ * Fills in an ELF section header. The object files written by objcode.c have
+ * their section headers filled in in the same way, at address 0.
+ */
+void gdbjit_section_header(Elf64_Shdr *shdr, int name, int type, int flags,
+	uint64_t addr, int offset, int size, int link, int info, int align,
+	int entsize) {
+
+	shdr->sh_name = name;
+	shdr->sh_type = type;
+	shdr->sh_flags = flags;
+	shdr->sh_addr = addr;
+	shdr->sh_offset = offset;
+	shdr->sh_size = size;
+	shdr->sh_link = link;
+	shdr->sh_info = info;
+	shdr->sh_addralign = align;
+	shdr->sh_entsize = entsize;
+}
+
+/*
+ * Builds an ELF object describing a piece of compiled code: a .text section
+ * at the code's address (with no contents, as the code is already in memory),
+ * a symbol with the given name covering the code, and DWARF debug information
+ * describing the function and mapping the code to source lines using the
+ * given CodeMarks. The object is relocatable, with the .text section placed at
+ * the code's address, as gdb expects. Its length is stored in elf_len, and it
+ * should be freed with free().
+ */
+char *gdbjit_elf(void *code, int len, char *name, FNDecl *func,
+	LinkedList *marks, int *elf_len) {
+
+	LinkedList *no_marks = LinkedList_init();
+	if(!marks) marks = no_marks;
+
+	ArrLen *elf = ArrLen_init(NULL, 0);
+
+	// Reserve space for the ELF header, which is written last
+	Elf64_Ehdr ehdr;
+	memset(&ehdr, 0, sizeof(Elf64_Ehdr));
+	buffer_append(elf, &ehdr, sizeof(Elf64_Ehdr));
+
+	// Section names
+	ArrLen *shstrtab = ArrLen_init(NULL, 0);
+	int section_names[SECTION_COUNT];
+	char *names[SECTION_COUNT] = { "", ".text", ".symtab", ".strtab",
+		".debug_abbrev", ".debug_info", ".debug_line", ".shstrtab" };
+	int i;
+	for(i = 0; i < SECTION_COUNT; i++) {
+		section_names[i] = shstrtab->len;
+		buffer_append_string(shstrtab, names[i]);
+	}
+
+	// Symbols: the null symbol, the source file, and the function
+	ArrLen *strtab = ArrLen_init(NULL, 0);
+	buffer_append_byte(strtab, 0);
+	Elf64_Sym symbols[3];
+	memset(symbols, 0, sizeof(symbols));
+
+	symbols[1].st_name = strtab->len;
+	buffer_append_string(strtab,
+		source_filename ? source_filename : "<minty>");
+	symbols[1].st_info = ELF64_ST_INFO(STB_LOCAL, STT_FILE);
+	symbols[1].st_shndx = SHN_ABS;
+
+	symbols[2].st_name = strtab->len;
+	buffer_append_string(strtab, name);
+	symbols[2].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+	symbols[2].st_shndx = SECTION_TEXT;
+	symbols[2].st_value = 0;
+	symbols[2].st_size = len;
+
+	// Debug information
+	ArrLen *debug_abbrev = ArrLen_init(NULL, 0);
+	ArrLen *debug_info = ArrLen_init(NULL, 0);
+	ArrLen *debug_line = ArrLen_init(NULL, 0);
+	write_debug_abbrev(debug_abbrev);
+	write_debug_info(debug_info, code, len, name, func);
+	write_debug_line(debug_line, code, len, func, marks);
+
+	// Write the contents of each section, recording where they were put
+	int symtab_offset = buffer_append(elf, symbols, sizeof(symbols));
+	int strtab_offset = buffer_append(elf, strtab->arr, strtab->len);
+	int debug_abbrev_offset =
+		buffer_append(elf, debug_abbrev->arr, debug_abbrev->len);
+	int debug_info_offset =
+		buffer_append(elf, debug_info->arr, debug_info->len);
+	int debug_line_offset =
+		buffer_append(elf, debug_line->arr, debug_line->len);
+	int shstrtab_offset = buffer_append(elf, shstrtab->arr, shstrtab->len);
+
+	// Align the section header table
+	while(elf->len % 8) buffer_append_byte(elf, 0);
+
+	Elf64_Shdr shdrs[SECTION_COUNT];
+	memset(shdrs, 0, sizeof(shdrs));
+	gdbjit_section_header(&shdrs[SECTION_TEXT], section_names[SECTION_TEXT],
+		SHT_NOBITS, SHF_ALLOC | SHF_EXECINSTR, (uint64_t)code, 0, len,
+		0, 0, 16, 0);
+	gdbjit_section_header(&shdrs[SECTION_SYMTAB],
+		section_names[SECTION_SYMTAB], SHT_SYMTAB, 0, 0, symtab_offset,
+		sizeof(symbols), SECTION_STRTAB, 2, 8, sizeof(Elf64_Sym));
+	gdbjit_section_header(&shdrs[SECTION_STRTAB],
+		section_names[SECTION_STRTAB], SHT_STRTAB, 0, 0, strtab_offset,
+		strtab->len, 0, 0, 1, 0);
+	gdbjit_section_header(&shdrs[SECTION_DEBUG_ABBREV],
+		section_names[SECTION_DEBUG_ABBREV], SHT_PROGBITS, 0, 0,
+		debug_abbrev_offset, debug_abbrev->len, 0, 0, 1, 0);
+	gdbjit_section_header(&shdrs[SECTION_DEBUG_INFO],
+		section_names[SECTION_DEBUG_INFO], SHT_PROGBITS, 0, 0,
+		debug_info_offset, debug_info->len, 0, 0, 1, 0);
+	gdbjit_section_header(&shdrs[SECTION_DEBUG_LINE],
+		section_names[SECTION_DEBUG_LINE], SHT_PROGBITS, 0, 0,
+		debug_line_offset, debug_line->len, 0, 0, 1, 0);
+	gdbjit_section_header(&shdrs[SECTION_SHSTRTAB],
+		section_names[SECTION_SHSTRTAB], SHT_STRTAB, 0, 0, shstrtab_offset,
+		shstrtab->len, 0, 0, 1, 0);
+	int shdrs_offset = buffer_append(elf, shdrs, sizeof(shdrs));
+
+	// Now the layout is known, write the ELF header
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+	ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	ehdr.e_type = ET_REL;
+	ehdr.e_machine = EM_X86_64;
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_shoff = shdrs_offset;
+	ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+	ehdr.e_shentsize = sizeof(Elf64_Shdr);
+	ehdr.e_shnum = SECTION_COUNT;
+	ehdr.e_shstrndx = SECTION_SHSTRTAB;
+	memcpy(elf->arr, &ehdr, sizeof(Elf64_Ehdr));
+
+	ArrLen_free(shstrtab);
+	ArrLen_free(strtab);
+	ArrLen_free(debug_abbrev);
+	ArrLen_free(debug_info);
+	ArrLen_free(debug_line);
+	LinkedList_free(no_marks);
+
+	char *out = (char *)elf->arr;
+	*elf_len = elf->len;
+	free(elf);
+	return out;
+}
+
+/*
+ * Describes a piece of compiled code to gdb. Returns the entry added to the
+ * descriptor, which must be passed to gdbjit_unregister() before the code is
+ * freed, or NULL if registration is disabled.
+ */
+struct jit_code_entry *gdbjit_register(void *code, int len, char *name,
+	FNDecl *func, LinkedList *marks) {
+
+	if(!gdbjit_enabled) return NULL;
+
+	int elf_len;
+	char *elf = gdbjit_elf(code, len, name, func, marks, &elf_len);
+
+	struct jit_code_entry *entry = safe_alloc(sizeof(struct jit_code_entry));
+	entry->symfile_addr = elf;
+	entry->symfile_size = elf_len;
+
+	// Add the entry to the start of the list, then tell gdb
+	entry->prev_entry = NULL;
+	entry->next_entry = __jit_debug_descriptor.first_entry;
+	if(entry->next_entry) entry->next_entry->prev_entry = entry;
+	__jit_debug_descriptor.first_entry = entry;
+
+	__jit_debug_descriptor.relevant_entry = entry;
+	__jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+	__jit_debug_register_code();
+
+	return entry;
+}
+
+/*
+ * Removes a piece of compiled code from gdb's view, and frees its description
+ */
+void gdbjit_unregister(struct jit_code_entry *entry) {
+	if(!entry) return;
+
+	if(entry->prev_entry) entry->prev_entry->next_entry = entry->next_entry;
+	else __jit_debug_descriptor.first_entry = entry->next_entry;
+	if(entry->next_entry) entry->next_entry->prev_entry = entry->prev_entry;
+
+	__jit_debug_descriptor.relevant_entry = entry;
+	__jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+	__jit_debug_register_code();
+
+	free((char *)entry->symfile_addr);
+	free(entry);
+}
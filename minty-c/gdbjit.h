@@ -0,0 +1,68 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef GDBJIT
+#define GDBJIT
+
+#include <stdint.h>
+#include <elf.h>
+
+/*
+ * Support for debugging compiled code with gdb, through gdb's JIT interface
+ * (see "JIT Compilation Interface" in the gdb manual). Each compiled function
+ * is described by a small ELF object held in memory, with a symbol for the
+ * function and DWARF line information mapping its code back to the statements
+ * it was compiled from. The objects are listed in __jit_debug_descriptor,
+ * where gdb reads them from both running processes and core dumps.
+ */
+
+/*
+ * The structures and symbols that gdb looks for, which must have exactly these
+ * names and layouts
+ */
+typedef enum {
+	JIT_NOACTION = 0,
+	JIT_REGISTER_FN,
+	JIT_UNREGISTER_FN
+} jit_actions_t;
+
+struct jit_code_entry {
+	struct jit_code_entry *next_entry;
+	struct jit_code_entry *prev_entry;
+	const char *symfile_addr;
+	uint64_t symfile_size;
+};
+
+struct jit_descriptor {
+	uint32_t version;
+	uint32_t action_flag;
+	struct jit_code_entry *relevant_entry;
+	struct jit_code_entry *first_entry;
+};
+
+extern struct jit_descriptor __jit_debug_descriptor;
+
+void __jit_debug_register_code();
+
+void gdbjit_set_enabled(bool enabled);
+
+void gdbjit_set_source(char *filename);
+
+char *gdbjit_elf(void *code, int len, char *name, FNDecl *func,
+	LinkedList *marks, int *elf_len);
+
+struct jit_code_entry *gdbjit_register(void *code, int len, char *name,
+	FNDecl *func, LinkedList *marks);
+
+void gdbjit_unregister(struct jit_code_entry *entry);
+
+void gdbjit_section_header(Elf64_Shdr *shdr, int name, int type, int flags,
+	uint64_t addr, int offset, int size, int link, int info, int align,
+	int entsize);
+
+#endif // GDBJIT
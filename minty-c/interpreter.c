@@ -4,7 +4,16 @@
 #include "minty_util.h"
 #include "token.h"
 #include "AST.h"
+#include "optimiser.h"
 #include "interpreter.h"
+#include "jitcode.h"
+#include "jitcache.h"
+#include "trace.h"
+#include "ccode.h"
+
+// Whether the interpreter is collecting a profile for the ahead-of-time
+// compilers (see interpreter_set_profiling())
+static bool profiling = false;
 
 /*
  * Struct representing a single variable
@@ -90,7 +99,8 @@ Scope *Scope_init(LinkedList *arg_names, LinkedList *args_given) {
 /*
  * Update the scope with the given variable. If a variable under the given name
  * already exists, replace its value with the given one. Otherwise, create a new
- * Variable object entry.
+ * Variable object entry. The name is copied, so the caller keeps ownership of
+ * the given string.
  */
 void Scope_update(Scope *scope, char *name, int value) {
 
@@ -115,8 +125,28 @@ void Scope_update(Scope *scope, char *name, int value) {
 
 	// If we didn't find the variable, create it
 	if(!found_existing) {
-		LinkedList_append(scope->variables, (void *)Variable_init(name, value));
+		LinkedList_append(scope->variables,
+			(void *)Variable_init(safe_strdup(name), value));
+	}
+}
+
+/*
+ * Returns the variable with the given name in the given scope, or NULL if there
+ * is no such variable. The variable stays where it is until it is removed from
+ * the scope by Scope_recede(), so it can be updated directly until then.
+ */
+static Variable *Scope_variable(Scope *scope, char *name) {
+	Variable *found = NULL;
+
+	LLIterator *vars_iter = LLIterator_init(scope->variables);
+	while(!LLIterator_ended(vars_iter) && !found) {
+		Variable *var = (Variable *)LLIterator_get_current(vars_iter);
+		if(str_equal(var->name, name)) found = var;
+		LLIterator_advance(vars_iter);
 	}
+	free(vars_iter);
+
+	return found;
 }
 
 /*
@@ -223,6 +253,49 @@ bool Scope_has(Scope *scope, char *name) {
 	return found;
 }
 
+/*
+ * Returns the number of variables in the given scope
+ */
+int Scope_size(Scope *scope) {
+	return LinkedList_length(scope->variables);
+}
+
+/*
+ * Returns the name of the variable at the given index in the scope. Variables
+ * keep their index until a variable before them is removed by Scope_recede().
+ */
+char *Scope_name(Scope *scope, int index) {
+	return ((Variable *)LinkedList_get(scope->variables, index))->name;
+}
+
+/*
+ * Copies the values of the variables in the scope into the given array, in the
+ * order of their indices
+ */
+void Scope_get_values(Scope *scope, int *values) {
+	LLIterator *vars_iter = LLIterator_init(scope->variables);
+	while(!LLIterator_ended(vars_iter)) {
+		values[LLIterator_current_index(vars_iter)] =
+			((Variable *)LLIterator_get_current(vars_iter))->value;
+		LLIterator_advance(vars_iter);
+	}
+	free(vars_iter);
+}
+
+/*
+ * Sets the values of the variables in the scope from the given array, in the
+ * order of their indices
+ */
+void Scope_set_values(Scope *scope, int *values) {
+	LLIterator *vars_iter = LLIterator_init(scope->variables);
+	while(!LLIterator_ended(vars_iter)) {
+		((Variable *)LLIterator_get_current(vars_iter))->value =
+			values[LLIterator_current_index(vars_iter)];
+		LLIterator_advance(vars_iter);
+	}
+	free(vars_iter);
+}
+
 /*
  * Frees a given scope object, including all variables and their names
  */
@@ -329,10 +402,17 @@ int interpret_expression(Expression *expr, Scope *scope, Program *prog) {
 						scope, prog));
 			}
 
+			FNDecl *callee =
+				Program_get_FNDecl(prog, expr->expr->fncall->name);
+
+			// Record the argument values for value specialisation, and count
+			// the call for profiles
+			profile_arguments(callee, evaluated_args);
+			expr->expr->fncall->exec_count++;
+
 			// get the result of interpreting the function with the given
 			// arguments
-			int call_result = interpret_function(Program_get_FNDecl(prog,
-				expr->expr->fncall->name), evaluated_args, prog);
+			int call_result = interpret_function(callee, evaluated_args, prog);
 
 			// Free the list of evaluated arguments
 			LinkedList_free(evaluated_args);
@@ -363,6 +443,86 @@ int interpret_expression(Expression *expr, Scope *scope, Program *prog) {
 	return (int) NULL;
 }
 
+/*
+ * Determines whether interpreting the given statements, as the body of a loop,
+ * can create variables in the scope of the body. These would have to be removed
+ * at the end of every iteration by Scope_recede(). Statements nested in
+ * while-loops and if-statements are not checked, as they have scopes of their
+ * own, but the assignments in the declarations of for-loops are.
+ */
+static bool creates_variables(LinkedList *stmts, Scope *scope) {
+	bool creates = false;
+
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter) && !creates) {
+		Statement *stmt = (Statement *)LLIterator_get_current(stmts_iter);
+		if(stmt->type == stmt_For) stmt = stmt->stmt->_for->assignment;
+
+		creates = stmt->type == stmt_Assignment && !Scope_has(scope,
+			stmt->stmt->_assignment->ident->expr->ident->name);
+
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+
+	return creates;
+}
+
+/*
+ * Interprets a for loop in the counted shape recognised by For_is_counted(),
+ * with the given step. The counter is kept and incremented in a C variable, and
+ * the limit is evaluated once, rather than interpreting the condition and the
+ * incrementor on every iteration. The counter's variable in the scope is
+ * written directly at the start of each iteration, as the loop body and the
+ * tracing JIT compiler may read it, but is never looked up by name. The scope
+ * is only proliferated and receded around the body if the body can create
+ * variables.
+ */
+static void interpret_counted_for(Statement *stmt, int step, Scope *scope,
+	Program *prog) {
+
+	For *loop = stmt->stmt->_for;
+	BooleanExpr *cond = loop->bool_expr->expr->blean;
+
+	interpret_statement(loop->assignment, scope, prog);
+	Variable *counter = Scope_variable(scope,
+		loop->assignment->stmt->_assignment->ident->expr->ident->name);
+	int value = counter->value;
+	int limit = interpret_expression(cond->rhs, scope, prog);
+	bool inclusive = cond->op == LESS_OR_EQUAL;
+	bool scoped = creates_variables(loop->stmts, scope);
+
+	while(true) {
+		// A compiled trace may run any number of iterations, whether or not
+		// it reports that this one has been run
+		counter->value = value;
+		bool traced = !profiling && trace_loop_iteration(stmt, scope, prog);
+		value = counter->value;
+		if(traced) continue;
+		if(inclusive ? value > limit : value >= limit) break;
+		stmt->taken_count++;
+
+		if(scoped) Scope_proliferate(scope);
+
+		LLIterator *stmts_iter = LLIterator_init(loop->stmts);
+		while(!LLIterator_ended(stmts_iter) && !scope->has_return) {
+			interpret_statement(
+				(Statement *)LLIterator_get_current(stmts_iter), scope, prog);
+			LLIterator_advance(stmts_iter);
+		}
+		free(stmts_iter);
+
+		if(scoped) Scope_recede(scope);
+
+		if(scope->has_return) break;
+
+		// Overflow wraps around, as it does when the incrementor is
+		// interpreted
+		loop->incrementor->exec_count++;
+		value = (int)((unsigned)value + step);
+	}
+}
+
 /*
  * interpret_statement is a function that interprets a single statement. In the
  * case that the statement to be interpreted is a loop construct, this function
@@ -386,13 +546,26 @@ void interpret_statement(Statement *stmt, Scope *scope, Program *prog) {
 	switch(stmt->type) {
 
 		case stmt_For: {
+			// Counted loops are run natively
+			int step;
+			if(For_is_counted(stmt->stmt->_for, &step)) {
+				interpret_counted_for(stmt, step, scope, prog);
+				break;
+			}
+
 			// Interpret the assignment in the for loop declaration
 			interpret_statement(stmt->stmt->_for->assignment, scope, prog);
 
 			// Repeatedly execute each sub-statement, and do the specified
-			// incrementation after each iteration
-			while(interpret_expression(
-				stmt->stmt->_for->bool_expr, scope, prog)) {
+			// incrementation after each iteration. Iterations that the
+			// tracing JIT compiler runs (see trace.h) are skipped.
+			while(true) {
+				if(!profiling && trace_loop_iteration(stmt, scope, prog)) {
+					continue;
+				}
+				if(!interpret_expression(
+					stmt->stmt->_for->bool_expr, scope, prog)) break;
+				stmt->taken_count++;
 
 				// Proliferate the scope for this iteration of the for-loop body
 				Scope_proliferate(scope);
@@ -423,10 +596,15 @@ void interpret_statement(Statement *stmt, Scope *scope, Program *prog) {
 			break;
 		}
 		case stmt_While: {
-			// Repeatedly execute each sub-statement, and do the specified
-			// incrementation after each iteration
-			while(interpret_expression(
-				stmt->stmt->_while->bool_expr, scope, prog)) {
+			// Repeatedly execute each sub-statement. Iterations that the
+			// tracing JIT compiler runs (see trace.h) are skipped.
+			while(true) {
+				if(!profiling && trace_loop_iteration(stmt, scope, prog)) {
+					continue;
+				}
+				if(!interpret_expression(
+					stmt->stmt->_while->bool_expr, scope, prog)) break;
+				stmt->taken_count++;
 
 				// Proliferate the scope for this iteration of the for-loop body
 				Scope_proliferate(scope);
@@ -454,9 +632,11 @@ void interpret_statement(Statement *stmt, Scope *scope, Program *prog) {
 		}
 		case stmt_If: {
 			// Determine which statement list will be interpreted
-			LinkedList *stmts_to_interpret = 
-				interpret_expression(stmt->stmt->_if->bool_expr, scope, prog) ?
-					stmt->stmt->_if->true_stmts : stmt->stmt->_if->false_stmts;
+			bool condition =
+				interpret_expression(stmt->stmt->_if->bool_expr, scope, prog);
+			if(condition) stmt->taken_count++;
+			LinkedList *stmts_to_interpret = condition ?
+				stmt->stmt->_if->true_stmts : stmt->stmt->_if->false_stmts;
 
 			// Proliferate the scope for the if/else statements
 			Scope_proliferate(scope);
@@ -507,6 +687,48 @@ void interpret_statement(Statement *stmt, Scope *scope, Program *prog) {
 	}
 }
 
+/*
+ * Sets whether the interpreter is collecting a profile of the program it runs
+ * (see profile.h). While profiling, every function is interpreted, without
+ * being compiled by the JIT compiler and without tracing its loops, so that
+ * every call and every branch taken is counted.
+ */
+void interpreter_set_profiling(bool enabled) {
+	profiling = enabled;
+}
+
+/*
+ * Records the argument values of a call to the given function in its argument
+ * profile. An argument that has been given the same value by every call so far
+ * is constant, and one that has been given different values is varying. The
+ * JIT compiler uses the profile to compile versions of functions that are
+ * specialised to their constant arguments.
+ */
+void profile_arguments(FNDecl *function, LinkedList *arg_vals) {
+
+	// Calls with the wrong number of arguments are reported by
+	// interpret_function, so are not recorded
+	if(LinkedList_length(arg_vals) != LinkedList_length(function->args)) return;
+
+	LLIterator *args_iter = LLIterator_init(arg_vals);
+	while(!LLIterator_ended(args_iter)) {
+		ArgProfile *profile =
+			&(function->arg_profile[LLIterator_current_index(args_iter)]);
+		int value = (int)(long)LLIterator_get_current(args_iter);
+
+		if(profile->state == arg_Unseen) {
+			profile->state = arg_Constant;
+			profile->value = value;
+		}
+		else if(profile->state == arg_Constant && profile->value != value) {
+			profile->state = arg_Varying;
+		}
+
+		LLIterator_advance(args_iter);
+	}
+	free(args_iter);
+}
+
 /*
  * interpret_function is responsible for the interpretation of the AST objects
  * that correspond to functions. Since a function should have its own scope, a
@@ -546,6 +768,53 @@ int interpret_function(FNDecl *function, LinkedList *arg_vals, Program *prog) {
 		exit(EXIT_FAILURE);
 	}
 
+	// Once the function has been called BASELINE_THRESHOLD times, it is
+	// quickly compiled by the baseline compiler, and once it has been called
+	// JIT_THRESHOLD times it is considered hot, and is compiled by the
+	// optimising compiler. From then on, its compiled code is run instead of
+	// interpreting it. Code compiled for the function by an earlier run is
+	// loaded from the JIT cache on the first call, if there is any. The
+	// baseline code is kept after the function is optimised, as it may still
+	// be running further up the call stack, until it is evicted to keep
+	// within the JIT's code budget. Calls are counted towards the thresholds
+	// from the last time the function's code was evicted. The optimising
+	// compiler may run on worker threads, in which case the function keeps
+	// running its baseline code until its optimised code is installed. Once
+	// any function has been called CCODE_THRESHOLD times, the whole program is
+	// compiled by the C tier, if it is enabled, and the C compiler's code is
+	// run in preference to the JIT compiler's once it is loaded. Nothing is
+	// compiled while profiling, so that everything is counted. Calls that
+	// optimised code makes to other optimised code skip all of this, but are
+	// still counted (see jit_call_value() in jitcode.c).
+	jitcode_install_finished();
+	ccode_install_finished();
+	function->exec_count++;
+	if(!profiling) {
+		if(function->exec_count >= CCODE_THRESHOLD) ccode_compile(prog);
+		if(function->native) return ccode_run(function, arg_vals);
+
+		int calls = function->exec_count - function->evicted_at;
+		if(!function->compiled && function->exec_count == 1) {
+			jitcache_load(function, prog);
+			jitcode_evict();
+		}
+		if(!function->compiled && !function->compiling
+			&& calls >= JIT_THRESHOLD) {
+
+			jitcompile(function, prog);
+			if(function->compiled) jitcache_store(function);
+			jitcode_evict();
+		}
+		else if(!function->compiled && !function->baseline
+			&& calls >= BASELINE_THRESHOLD) {
+			function->baseline = jitcompile_baseline(function, prog);
+			jitcode_evict();
+		}
+		if(function->compiled || function->baseline) {
+			return jitexec_function(function, arg_vals);
+		}
+	}
+
 	// Create the VariableScope for this function
 	Scope *scope = Scope_init(function->args, arg_vals);
 
@@ -594,6 +863,9 @@ int interpret_function(FNDecl *function, LinkedList *arg_vals, Program *prog) {
  */
 int interpret_program(Program *prog, LinkedList *arg_vals) {
 
+	// Optimise the program's loops before running it
+	Program_optimise(prog);
+
 	// Search for a function named 'main', storing it in a temporary variable
 	// when found
 	FNDecl *main_function = NULL;
@@ -13,6 +13,13 @@
 #ifndef INTERPRETER
 #define INTERPRETER
 
+/*
+ * The number of calls after which a function is compiled by the baseline JIT
+ * compiler (see stencil.h), and then by the optimising JIT compiler
+ */
+#define BASELINE_THRESHOLD 2
+#define JIT_THRESHOLD 10
+
 /*
  * Struct representing scope (the execution context for a particuar part of a
  * program)
@@ -45,12 +52,24 @@ void Scope_recede(Scope *scope);
 
 bool Scope_has(Scope *scope, char *name);
 
+int Scope_size(Scope *scope);
+
+char *Scope_name(Scope *scope, int index);
+
+void Scope_get_values(Scope *scope, int *values);
+
+void Scope_set_values(Scope *scope, int *values);
+
 void Scope_free(Scope *scope);
 
 /*
  * Interpreter functions
  */
- 
+
+void interpreter_set_profiling(bool enabled);
+
+void profile_arguments(FNDecl *function, LinkedList *arg_vals);
+
 int interpret_expression(Expression *expr, Scope *scope, Program *prog);
 
 void interpret_statement(Statement *stmt, Scope *scope, Program *prog);
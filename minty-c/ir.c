@@ -0,0 +1,2046 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "ir.h"
+
+/*
+ * Appends an element to a growable array of pointers that holds count
+ * elements, returning the array, which may have moved. An empty array is NULL,
+ * and the space is doubled whenever count reaches a power of two.
+ */
+static void *array_append(void *array, int count, void *element) {
+	void **arr = array;
+	if((count & (count - 1)) == 0) {
+		arr = realloc(arr, sizeof(void *) * (count == 0 ? 1 : 2 * count));
+		assert(arr);
+	}
+	arr[count] = element;
+	return arr;
+}
+
+/*
+ * Allocates an array of count zeroed elements of the given size
+ */
+static void *zeroed_array(int count, int size) {
+	void *array = safe_alloc((count * size) + 1);
+	memset(array, 0, (count * size) + 1);
+	return array;
+}
+
+/*
+ * Follows a value's replacements to the value that is now computed in its place
+ */
+static IRValue *resolve(IRValue *value) {
+	while(value->replacement) value = value->replacement;
+	return value;
+}
+
+/*
+ * Creates a value, numbering it and recording it in the function, but not
+ * putting it in a block
+ */
+static IRValue *IRValue_init(IRFunction *ir, ir_op op) {
+	IRValue *value = safe_alloc(sizeof(IRValue));
+	value->op = op;
+	value->id = ir->value_count;
+	value->operator = ERROR;
+	value->value = 0;
+	value->args = NULL;
+	value->arg_count = 0;
+	value->call = NULL;
+	value->block = NULL;
+	value->stmt = NULL;
+	value->expr = NULL;
+	value->replacement = NULL;
+
+	ir->values = array_append(ir->values, ir->value_count, value);
+	ir->value_count++;
+
+	return value;
+}
+
+static void IRValue_add_arg(IRValue *value, IRValue *arg) {
+	value->args = array_append(value->args, value->arg_count, arg);
+	value->arg_count++;
+}
+
+/*
+ * Creates an empty block, which exits with ir_MissingReturn until it is given
+ * another exit
+ */
+static IRBlock *IRBlock_init(IRFunction *ir) {
+	IRBlock *block = safe_alloc(sizeof(IRBlock));
+	block->id = ir->next_block_id++;
+	block->values = NULL;
+	block->value_count = 0;
+	block->preds = NULL;
+	block->pred_count = 0;
+
+	block->exit = ir_MissingReturn;
+	block->exit_value = NULL;
+	block->succs[0] = NULL;
+	block->succs[1] = NULL;
+	block->counts[0] = 0;
+	block->counts[1] = 0;
+	block->exit_stmt = NULL;
+
+	block->defs = zeroed_array(ir->variable_count, sizeof(IRValue *));
+	block->sealed = false;
+	block->incomplete = NULL;
+	block->incomplete_count = 0;
+
+	block->order = -1;
+	block->idom = NULL;
+
+	ir->blocks = array_append(ir->blocks, ir->block_count, block);
+	ir->block_count++;
+
+	return block;
+}
+
+static void IRBlock_free(IRBlock *block) {
+	free(block->values);
+	free(block->preds);
+	free(block->defs);
+	free(block->incomplete);
+	free(block);
+}
+
+/*
+ * Puts a value into a block at the given position
+ */
+static void IRBlock_insert(IRBlock *block, int index, IRValue *value) {
+	block->values = array_append(block->values, block->value_count, NULL);
+	memmove(block->values + index + 1, block->values + index,
+		sizeof(IRValue *) * (block->value_count - index));
+	block->values[index] = value;
+	block->value_count++;
+	value->block = block;
+}
+
+/*
+ * Returns the number of phis at the start of a block
+ */
+static int IRBlock_phi_count(IRBlock *block) {
+	int count = 0;
+	while(count < block->value_count &&
+		block->values[count]->op == ir_Phi) count++;
+	return count;
+}
+
+/*
+ * Returns the number of blocks that a block can exit to
+ */
+static int IRBlock_succ_count(IRBlock *block) {
+	if(block->exit == ir_Jump) return 1;
+	if(block->exit == ir_Branch) return 2;
+	return 0;
+}
+
+/*
+ * Returns the position of pred in a block's predecessors, which is also the
+ * position of the value that each of the block's phis takes when the block is
+ * entered from pred, or -1 if pred is not a predecessor
+ */
+int IRBlock_pred_index(IRBlock *block, IRBlock *pred) {
+	int i;
+	for(i = 0; i < block->pred_count; i++) {
+		if(block->preds[i] == pred) return i;
+	}
+	return -1;
+}
+
+static void add_edge(IRBlock *from, IRBlock *to) {
+	to->preds = array_append(to->preds, to->pred_count, from);
+	to->pred_count++;
+}
+
+/*
+ * Removes the edge from one block to another, along with the values that the
+ * phis of the second block take along it. The exit of the first block is not
+ * changed.
+ */
+static void remove_edge(IRBlock *from, IRBlock *to) {
+	int index = IRBlock_pred_index(to, from);
+	if(index == -1) return;
+
+	memmove(to->preds + index, to->preds + index + 1,
+		sizeof(IRBlock *) * (to->pred_count - index - 1));
+	to->pred_count--;
+
+	int i;
+	for(i = 0; i < to->value_count; i++) {
+		IRValue *phi = to->values[i];
+		if(phi->op != ir_Phi) continue;
+
+		memmove(phi->args + index, phi->args + index + 1,
+			sizeof(IRValue *) * (phi->arg_count - index - 1));
+		phi->arg_count--;
+	}
+}
+
+/*
+ * Removes the values that have been replaced from their blocks, and makes
+ * every remaining value and exit refer directly to the replacements
+ */
+static void apply_replacements(IRFunction *ir) {
+	int i, j, k;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+
+		int kept = 0;
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			if(value->replacement) continue;
+
+			for(k = 0; k < value->arg_count; k++) {
+				value->args[k] = resolve(value->args[k]);
+			}
+			block->values[kept++] = value;
+		}
+		block->value_count = kept;
+
+		if(block->exit_value) block->exit_value = resolve(block->exit_value);
+	}
+}
+
+/*
+ * Replaces each phi whose values are all the same, or the phi itself, with
+ * that value. Removing one phi can make another trivial, so this is repeated
+ * until there are none left.
+ */
+static void remove_trivial_phis(IRFunction *ir) {
+	bool changed = true;
+	while(changed) {
+		changed = false;
+
+		int i, j, k;
+		for(i = 0; i < ir->block_count; i++) {
+			IRBlock *block = ir->blocks[i];
+
+			for(j = 0; j < block->value_count; j++) {
+				IRValue *phi = block->values[j];
+				if(phi->op != ir_Phi || phi->replacement) continue;
+
+				IRValue *same = NULL;
+				bool trivial = true;
+				for(k = 0; k < phi->arg_count && trivial; k++) {
+					IRValue *arg = resolve(phi->args[k]);
+					if(arg == phi || arg == same) continue;
+					if(same) trivial = false;
+					same = arg;
+				}
+
+				if(trivial) {
+					phi->replacement = same ? same : ir->undefined;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	apply_replacements(ir);
+}
+
+/*
+ * Removes every block for which keep (indexed by block id) is false, along with
+ * its edges to the blocks that are kept
+ */
+static void remove_blocks(IRFunction *ir, bool *keep) {
+	int i, j;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		if(keep[block->id]) continue;
+
+		for(j = 0; j < IRBlock_succ_count(block); j++) {
+			if(keep[block->succs[j]->id]) remove_edge(block, block->succs[j]);
+		}
+	}
+
+	int kept = 0;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		if(keep[block->id]) ir->blocks[kept++] = block;
+		else IRBlock_free(block);
+	}
+	ir->block_count = kept;
+}
+
+/*
+ * Removes the blocks that cannot be reached from the entry block, and puts the
+ * rest in reverse postorder, recording each block's position in order. In
+ * reverse postorder, every block comes after its dominators.
+ */
+static void order_blocks(IRFunction *ir) {
+	bool *reached = zeroed_array(ir->next_block_id, sizeof(bool));
+	IRBlock **postorder = zeroed_array(ir->block_count, sizeof(IRBlock *));
+	IRBlock **stack = zeroed_array(ir->block_count, sizeof(IRBlock *));
+	int *next_succ = zeroed_array(ir->block_count, sizeof(int));
+	int count = 0;
+	int depth = 1;
+
+	stack[0] = ir->blocks[0];
+	reached[ir->blocks[0]->id] = true;
+	while(depth > 0) {
+		IRBlock *block = stack[depth - 1];
+
+		// The successors are visited last first, so that in reverse postorder
+		// a branch is followed by the block it goes to when true
+		if(next_succ[depth - 1] < IRBlock_succ_count(block)) {
+			IRBlock *succ = block->succs[
+				IRBlock_succ_count(block) - 1 - next_succ[depth - 1]++];
+			if(!reached[succ->id]) {
+				reached[succ->id] = true;
+				stack[depth] = succ;
+				next_succ[depth] = 0;
+				depth++;
+			}
+		}
+		else {
+			postorder[count++] = block;
+			depth--;
+		}
+	}
+
+	remove_blocks(ir, reached);
+
+	int i;
+	for(i = 0; i < count; i++) {
+		ir->blocks[i] = postorder[count - 1 - i];
+		ir->blocks[i]->order = i;
+	}
+
+	free(reached);
+	free(postorder);
+	free(stack);
+	free(next_succ);
+}
+
+/*
+ * The following functions build the SSA form of a function from its AST, using
+ * the algorithm of Braun et al., "Simple and Efficient Construction of Static
+ * Single Assignment Form". The value that each variable has at the end of each
+ * block is recorded as the block is built. When a variable is read in a block
+ * that has not assigned it, its value is looked up in the block's
+ * predecessors, with a phi where they merge. A block is sealed once all of its
+ * predecessors are known - until then, lookups that reach it leave phis
+ * waiting to be completed.
+ */
+
+/*
+ * The state of the construction: the block being added to, the statement that
+ * values are being produced for, and whether branches are given the counts from
+ * the function's profile
+ */
+typedef struct {
+	IRFunction *ir;
+	IRBlock *current;
+	Statement *stmt;
+	bool profiled;
+} IRBuilder;
+
+static IRValue *read_variable(IRFunction *ir, int variable, IRBlock *block);
+
+/*
+ * Gives a phi the value of its variable at the end of each predecessor of its
+ * block
+ */
+static void add_phi_operands(IRFunction *ir, IRValue *phi) {
+	int i;
+	for(i = 0; i < phi->block->pred_count; i++) {
+		IRValue_add_arg(phi,
+			read_variable(ir, phi->value, phi->block->preds[i]));
+	}
+}
+
+static IRValue *new_phi(IRFunction *ir, IRBlock *block, int variable) {
+	IRValue *phi = IRValue_init(ir, ir_Phi);
+	phi->value = variable;
+	IRBlock_insert(block, IRBlock_phi_count(block), phi);
+	return phi;
+}
+
+/*
+ * Returns the value that a variable (given by its stack offset divided by 4)
+ * has at the end of a block
+ */
+static IRValue *read_variable(IRFunction *ir, int variable, IRBlock *block) {
+	if(block->defs[variable]) return block->defs[variable];
+
+	IRValue *value;
+	if(!block->sealed) {
+		value = new_phi(ir, block, variable);
+		block->incomplete = array_append(block->incomplete,
+			block->incomplete_count, value);
+		block->incomplete_count++;
+	}
+	else if(block->pred_count == 0) value = ir->undefined;
+	else if(block->pred_count == 1) {
+		value = read_variable(ir, variable, block->preds[0]);
+	}
+	else {
+		// The phi is recorded before its operands are looked up, as a loop
+		// will lead the lookup back to this block
+		value = new_phi(ir, block, variable);
+		block->defs[variable] = value;
+		add_phi_operands(ir, value);
+	}
+
+	block->defs[variable] = value;
+	return value;
+}
+
+/*
+ * Records that all of a block's predecessors are known, completing the phis
+ * that were waiting for them
+ */
+static void seal_block(IRFunction *ir, IRBlock *block) {
+	int i;
+	for(i = 0; i < block->incomplete_count; i++) {
+		add_phi_operands(ir, block->incomplete[i]);
+	}
+	free(block->incomplete);
+	block->incomplete = NULL;
+	block->incomplete_count = 0;
+	block->sealed = true;
+}
+
+/*
+ * Returns the variable number of an identifier, which is its stack offset
+ * divided by 4
+ */
+static int variable_number(Expression *ident) {
+	if(ident->expr->ident->stack_offset < 0) {
+		printf("Identifier '%s' has no stack offset - cannot build IR\n",
+			ident->expr->ident->name);
+		exit(EXIT_FAILURE);
+	}
+	return ident->expr->ident->stack_offset / 4;
+}
+
+/*
+ * Adds a new value to the end of the current block
+ */
+static IRValue *emit_value(IRBuilder *b, ir_op op, Expression *expr) {
+	IRValue *value = IRValue_init(b->ir, op);
+	value->stmt = b->stmt;
+	value->expr = expr;
+	IRBlock_insert(b->current, b->current->value_count, value);
+	return value;
+}
+
+static void set_jump(IRBuilder *b, IRBlock *target) {
+	b->current->exit = ir_Jump;
+	b->current->succs[0] = target;
+	b->current->exit_stmt = b->stmt;
+	add_edge(b->current, target);
+}
+
+/*
+ * Ends the current block with a branch, which the profile shows to have gone
+ * to each block the given number of times
+ */
+static void set_branch(IRBuilder *b, IRValue *condition,
+	IRBlock *if_true, int true_count, IRBlock *if_false, int false_count) {
+
+	b->current->exit = ir_Branch;
+	b->current->exit_value = condition;
+	b->current->succs[0] = if_true;
+	b->current->succs[1] = if_false;
+	b->current->counts[0] = true_count;
+	b->current->counts[1] = false_count;
+	b->current->exit_stmt = b->stmt;
+	add_edge(b->current, if_true);
+	add_edge(b->current, if_false);
+}
+
+static IRValue *build_expression(IRBuilder *b, Expression *expr);
+
+/*
+ * Builds a binary (boolean or arithmetic) expression. Operands are evaluated
+ * left to right, as in the interpreter.
+ */
+static IRValue *build_binary(IRBuilder *b, ir_op op, Expression *expr,
+	Expression *lhs, token_type operator, Expression *rhs) {
+
+	IRValue *lhs_value = build_expression(b, lhs);
+	IRValue *rhs_value = build_expression(b, rhs);
+
+	IRValue *value = emit_value(b, op, expr);
+	value->operator = operator;
+	IRValue_add_arg(value, lhs_value);
+	IRValue_add_arg(value, rhs_value);
+	return value;
+}
+
+/*
+ * Builds the values that compute an expression, returning the value of the
+ * expression
+ */
+static IRValue *build_expression(IRBuilder *b, Expression *expr) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr:
+			return build_binary(b, ir_Compare, expr, expr->expr->blean->lhs,
+				expr->expr->blean->op, expr->expr->blean->rhs);
+
+		case expr_ArithmeticExpr:
+			return build_binary(b, ir_Arithmetic, expr, expr->expr->arith->lhs,
+				expr->expr->arith->op, expr->expr->arith->rhs);
+
+		case expr_Identifier:
+			return read_variable(b->ir, variable_number(expr), b->current);
+
+		case expr_IntegerLiteral: {
+			IRValue *value = emit_value(b, ir_Constant, expr);
+			value->value = expr->expr->intgr;
+			return value;
+		}
+
+		case expr_FNCall: {
+			if(expr->expr->fncall->call_index < 0) {
+				printf("Call to '%s' has no call index - cannot build IR\n",
+					expr->expr->fncall->name);
+				exit(EXIT_FAILURE);
+			}
+
+			// Evaluate the arguments in order before making the call
+			int arg_count = LinkedList_length(expr->expr->fncall->args);
+			IRValue **args = zeroed_array(arg_count, sizeof(IRValue *));
+			LLIterator *args_iter = LLIterator_init(expr->expr->fncall->args);
+			while(!LLIterator_ended(args_iter)) {
+				args[LLIterator_current_index(args_iter)] = build_expression(b,
+					(Expression *)LLIterator_get_current(args_iter));
+				LLIterator_advance(args_iter);
+			}
+			free(args_iter);
+
+			IRValue *value = emit_value(b, ir_Call, expr);
+			value->call = expr->expr->fncall;
+			int i;
+			for(i = 0; i < arg_count; i++) IRValue_add_arg(value, args[i]);
+			free(args);
+
+			return value;
+		}
+
+		case expr_Ternary: {
+			IRValue *condition =
+				build_expression(b, expr->expr->trnry->bool_expr);
+
+			IRBlock *if_true = IRBlock_init(b->ir);
+			IRBlock *if_false = IRBlock_init(b->ir);
+			IRBlock *join = IRBlock_init(b->ir);
+			set_branch(b, condition, if_true, 0, if_false, 0);
+			seal_block(b->ir, if_true);
+			seal_block(b->ir, if_false);
+
+			b->current = if_true;
+			IRValue *true_value =
+				build_expression(b, expr->expr->trnry->true_expr);
+			set_jump(b, join);
+
+			b->current = if_false;
+			IRValue *false_value =
+				build_expression(b, expr->expr->trnry->false_expr);
+			set_jump(b, join);
+
+			seal_block(b->ir, join);
+			b->current = join;
+
+			// The phi is not for a variable, so it is given its operands
+			// directly, in the order of join's predecessors
+			IRValue *phi = IRValue_init(b->ir, ir_Phi);
+			phi->value = -1;
+			phi->stmt = b->stmt;
+			phi->expr = expr;
+			IRValue_add_arg(phi, true_value);
+			IRValue_add_arg(phi, false_value);
+			IRBlock_insert(join, IRBlock_phi_count(join), phi);
+
+			return phi;
+		}
+	}
+
+	printf("Invalid expression type in AST\n");
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
+static void build_statement(IRBuilder *b, Statement *stmt);
+
+static void build_statement_list(IRBuilder *b, LinkedList *stmts) {
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter)) {
+		build_statement(b, (Statement *)LLIterator_get_current(stmts_iter));
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+}
+
+/*
+ * Builds a loop: a header block that evaluates the condition, a body that runs
+ * the statements (followed by the incrementor of a for loop, if any) and jumps
+ * back to the header, and the block after the loop. The header is sealed once
+ * the body has been built, as the body's end is the header's last predecessor.
+ * Each time the loop statement ran, its condition was false once at the end
+ * (unless the body returned).
+ */
+static void build_loop(IRBuilder *b, Expression *bool_expr, LinkedList *stmts,
+	Statement *incrementor) {
+
+	Statement *loop = b->stmt;
+
+	IRBlock *header = IRBlock_init(b->ir);
+	set_jump(b, header);
+	b->current = header;
+
+	IRValue *condition = build_expression(b, bool_expr);
+	IRBlock *body = IRBlock_init(b->ir);
+	IRBlock *after = IRBlock_init(b->ir);
+	set_branch(b, condition, body, b->profiled ? loop->taken_count : 0, after,
+		b->profiled ? loop->exec_count : 0);
+	seal_block(b->ir, body);
+
+	b->current = body;
+	build_statement_list(b, stmts);
+	if(incrementor) build_statement(b, incrementor);
+	set_jump(b, header);
+
+	seal_block(b->ir, header);
+	seal_block(b->ir, after);
+	b->current = after;
+}
+
+/*
+ * Builds the values and blocks that carry out a statement
+ */
+static void build_statement(IRBuilder *b, Statement *stmt) {
+	Statement *outer = b->stmt;
+	b->stmt = stmt;
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			build_statement(b, stmt->stmt->_for->assignment);
+			build_loop(b, stmt->stmt->_for->bool_expr,
+				stmt->stmt->_for->stmts, stmt->stmt->_for->incrementor);
+			break;
+
+		case stmt_While:
+			build_loop(b, stmt->stmt->_while->bool_expr,
+				stmt->stmt->_while->stmts, NULL);
+			break;
+
+		case stmt_If: {
+			IRValue *condition = build_expression(b,
+				stmt->stmt->_if->bool_expr);
+
+			IRBlock *if_true = IRBlock_init(b->ir);
+			IRBlock *if_false = IRBlock_init(b->ir);
+			IRBlock *join = IRBlock_init(b->ir);
+			set_branch(b, condition, if_true,
+				b->profiled ? stmt->taken_count : 0, if_false,
+				b->profiled ? stmt->exec_count - stmt->taken_count : 0);
+			seal_block(b->ir, if_true);
+			seal_block(b->ir, if_false);
+
+			b->current = if_true;
+			build_statement_list(b, stmt->stmt->_if->true_stmts);
+			set_jump(b, join);
+
+			b->current = if_false;
+			build_statement_list(b, stmt->stmt->_if->false_stmts);
+			set_jump(b, join);
+
+			seal_block(b->ir, join);
+			b->current = join;
+			break;
+		}
+
+		case stmt_Print: {
+			IRValue *value = build_expression(b, stmt->stmt->_print->expr);
+			IRValue *print = emit_value(b, ir_Print, NULL);
+			IRValue_add_arg(print, value);
+			break;
+		}
+
+		case stmt_Assignment: {
+			IRValue *value =
+				build_expression(b, stmt->stmt->_assignment->expr);
+			b->current->defs[variable_number(
+				stmt->stmt->_assignment->ident)] = value;
+			break;
+		}
+
+		case stmt_Return: {
+			IRValue *value = build_expression(b, stmt->stmt->_return->expr);
+			b->current->exit = ir_Return;
+			b->current->exit_value = value;
+			b->current->exit_stmt = stmt;
+
+			// Any statements after the return are unreachable, and are built
+			// into a block with no predecessors, which the passes remove
+			b->current = IRBlock_init(b->ir);
+			seal_block(b->ir, b->current);
+			break;
+		}
+	}
+
+	b->stmt = outer;
+}
+
+/*
+ * Builds the SSA form of a function. The function's stack offsets are generated
+ * first if that has not already been done, as variables are numbered by them.
+ * Unless profiled is true, the counts in the function's statements are not
+ * read, so that the function can be built on another thread while the
+ * interpreter updates them, and every branch count is 0.
+ */
+IRFunction *IRFunction_build(FNDecl *func, bool profiled) {
+	if(func->variable_count == -1) FNDecl_generate_offsets(func);
+
+	IRFunction *ir = safe_alloc(sizeof(IRFunction));
+	ir->func = func;
+	ir->blocks = NULL;
+	ir->block_count = 0;
+	ir->values = NULL;
+	ir->value_count = 0;
+	ir->next_block_id = 0;
+	ir->variable_count = func->variable_count;
+
+	IRBuilder b;
+	b.ir = ir;
+	b.current = IRBlock_init(ir);
+	b.stmt = NULL;
+	b.profiled = profiled;
+	seal_block(ir, b.current);
+
+	// Variables that are read before being assigned all share one value
+	ir->undefined = emit_value(&b, ir_Undefined, NULL);
+
+	LLIterator *args_iter = LLIterator_init(func->args);
+	while(!LLIterator_ended(args_iter)) {
+		Expression *arg = (Expression *)LLIterator_get_current(args_iter);
+		IRValue *value = emit_value(&b, ir_Argument, arg);
+		value->value = LLIterator_current_index(args_iter);
+		b.current->defs[variable_number(arg)] = value;
+		LLIterator_advance(args_iter);
+	}
+	free(args_iter);
+
+	build_statement_list(&b, func->stmts);
+
+	remove_trivial_phis(ir);
+	return ir;
+}
+
+/*
+ * Applies an arithmetic or comparison operator to two constants, storing the
+ * result in result. Returns false, leaving the operation to be carried out at
+ * runtime, for the divisions that fail: by zero, and the one that overflows.
+ * Overflow otherwise wraps around as it does in the machine code.
+ */
+static bool fold_operator(token_type operator, int lhs, int rhs, int *result) {
+	unsigned int ulhs = lhs;
+	unsigned int urhs = rhs;
+
+	switch(operator) {
+		case PLUS: *result = (int)(ulhs + urhs); return true;
+		case MINUS: *result = (int)(ulhs - urhs); return true;
+		case MULTIPLY: *result = (int)(ulhs * urhs); return true;
+		case EQUAL: *result = lhs == rhs; return true;
+		case NOT_EQUAL: *result = lhs != rhs; return true;
+		case LESS_THAN: *result = lhs < rhs; return true;
+		case GREATER_THAN: *result = lhs > rhs; return true;
+		case LESS_OR_EQUAL: *result = lhs <= rhs; return true;
+		case GREATER_OR_EQUAL: *result = lhs >= rhs; return true;
+
+		case DIVIDE:
+		case MODULO:
+			if(rhs == 0 || (lhs == INT_MIN && rhs == -1)) return false;
+			*result = operator == DIVIDE ? lhs / rhs : lhs % rhs;
+			return true;
+
+		default:
+			printf("Invalid operator in IR\n");
+			exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Sparse conditional constant propagation, after Wegman and Zadeck, "Constant
+ * Propagation with Conditional Branches". Every value starts out unknown (top)
+ * and every edge of the control flow graph unexecuted. Starting from the entry
+ * block, edges are marked executed as the branches that take them are found to
+ * be possible, and values are lowered to a constant, or to varying (bottom),
+ * as their operands are. Phis only consider the values arriving along executed
+ * edges, so a variable that is only ever assigned one constant on the paths
+ * that can actually be taken is found to be that constant, even around loops.
+ */
+
+typedef enum {
+	lattice_Top,
+	lattice_Constant,
+	lattice_Bottom
+} lattice;
+
+typedef struct {
+	IRFunction *ir;
+
+	// The lattice state of each value, and its constant, by value id
+	lattice *states;
+	int *constants;
+
+	// The values that use each value, and the blocks whose exits use it, by
+	// value id
+	IRValue ***users;
+	int *user_counts;
+	IRBlock ***exit_users;
+	int *exit_user_counts;
+
+	// Whether each block has been visited, and whether each edge into it has
+	// been executed (indexed by predecessor position), by block id
+	bool *visited;
+	bool **executed;
+
+	// The blocks waiting to be visited, and the values whose state has changed
+	// since their users were last evaluated
+	IRBlock **block_work;
+	int block_work_count;
+	IRValue **value_work;
+	int value_work_count;
+} SCCP;
+
+/*
+ * Works out a value's lattice state from its operands, queueing its users to
+ * be evaluated again if it has changed
+ */
+static void sccp_evaluate(SCCP *sccp, IRValue *value) {
+	lattice state = lattice_Bottom;
+	int constant = 0;
+
+	switch(value->op) {
+		case ir_Constant:
+			state = lattice_Constant;
+			constant = value->value;
+			break;
+
+		case ir_Arithmetic:
+		case ir_Compare: {
+			int lhs = value->args[0]->id;
+			int rhs = value->args[1]->id;
+
+			if(sccp->states[lhs] == lattice_Bottom ||
+				sccp->states[rhs] == lattice_Bottom) state = lattice_Bottom;
+			else if(sccp->states[lhs] == lattice_Top ||
+				sccp->states[rhs] == lattice_Top) state = lattice_Top;
+			else if(fold_operator(value->operator, sccp->constants[lhs],
+				sccp->constants[rhs], &constant)) state = lattice_Constant;
+			break;
+		}
+
+		case ir_Phi: {
+			state = lattice_Top;
+			bool *executed = sccp->executed[value->block->id];
+
+			int i;
+			for(i = 0; i < value->arg_count && state != lattice_Bottom; i++) {
+				int arg = value->args[i]->id;
+				if(!executed[i] || sccp->states[arg] == lattice_Top) continue;
+
+				if(sccp->states[arg] == lattice_Bottom) state = lattice_Bottom;
+				else if(state == lattice_Top) {
+					state = lattice_Constant;
+					constant = sccp->constants[arg];
+				}
+				else if(sccp->constants[arg] != constant) {
+					state = lattice_Bottom;
+				}
+			}
+			break;
+		}
+
+		// Arguments, calls and undefined variables could have any value
+		default:
+			break;
+	}
+
+	if(state == sccp->states[value->id] &&
+		(state != lattice_Constant ||
+			constant == sccp->constants[value->id])) return;
+
+	sccp->states[value->id] = state;
+	sccp->constants[value->id] = constant;
+	sccp->value_work[sccp->value_work_count++] = value;
+}
+
+/*
+ * Marks the edge from one block to another as executed. The first time a block
+ * is reached it is queued to be visited; after that, only its phis need to be
+ * evaluated again, as they are the only values to depend on which edges have
+ * been executed.
+ */
+static void sccp_execute_edge(SCCP *sccp, IRBlock *from, IRBlock *to) {
+	int index = IRBlock_pred_index(to, from);
+	if(sccp->executed[to->id][index]) return;
+	sccp->executed[to->id][index] = true;
+
+	if(!sccp->visited[to->id]) {
+		sccp->block_work[sccp->block_work_count++] = to;
+		return;
+	}
+
+	int i;
+	for(i = 0; i < to->value_count; i++) {
+		if(to->values[i]->op == ir_Phi) sccp_evaluate(sccp, to->values[i]);
+	}
+}
+
+/*
+ * Marks the edges that a block's exit may take as executed
+ */
+static void sccp_evaluate_exit(SCCP *sccp, IRBlock *block) {
+	if(block->exit == ir_Jump) {
+		sccp_execute_edge(sccp, block, block->succs[0]);
+	}
+	else if(block->exit == ir_Branch) {
+		int condition = block->exit_value->id;
+
+		if(sccp->states[condition] == lattice_Constant) {
+			sccp_execute_edge(sccp, block,
+				block->succs[sccp->constants[condition] ? 0 : 1]);
+		}
+		else if(sccp->states[condition] == lattice_Bottom) {
+			sccp_execute_edge(sccp, block, block->succs[0]);
+			sccp_execute_edge(sccp, block, block->succs[1]);
+		}
+	}
+}
+
+/*
+ * Records the users of every value, so that they can be evaluated again when
+ * it changes
+ */
+static void sccp_find_users(SCCP *sccp) {
+	IRFunction *ir = sccp->ir;
+	int i, j, k;
+
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			for(k = 0; k < value->arg_count; k++) {
+				int arg = value->args[k]->id;
+				sccp->users[arg] = array_append(sccp->users[arg],
+					sccp->user_counts[arg], value);
+				sccp->user_counts[arg]++;
+			}
+		}
+
+		if(block->exit_value) {
+			int arg = block->exit_value->id;
+			sccp->exit_users[arg] = array_append(sccp->exit_users[arg],
+				sccp->exit_user_counts[arg], block);
+			sccp->exit_user_counts[arg]++;
+		}
+	}
+}
+
+/*
+ * Rewrites the function with the results of the analysis: values found to be
+ * constant become constants, branches on constants become jumps, and blocks
+ * that were never reached are removed
+ */
+static void sccp_apply(SCCP *sccp) {
+	IRFunction *ir = sccp->ir;
+	int i, j;
+
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		if(!sccp->visited[block->id]) continue;
+
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			if(sccp->states[value->id] != lattice_Constant ||
+				value->op == ir_Constant) continue;
+
+			value->op = ir_Constant;
+			value->operator = ERROR;
+			value->value = sccp->constants[value->id];
+			free(value->args);
+			value->args = NULL;
+			value->arg_count = 0;
+		}
+
+		// The condition may be in a block that comes later, and so not have
+		// been made a constant yet
+		if(block->exit == ir_Branch &&
+			sccp->states[block->exit_value->id] == lattice_Constant) {
+
+			int taken = sccp->constants[block->exit_value->id] ? 0 : 1;
+			remove_edge(block, block->succs[1 - taken]);
+			block->succs[0] = block->succs[taken];
+			block->succs[1] = NULL;
+			block->exit = ir_Jump;
+			block->exit_value = NULL;
+		}
+	}
+
+	remove_blocks(ir, sccp->visited);
+	remove_trivial_phis(ir);
+}
+
+/*
+ * Runs sparse conditional constant propagation on a function
+ */
+void ir_sccp(IRFunction *ir) {
+	int value_count = ir->value_count;
+	int block_ids = ir->next_block_id;
+
+	SCCP sccp;
+	sccp.ir = ir;
+	sccp.states = zeroed_array(value_count, sizeof(lattice));
+	sccp.constants = zeroed_array(value_count, sizeof(int));
+	sccp.users = zeroed_array(value_count, sizeof(IRValue **));
+	sccp.user_counts = zeroed_array(value_count, sizeof(int));
+	sccp.exit_users = zeroed_array(value_count, sizeof(IRBlock **));
+	sccp.exit_user_counts = zeroed_array(value_count, sizeof(int));
+	sccp.visited = zeroed_array(block_ids, sizeof(bool));
+	sccp.executed = zeroed_array(block_ids, sizeof(bool *));
+	sccp.block_work =
+		zeroed_array((2 * ir->block_count) + 1, sizeof(IRBlock *));
+	sccp.block_work_count = 0;
+
+	// A value is queued each time its state is lowered, which happens at most
+	// twice
+	sccp.value_work = zeroed_array(2 * value_count, sizeof(IRValue *));
+	sccp.value_work_count = 0;
+
+	int i, j;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		sccp.executed[block->id] =
+			zeroed_array(block->pred_count, sizeof(bool));
+	}
+	sccp_find_users(&sccp);
+
+	sccp.block_work[sccp.block_work_count++] = ir->blocks[0];
+	while(sccp.block_work_count > 0 || sccp.value_work_count > 0) {
+
+		if(sccp.block_work_count > 0) {
+			IRBlock *block = sccp.block_work[--sccp.block_work_count];
+			if(sccp.visited[block->id]) continue;
+			sccp.visited[block->id] = true;
+
+			for(j = 0; j < block->value_count; j++) {
+				sccp_evaluate(&sccp, block->values[j]);
+			}
+			sccp_evaluate_exit(&sccp, block);
+			continue;
+		}
+
+		IRValue *value = sccp.value_work[--sccp.value_work_count];
+		for(j = 0; j < sccp.user_counts[value->id]; j++) {
+			IRValue *user = sccp.users[value->id][j];
+			if(sccp.visited[user->block->id]) sccp_evaluate(&sccp, user);
+		}
+		for(j = 0; j < sccp.exit_user_counts[value->id]; j++) {
+			IRBlock *block = sccp.exit_users[value->id][j];
+			if(sccp.visited[block->id]) sccp_evaluate_exit(&sccp, block);
+		}
+	}
+
+	sccp_apply(&sccp);
+
+	for(i = 0; i < value_count; i++) {
+		free(sccp.users[i]);
+		free(sccp.exit_users[i]);
+	}
+	for(i = 0; i < block_ids; i++) free(sccp.executed[i]);
+	free(sccp.states);
+	free(sccp.constants);
+	free(sccp.users);
+	free(sccp.user_counts);
+	free(sccp.exit_users);
+	free(sccp.exit_user_counts);
+	free(sccp.visited);
+	free(sccp.executed);
+	free(sccp.block_work);
+	free(sccp.value_work);
+}
+
+/*
+ * Dominators are computed with the algorithm of Cooper, Harvey and Kennedy,
+ * "A Simple, Fast Dominance Algorithm", which walks up the dominator tree built
+ * so far from two predecessors of a block until the walks meet
+ */
+static IRBlock *intersect(IRBlock *b1, IRBlock *b2) {
+	while(b1 != b2) {
+		while(b1->order > b2->order) b1 = b1->idom;
+		while(b2->order > b1->order) b2 = b2->idom;
+	}
+	return b1;
+}
+
+/*
+ * The dominator tree of a function: the blocks that each block immediately
+ * dominates, by block id
+ */
+typedef struct {
+	IRBlock ***children;
+	int *child_counts;
+	int size;
+} DominatorTree;
+
+/*
+ * Removes a function's unreachable blocks, puts the rest in reverse postorder,
+ * and computes its dominator tree
+ */
+static DominatorTree *DominatorTree_init(IRFunction *ir) {
+	order_blocks(ir);
+
+	int i, j;
+	for(i = 0; i < ir->block_count; i++) ir->blocks[i]->idom = NULL;
+	ir->blocks[0]->idom = ir->blocks[0];
+
+	bool changed = true;
+	while(changed) {
+		changed = false;
+
+		for(i = 1; i < ir->block_count; i++) {
+			IRBlock *block = ir->blocks[i];
+
+			IRBlock *idom = NULL;
+			for(j = 0; j < block->pred_count; j++) {
+				IRBlock *pred = block->preds[j];
+				if(!pred->idom) continue;
+				idom = idom ? intersect(pred, idom) : pred;
+			}
+
+			if(block->idom != idom) {
+				block->idom = idom;
+				changed = true;
+			}
+		}
+	}
+
+	DominatorTree *tree = safe_alloc(sizeof(DominatorTree));
+	tree->size = ir->next_block_id;
+	tree->children = zeroed_array(tree->size, sizeof(IRBlock **));
+	tree->child_counts = zeroed_array(tree->size, sizeof(int));
+
+	for(i = 1; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		int parent = block->idom->id;
+		tree->children[parent] = array_append(tree->children[parent],
+			tree->child_counts[parent], block);
+		tree->child_counts[parent]++;
+	}
+
+	return tree;
+}
+
+static void DominatorTree_free(DominatorTree *tree) {
+	int i;
+	for(i = 0; i < tree->size; i++) free(tree->children[i]);
+	free(tree->children);
+	free(tree->child_counts);
+	free(tree);
+}
+
+/*
+ * A hash table of values, keyed on the operation they perform, used to find
+ * values that compute the same thing. Operands are compared directly, or, if
+ * numbers is not NULL, by the value numbers it gives them (where NULL stands
+ * for a value that has not been numbered yet). Values in the same bucket are
+ * chained through chain, by value id. Values must be removed in the reverse of
+ * the order they were inserted.
+ */
+typedef struct {
+	IRValue **buckets;
+	unsigned int mask;
+	IRValue **chain;
+	unsigned int *hashes;
+	IRValue **numbers;
+} ValueTable;
+
+static ValueTable *ValueTable_init(IRFunction *ir, IRValue **numbers) {
+	ValueTable *table = safe_alloc(sizeof(ValueTable));
+
+	unsigned int size = 16;
+	while(size < 2 * ir->value_count) size *= 2;
+
+	table->buckets = zeroed_array(size, sizeof(IRValue *));
+	table->mask = size - 1;
+	table->chain = zeroed_array(ir->value_count, sizeof(IRValue *));
+	table->hashes = zeroed_array(ir->value_count, sizeof(unsigned int));
+	table->numbers = numbers;
+
+	return table;
+}
+
+static void ValueTable_clear(ValueTable *table) {
+	memset(table->buckets, 0, sizeof(IRValue *) * (table->mask + 1));
+}
+
+static void ValueTable_free(ValueTable *table) {
+	free(table->buckets);
+	free(table->chain);
+	free(table->hashes);
+	free(table);
+}
+
+/*
+ * Returns true for the values that are worth looking up: those that compute
+ * something from their operands alone
+ */
+static bool ValueTable_eligible(IRValue *value) {
+	return value->op == ir_Constant || value->op == ir_Argument ||
+		value->op == ir_Arithmetic || value->op == ir_Compare ||
+		value->op == ir_Phi;
+}
+
+static bool commutative(IRValue *value) {
+	return (value->op == ir_Arithmetic || value->op == ir_Compare) &&
+		(value->operator == PLUS || value->operator == MULTIPLY ||
+		value->operator == EQUAL || value->operator == NOT_EQUAL);
+}
+
+static IRValue *ValueTable_operand(ValueTable *table, IRValue *value, int i) {
+	IRValue *arg = resolve(value->args[i]);
+	return table->numbers ? table->numbers[arg->id] : arg;
+}
+
+static unsigned int ValueTable_hash(ValueTable *table, IRValue *value) {
+	unsigned int hash = (value->op * 31) + value->operator;
+	if(value->op == ir_Phi) hash = (hash * 31) + value->block->id;
+	else hash = (hash * 31) + value->value;
+
+	// The operands of commutative operations are summed, so that their order
+	// does not matter
+	int i;
+	for(i = 0; i < value->arg_count; i++) {
+		IRValue *operand = ValueTable_operand(table, value, i);
+		unsigned int operand_hash = operand ? operand->id + 1 : 0;
+		if(commutative(value)) hash += operand_hash * 2654435761u;
+		else hash = (hash * 31) + operand_hash;
+	}
+
+	return hash;
+}
+
+/*
+ * Returns true if two values perform the same operation on the same operands.
+ * Phis are only the same if they are in the same block, whichever variables
+ * they were built for.
+ */
+static bool ValueTable_same(ValueTable *table, IRValue *v1, IRValue *v2) {
+	if(v1->op != v2->op || v1->operator != v2->operator ||
+		v1->arg_count != v2->arg_count) return false;
+	if(v1->op == ir_Phi && v1->block != v2->block) return false;
+	if(v1->op != ir_Phi && v1->value != v2->value) return false;
+
+	if(commutative(v1) &&
+		ValueTable_operand(table, v1, 0) == ValueTable_operand(table, v2, 1) &&
+		ValueTable_operand(table, v1, 1) == ValueTable_operand(table, v2, 0)) {
+
+		return true;
+	}
+
+	int i;
+	for(i = 0; i < v1->arg_count; i++) {
+		if(ValueTable_operand(table, v1, i) !=
+			ValueTable_operand(table, v2, i)) return false;
+	}
+	return true;
+}
+
+/*
+ * Returns a value in the table that is the same as the given value, which has
+ * the given hash, or NULL if there is none
+ */
+static IRValue *ValueTable_find(ValueTable *table, IRValue *value,
+	unsigned int hash) {
+
+	IRValue *found = table->buckets[hash & table->mask];
+	while(found && (found == value || !ValueTable_same(table, found, value))) {
+		found = table->chain[found->id];
+	}
+	return found;
+}
+
+static void ValueTable_insert(ValueTable *table, IRValue *value,
+	unsigned int hash) {
+
+	table->hashes[value->id] = hash;
+	table->chain[value->id] = table->buckets[hash & table->mask];
+	table->buckets[hash & table->mask] = value;
+}
+
+/*
+ * Removes the value that was inserted into the table most recently
+ */
+static void ValueTable_remove_latest(ValueTable *table, IRValue *value) {
+	table->buckets[table->hashes[value->id] & table->mask] =
+		table->chain[value->id];
+}
+
+/*
+ * Common subexpression elimination. The dominator tree is walked from the
+ * entry block, keeping a table of the values computed by the blocks that
+ * dominate the current one. A value that performs the same operation on the
+ * same operands as one in the table is replaced by it, as that value has
+ * always been computed already when control reaches this one.
+ */
+
+typedef struct {
+	DominatorTree *tree;
+	ValueTable *table;
+	IRValue **scope;
+	int scope_count;
+} CSE;
+
+static void cse_block(CSE *cse, IRBlock *block) {
+	int scope_start = cse->scope_count;
+
+	int i;
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *value = block->values[i];
+		if(!ValueTable_eligible(value)) continue;
+
+		unsigned int hash = ValueTable_hash(cse->table, value);
+		IRValue *found = ValueTable_find(cse->table, value, hash);
+		if(found) value->replacement = found;
+		else {
+			ValueTable_insert(cse->table, value, hash);
+			cse->scope[cse->scope_count++] = value;
+		}
+	}
+
+	for(i = 0; i < cse->tree->child_counts[block->id]; i++) {
+		cse_block(cse, cse->tree->children[block->id][i]);
+	}
+
+	// The values of this block are not available in its siblings
+	while(cse->scope_count > scope_start) {
+		ValueTable_remove_latest(cse->table, cse->scope[--cse->scope_count]);
+	}
+}
+
+/*
+ * Runs common subexpression elimination on a function
+ */
+void ir_cse(IRFunction *ir) {
+	CSE cse;
+	cse.tree = DominatorTree_init(ir);
+	cse.table = ValueTable_init(ir, NULL);
+	cse.scope = zeroed_array(ir->value_count, sizeof(IRValue *));
+	cse.scope_count = 0;
+
+	cse_block(&cse, ir->blocks[0]);
+	apply_replacements(ir);
+
+	DominatorTree_free(cse.tree);
+	ValueTable_free(cse.table);
+	free(cse.scope);
+}
+
+/*
+ * Global value numbering, using the optimistic algorithm of Simpson, "Value-
+ * Driven Redundancy Elimination". Each value is given a value number - the
+ * first value seen to compute the same thing - by hashing its operation and the
+ * numbers of its operands. The blocks are numbered in reverse postorder, which
+ * is repeated until the numbers stop changing. Phis ignore operands that have
+ * not been numbered yet (along loop back edges) and take the number of their
+ * remaining operands if those all agree, so values that are only congruent
+ * because they are built up in the same way around a loop, such as two loop
+ * counters stepped in lockstep, are found to be equal. Unlike common
+ * subexpression elimination, this finds equal phis and the values that depend
+ * on them. Each value is then replaced by a value with the same number that
+ * dominates it, if there is one.
+ */
+
+typedef struct {
+	DominatorTree *tree;
+	IRValue **numbers;
+	IRValue **leaders;
+	IRValue **scope;
+	int scope_count;
+} GVN;
+
+/*
+ * Returns the number shared by all the numbered operands of a phi, or NULL if
+ * they do not agree
+ */
+static IRValue *phi_number(IRValue **numbers, IRValue *phi) {
+	IRValue *common = NULL;
+
+	int i;
+	for(i = 0; i < phi->arg_count; i++) {
+		IRValue *number = numbers[resolve(phi->args[i])->id];
+		if(!number) continue;
+		if(common && number != common) return NULL;
+		common = number;
+	}
+	return common;
+}
+
+static void gvn_number(IRFunction *ir, IRValue **numbers) {
+	ValueTable *table = ValueTable_init(ir, numbers);
+
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		ValueTable_clear(table);
+
+		int i, j;
+		for(i = 0; i < ir->block_count; i++) {
+			IRBlock *block = ir->blocks[i];
+
+			for(j = 0; j < block->value_count; j++) {
+				IRValue *value = block->values[j];
+				IRValue *number = value;
+
+				if(ValueTable_eligible(value)) {
+					number = value->op == ir_Phi ?
+						phi_number(numbers, value) : NULL;
+
+					if(!number) {
+						unsigned int hash = ValueTable_hash(table, value);
+						number = ValueTable_find(table, value, hash);
+						if(!number) {
+							ValueTable_insert(table, value, hash);
+							number = value;
+						}
+					}
+				}
+
+				if(numbers[value->id] != number) {
+					numbers[value->id] = number;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	ValueTable_free(table);
+}
+
+/*
+ * Replaces each value in a block and the blocks it dominates with the first
+ * value with the same number that dominates it
+ */
+static void gvn_block(GVN *gvn, IRBlock *block) {
+	int scope_start = gvn->scope_count;
+
+	int i;
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *value = block->values[i];
+		if(!ValueTable_eligible(value)) continue;
+
+		IRValue *number = gvn->numbers[value->id];
+		IRValue *leader = gvn->leaders[number->id];
+		if(leader) value->replacement = leader;
+		else {
+			gvn->leaders[number->id] = value;
+			gvn->scope[gvn->scope_count++] = number;
+		}
+	}
+
+	for(i = 0; i < gvn->tree->child_counts[block->id]; i++) {
+		gvn_block(gvn, gvn->tree->children[block->id][i]);
+	}
+
+	while(gvn->scope_count > scope_start) {
+		gvn->leaders[gvn->scope[--gvn->scope_count]->id] = NULL;
+	}
+}
+
+/*
+ * Runs global value numbering on a function
+ */
+void ir_gvn(IRFunction *ir) {
+	GVN gvn;
+	gvn.tree = DominatorTree_init(ir);
+	gvn.numbers = zeroed_array(ir->value_count, sizeof(IRValue *));
+	gvn.leaders = zeroed_array(ir->value_count, sizeof(IRValue *));
+	gvn.scope = zeroed_array(ir->value_count, sizeof(IRValue *));
+	gvn.scope_count = 0;
+
+	gvn_number(ir, gvn.numbers);
+	gvn_block(&gvn, ir->blocks[0]);
+	apply_replacements(ir);
+
+	DominatorTree_free(gvn.tree);
+	free(gvn.numbers);
+	free(gvn.leaders);
+	free(gvn.scope);
+}
+
+/*
+ * Returns true if a value must be kept even if nothing uses it: calls and
+ * prints, and divisions that may fail at runtime
+ */
+static bool has_side_effects(IRValue *value) {
+	if(value->op == ir_Call || value->op == ir_Print) return true;
+
+	if(value->op == ir_Arithmetic &&
+		(value->operator == DIVIDE || value->operator == MODULO)) {
+
+		IRValue *divisor = value->args[1];
+		return divisor->op != ir_Constant || divisor->value == 0 ||
+			divisor->value == -1;
+	}
+	return false;
+}
+
+/*
+ * Merges each block that ends by jumping to a block with no other predecessor
+ * with that block
+ */
+static void merge_blocks(IRFunction *ir) {
+	bool *keep = zeroed_array(ir->next_block_id, sizeof(bool));
+
+	int i, j;
+	for(i = 0; i < ir->block_count; i++) keep[ir->blocks[i]->id] = true;
+
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		if(!keep[block->id]) continue;
+
+		while(block->exit == ir_Jump && block->succs[0]->pred_count == 1 &&
+			block->succs[0] != block && block->succs[0] != ir->blocks[0]) {
+
+			IRBlock *succ = block->succs[0];
+
+			// With one predecessor, any phis in succ have one operand
+			for(j = 0; j < succ->value_count; j++) {
+				IRValue *value = succ->values[j];
+				if(value->op == ir_Phi) value->replacement = value->args[0];
+				else IRBlock_insert(block, block->value_count, value);
+			}
+			succ->value_count = 0;
+
+			block->exit = succ->exit;
+			block->exit_value = succ->exit_value;
+			block->succs[0] = succ->succs[0];
+			block->succs[1] = succ->succs[1];
+			block->counts[0] = succ->counts[0];
+			block->counts[1] = succ->counts[1];
+			block->exit_stmt = succ->exit_stmt;
+
+			for(j = 0; j < IRBlock_succ_count(succ); j++) {
+				IRBlock *next = succ->succs[j];
+				next->preds[IRBlock_pred_index(next, succ)] = block;
+			}
+			keep[succ->id] = false;
+		}
+	}
+
+	// The merged blocks no longer have edges to the blocks that are kept
+	int kept = 0;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		if(keep[block->id]) ir->blocks[kept++] = block;
+		else IRBlock_free(block);
+	}
+	ir->block_count = kept;
+
+	free(keep);
+	apply_replacements(ir);
+}
+
+/*
+ * Dead code elimination. Values are kept if they have side effects, or are used
+ * by a block's exit or by another value that is kept; all other values are
+ * removed. Unreachable blocks are removed, blocks that simply follow one
+ * another are merged, and the blocks are left in reverse postorder.
+ */
+void ir_dce(IRFunction *ir) {
+	order_blocks(ir);
+
+	bool *live = zeroed_array(ir->value_count, sizeof(bool));
+	IRValue **work = zeroed_array(ir->value_count, sizeof(IRValue *));
+	int work_count = 0;
+
+	int i, j;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			if(has_side_effects(value) && !live[value->id]) {
+				live[value->id] = true;
+				work[work_count++] = value;
+			}
+		}
+
+		IRValue *exit_value = block->exit_value;
+		if(exit_value && !live[exit_value->id]) {
+			live[exit_value->id] = true;
+			work[work_count++] = exit_value;
+		}
+	}
+
+	while(work_count > 0) {
+		IRValue *value = work[--work_count];
+		for(i = 0; i < value->arg_count; i++) {
+			IRValue *arg = value->args[i];
+			if(!live[arg->id]) {
+				live[arg->id] = true;
+				work[work_count++] = arg;
+			}
+		}
+	}
+
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+
+		int kept = 0;
+		for(j = 0; j < block->value_count; j++) {
+			if(live[block->values[j]->id]) {
+				block->values[kept++] = block->values[j];
+			}
+		}
+		block->value_count = kept;
+	}
+
+	free(live);
+	free(work);
+
+	merge_blocks(ir);
+}
+
+/*
+ * Calls are only inlined if the function called has no more than
+ * INLINE_MAX_SIZE values once optimised, and a function stops having calls
+ * inlined into it once it has grown by INLINE_BUDGET values
+ */
+#define INLINE_MAX_SIZE 40
+#define INLINE_BUDGET 200
+
+/*
+ * Returns the number of values in a function's blocks, or -1 if the function
+ * cannot be inlined: if it can reach its end without returning, as the error
+ * reported would name the wrong function, or if its entry block is the target
+ * of a jump
+ */
+static int inline_size(IRFunction *callee) {
+	if(callee->blocks[0]->pred_count > 0) return -1;
+
+	int i, size = 0;
+	for(i = 0; i < callee->block_count; i++) {
+		if(callee->blocks[i]->exit == ir_MissingReturn) return -1;
+		size += callee->blocks[i]->value_count;
+	}
+	return size;
+}
+
+/*
+ * Replaces a call with a copy of the body of the function it calls, given in
+ * optimised SSA form, in which the values passed to the call take the place of
+ * the arguments. The block making the call is split in two: the first part
+ * jumps to the copy of the callee's entry block, and each return jumps to the
+ * second part, where a phi chooses the value returned if there is more than
+ * one return. Users of the call are left to apply_replacements().
+ */
+static void inline_call(IRFunction *ir, IRValue *call, IRFunction *callee) {
+	IRBlock *block = call->block;
+	int i, j, k;
+
+	// The values after the call, and the block's exit, move to a new block
+	int index = 0;
+	while(block->values[index] != call) index++;
+	IRBlock *after = IRBlock_init(ir);
+	for(i = index + 1; i < block->value_count; i++) {
+		IRBlock_insert(after, after->value_count, block->values[i]);
+	}
+	block->value_count = index;
+
+	after->exit = block->exit;
+	after->exit_value = block->exit_value;
+	after->succs[0] = block->succs[0];
+	after->succs[1] = block->succs[1];
+	after->counts[0] = block->counts[0];
+	after->counts[1] = block->counts[1];
+	after->exit_stmt = block->exit_stmt;
+	for(i = 0; i < IRBlock_succ_count(after); i++) {
+		IRBlock *succ = after->succs[i];
+		succ->preds[IRBlock_pred_index(succ, block)] = after;
+	}
+
+	// Copy the callee's blocks and values, recording each one's copy by the
+	// callee's id for it
+	IRBlock **blocks = zeroed_array(callee->next_block_id, sizeof(IRBlock *));
+	IRValue **values = zeroed_array(callee->value_count, sizeof(IRValue *));
+	for(i = 0; i < callee->block_count; i++) {
+		blocks[callee->blocks[i]->id] = IRBlock_init(ir);
+	}
+	for(i = 0; i < callee->block_count; i++) {
+		IRBlock *from = callee->blocks[i];
+		for(j = 0; j < from->value_count; j++) {
+			IRValue *value = from->values[j];
+			if(value->op == ir_Argument) {
+				values[value->id] = call->args[value->value];
+				continue;
+			}
+
+			IRValue *copy = IRValue_init(ir, value->op);
+			copy->operator = value->operator;
+			copy->value = value->value;
+			copy->call = value->call;
+			copy->stmt = value->stmt;
+			copy->expr = value->expr;
+			IRBlock_insert(blocks[from->id], blocks[from->id]->value_count,
+				copy);
+			values[value->id] = copy;
+		}
+	}
+
+	// Then connect the copies up in the same way, except that returns jump to
+	// the block after the call
+	IRValue **returned = zeroed_array(callee->block_count, sizeof(IRValue *));
+	for(i = 0; i < callee->block_count; i++) {
+		IRBlock *from = callee->blocks[i];
+		IRBlock *to = blocks[from->id];
+
+		for(j = 0; j < from->value_count; j++) {
+			IRValue *value = from->values[j];
+			if(value->op == ir_Argument) continue;
+			for(k = 0; k < value->arg_count; k++) {
+				IRValue_add_arg(values[value->id], values[value->args[k]->id]);
+			}
+		}
+		for(j = 0; j < from->pred_count; j++) {
+			add_edge(blocks[from->preds[j]->id], to);
+		}
+
+		to->exit_stmt = from->exit_stmt;
+		if(from->exit == ir_Return) {
+			returned[after->pred_count] = values[from->exit_value->id];
+			to->exit = ir_Jump;
+			to->succs[0] = after;
+			add_edge(to, after);
+			continue;
+		}
+
+		to->exit = from->exit;
+		if(from->exit_value) to->exit_value = values[from->exit_value->id];
+		for(j = 0; j < IRBlock_succ_count(from); j++) {
+			to->succs[j] = blocks[from->succs[j]->id];
+			to->counts[j] = from->counts[j];
+		}
+	}
+
+	IRBlock *entry = blocks[callee->blocks[0]->id];
+	block->exit = ir_Jump;
+	block->exit_value = NULL;
+	block->succs[0] = entry;
+	block->succs[1] = NULL;
+	block->counts[0] = 0;
+	block->counts[1] = 0;
+	block->exit_stmt = call->stmt;
+	add_edge(block, entry);
+
+	// If the callee never returns, nothing after the call can be reached
+	if(after->pred_count == 0) call->replacement = ir->undefined;
+	else if(after->pred_count == 1) call->replacement = returned[0];
+	else {
+		IRValue *phi = IRValue_init(ir, ir_Phi);
+		phi->value = -1;
+		phi->stmt = call->stmt;
+		phi->expr = call->expr;
+		for(i = 0; i < after->pred_count; i++) {
+			IRValue_add_arg(phi, returned[i]);
+		}
+		IRBlock_insert(after, 0, phi);
+		call->replacement = phi;
+	}
+
+	free(blocks);
+	free(values);
+	free(returned);
+}
+
+/*
+ * Orders calls by the number of times the profile shows them to have been
+ * made, most first, and otherwise by id so that the order is always the same
+ */
+static int compare_call_counts(const void *a, const void *b) {
+	IRValue *ca = *(IRValue **)a;
+	IRValue *cb = *(IRValue **)b;
+	if(ca->call->exec_count != cb->call->exec_count) {
+		return ca->call->exec_count < cb->call->exec_count ? 1 : -1;
+	}
+	return ca->id - cb->id;
+}
+
+/*
+ * Inlines the calls in a function that its profile (see profile.h) shows to
+ * have been made, to functions small enough to be worth copying, hottest
+ * first, until the function has grown by INLINE_BUDGET values. The function is
+ * then optimised again, as the values passed to the calls may simplify the
+ * code inlined. Only the calls made by the function itself are inlined, not
+ * those in the code inlined into it, and recursive calls are not inlined.
+ * Without a profile, nothing is inlined.
+ */
+void ir_inline_calls(IRFunction *ir, Program *prog) {
+	IRValue **calls = NULL;
+	int call_count = 0;
+
+	int i, j;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			if(value->op == ir_Call && value->call->exec_count > 0) {
+				calls = array_append(calls, call_count, value);
+				call_count++;
+			}
+		}
+	}
+	if(call_count == 0) return;
+	qsort(calls, call_count, sizeof(IRValue *), compare_call_counts);
+
+	int budget = INLINE_BUDGET;
+	bool inlined = false;
+	for(i = 0; i < call_count; i++) {
+		FNDecl *func = Program_find_FNDecl(prog, calls[i]->call->name);
+		if(!func || func == ir->func ||
+			LinkedList_length(func->args) != calls[i]->arg_count) continue;
+
+		IRFunction *callee = IRFunction_build(func, true);
+		ir_sccp(callee);
+		ir_gvn(callee);
+		ir_dce(callee);
+
+		int size = inline_size(callee);
+		if(size >= 0 && size <= INLINE_MAX_SIZE && size <= budget) {
+			inline_call(ir, calls[i], callee);
+			budget -= size;
+			inlined = true;
+		}
+		IRFunction_free(callee);
+	}
+	free(calls);
+	if(!inlined) return;
+
+	// The passes may use the function's undefined value, which ir_dce() will
+	// have removed if nothing used it
+	IRBlock *entry = ir->blocks[0];
+	for(i = 0; i < entry->value_count; i++) {
+		if(entry->values[i] == ir->undefined) break;
+	}
+	if(i == entry->value_count) IRBlock_insert(entry, 0, ir->undefined);
+
+	apply_replacements(ir);
+	ir_sccp(ir);
+	ir_gvn(ir);
+	ir_dce(ir);
+}
+
+/*
+ * A branch's successor is cold if the profile shows the branch to have gone
+ * there fewer than 1 in COLD_BRANCH_RATIO times as often as to its other
+ * successor
+ */
+#define COLD_BRANCH_RATIO 20
+
+static bool cold_edge(IRBlock *from, IRBlock *to) {
+	if(from->exit != ir_Branch || from->succs[0] == from->succs[1]) {
+		return false;
+	}
+	int i = from->succs[0] == to ? 0 : 1;
+	return (long)from->counts[i] * COLD_BRANCH_RATIO < from->counts[1 - i];
+}
+
+/*
+ * Moves the blocks that the function's profile (see profile.h) shows to be
+ * rarely run after all the others, so that the code that runs most is
+ * contiguous and branches to cold blocks are not taken. A block is cold if
+ * every edge into it is a cold edge out of a branch, or comes from a cold
+ * block. The blocks are otherwise kept in the same order, so this should be
+ * done after anything that relies on the blocks being in reverse postorder,
+ * such as regalloc_function(). Without a profile, no block is cold.
+ */
+void ir_layout(IRFunction *ir) {
+	bool *cold = zeroed_array(ir->next_block_id, sizeof(bool));
+
+	// Every block but the entry starts out cold, and becomes hot if it has an
+	// edge into it that is not cold, until nothing changes, so that a loop
+	// that is only entered from a cold edge stays cold
+	int i, j;
+	for(i = 1; i < ir->block_count; i++) cold[ir->blocks[i]->id] = true;
+
+	bool changed = true;
+	while(changed) {
+		changed = false;
+
+		for(i = 1; i < ir->block_count; i++) {
+			IRBlock *block = ir->blocks[i];
+			if(!cold[block->id]) continue;
+
+			for(j = 0; j < block->pred_count; j++) {
+				IRBlock *pred = block->preds[j];
+				if(!cold[pred->id] && !cold_edge(pred, block)) {
+					cold[block->id] = false;
+					changed = true;
+					break;
+				}
+			}
+		}
+	}
+
+	IRBlock **blocks = zeroed_array(ir->block_count, sizeof(IRBlock *));
+	int count = 0;
+	for(i = 0; i < ir->block_count; i++) {
+		if(!cold[ir->blocks[i]->id]) blocks[count++] = ir->blocks[i];
+	}
+	for(i = 0; i < ir->block_count; i++) {
+		if(cold[ir->blocks[i]->id]) blocks[count++] = ir->blocks[i];
+	}
+	memcpy(ir->blocks, blocks, sizeof(IRBlock *) * ir->block_count);
+
+	free(blocks);
+	free(cold);
+}
+
+/*
+ * Returns a newly allocated string describing a value, for example
+ * "v3 = v1 PLUS v2"
+ */
+char *IRValue_str(IRValue *value) {
+	char buffer[64];
+	char *str;
+	int i;
+
+	switch(value->op) {
+		case ir_Constant:
+			sprintf(buffer, "v%d = %d", value->id, value->value);
+			return safe_strdup(buffer);
+
+		case ir_Argument:
+			sprintf(buffer, "v%d = argument %d", value->id, value->value);
+			return safe_strdup(buffer);
+
+		case ir_Undefined:
+			sprintf(buffer, "v%d = undefined", value->id);
+			return safe_strdup(buffer);
+
+		case ir_Arithmetic:
+		case ir_Compare:
+			sprintf(buffer, "v%d = v%d %s v%d", value->id, value->args[0]->id,
+				Token_str(value->operator), value->args[1]->id);
+			return safe_strdup(buffer);
+
+		case ir_Print:
+			sprintf(buffer, "print v%d", value->args[0]->id);
+			return safe_strdup(buffer);
+
+		case ir_Call:
+		case ir_Phi: {
+			if(value->op == ir_Call) {
+				sprintf(buffer, "v%d = call ", value->id);
+				str = str_concat(3, buffer, value->call->name, "(");
+			}
+			else {
+				sprintf(buffer, "v%d = phi(", value->id);
+				str = safe_strdup(buffer);
+			}
+
+			for(i = 0; i < value->arg_count; i++) {
+				sprintf(buffer, "%sv%d", i == 0 ? "" : ", ",
+					value->args[i]->id);
+				char *temp = str_concat_2(str, buffer);
+				free(str);
+				str = temp;
+			}
+
+			char *out = str_concat_2(str, ")");
+			free(str);
+			return out;
+		}
+	}
+
+	printf("Invalid value in IR\n");
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
+/*
+ * Returns a newly allocated string listing a function's blocks, each with its
+ * predecessors, values and exit, one per line
+ */
+char *IRFunction_str(IRFunction *ir) {
+	char buffer[64];
+	char *str = str_concat(3, "fn ", ir->func->name, "\n");
+	int i, j;
+
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+
+		sprintf(buffer, "b%d:", block->id);
+		char *line = safe_strdup(buffer);
+		for(j = 0; j < block->pred_count; j++) {
+			sprintf(buffer, "%sb%d", j == 0 ? " <- " : ", ",
+				block->preds[j]->id);
+			char *temp = str_concat_2(line, buffer);
+			free(line);
+			line = temp;
+		}
+		char *temp = str_concat(3, str, line, "\n");
+		free(str);
+		free(line);
+		str = temp;
+
+		for(j = 0; j < block->value_count; j++) {
+			char *value = IRValue_str(block->values[j]);
+			temp = str_concat(4, str, "  ", value, "\n");
+			free(str);
+			free(value);
+			str = temp;
+		}
+
+		switch(block->exit) {
+			case ir_Jump:
+				sprintf(buffer, "  jump b%d\n", block->succs[0]->id);
+				break;
+			case ir_Branch:
+				sprintf(buffer, "  branch v%d, b%d, b%d\n",
+					block->exit_value->id, block->succs[0]->id,
+					block->succs[1]->id);
+				break;
+			case ir_Return:
+				sprintf(buffer, "  return v%d\n", block->exit_value->id);
+				break;
+			case ir_MissingReturn:
+				sprintf(buffer, "  missing return\n");
+				break;
+		}
+		temp = str_concat_2(str, buffer);
+		free(str);
+		str = temp;
+	}
+
+	return str;
+}
+
+void IRFunction_free(IRFunction *ir) {
+	int i;
+	for(i = 0; i < ir->block_count; i++) IRBlock_free(ir->blocks[i]);
+	for(i = 0; i < ir->value_count; i++) {
+		free(ir->values[i]->args);
+		free(ir->values[i]);
+	}
+	free(ir->blocks);
+	free(ir->values);
+	free(ir);
+}
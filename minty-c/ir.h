@@ -0,0 +1,166 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef IR
+#define IR
+
+/*
+ * The intermediate representation that functions are compiled through. A
+ * function is translated from its AST into static single assignment (SSA) form:
+ * a control flow graph of basic blocks, each holding a sequence of values and
+ * ending with an exit. Every value is computed exactly once, and variables
+ * disappear - an assignment just names the value being assigned, and where
+ * control flow merges, phi values choose between the values a variable had on
+ * each incoming path.
+ *
+ * The optimisation passes below transform a function in place. Both back ends
+ * run ir_sccp() first and ir_dce() last. The JIT compiler (jitcode.c) uses
+ * ir_cse() between them as it is cheap, and the assembly code generator
+ * (codegen.c), which is not in a hurry, uses the more thorough ir_gvn(). The
+ * ahead-of-time compilers also use the program's profile, if it has one, to
+ * inline hot calls (ir_inline_calls()) and to move rarely run blocks out of the
+ * way (ir_layout()).
+ */
+
+/*
+ * The operations a value can perform:
+ *     ir_Constant    the integer value
+ *     ir_Argument    the function's argument number value
+ *     ir_Undefined   a variable read before it was assigned
+ *     ir_Arithmetic  args[0] operator args[1], for an arithmetic operator
+ *     ir_Compare     args[0] operator args[1], 1 or 0, for a boolean operator
+ *     ir_Call        the result of call, with the arguments in args
+ *     ir_Print       prints args[0], producing no value
+ *     ir_Phi         args[i] when the block was entered from preds[i]
+ */
+typedef enum {
+	ir_Constant,
+	ir_Argument,
+	ir_Undefined,
+	ir_Arithmetic,
+	ir_Compare,
+	ir_Call,
+	ir_Print,
+	ir_Phi
+} ir_op;
+
+/*
+ * The ways a block can be left:
+ *     ir_Jump            to succs[0]
+ *     ir_Branch          to succs[0] if value is non-zero, else to succs[1]
+ *     ir_Return          returning value from the function
+ *     ir_MissingReturn   the end of the function was reached without a return
+ */
+typedef enum {
+	ir_Jump,
+	ir_Branch,
+	ir_Return,
+	ir_MissingReturn
+} ir_exit;
+
+typedef struct IRValue IRValue;
+typedef struct IRBlock IRBlock;
+
+/*
+ * A value, numbered by id uniquely within its function. The statement and
+ * expression that a value was produced for are kept so that compiled code can
+ * be mapped back to the source, and are NULL where there are none (arguments
+ * have no statement, and prints have no expression). When a pass finds a value
+ * to be redundant, it records the value that replaces it in replacement.
+ */
+struct IRValue {
+	ir_op op;
+	int id;
+	token_type operator;
+	int value;
+	IRValue **args;
+	int arg_count;
+	FNCall *call;
+	IRBlock *block;
+	Statement *stmt;
+	Expression *expr;
+	IRValue *replacement;
+};
+
+/*
+ * A basic block. Phi values always come before the block's other values. The
+ * statement that the exit was produced for is kept in exit_stmt, which is NULL
+ * for the exit at the end of the function. For a branch, counts holds the
+ * number of times each successor was taken according to the function's profile
+ * (see profile.h), which are 0 if there is none.
+ */
+struct IRBlock {
+	int id;
+	IRValue **values;
+	int value_count;
+	IRBlock **preds;
+	int pred_count;
+
+	ir_exit exit;
+	IRValue *exit_value;
+	IRBlock *succs[2];
+	int counts[2];
+	Statement *exit_stmt;
+
+	// State used while the block is built: the value each variable has at the
+	// end of the block so far, whether all of the block's predecessors are
+	// known yet, and the phis waiting for them if not
+	IRValue **defs;
+	bool sealed;
+	IRValue **incomplete;
+	int incomplete_count;
+
+	// The block's position in reverse postorder and its immediate dominator,
+	// as last computed by a pass
+	int order;
+	IRBlock *idom;
+};
+
+/*
+ * A function in SSA form. blocks holds the function's blocks with the entry
+ * block first, and values every value created for the function, indexed by id,
+ * including ones that have since been removed from their blocks.
+ */
+typedef struct {
+	FNDecl *func;
+	IRBlock **blocks;
+	int block_count;
+	IRValue **values;
+	int value_count;
+	int next_block_id;
+	int variable_count;
+	IRValue *undefined;
+} IRFunction;
+
+IRFunction *IRFunction_build(FNDecl *func, bool profiled);
+
+void ir_sccp(IRFunction *ir);
+
+void ir_cse(IRFunction *ir);
+
+void ir_gvn(IRFunction *ir);
+
+void ir_dce(IRFunction *ir);
+
+void ir_inline_calls(IRFunction *ir, Program *prog);
+
+void ir_layout(IRFunction *ir);
+
+int IRBlock_pred_index(IRBlock *block, IRBlock *pred);
+
+char *IRValue_str(IRValue *value);
+
+char *IRFunction_str(IRFunction *ir);
+
+void IRFunction_free(IRFunction *ir);
+
+#endif // IR
@@ -0,0 +1,452 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include <unistd.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "optimiser.h"
+#include "jitcode.h"
+#include "jitcache.h"
+
+/*
+ * Every cache file starts with this string, followed by:
+ *     int         the length of the key
+ *     char[]      the key, which is compared against the key of the function
+ *                 being loaded to rule out hash collisions
+ *     int         the number of compiled versions that follow - 1 for general
+ *                 code only, or 2 if a specialised version follows it
+ * and then for each compiled version:
+ *     int         the number of arguments
+ *     int[][2]    for each argument, whether it is guarded, and its value
+ *     int         the length of the code in bytes
+ *     byte[]      the code
+ *     int         the length of the cold code at the end of it (see ArrLen)
+ *     int         the number of jumps into the cold code
+ *     int[]       the offset of each jump's displacement
+ * Values are written in the byte order of the machine, as the code is specific
+ * to the machine anyway.
+ */
+#define JITCACHE_MAGIC "MINTYJIT"
+
+/*
+ * Cache files claiming to hold more code than this are taken to be corrupt
+ */
+#define JITCACHE_MAX_CODE_SIZE (16 * 1024 * 1024)
+
+/*
+ * The directory that the cache is stored in, or NULL if the cache is disabled
+ */
+static char *cache_directory = NULL;
+
+/*
+ * Sets the directory that the cache is stored in. The directory must already
+ * exist. Passing NULL disables the cache.
+ */
+void jitcache_set_directory(char *directory) {
+	free(cache_directory);
+	cache_directory = directory ? safe_strdup(directory) : NULL;
+}
+
+/*
+ * Returns true if a cache directory has been set
+ */
+bool jitcache_enabled() {
+	return cache_directory != NULL;
+}
+
+/*
+ * Appends a string to a key that is being built, freeing the old key
+ */
+static char *key_append(char *key, char *str) {
+	char *new_key = str_concat_2(key, str);
+	free(key);
+	return new_key;
+}
+
+/*
+ * Appends the decimal representation of an integer to a key
+ */
+static char *key_append_int(char *key, int value) {
+	char buffer[16];
+	sprintf(buffer, "%d", value);
+	return key_append(key, buffer);
+}
+
+static char *Statement_key(char *key, Statement *stmt);
+
+/*
+ * Appends the normalised form of an expression to a key. Variables are written
+ * as their stack offsets rather than their names, so that renaming a variable
+ * does not change the key. Called functions are written by name, as the code
+ * does not depend on what the callee does.
+ */
+static char *Expression_key(char *key, Expression *expr) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr:
+			key = key_append(key, "(");
+			key = Expression_key(key, expr->expr->blean->lhs);
+			key = key_append(key, " ");
+			key = key_append(key, Token_str(expr->expr->blean->op));
+			key = key_append(key, " ");
+			key = Expression_key(key, expr->expr->blean->rhs);
+			return key_append(key, ")");
+
+		case expr_ArithmeticExpr:
+			key = key_append(key, "(");
+			key = Expression_key(key, expr->expr->arith->lhs);
+			key = key_append(key, " ");
+			key = key_append(key, Token_str(expr->expr->arith->op));
+			key = key_append(key, " ");
+			key = Expression_key(key, expr->expr->arith->rhs);
+			return key_append(key, ")");
+
+		case expr_Identifier:
+			key = key_append(key, "$");
+			return key_append_int(key, expr->expr->ident->stack_offset);
+
+		case expr_IntegerLiteral:
+			return key_append_int(key, expr->expr->intgr);
+
+		case expr_FNCall: {
+			key = key_append(key, expr->expr->fncall->name);
+			key = key_append(key, "(");
+
+			LLIterator *args_iter = LLIterator_init(expr->expr->fncall->args);
+			while(!LLIterator_ended(args_iter)) {
+				key = Expression_key(key,
+					(Expression *)LLIterator_get_current(args_iter));
+				key = key_append(key, ",");
+				LLIterator_advance(args_iter);
+			}
+			free(args_iter);
+
+			return key_append(key, ")");
+		}
+
+		case expr_Ternary:
+			key = key_append(key, "(");
+			key = Expression_key(key, expr->expr->trnry->bool_expr);
+			key = key_append(key, " ? ");
+			key = Expression_key(key, expr->expr->trnry->true_expr);
+			key = key_append(key, " : ");
+			key = Expression_key(key, expr->expr->trnry->false_expr);
+			return key_append(key, ")");
+	}
+	printf("Invalid expression type given to Expression_key()\n");
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
+/*
+ * Appends the normalised form of a list of statements to a key
+ */
+static char *stmt_list_key(char *key, LinkedList *stmts) {
+	key = key_append(key, "{");
+
+	LLIterator *stmt_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmt_iter)) {
+		key = Statement_key(key, (Statement *)LLIterator_get_current(stmt_iter));
+		LLIterator_advance(stmt_iter);
+	}
+	free(stmt_iter);
+
+	return key_append(key, "}");
+}
+
+/*
+ * Appends the normalised form of a statement to a key
+ */
+static char *Statement_key(char *key, Statement *stmt) {
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			key = key_append(key, "for ");
+			key = Statement_key(key, stmt->stmt->_for->assignment);
+			key = Expression_key(key, stmt->stmt->_for->bool_expr);
+			key = key_append(key, "; ");
+			key = Statement_key(key, stmt->stmt->_for->incrementor);
+			return stmt_list_key(key, stmt->stmt->_for->stmts);
+
+		case stmt_While:
+			key = key_append(key, "while ");
+			key = Expression_key(key, stmt->stmt->_while->bool_expr);
+			return stmt_list_key(key, stmt->stmt->_while->stmts);
+
+		case stmt_If:
+			key = key_append(key, "if ");
+			key = Expression_key(key, stmt->stmt->_if->bool_expr);
+			key = stmt_list_key(key, stmt->stmt->_if->true_stmts);
+			key = key_append(key, "else");
+			return stmt_list_key(key, stmt->stmt->_if->false_stmts);
+
+		case stmt_Print:
+			key = key_append(key, "print ");
+			key = Expression_key(key, stmt->stmt->_print->expr);
+			return key_append(key, "; ");
+
+		case stmt_Assignment:
+			key = Expression_key(key, stmt->stmt->_assignment->ident);
+			key = key_append(key, " = ");
+			key = Expression_key(key, stmt->stmt->_assignment->expr);
+			return key_append(key, "; ");
+
+		case stmt_Return:
+			key = key_append(key, "return ");
+			key = Expression_key(key, stmt->stmt->_return->expr);
+			return key_append(key, "; ");
+	}
+	printf("Invalid statement type given to Statement_key()\n");
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
+/*
+ * Returns the key under which the code compiled from a function is cached: the
+ * JIT compiler version followed by the function's normalised AST. Functions
+ * that differ only in their name or the names of their variables have the same
+ * key, as the same code is compiled for them. The function's stack offsets
+ * must have been generated.
+ */
+char *jitcache_key(FNDecl *func) {
+	char *key = str_concat(2, JIT_VERSION, " fn(");
+	key = key_append_int(key, LinkedList_length(func->args));
+	key = key_append(key, ") vars ");
+	key = key_append_int(key, func->variable_count);
+	return stmt_list_key(key, func->stmts);
+}
+
+/*
+ * Returns the path of the cache file for the given key, which is named after
+ * the 64-bit FNV-1a hash of the key
+ */
+static char *cache_path(char *key) {
+	unsigned long hash = 14695981039346656037UL;
+	char *c;
+	for(c = key; *c; c++) {
+		hash ^= (unsigned char)*c;
+		hash *= 1099511628211UL;
+	}
+
+	char filename[32];
+	sprintf(filename, "/%016lx.mjc", hash);
+	return str_concat_2(cache_directory, filename);
+}
+
+/*
+ * Reads an int from a cache file, returning false if the file has ended
+ */
+static bool read_int(FILE *file, int *value) {
+	return fread(value, sizeof(int), 1, file) == 1;
+}
+
+/*
+ * Reads one compiled version of a function from a cache file. The guarded and
+ * values arrays must have space for one entry per argument. Returns NULL if the
+ * file does not contain a valid compiled version.
+ */
+static ArrLen *read_version(FILE *file, int arg_count,
+	bool *guarded, int *values) {
+
+	int stored_arg_count;
+	if(!read_int(file, &stored_arg_count) || stored_arg_count != arg_count) {
+		return NULL;
+	}
+
+	int i;
+	for(i = 0; i < arg_count; i++) {
+		int is_guarded;
+		if(!read_int(file, &is_guarded) || !read_int(file, &values[i])) {
+			return NULL;
+		}
+		guarded[i] = is_guarded;
+	}
+
+	int len;
+	if(!read_int(file, &len) || len <= 0 || len > JITCACHE_MAX_CODE_SIZE) {
+		return NULL;
+	}
+
+	byte *code = safe_alloc(len);
+	if(fread(code, 1, len, file) != len) {
+		free(code);
+		return NULL;
+	}
+	ArrLen *version = ArrLen_init(code, len);
+
+	// Then the length of the cold code at the end, and the jumps into it
+	int jump_count;
+	if(!read_int(file, &version->cold_len) || version->cold_len < 0 ||
+		version->cold_len >= len || !read_int(file, &jump_count) ||
+		jump_count < 0 || (jump_count > 0 && version->cold_len == 0)) {
+
+		ArrLen_free(version);
+		return NULL;
+	}
+	if(jump_count > 0) version->cold_jumps = LinkedList_init();
+	for(i = 0; i < jump_count; i++) {
+		int offset;
+		if(!read_int(file, &offset) || offset < 0 ||
+			offset > len - version->cold_len - 4) {
+
+			ArrLen_free(version);
+			return NULL;
+		}
+		LinkedList_append(version->cold_jumps, (void *)(long)offset);
+	}
+
+	return version;
+}
+
+/*
+ * Looks for code compiled from the given function in the cache, and if it is
+ * found, installs it as the function's compiled (and specialised) code so that
+ * the function does not have to be profiled and compiled again. The code is
+ * relocated to this process by building its constant pool. Returns true if code
+ * was loaded. A missing or invalid cache file is not an error - the function is
+ * then compiled as normal when it becomes hot.
+ */
+bool jitcache_load(FNDecl *func, Program *prog) {
+	if(!cache_directory) return false;
+	if(func->variable_count == -1) FNDecl_generate_offsets(func);
+
+	char *key = jitcache_key(func);
+	char *path = cache_path(key);
+	FILE *file = fopen(path, "rb");
+	free(path);
+	if(!file) {
+		free(key);
+		return false;
+	}
+
+	// Check that the file holds the code for this function
+	int key_len = strlen(key);
+	char magic[sizeof(JITCACHE_MAGIC)];
+	char *stored_key = safe_alloc(key_len + 1);
+	int stored_key_len;
+	bool valid =
+		fread(magic, 1, strlen(JITCACHE_MAGIC), file) ==
+			strlen(JITCACHE_MAGIC) &&
+		!memcmp(magic, JITCACHE_MAGIC, strlen(JITCACHE_MAGIC)) &&
+		read_int(file, &stored_key_len) &&
+		stored_key_len == key_len &&
+		fread(stored_key, 1, key_len, file) == key_len &&
+		!memcmp(stored_key, key, key_len);
+	free(stored_key);
+	free(key);
+
+	int version_count;
+	valid = valid && read_int(file, &version_count) &&
+		(version_count == 1 || version_count == 2);
+
+	// Read the general code, and the specialised code if there is any
+	int arg_count = LinkedList_length(func->args);
+	bool *guarded = safe_alloc(sizeof(bool) * (arg_count + 1));
+	int *values = safe_alloc(sizeof(int) * (arg_count + 1));
+	ArrLen *general = valid ?
+		read_version(file, arg_count, guarded, values) : NULL;
+	ArrLen *specialised = general && version_count == 2 ?
+		read_version(file, arg_count, guarded, values) : NULL;
+	fclose(file);
+
+	if(!general || (version_count == 2 && !specialised)) {
+		if(general) ArrLen_free(general);
+		free(guarded);
+		free(values);
+		return false;
+	}
+
+	// Install the code, relocating it by building its constant pool
+	func->compiled = JITFunction_init(general, func, prog);
+	ArrLen_free(general);
+
+	if(specialised) {
+		FNDecl *source = FNDecl_substitute_args(func, guarded, values);
+		FNDecl_generate_offsets(source);
+
+		func->specialised = JITFunction_init(specialised, source, prog);
+		func->specialised->owner = func;
+		func->specialised->source = source;
+		func->specialised->guarded = guarded;
+		func->specialised->guard_values = values;
+		ArrLen_free(specialised);
+	}
+	else {
+		free(guarded);
+		free(values);
+	}
+
+	return true;
+}
+
+/*
+ * Writes one compiled version of a function to a cache file
+ */
+static void write_version(FILE *file, JITFunction *jf, int arg_count) {
+	fwrite(&arg_count, sizeof(int), 1, file);
+
+	int i;
+	for(i = 0; i < arg_count; i++) {
+		int is_guarded = jf->guarded ? jf->guarded[i] : 0;
+		int value = jf->guard_values ? jf->guard_values[i] : 0;
+		fwrite(&is_guarded, sizeof(int), 1, file);
+		fwrite(&value, sizeof(int), 1, file);
+	}
+
+	// The code is stored as it was compiled, with the cold code after the rest
+	ArrLen *code = JITFunction_code(jf);
+	fwrite(&code->len, sizeof(int), 1, file);
+	fwrite(code->arr, 1, code->len, file);
+
+	int jump_count = code->cold_jumps ? LinkedList_length(code->cold_jumps) : 0;
+	fwrite(&code->cold_len, sizeof(int), 1, file);
+	fwrite(&jump_count, sizeof(int), 1, file);
+	for(i = 0; i < jump_count; i++) {
+		int offset = (int)(long)LinkedList_get(code->cold_jumps, i);
+		fwrite(&offset, sizeof(int), 1, file);
+	}
+	ArrLen_free(code);
+}
+
+/*
+ * Writes the compiled code of a function to the cache. The file is written
+ * under a temporary name and then renamed, so that a concurrent run never reads
+ * a partly written file. Failure to write to the cache is not an error.
+ */
+void jitcache_store(FNDecl *func) {
+	if(!cache_directory || !func->compiled) return;
+
+	char *key = jitcache_key(func);
+	char *path = cache_path(key);
+
+	char pid[16];
+	sprintf(pid, ".%d", (int)getpid());
+	char *temp_path = str_concat(2, path, pid);
+
+	FILE *file = fopen(temp_path, "wb");
+	if(file) {
+		int key_len = strlen(key);
+		int version_count = func->specialised ? 2 : 1;
+		int arg_count = LinkedList_length(func->args);
+
+		fwrite(JITCACHE_MAGIC, 1, strlen(JITCACHE_MAGIC), file);
+		fwrite(&key_len, sizeof(int), 1, file);
+		fwrite(key, 1, key_len, file);
+		fwrite(&version_count, sizeof(int), 1, file);
+		write_version(file, func->compiled, arg_count);
+		if(func->specialised) {
+			write_version(file, func->specialised, arg_count);
+		}
+
+		if(fclose(file) == 0) rename(temp_path, path);
+		else remove(temp_path);
+	}
+
+	free(key);
+	free(path);
+	free(temp_path);
+}
@@ -0,0 +1,34 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef JITCACHE
+#define JITCACHE
+
+/*
+ * The JIT cache stores the machine code compiled for functions on disk, so that
+ * a later run of a program can load the code for its hot functions instead of
+ * profiling and compiling them again. Each function is stored in its own file,
+ * named after a hash of the function's normalised AST and the JIT compiler
+ * version. The cache is disabled until a directory is set.
+ */
+
+void jitcache_set_directory(char *directory);
+
+bool jitcache_enabled();
+
+char *jitcache_key(FNDecl *func);
+
+bool jitcache_load(FNDecl *func, Program *prog);
+
+void jitcache_store(FNDecl *func);
+
+#endif // JITCACHE
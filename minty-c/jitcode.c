@@ -3,30 +3,95 @@
 #include <malloc.h>
 #include <string.h>
 #include <stdarg.h>
-#include <sys/mman.h>
+#include <stddef.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
 #include "minty_util.h"
 #include "token.h"
 #include "AST.h"
+#include "interpreter.h"
+#include "optimiser.h"
+#include "ir.h"
 #include "jitcode.h"
+#include "jitcache.h"
+#include "execmem.h"
+#include "perfmap.h"
+#include "gdbjit.h"
+#include "jitdebug.h"
+#include "trace.h"
+#include "stencil.h"
+#include "ccode.h"
+
+/*
+ * Compiled functions save %rbx, %r12 and %r13 below the saved %rbp, so
+ * variables are stored beneath these 24 bytes in the stack frame
+ */
+#define SAVED_REGISTERS_SIZE 24
 
 ArrLen *ArrLen_init(byte *arr, int len) {
 	ArrLen *al = (ArrLen *)malloc(sizeof(ArrLen));
 	al->arr = arr;
 	al->len = len;
+	al->marks = NULL;
+	al->cold_len = 0;
+	al->cold_jumps = NULL;
 	return al;
 }
 
+/*
+ * Copies the CodeMarks of one ArrLen into another, moving them along by the
+ * given number of bytes
+ */
+static void ArrLen_copy_marks(ArrLen *dest, ArrLen *src, int shift) {
+	if(!src->marks) return;
+	if(!dest->marks) dest->marks = LinkedList_init();
+
+	LLIterator *marks_iter = LLIterator_init(src->marks);
+	while(!LLIterator_ended(marks_iter)) {
+		CodeMark *mark = (CodeMark *)LLIterator_get_current(marks_iter);
+
+		CodeMark *copy = safe_alloc(sizeof(CodeMark));
+		copy->offset = mark->offset + shift;
+		copy->len = mark->len;
+		copy->stmt = mark->stmt;
+		copy->expr = mark->expr;
+		LinkedList_append(dest->marks, copy);
+
+		LLIterator_advance(marks_iter);
+	}
+	free(marks_iter);
+}
+
 ArrLen *ArrLen_copy(ArrLen *original) {
 	void *new_arr = malloc(original->len);
-	memcpy(new_arr, original->arr, original->len);
-	return ArrLen_init(new_arr, original->len);
+	if(original->len > 0) memcpy(new_arr, original->arr, original->len);
+	ArrLen *copy = ArrLen_init(new_arr, original->len);
+	ArrLen_copy_marks(copy, original, 0);
+
+	copy->cold_len = original->cold_len;
+	if(original->cold_jumps) {
+		copy->cold_jumps = LinkedList_init();
+		LLIterator *jumps_iter = LLIterator_init(original->cold_jumps);
+		while(!LLIterator_ended(jumps_iter)) {
+			LinkedList_append(copy->cold_jumps,
+				LLIterator_get_current(jumps_iter));
+			LLIterator_advance(jumps_iter);
+		}
+		free(jumps_iter);
+	}
+
+	return copy;
 }
 
 ArrLen *ArrLen_concat_2(ArrLen *al1, ArrLen *al2) {
 	void *new_mem = malloc(al1->len + al2->len);
-	memcpy(new_mem, al1->arr, al1->len);
-	memcpy(new_mem + al1->len, al2->arr, al2->len);
-	return ArrLen_init(new_mem, al1->len + al2->len);
+	if(al1->len > 0) memcpy(new_mem, al1->arr, al1->len);
+	if(al2->len > 0) memcpy(new_mem + al1->len, al2->arr, al2->len);
+	ArrLen *out = ArrLen_init(new_mem, al1->len + al2->len);
+	ArrLen_copy_marks(out, al1, 0);
+	ArrLen_copy_marks(out, al2, al1->len);
+	return out;
 }
 
 /*
@@ -53,6 +118,15 @@ void put_int_as_bytes(byte *buffer, int offset, int value) {
 		(byte)((value & 0xFF000000) >> 24);
 }
 
+/*
+ * Writes a 64-bit value into a byte buffer in the same way as
+ * put_int_as_bytes(), used for embedding addresses in machine code
+ */
+void put_long_as_bytes(byte *buffer, int offset, long value) {
+	put_int_as_bytes(buffer, offset, (int)(value & 0xFFFFFFFF));
+	put_int_as_bytes(buffer, offset + 4, (int)((value >> 32) & 0xFFFFFFFF));
+}
+
 ArrLen *ArrLen_concat(int count, ...) {
 
 	// If count is zero, there is nothing to do, return NULL as specified.
@@ -81,8 +155,7 @@ ArrLen *ArrLen_concat(int count, ...) {
 		ArrLen *temp = va_arg(args, ArrLen *);
 		ArrLen *temp_2 = ArrLen_concat_2(next_arrlen, temp);
 
-		free(next_arrlen->arr);
-		free(next_arrlen);
+		ArrLen_free(next_arrlen);
 		next_arrlen = temp_2;
 	}
 
@@ -91,7 +164,294 @@ ArrLen *ArrLen_concat(int count, ...) {
 	return next_arrlen;
 }
 
-ArrLen *jitcode_expression(Expression *expr, Program *prog) {
+/*
+ * Frees an ArrLen object along with the heap-allocated array and CodeMarks it
+ * contains
+ */
+void ArrLen_free(ArrLen *al) {
+	if(al->marks) {
+		LLMAP(al->marks, CodeMark *, free);
+		LinkedList_free(al->marks);
+	}
+	if(al->cold_jumps) LinkedList_free(al->cold_jumps);
+	free(al->arr);
+	free(al);
+}
+
+/*
+ * Marks all of the code in an ArrLen as having been generated for the given
+ * statement or expression (one of which should be NULL). The mark is put before
+ * any marks for nodes nested inside it.
+ */
+void ArrLen_mark(ArrLen *al, Statement *stmt, Expression *expr) {
+	CodeMark *mark = safe_alloc(sizeof(CodeMark));
+	mark->offset = 0;
+	mark->len = al->len;
+	mark->stmt = stmt;
+	mark->expr = expr;
+
+	LinkedList *marks = LinkedList_init();
+	LinkedList_append(marks, mark);
+	if(al->marks) {
+		LLIterator *marks_iter = LLIterator_init(al->marks);
+		while(!LLIterator_ended(marks_iter)) {
+			LinkedList_append(marks, LLIterator_get_current(marks_iter));
+			LLIterator_advance(marks_iter);
+		}
+		free(marks_iter);
+		LinkedList_free(al->marks);
+	}
+	al->marks = marks;
+}
+
+/*
+ * The following functions generate short machine code sequences that are used
+ * in several places by the compiler. They all return ArrLen objects with
+ * heap-allocated arrays, which should be freed with ArrLen_free().
+ */
+
+/*
+ * Loads a pointer from a slot of the constant pool into a register. The
+ * register is given by its number: 0 for %rax, 2 for %rdx, 6 for %rsi and 7 for
+ * %rdi.
+ */
+static ArrLen *jit_load_pool(byte reg, int slot) {
+	byte *opcode = malloc(sizeof(byte) * 7);
+
+	// movq <8 * slot>(%r13), <reg>
+	opcode[0] = (byte) 0x49;
+	opcode[1] = (byte) 0x8B;
+	opcode[2] = (byte) (0x85 | (reg << 3));
+	put_int_as_bytes(opcode, 3, 8 * slot);
+
+	return ArrLen_init(opcode, sizeof(byte) * 7);
+}
+
+/*
+ * Calls the C function in the given constant pool slot. Code inside
+ * expressions pushes intermediate values, so the stack pointer may not be
+ * aligned to 16 bytes as the C calling convention requires. The stack pointer
+ * is therefore saved in %r12 (which the callee must preserve), aligned for the
+ * call, and restored afterwards. Arguments must already be in the argument
+ * registers, and the result is left in %eax.
+ */
+static ArrLen *jit_call_c_function(int slot) {
+	ArrLen *load = jit_load_pool(0, slot);
+
+	byte instr[12] = {
+
+		// movq %rsp, %r12
+		0x49, 0x89, 0xE4,
+
+		// andq $-16, %rsp
+		0x48, 0x83, 0xE4, 0xF0,
+
+		// call *%rax
+		0xFF, 0xD0,
+
+		// movq %r12, %rsp
+		0x4C, 0x89, 0xE4
+	};
+	ArrLen *arrlen_instr = ArrLen_init(&(instr[0]), 12);
+
+	ArrLen *out = ArrLen_concat_2(load, arrlen_instr);
+
+	ArrLen_free(load);
+	free(arrlen_instr);
+
+	return out;
+}
+
+/*
+ * Moves a variable's value between %eax and its slot in the stack frame of a
+ * compiled function. The opcode should be 0x8B to load the variable into %eax,
+ * or 0x89 to store %eax into the variable.
+ */
+static ArrLen *jit_variable_access(byte opcode, Identifier *ident) {
+
+	// The stack offsets must have been generated for us to know where the
+	// variable lives
+	if(ident->stack_offset < 0) {
+		printf("Identifier '%s' has no stack offset - cannot jit\n",
+			ident->name);
+		exit(EXIT_FAILURE);
+	}
+
+	byte *instr = malloc(sizeof(byte) * 6);
+
+	// movl <disp>(%rbp), %eax  OR  movl %eax, <disp>(%rbp)
+	instr[0] = opcode;
+	instr[1] = (byte) 0x85;
+	put_int_as_bytes(instr, 2,
+		-(SAVED_REGISTERS_SIZE + ident->stack_offset + 4));
+
+	return ArrLen_init(instr, sizeof(byte) * 6);
+}
+
+/*
+ * Returns from a compiled function, leaving the value in %eax as the return
+ * value. Restores the registers saved by the prologue generated in
+ * jitcode_function().
+ */
+static ArrLen *jit_epilogue() {
+	byte *instr = malloc(sizeof(byte) * 11);
+
+	byte epilogue[11] = {
+
+		// leaq -24(%rbp), %rsp
+		0x48, 0x8D, 0x65, 0xE8,
+
+		// popq %r13
+		0x41, 0x5D,
+
+		// popq %r12
+		0x41, 0x5C,
+
+		// popq %rbx
+		0x5B,
+
+		// popq %rbp
+		0x5D,
+
+		// ret
+		0xC3
+	};
+	memcpy(instr, epilogue, sizeof(byte) * 11);
+
+	return ArrLen_init(instr, sizeof(byte) * 11);
+}
+
+/*
+ * Carries out a function call from compiled code, given the argument values. If
+ * the callee could not be found when the call was compiled, it is looked up
+ * now, which raises the same error as the interpreter would.
+ */
+static int jit_call_values(FNCall *call, FNDecl *callee, Program *prog,
+	LinkedList *arg_vals) {
+
+	if(!callee) callee = Program_get_FNDecl(prog, call->name);
+
+	// Record the argument values for value specialisation, then hand the call
+	// to the interpreter, which will run the callee's compiled code if it has
+	// any
+	profile_arguments(callee, arg_vals);
+	return interpret_function(callee, arg_vals, prog);
+}
+
+/*
+ * Called by compiled code to carry out a function call. The arguments have been
+ * evaluated and pushed onto the stack in order, so the last argument is at
+ * pushed_args[0].
+ */
+static int jit_call(FNCall *call, FNDecl *callee, Program *prog,
+	long *pushed_args) {
+
+	// Build the argument list that the interpreter expects
+	int arg_count = LinkedList_length(call->args);
+	LinkedList *arg_vals = LinkedList_init();
+	int i;
+	for(i = arg_count - 1; i >= 0; i--) {
+		LinkedList_append(arg_vals, (void *)(long)(int)pushed_args[i]);
+	}
+
+	int result = jit_call_values(call, callee, prog, arg_vals);
+
+	LinkedList_free(arg_vals);
+	return result;
+}
+
+/*
+ * Called by code compiled from stencils (see stencil.h) to carry out a function
+ * call. The arguments have been evaluated into consecutive slots of the
+ * caller's frame, the first of which args points to.
+ */
+static int jit_call_frame(FNCall *call, FNDecl *callee, Program *prog,
+	int *args) {
+
+	int arg_count = LinkedList_length(call->args);
+	LinkedList *arg_vals = LinkedList_init();
+	int i;
+	for(i = 0; i < arg_count; i++) {
+		LinkedList_append(arg_vals, (void *)(long)args[i]);
+	}
+
+	int result = jit_call_values(call, callee, prog, arg_vals);
+
+	LinkedList_free(arg_vals);
+	return result;
+}
+
+/*
+ * Called by compiled code to execute a print statement
+ */
+static void jit_print(int value) {
+	printf("%d\n", value);
+}
+
+/*
+ * Called by compiled code when the end of a function is reached without a
+ * return statement
+ */
+static void jit_missing_return(FNDecl *func) {
+	printf("Reached end of function '%s' without return statement\n",
+		func->name);
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Calls jit_call(call, callee, prog, pushed_args) for a call site whose
+ * arguments have been pushed, so that they are at the top of the stack, and
+ * pops them afterwards. The call site must have been numbered so that we know
+ * where its pool slots are.
+ */
+static ArrLen *jit_call_site(FNCall *fncall, int arg_count) {
+	int call_index = fncall->call_index;
+	if(call_index < 0) {
+		printf("Call to '%s' has no call index - cannot jit\n", fncall->name);
+		exit(EXIT_FAILURE);
+	}
+	ArrLen *load_call = jit_load_pool(7, POOL_CALL_SITE(call_index));
+	ArrLen *load_callee = jit_load_pool(6, POOL_CALLEE(call_index));
+	ArrLen *load_prog = jit_load_pool(2, POOL_PROGRAM);
+
+	// movq %rsp, %rcx
+	byte instr1[3] = { 0x48, 0x89, 0xE1 };
+	ArrLen *arrlen_instr1 = ArrLen_init(&(instr1[0]), 3);
+
+	ArrLen *call = jit_call_c_function(POOL_JIT_CALL);
+
+	// addq $<8 * arg_count>, %rsp (pops the arguments)
+	byte instr2[7] = { 0x48, 0x81, 0xC4, 0x00, 0x00, 0x00, 0x00 };
+	put_int_as_bytes(instr2, 3, 8 * arg_count);
+	ArrLen *arrlen_instr2 = ArrLen_init(&(instr2[0]), 7);
+
+	ArrLen *out = ArrLen_concat(6,
+		load_call,
+		load_callee,
+		load_prog,
+		arrlen_instr1,
+		call,
+		arrlen_instr2
+	);
+
+	ArrLen_free(load_call);
+	ArrLen_free(load_callee);
+	ArrLen_free(load_prog);
+	free(arrlen_instr1);
+	ArrLen_free(call);
+	free(arrlen_instr2);
+
+	return out;
+}
+
+/*
+ * Generates machine code for an expression. The result of the expression is
+ * left in %eax. Identifiers refer to variables in the stack frame set up by
+ * jitcode_function(), and calls use the constant pool that it loads, so
+ * expressions that contain identifiers or calls can only be compiled as part of
+ * a function.
+ */
+static ArrLen *jitcode_expression_contents(Expression *expr, Program *prog) {
 
 	switch(expr->type) {
 
@@ -106,32 +466,32 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 			// Store the appropriate opcode
 			if(expr->expr->blean->op == EQUAL) {
 				// cmove %edx, %ecx
-				byte opc[3] = { 0x0F, 0x44, 0xCA };
+				static byte opc[3] = { 0x0F, 0x44, 0xCA };
 				opcode = ArrLen_init(&(opc[0]), 3);
 			}
 			else if(expr->expr->blean->op == NOT_EQUAL) {
 				// cmovne %edx, %ecx
-				byte opc[3] = { 0x0F, 0x45, 0xCA };
+				static byte opc[3] = { 0x0F, 0x45, 0xCA };
 				opcode = ArrLen_init(&(opc[0]), 3);
 			}
 			else if(expr->expr->blean->op == LESS_THAN) {
 				// cmovl %edx, %ecx
-				byte opc[3] = { 0x0F, 0x4C, 0xCA };
+				static byte opc[3] = { 0x0F, 0x4C, 0xCA };
 				opcode = ArrLen_init(&(opc[0]), 3);
 			}
 			else if(expr->expr->blean->op == LESS_OR_EQUAL) {
 				// cmovle %edx, %ecx
-				byte opc[3] = { 0x0F, 0x4E, 0xCA };
+				static byte opc[3] = { 0x0F, 0x4E, 0xCA };
 				opcode = ArrLen_init(&(opc[0]), 3);
 			}
 			else if(expr->expr->blean->op == GREATER_THAN) {
 				// cmovg %edx, %ecx
-				byte opc[3] = { 0x0F, 0x4F, 0xCA };
+				static byte opc[3] = { 0x0F, 0x4F, 0xCA };
 				opcode = ArrLen_init(&(opc[0]), 3);
 			}
 			else if(expr->expr->blean->op == GREATER_OR_EQUAL) {
 				// cmovge %edx, %ecx
-				byte opc[3] = { 0x0F, 0x4D, 0xCA };
+				static byte opc[3] = { 0x0F, 0x4D, 0xCA };
 				opcode = ArrLen_init(&(opc[0]), 3);
 			}
 			else {
@@ -186,11 +546,9 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 
 			// We can free lhs and rhs as their contents are copied into out by
 			// str_concat
-			free(lhs->arr);
-			free(lhs);
+			ArrLen_free(lhs);
 			free(arrlen_instr1);
-			free(rhs->arr);
-			free(rhs);
+			ArrLen_free(rhs);
 			free(arrlen_instr2);
 			free(opcode);
 			free(arrlen_instr3);
@@ -210,27 +568,36 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 			// Store the appropriate opcode
 			if(expr->expr->arith->op == PLUS) {
 				// addl %ebx, %eax
-				byte opc[2] = { 0x01, 0xD8 };
+				static byte opc[2] = { 0x01, 0xD8 };
 				opcode = ArrLen_init(&(opc[0]), 2);
 			}
 			else if(expr->expr->arith->op == MINUS) {
 				// subl %ebx, %eax
-				byte opc[2] = { 0x29, 0xD8 };
+				static byte opc[2] = { 0x29, 0xD8 };
 				opcode = ArrLen_init(&(opc[0]), 2);
 			}
 			else if(expr->expr->arith->op == MULTIPLY) {
 				// imull %ebx
-				byte opc[2] = { 0xF7, 0xEB };
+				static byte opc[2] = { 0xF7, 0xEB };
 				opcode = ArrLen_init(&(opc[0]), 2);
 			}
 			else if(expr->expr->arith->op == DIVIDE) {
-				// idivl %ebx
-				byte opc[2] = { 0xF7, 0xFB };
-				opcode = ArrLen_init(&(opc[0]), 2);
+				static byte opc[3] = {
+
+					// cltd (sign-extend %eax into %edx for the division)
+					0x99,
+
+					// idivl %ebx
+					0xF7, 0xFB };
+
+				opcode = ArrLen_init(&(opc[0]), 3);
 			}
 			else if(expr->expr->arith->op == MODULO) {
 				
-				byte opc[4] = { 
+				static byte opc[5] = { 
+
+					// cltd
+					0x99,
 					
 					// idivl %ebx
 					0xF7, 0xFB, 
@@ -238,7 +605,7 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 					// movl %edx, %eax
 					0x89, 0xD0 };
 
-				opcode = ArrLen_init(&(opc[0]), 4);
+				opcode = ArrLen_init(&(opc[0]), 5);
 			}
 			else {
 				printf("Invalid arithmetic operation type in AST\n");
@@ -275,11 +642,9 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 
 			// We can free lhs and rhs as their contents are copied into out by
 			// str_concat
-			free(lhs->arr);
-			free(lhs);
+			ArrLen_free(lhs);
 			free(arrlen_instr1);
-			free(rhs->arr);
-			free(rhs);
+			ArrLen_free(rhs);
 			free(arrlen_instr2);
 			free(opcode);
 
@@ -288,8 +653,8 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 		}
 
 		case expr_Identifier: {
-			printf("Identifier jit not yet implemented");
-			exit(EXIT_FAILURE);
+			// movl <disp>(%rbp), %eax
+			return jit_variable_access(0x8B, expr->expr->ident);
 		}
 
 		case expr_IntegerLiteral: {
@@ -304,8 +669,38 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 		}
 
 		case expr_FNCall: {
-			printf("Function call jit not yet implemented");
-			exit(EXIT_FAILURE);
+
+			// Evaluate each argument in order, pushing each result
+			ArrLen *out = ArrLen_init(NULL, 0);
+			int arg_count = 0;
+
+			LLIterator *args_iter = LLIterator_init(expr->expr->fncall->args);
+			while(!LLIterator_ended(args_iter)) {
+
+				ArrLen *next_arg = jitcode_expression(
+					(Expression *)LLIterator_get_current(args_iter), prog);
+
+				// pushq %rax
+				byte push[1] = { 0x50 };
+				ArrLen *arrlen_push = ArrLen_init(&(push[0]), 1);
+
+				ArrLen *temp = ArrLen_concat(3, out, next_arg, arrlen_push);
+				ArrLen_free(out);
+				ArrLen_free(next_arg);
+				free(arrlen_push);
+				out = temp;
+
+				arg_count++;
+				LLIterator_advance(args_iter);
+			}
+			free(args_iter);
+
+			ArrLen *call = jit_call_site(expr->expr->fncall, arg_count);
+			ArrLen *temp = ArrLen_concat_2(out, call);
+			ArrLen_free(out);
+			ArrLen_free(call);
+
+			return temp;
 		}
 
 		case expr_Ternary: {
@@ -385,14 +780,11 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 				f_exp
 			);
 
-			free(b_exp->arr);
-			free(b_exp);
+			ArrLen_free(b_exp);
 			free(arrlen_instr1);
-			free(t_exp->arr);
-			free(t_exp);
+			ArrLen_free(t_exp);
 			free(arrlen_instr2);
-			free(f_exp->arr);
-			free(f_exp);
+			ArrLen_free(f_exp);
 
 			return out;
 		}
@@ -402,32 +794,1811 @@ ArrLen *jitcode_expression(Expression *expr, Program *prog) {
 	return NULL;
 }
 
-int jitexec_expression(ArrLen *expr_code) {
+/*
+ * Generates machine code for an expression (see jitcode_expression_contents()).
+ * When JIT debugging is enabled the code is marked as belonging to the
+ * expression, so that it can be listed alongside it.
+ */
+ArrLen *jitcode_expression(Expression *expr, Program *prog) {
+	ArrLen *out = jitcode_expression_contents(expr, prog);
+	if(jitdebug_enabled()) ArrLen_mark(out, NULL, expr);
+	return out;
+}
 
-	// Map the appropriate amount of writeable, executable memory, so we can
-	// write the code in place and jump to it. We ask for space 1 greater than
-	// the length of the given code so that we can include the return operation,
-	// which is one byte long
-	void *jit_memory = mmap(NULL, expr_code->len + sizeof(byte),
-		PROT_WRITE | PROT_EXEC,	MAP_ANON | MAP_PRIVATE, -1, 0);
+/*
+ * Generates machine code for a list of statements, by concatenating the code
+ * for each statement
+ */
+ArrLen *jitcode_statement_list(LinkedList *stmts, Program *prog) {
+	ArrLen *out = ArrLen_init(NULL, 0);
 
-	// Write the code in place
-	memcpy(jit_memory, expr_code->arr, expr_code->len);
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter)) {
+		ArrLen *next_stmt = jitcode_statement(
+			(Statement *)LLIterator_get_current(stmts_iter), prog);
 
-	// The return operation
-	byte ret = (byte) 0xC3; // ret
+		ArrLen *temp = ArrLen_concat_2(out, next_stmt);
+		ArrLen_free(out);
+		ArrLen_free(next_stmt);
+		out = temp;
 
-	// Write the return operation in place
-	memcpy(jit_memory + expr_code->len, &ret, sizeof(byte));
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
 
-	// Declare the mapped memory as a function so we can jump to it
-	int (*jitexec)() = jit_memory;
-	
-	// Call the function we have created
-	int result = (*jitexec)();
+	return out;
+}
 
-	// Free the memory that we mapped
-	munmap(jit_memory, expr_code->len + sizeof(byte));
+/*
+ * Generates machine code for a statement within a function compiled by
+ * jitcode_function(). Variables live in the function's stack frame, so nesting
+ * levels need no special handling: a variable simply keeps its slot for the
+ * whole function.
+ *
+ * As with ternary expressions, jumps are relative, so each jump's distance is
+ * calculated from the lengths of the ArrLen objects it jumps over. A jump
+ * backwards has a negative distance that also includes the length of the jump
+ * instruction itself.
+ */
+static ArrLen *jitcode_statement_contents(Statement *stmt, Program *prog) {
 
-	return result;
+	switch(stmt->type) {
+
+		case stmt_For: {
+
+			// Generate code for each part of the for-loop
+			ArrLen *assignment = jitcode_statement(
+				stmt->stmt->_for->assignment, prog);
+			ArrLen *b_exp = jitcode_expression(
+				stmt->stmt->_for->bool_expr, prog);
+			ArrLen *stmts = jitcode_statement_list(
+				stmt->stmt->_for->stmts, prog);
+			ArrLen *incrementor = jitcode_statement(
+				stmt->stmt->_for->incrementor, prog);
+
+			// assignment goes here
+
+			// for_begin:
+			// b_exp goes here
+
+			byte instr1[9] = {
+
+				// cmpl $0, %eax
+				0x83, 0xF8, 0x00,
+
+				// je for_end
+				0x0F, 0x84, 0x00, 0x00, 0x00, 0x00
+			};
+
+			// Jump over the body, the incrementor and the jump back
+			put_int_as_bytes(instr1, 5,
+				stmts->len + incrementor->len + (sizeof(byte) * 5));
+			ArrLen *arrlen_instr1 = ArrLen_init(&(instr1[0]), 9);
+
+			// stmts goes here
+			// incrementor goes here
+
+			// jmp for_begin
+			byte instr2[5] = { 0xE9, 0x00, 0x00, 0x00, 0x00 };
+			put_int_as_bytes(instr2, 1, -(b_exp->len + arrlen_instr1->len +
+				stmts->len + incrementor->len + (sizeof(byte) * 5)));
+			ArrLen *arrlen_instr2 = ArrLen_init(&(instr2[0]), 5);
+
+			// for_end:
+
+			ArrLen *out = ArrLen_concat(6,
+				assignment,
+				b_exp,
+				arrlen_instr1,
+				stmts,
+				incrementor,
+				arrlen_instr2
+			);
+
+			ArrLen_free(assignment);
+			ArrLen_free(b_exp);
+			free(arrlen_instr1);
+			ArrLen_free(stmts);
+			ArrLen_free(incrementor);
+			free(arrlen_instr2);
+
+			return out;
+		}
+
+		case stmt_While: {
+
+			// Generate code for the boolean expression and the loop body
+			ArrLen *b_exp = jitcode_expression(
+				stmt->stmt->_while->bool_expr, prog);
+			ArrLen *stmts = jitcode_statement_list(
+				stmt->stmt->_while->stmts, prog);
+
+			// while_begin:
+			// b_exp goes here
+
+			byte instr1[9] = {
+
+				// cmpl $0, %eax
+				0x83, 0xF8, 0x00,
+
+				// je while_end
+				0x0F, 0x84, 0x00, 0x00, 0x00, 0x00
+			};
+
+			// Jump over the body and the jump back
+			put_int_as_bytes(instr1, 5, stmts->len + (sizeof(byte) * 5));
+			ArrLen *arrlen_instr1 = ArrLen_init(&(instr1[0]), 9);
+
+			// stmts goes here
+
+			// jmp while_begin
+			byte instr2[5] = { 0xE9, 0x00, 0x00, 0x00, 0x00 };
+			put_int_as_bytes(instr2, 1, -(b_exp->len + arrlen_instr1->len +
+				stmts->len + (sizeof(byte) * 5)));
+			ArrLen *arrlen_instr2 = ArrLen_init(&(instr2[0]), 5);
+
+			// while_end:
+
+			ArrLen *out = ArrLen_concat(4,
+				b_exp,
+				arrlen_instr1,
+				stmts,
+				arrlen_instr2
+			);
+
+			ArrLen_free(b_exp);
+			free(arrlen_instr1);
+			ArrLen_free(stmts);
+			free(arrlen_instr2);
+
+			return out;
+		}
+
+		case stmt_If: {
+
+			// Generate code for the boolean expression and both branches
+			ArrLen *b_exp = jitcode_expression(
+				stmt->stmt->_if->bool_expr, prog);
+			ArrLen *t_stmts = jitcode_statement_list(
+				stmt->stmt->_if->true_stmts, prog);
+			ArrLen *f_stmts = jitcode_statement_list(
+				stmt->stmt->_if->false_stmts, prog);
+
+			// b_exp goes here
+
+			byte instr1[9] = {
+
+				// cmpl $0, %eax
+				0x83, 0xF8, 0x00,
+
+				// je else_branch
+				0x0F, 0x84, 0x00, 0x00, 0x00, 0x00
+			};
+
+			// Jump over the true statements and the jump that follows them
+			put_int_as_bytes(instr1, 5, t_stmts->len + (sizeof(byte) * 5));
+			ArrLen *arrlen_instr1 = ArrLen_init(&(instr1[0]), 9);
+
+			// t_stmts goes here
+
+			// jmp if_end
+			byte instr2[5] = { 0xE9, 0x00, 0x00, 0x00, 0x00 };
+			put_int_as_bytes(instr2, 1, f_stmts->len);
+			ArrLen *arrlen_instr2 = ArrLen_init(&(instr2[0]), 5);
+
+			// else_branch:
+			// f_stmts goes here
+
+			// if_end:
+
+			ArrLen *out = ArrLen_concat(5,
+				b_exp,
+				arrlen_instr1,
+				t_stmts,
+				arrlen_instr2,
+				f_stmts
+			);
+
+			ArrLen_free(b_exp);
+			free(arrlen_instr1);
+			ArrLen_free(t_stmts);
+			free(arrlen_instr2);
+			ArrLen_free(f_stmts);
+
+			return out;
+		}
+
+		case stmt_Print: {
+
+			// Evaluate the expression into %eax
+			ArrLen *expr = jitcode_expression(stmt->stmt->_print->expr, prog);
+
+			// movl %eax, %edi (the argument to jit_print)
+			byte instr1[2] = { 0x89, 0xC7 };
+			ArrLen *arrlen_instr1 = ArrLen_init(&(instr1[0]), 2);
+
+			ArrLen *call = jit_call_c_function(POOL_JIT_PRINT);
+
+			ArrLen *out = ArrLen_concat(3, expr, arrlen_instr1, call);
+
+			ArrLen_free(expr);
+			free(arrlen_instr1);
+			ArrLen_free(call);
+
+			return out;
+		}
+
+		case stmt_Assignment: {
+
+			// Evaluate the expression into %eax, then store it in the
+			// variable's slot
+			ArrLen *expr = jitcode_expression(
+				stmt->stmt->_assignment->expr, prog);
+			ArrLen *store = jit_variable_access(0x89,
+				stmt->stmt->_assignment->ident->expr->ident);
+
+			ArrLen *out = ArrLen_concat_2(expr, store);
+
+			ArrLen_free(expr);
+			ArrLen_free(store);
+
+			return out;
+		}
+
+		case stmt_Return: {
+
+			// Evaluate the expression into %eax, then return
+			ArrLen *expr = jitcode_expression(stmt->stmt->_return->expr, prog);
+			ArrLen *epilogue = jit_epilogue();
+
+			ArrLen *out = ArrLen_concat_2(expr, epilogue);
+
+			ArrLen_free(expr);
+			ArrLen_free(epilogue);
+
+			return out;
+		}
+	}
+	printf("Invalid statement type in AST\n");
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
+/*
+ * Generates machine code for a statement (see jitcode_statement_contents()),
+ * marking the code as belonging to the statement
+ */
+ArrLen *jitcode_statement(Statement *stmt, Program *prog) {
+	ArrLen *out = jitcode_statement_contents(stmt, prog);
+	ArrLen_mark(out, stmt, NULL);
+	return out;
+}
+
+/*
+ * The following functions generate machine code for a function from its SSA
+ * form (see ir.h). Every value has its own 4 byte slot in the stack frame,
+ * below the saved registers, and values are loaded into registers only for the
+ * instructions that use them. Constants are not given code of their own, but
+ * are loaded as immediates wherever they are used.
+ */
+
+/*
+ * Returns the offset from %rbp of the stack slot holding a value
+ */
+static int jit_value_slot(IRValue *value) {
+	return -(SAVED_REGISTERS_SIZE + (4 * (value->id + 1)));
+}
+
+/*
+ * Returns an ArrLen holding a copy of the given bytes
+ */
+static ArrLen *jit_bytes(int count, ...) {
+	byte *instr = malloc(sizeof(byte) * (count + 1));
+
+	va_list bytes;
+	va_start(bytes, count);
+	int i;
+	for(i = 0; i < count; i++) instr[i] = (byte) va_arg(bytes, int);
+	va_end(bytes);
+
+	return ArrLen_init(instr, count);
+}
+
+/*
+ * Appends code to the end of out, freeing both, and returns the result
+ */
+static ArrLen *jit_append(ArrLen *out, ArrLen *code) {
+	ArrLen *temp = ArrLen_concat_2(out, code);
+	ArrLen_free(out);
+	ArrLen_free(code);
+	return temp;
+}
+
+/*
+ * Loads a value into a register, given by its number: usually %eax (reg 0) or
+ * %ecx (reg 1), or an argument register for a direct call. Registers from %r8d
+ * up need a REX prefix. When JIT debugging, the load of a constant is marked
+ * with the expression it was produced for.
+ */
+static ArrLen *jit_load_value(IRValue *value, byte reg) {
+	byte *instr = malloc(sizeof(byte) * 7);
+	int rex = reg >= 8 ? 1 : 0;
+
+	if(value->op == ir_Constant) {
+		// movl $<value>, <reg>
+		if(rex) instr[0] = (byte) 0x41;
+		instr[rex] = (byte) (0xB8 + (reg & 7));
+		put_int_as_bytes(instr, rex + 1, value->value);
+		ArrLen *out = ArrLen_init(instr, rex + 5);
+		if(value->expr && jitdebug_enabled()) {
+			ArrLen_mark(out, NULL, value->expr);
+		}
+		return out;
+	}
+
+	// movl <slot>(%rbp), <reg>
+	if(rex) instr[0] = (byte) 0x44;
+	instr[rex] = (byte) 0x8B;
+	instr[rex + 1] = (byte) (0x85 | ((reg & 7) << 3));
+	put_int_as_bytes(instr, rex + 2, jit_value_slot(value));
+	return ArrLen_init(instr, rex + 6);
+}
+
+/*
+ * Stores a register, given by its number as for jit_load_value(), into a
+ * value's slot
+ */
+static ArrLen *jit_store_register(IRValue *value, byte reg) {
+	byte *instr = malloc(sizeof(byte) * 7);
+	int rex = reg >= 8 ? 1 : 0;
+
+	// movl <reg>, <slot>(%rbp)
+	if(rex) instr[0] = (byte) 0x44;
+	instr[rex] = (byte) 0x89;
+	instr[rex + 1] = (byte) (0x85 | ((reg & 7) << 3));
+	put_int_as_bytes(instr, rex + 2, jit_value_slot(value));
+	return ArrLen_init(instr, rex + 6);
+}
+
+/*
+ * Stores %eax into a value's slot
+ */
+static ArrLen *jit_store_value(IRValue *value) {
+	return jit_store_register(value, 0);
+}
+
+/*
+ * The registers that the first JIT_REGISTER_ARGS arguments of a direct call
+ * are passed in: %edi, %esi, %edx, %ecx, %r8d and %r9d
+ */
+static byte jit_arg_registers[JIT_REGISTER_ARGS] = { 7, 6, 2, 1, 8, 9 };
+
+/*
+ * Generates a call. If the callee has optimised code that is not specialised,
+ * and has been called fewer times than the C tier's limit (see
+ * ccode_call_limit()), the code is called directly at its internal entry point
+ * (see JIT_DIRECT_ENTRY), counting the call and marking the code as running so
+ * that it is not evicted. Otherwise the call is handed to the interpreter
+ * through jit_call_site(), which does everything else that a call can need:
+ * compiling the callee, checking a specialisation's guard, or running the C
+ * tier's code. The callee's JITFunction is kept in %rbx over a direct call.
+ */
+static ArrLen *jit_call_value(IRValue *value) {
+	int call_index = value->call->call_index;
+	if(call_index < 0) {
+		printf("Call to '%s' has no call index - cannot jit\n",
+			value->call->name);
+		exit(EXIT_FAILURE);
+	}
+	int slow_jumps[4];
+
+	// movq <callee>, %rax; testq %rax, %rax; je <slow>
+	ArrLen *out = jit_load_pool(0, POOL_CALLEE(call_index));
+	out = jit_append(out,
+		jit_bytes(9, 0x48, 0x85, 0xC0, 0x0F, 0x84, 0, 0, 0, 0));
+	slow_jumps[0] = out->len - 4;
+
+	// movq <compiled>(%rax), %rbx; testq %rbx, %rbx; je <slow>
+	ArrLen *check = jit_bytes(16, 0x48, 0x8B, 0x98, 0, 0, 0, 0,
+		0x48, 0x85, 0xDB, 0x0F, 0x84, 0, 0, 0, 0);
+	put_int_as_bytes(check->arr, 3, offsetof(FNDecl, compiled));
+	out = jit_append(out, check);
+	slow_jumps[1] = out->len - 4;
+
+	// cmpq $0, <specialised>(%rax); jne <slow>
+	check = jit_bytes(14, 0x48, 0x83, 0xB8, 0, 0, 0, 0, 0,
+		0x0F, 0x85, 0, 0, 0, 0);
+	put_int_as_bytes(check->arr, 3, offsetof(FNDecl, specialised));
+	out = jit_append(out, check);
+	slow_jumps[2] = out->len - 4;
+
+	// movl <exec_count>(%rax), %ecx; movq <limit>, %rdx; cmpl (%rdx), %ecx;
+	// jge <slow>
+	check = jit_bytes(6, 0x8B, 0x88, 0, 0, 0, 0);
+	put_int_as_bytes(check->arr, 2, offsetof(FNDecl, exec_count));
+	out = jit_append(out, check);
+	out = jit_append(out, jit_load_pool(2, POOL_CALL_LIMIT));
+	out = jit_append(out, jit_bytes(8, 0x3B, 0x0A, 0x0F, 0x8D, 0, 0, 0, 0));
+	slow_jumps[3] = out->len - 4;
+
+	// incl <exec_count>(%rax); incl <running>(%rbx); incq <executions>(%rbx)
+	ArrLen *count = jit_bytes(19, 0xFF, 0x80, 0, 0, 0, 0, 0xFF, 0x83, 0, 0,
+		0, 0, 0x48, 0xFF, 0x83, 0, 0, 0, 0);
+	put_int_as_bytes(count->arr, 2, offsetof(FNDecl, exec_count));
+	put_int_as_bytes(count->arr, 8, offsetof(JITFunction, running));
+	put_int_as_bytes(count->arr, 15, offsetof(JITFunction, executions));
+	out = jit_append(out, count);
+
+	// Push the arguments that do not fit in registers, last first, then load
+	// the rest into their registers
+	int i;
+	for(i = value->arg_count - 1; i >= JIT_REGISTER_ARGS; i--) {
+
+		// pushq %rax
+		out = jit_append(out, jit_load_value(value->args[i], 0));
+		out = jit_append(out, jit_bytes(1, 0x50));
+	}
+	for(i = 0; i < value->arg_count && i < JIT_REGISTER_ARGS; i++) {
+		out = jit_append(out,
+			jit_load_value(value->args[i], jit_arg_registers[i]));
+	}
+
+	// movq <pool>(%rbx), %r10; movq <code>(%rbx), %rax;
+	// addq $JIT_DIRECT_ENTRY, %rax; call *%rax
+	ArrLen *call = jit_bytes(20, 0x4C, 0x8B, 0x93, 0, 0, 0, 0,
+		0x48, 0x8B, 0x83, 0, 0, 0, 0, 0x48, 0x83, 0xC0, JIT_DIRECT_ENTRY,
+		0xFF, 0xD0);
+	put_int_as_bytes(call->arr, 3, offsetof(JITFunction, pool));
+	put_int_as_bytes(call->arr, 10, offsetof(JITFunction, code));
+	out = jit_append(out, call);
+
+	// addq $<8 * stack arguments>, %rsp
+	if(value->arg_count > JIT_REGISTER_ARGS) {
+		ArrLen *pop = jit_bytes(7, 0x48, 0x81, 0xC4, 0, 0, 0, 0);
+		put_int_as_bytes(pop->arr, 3,
+			8 * (value->arg_count - JIT_REGISTER_ARGS));
+		out = jit_append(out, pop);
+	}
+
+	// decl <running>(%rbx); jmp <done>
+	ArrLen *finish = jit_bytes(11, 0xFF, 0x8B, 0, 0, 0, 0, 0xE9, 0, 0, 0, 0);
+	put_int_as_bytes(finish->arr, 2, offsetof(JITFunction, running));
+	out = jit_append(out, finish);
+	int done_jump = out->len - 4;
+
+	// slow: push each argument in order, then call through the interpreter
+	for(i = 0; i < 4; i++) {
+		put_int_as_bytes(out->arr, slow_jumps[i],
+			out->len - (slow_jumps[i] + 4));
+	}
+	for(i = 0; i < value->arg_count; i++) {
+		out = jit_append(out, jit_load_value(value->args[i], 0));
+
+		// pushq %rax
+		out = jit_append(out, jit_bytes(1, 0x50));
+	}
+	out = jit_append(out, jit_call_site(value->call, value->arg_count));
+
+	// done:
+	put_int_as_bytes(out->arr, done_jump, out->len - (done_jump + 4));
+	return jit_append(out, jit_store_value(value));
+}
+
+/*
+ * Generates the code for a value, or returns NULL if it needs none. Phis are
+ * given their values by the blocks that jump to them (see jit_phi_moves()).
+ */
+static ArrLen *jitcode_value(IRValue *value) {
+	ArrLen *out;
+
+	switch(value->op) {
+		case ir_Arithmetic: {
+			out = jit_append(jit_load_value(value->args[0], 0),
+				jit_load_value(value->args[1], 1));
+
+			// addl/subl/imull %ecx, %eax, or cltd; idivl %ecx, leaving the
+			// remainder in %edx for a modulo: movl %edx, %eax
+			if(value->operator == PLUS) {
+				out = jit_append(out, jit_bytes(2, 0x01, 0xC8));
+			}
+			else if(value->operator == MINUS) {
+				out = jit_append(out, jit_bytes(2, 0x29, 0xC8));
+			}
+			else if(value->operator == MULTIPLY) {
+				out = jit_append(out, jit_bytes(3, 0x0F, 0xAF, 0xC1));
+			}
+			else if(value->operator == DIVIDE) {
+				out = jit_append(out, jit_bytes(3, 0x99, 0xF7, 0xF9));
+			}
+			else {
+				out = jit_append(out,
+					jit_bytes(5, 0x99, 0xF7, 0xF9, 0x89, 0xD0));
+			}
+			out = jit_append(out, jit_store_value(value));
+			break;
+		}
+
+		case ir_Compare: {
+			out = jit_append(jit_load_value(value->args[0], 0),
+				jit_load_value(value->args[1], 1));
+
+			int setcc;
+			switch(value->operator) {
+				case EQUAL: setcc = 0x94; break;
+				case NOT_EQUAL: setcc = 0x95; break;
+				case LESS_THAN: setcc = 0x9C; break;
+				case GREATER_THAN: setcc = 0x9F; break;
+				case LESS_OR_EQUAL: setcc = 0x9E; break;
+				default: setcc = 0x9D; break;
+			}
+
+			// cmpl %ecx, %eax; set<cc> %al; movzbl %al, %eax
+			out = jit_append(out,
+				jit_bytes(8, 0x39, 0xC8, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0));
+			out = jit_append(out, jit_store_value(value));
+			break;
+		}
+
+		case ir_Call:
+			out = jit_call_value(value);
+			break;
+
+		case ir_Print: {
+			// movl <value>, %eax; movl %eax, %edi; call jit_print
+			out = jit_append(jit_load_value(value->args[0], 0),
+				jit_bytes(2, 0x89, 0xC7));
+			out = jit_append(out, jit_call_c_function(POOL_JIT_PRINT));
+			break;
+		}
+
+		default:
+			return NULL;
+	}
+
+	if(value->expr && jitdebug_enabled()) ArrLen_mark(out, NULL, value->expr);
+	if(value->stmt) ArrLen_mark(out, value->stmt, NULL);
+	return out;
+}
+
+/*
+ * Returns true if entering a block from pred requires any phi to be given a
+ * value
+ */
+static bool jit_has_phi_moves(IRBlock *pred, IRBlock *block) {
+	int index = IRBlock_pred_index(block, pred);
+
+	int i;
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *phi = block->values[i];
+		if(phi->op == ir_Phi && phi->args[index] != phi) return true;
+	}
+	return false;
+}
+
+/*
+ * Generates the code that gives a block's phis their values on entry from
+ * pred. All the values are pushed before any phi is written, as one phi may be
+ * the value that another takes.
+ */
+static ArrLen *jit_phi_moves(IRBlock *pred, IRBlock *block) {
+	int index = IRBlock_pred_index(block, pred);
+	ArrLen *out = ArrLen_init(NULL, 0);
+
+	int i;
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *phi = block->values[i];
+		if(phi->op != ir_Phi || phi->args[index] == phi) continue;
+
+		// pushq %rax
+		out = jit_append(out, jit_load_value(phi->args[index], 0));
+		out = jit_append(out, jit_bytes(1, 0x50));
+	}
+
+	for(i = block->value_count - 1; i >= 0; i--) {
+		IRValue *phi = block->values[i];
+		if(phi->op != ir_Phi || phi->args[index] == phi) continue;
+
+		// popq %rax
+		out = jit_append(out, jit_bytes(1, 0x58));
+		out = jit_append(out, jit_store_value(phi));
+	}
+
+	return out;
+}
+
+/*
+ * The jumps between the blocks of a function being compiled, whose 32 bit
+ * displacements are filled in once the blocks have been placed: the offset of
+ * each displacement, and the block it should land on
+ */
+typedef struct {
+	int *offsets;
+	IRBlock **targets;
+	int count;
+} JumpList;
+
+static void JumpList_add(JumpList *jumps, int offset, IRBlock *target) {
+	jumps->offsets[jumps->count] = offset;
+	jumps->targets[jumps->count] = target;
+	jumps->count++;
+}
+
+/*
+ * Appends a jmp to a block to the end of out
+ */
+static ArrLen *jit_jump(ArrLen *out, IRBlock *target, JumpList *jumps) {
+	out = jit_append(out, jit_bytes(5, 0xE9, 0, 0, 0, 0));
+	JumpList_add(jumps, out->len - 4, target);
+	return out;
+}
+
+/*
+ * Generates the code that leaves a block, where next is the block placed after
+ * it. The offsets of any jumps are recorded relative to the start of the code.
+ */
+static ArrLen *jitcode_exit(IRBlock *block, IRBlock *next, JumpList *jumps) {
+	ArrLen *out = ArrLen_init(NULL, 0);
+
+	switch(block->exit) {
+		case ir_Jump: {
+			out = jit_append(out, jit_phi_moves(block, block->succs[0]));
+			if(block->succs[0] != next) {
+				out = jit_jump(out, block->succs[0], jumps);
+			}
+			break;
+		}
+
+		case ir_Branch: {
+			IRBlock *if_true = block->succs[0];
+			IRBlock *if_false = block->succs[1];
+			bool false_moves = jit_has_phi_moves(block, if_false);
+
+			// testl %eax, %eax; je <if_false>
+			out = jit_append(out, jit_load_value(block->exit_value, 0));
+			out = jit_append(out,
+				jit_bytes(8, 0x85, 0xC0, 0x0F, 0x84, 0, 0, 0, 0));
+			int false_jump = out->len - 4;
+
+			out = jit_append(out, jit_phi_moves(block, if_true));
+			if(if_true != next || false_moves) {
+				out = jit_jump(out, if_true, jumps);
+			}
+
+			// If phis must be given values on the way to if_false, the je lands
+			// on code that does so
+			if(false_moves) {
+				put_int_as_bytes(out->arr, false_jump,
+					out->len - (false_jump + 4));
+				out = jit_append(out, jit_phi_moves(block, if_false));
+				out = jit_jump(out, if_false, jumps);
+			}
+			else JumpList_add(jumps, false_jump, if_false);
+			break;
+		}
+
+		case ir_Return:
+			out = jit_append(out, jit_load_value(block->exit_value, 0));
+			out = jit_append(out, jit_epilogue());
+			break;
+
+		case ir_MissingReturn:
+			// If we reach the end of the function without returning, report
+			// the error in the same way as the interpreter
+			out = jit_append(out, jit_load_pool(7, POOL_FUNCTION));
+			out = jit_append(out, jit_call_c_function(POOL_JIT_MISSING_RETURN));
+			break;
+	}
+
+	if(block->exit_stmt && out->len > 0) {
+		ArrLen_mark(out, block->exit_stmt, NULL);
+	}
+	return out;
+}
+
+/*
+ * Checks whether a block is cold, as it only leads to reporting an error
+ */
+static bool jit_cold_block(IRFunction *ir, IRBlock *block) {
+	return block->exit == ir_MissingReturn && block != ir->blocks[0];
+}
+
+/*
+ * Renumbers the values of a function so that those given a stack slot - the
+ * values left in its blocks that are not constants - come first, and returns
+ * how many of them there are. The values removed by the passes, and the
+ * constants, which are loaded as immediates, then take up no space in the
+ * stack frame.
+ */
+static int jit_number_slots(IRFunction *ir) {
+	IRValue **values = safe_alloc(sizeof(IRValue *) * (ir->value_count + 1));
+	bool *numbered = safe_alloc(sizeof(bool) * (ir->value_count + 1));
+	int slot_count = 0;
+
+	int i, j;
+	for(i = 0; i < ir->value_count; i++) numbered[i] = false;
+	for(i = 0; i < ir->block_count; i++) {
+		for(j = 0; j < ir->blocks[i]->value_count; j++) {
+			IRValue *value = ir->blocks[i]->values[j];
+			if(value->op == ir_Constant) continue;
+			numbered[value->id] = true;
+			values[slot_count++] = value;
+		}
+	}
+	int count = slot_count;
+	for(i = 0; i < ir->value_count; i++) {
+		if(!numbered[i]) values[count++] = ir->values[i];
+	}
+
+	for(i = 0; i < ir->value_count; i++) values[i]->id = i;
+	free(ir->values);
+	ir->values = values;
+	free(numbered);
+
+	return slot_count;
+}
+
+/*
+ * Generates the prologue of a compiled function, which saves the registers
+ * that the function uses, sets up its stack frame and loads its constant pool
+ * into %r13 from the given register: 6 for %rsi or 10 for %r10
+ */
+static ArrLen *jit_prologue(int frame_size, byte pool_reg) {
+	byte instr[19] = {
+
+		// pushq %rbp
+		0x55,
+
+		// movq %rsp, %rbp
+		0x48, 0x89, 0xE5,
+
+		// pushq %rbx
+		0x53,
+
+		// pushq %r12
+		0x41, 0x54,
+
+		// pushq %r13
+		0x41, 0x55,
+
+		// movq <pool_reg>, %r13
+		pool_reg >= 8 ? 0x4D : 0x49, 0x89, 0xC5 | ((pool_reg & 7) << 3),
+
+		// subq $<frame_size>, %rsp
+		0x48, 0x81, 0xEC, 0x00, 0x00, 0x00, 0x00
+	};
+	put_int_as_bytes(instr, 15, frame_size);
+	ArrLen *prologue = ArrLen_init(&(instr[0]), 19);
+	ArrLen *out = ArrLen_copy(prologue);
+	free(prologue);
+	return out;
+}
+
+/*
+ * Generates machine code for an entire function, by building its SSA form and
+ * optimising it (see ir.h). The code follows the C calling convention, and
+ * takes two arguments: a pointer to an array of the argument values, and a
+ * pointer to the function's constant pool. The stack offsets for the function
+ * are generated if that has not already been done. Blocks that report a missing
+ * return are cold code (see ArrLen).
+ *
+ * The code starts with a jump to that entry point, followed by the internal
+ * entry point that other compiled code calls (see JIT_DIRECT_ENTRY), which sets
+ * up the same stack frame from the argument registers and the stack, where the
+ * first argument passed on the stack is at 16(%rbp).
+ *
+ * The stack frame looks like this (offsets from %rbp):
+ *     +8           return address
+ *      0           caller's %rbp
+ *     -8           caller's %rbx
+ *     -16          caller's %r12
+ *     -24          caller's %r13
+ *     -28 - 4n     the value given the nth slot (see jit_number_slots())
+ */
+ArrLen *jitcode_function(FNDecl *func, Program *prog) {
+	IRFunction *ir = IRFunction_build(func, false);
+	ir_sccp(ir);
+	ir_cse(ir);
+	ir_dce(ir);
+
+	// Round the space needed for the values up to a multiple of 16, so that
+	// the stack stays aligned
+	int frame_size = ((jit_number_slots(ir) * 4) + 15) & ~15;
+
+	// jmp <external entry>
+	ArrLen *out = jit_bytes(JIT_DIRECT_ENTRY, 0xE9, 0, 0, 0, 0);
+
+	// Store each argument that is used from its register or the stack into
+	// its slot, then jump to the body
+	out = jit_append(out, jit_prologue(frame_size, 10));
+	IRBlock *entry = ir->blocks[0];
+	int i, j;
+	for(i = 0; i < entry->value_count; i++) {
+		IRValue *arg = entry->values[i];
+		if(arg->op != ir_Argument) continue;
+
+		if(arg->value < JIT_REGISTER_ARGS) {
+			out = jit_append(out,
+				jit_store_register(arg, jit_arg_registers[arg->value]));
+			continue;
+		}
+
+		// movl <16 + 8 * stack index>(%rbp), %eax
+		ArrLen *load = jit_bytes(6, 0x8B, 0x85, 0, 0, 0, 0);
+		put_int_as_bytes(load->arr, 2,
+			16 + (8 * (arg->value - JIT_REGISTER_ARGS)));
+		out = jit_append(out, load);
+		out = jit_append(out, jit_store_value(arg));
+	}
+	out = jit_append(out, jit_bytes(5, 0xE9, 0, 0, 0, 0));
+	int body_jump = out->len - 4;
+	put_int_as_bytes(out->arr, 1, out->len - JIT_DIRECT_ENTRY);
+
+	// Copy each argument that is used from the array pointed to by %rdi into
+	// its slot, before any call can overwrite %rdi
+	out = jit_append(out, jit_prologue(frame_size, 6));
+	for(i = 0; i < entry->value_count; i++) {
+		IRValue *arg = entry->values[i];
+		if(arg->op != ir_Argument) continue;
+
+		// movl <4 * index>(%rdi), %eax
+		ArrLen *load = jit_bytes(6, 0x8B, 0x87, 0, 0, 0, 0);
+		put_int_as_bytes(load->arr, 2, 4 * arg->value);
+		load = jit_append(load, jit_store_value(arg));
+		if(jitdebug_enabled()) ArrLen_mark(load, NULL, arg->expr);
+		out = jit_append(out, load);
+	}
+	put_int_as_bytes(out->arr, body_jump, out->len - (body_jump + 4));
+
+	// Each block can end with up to two jumps to other blocks
+	int *block_offsets = safe_alloc(sizeof(int) * (ir->next_block_id + 1));
+	JumpList jumps;
+	jumps.offsets = safe_alloc(sizeof(int) * ((2 * ir->block_count) + 1));
+	jumps.targets = safe_alloc(sizeof(IRBlock *) * ((2 * ir->block_count) + 1));
+	jumps.count = 0;
+
+	// Blocks that only report a missing return are cold, and go after all the
+	// other blocks, so that they can be placed apart from them. The first
+	// block is never cold, as the code starts with it.
+	IRBlock **layout = safe_alloc(sizeof(IRBlock *) * (ir->block_count + 1));
+	int hot_count = 0;
+	for(i = 0; i < ir->block_count; i++) {
+		if(!jit_cold_block(ir, ir->blocks[i])) {
+			layout[hot_count++] = ir->blocks[i];
+		}
+	}
+	int cold_count = 0;
+	for(i = 0; i < ir->block_count; i++) {
+		if(jit_cold_block(ir, ir->blocks[i])) {
+			layout[hot_count + cold_count++] = ir->blocks[i];
+		}
+	}
+
+	int hot_len = 0;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = layout[i];
+		IRBlock *next = i + 1 < ir->block_count && i + 1 != hot_count ?
+			layout[i + 1] : NULL;
+		if(i == hot_count) hot_len = out->len;
+		block_offsets[block->id] = out->len;
+
+		for(j = 0; j < block->value_count; j++) {
+			if(block->values[j]->op == ir_Argument) continue;
+			ArrLen *code = jitcode_value(block->values[j]);
+			if(code) out = jit_append(out, code);
+		}
+
+		int exit_start = out->len;
+		int first_jump = jumps.count;
+		out = jit_append(out, jitcode_exit(block, next, &jumps));
+		for(j = first_jump; j < jumps.count; j++) {
+			jumps.offsets[j] += exit_start;
+		}
+	}
+
+	for(i = 0; i < jumps.count; i++) {
+		int target = block_offsets[jumps.targets[i]->id];
+		put_int_as_bytes(out->arr, jumps.offsets[i],
+			target - (jumps.offsets[i] + 4));
+
+		if(cold_count > 0 && jumps.offsets[i] < hot_len && target >= hot_len) {
+			if(!out->cold_jumps) out->cold_jumps = LinkedList_init();
+			LinkedList_append(out->cold_jumps, (void *)(long)jumps.offsets[i]);
+		}
+	}
+	if(cold_count > 0) out->cold_len = out->len - hot_len;
+
+	free(layout);
+	free(block_offsets);
+	free(jumps.offsets);
+	free(jumps.targets);
+	IRFunction_free(ir);
+
+	return out;
+}
+
+int jitexec_expression(ArrLen *expr_code) {
+
+	// Expression code uses %rbx and %r12, which the C calling convention
+	// requires us to preserve, so they are saved before the code and restored
+	// after it
+	byte before[3] = {
+
+		// pushq %rbx
+		0x53,
+
+		// pushq %r12
+		0x41, 0x54
+	};
+
+	byte after[4] = {
+
+		// popq %r12
+		0x41, 0x5C,
+
+		// popq %rbx
+		0x5B,
+
+		// ret
+		0xC3
+	};
+
+	int total_len = sizeof(before) + expr_code->len + sizeof(after);
+
+	// Allocate the appropriate amount of executable memory, and write the code
+	// in place through its writable view, surrounded by the register saving
+	// code
+	void *writable;
+	void *jit_memory = execmem_alloc(total_len, false, NULL, &writable);
+	memcpy(writable, before, sizeof(before));
+	if(expr_code->len > 0) {
+		memcpy(writable + sizeof(before), expr_code->arr, expr_code->len);
+	}
+	memcpy(writable + sizeof(before) + expr_code->len, after, sizeof(after));
+
+	perfmap_register(jit_memory, total_len, "minty:expression");
+
+	// Declare the mapped memory as a function so we can jump to it
+	int (*jitexec)() = jit_memory;
+	
+	// Call the function we have created
+	int result = (*jitexec)();
+
+	// Free the memory that we mapped
+	execmem_free(jit_memory, total_len);
+
+	return result;
+}
+
+/*
+ * Builds the constant pool for the code compiled from a function. The
+ * function's call sites must have been numbered, as they are by
+ * FNDecl_generate_offsets().
+ */
+static void **jit_build_pool(FNDecl *func, Program *prog) {
+	LinkedList *sites = FNDecl_call_sites(func);
+	void **pool = safe_alloc(sizeof(void *) *
+		(POOL_CALL_SITES + (2 * LinkedList_length(sites))));
+
+	pool[POOL_JIT_CALL] = jit_call;
+	pool[POOL_JIT_PRINT] = jit_print;
+	pool[POOL_JIT_MISSING_RETURN] = jit_missing_return;
+	pool[POOL_PROGRAM] = prog;
+	pool[POOL_FUNCTION] = func;
+	pool[POOL_JIT_CALL_FRAME] = jit_call_frame;
+	pool[POOL_CALL_LIMIT] = ccode_call_limit();
+
+	// A callee that takes a different number of arguments is left out, so
+	// that the call is never made directly (see jit_call_value()), and the
+	// interpreter reports the error
+	LLIterator *sites_iter = LLIterator_init(sites);
+	while(!LLIterator_ended(sites_iter)) {
+		FNCall *call = (FNCall *)LLIterator_get_current(sites_iter);
+		FNDecl *callee = Program_find_FNDecl(prog, call->name);
+		if(callee && LinkedList_length(callee->args)
+			!= LinkedList_length(call->args)) {
+
+			callee = NULL;
+		}
+		pool[POOL_CALL_SITE(call->call_index)] = call;
+		pool[POOL_CALLEE(call->call_index)] = callee;
+		LLIterator_advance(sites_iter);
+	}
+	free(sites_iter);
+	LinkedList_free(sites);
+
+	return pool;
+}
+
+/*
+ * Returns the name that profilers, debuggers and JIT debugging reports use for
+ * code compiled from the given function. Specialised code is compiled from a
+ * copy of the function, so it can be told apart from the general code by not
+ * being the function that the program contains.
+ */
+static char *jit_code_name(FNDecl *func, Program *prog) {
+	return str_concat(3, "minty:", func->name,
+		Program_find_FNDecl(prog, func->name) == func ? "" : "'specialised");
+}
+
+/*
+ * Returns the current time in nanoseconds, for timing compilation
+ */
+static long jit_time_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000L) + ts.tv_nsec;
+}
+
+/*
+ * All the code installed by jit_install(), ordered from the most to the least
+ * recently run, the number of bytes of executable memory it takes up, and the
+ * limit on that number that jitcode_evict() enforces
+ */
+static JITFunction *newest_code = NULL;
+static JITFunction *oldest_code = NULL;
+static long code_memory_used = 0;
+static long code_budget = JIT_DEFAULT_CODE_BUDGET;
+
+/*
+ * Returns the number of bytes of executable memory taken up by code
+ */
+static long jit_memory_size(JITFunction *jf) {
+	return execmem_size(jf->len) + (jf->cold ? execmem_size(jf->cold_len) : 0);
+}
+
+/*
+ * Adds code to the front of the list of installed code, as the most recently
+ * run
+ */
+static void jit_push_newest(JITFunction *jf) {
+	jf->newer = NULL;
+	jf->older = newest_code;
+	if(newest_code) newest_code->newer = jf;
+	else oldest_code = jf;
+	newest_code = jf;
+}
+
+/*
+ * Removes code from the list of installed code
+ */
+static void jit_unlink(JITFunction *jf) {
+	if(jf->newer) jf->newer->older = jf->older;
+	else newest_code = jf->older;
+	if(jf->older) jf->older->newer = jf->newer;
+	else oldest_code = jf->newer;
+	jf->newer = NULL;
+	jf->older = NULL;
+}
+
+/*
+ * Checks whether one function calls another, by name
+ */
+static bool jit_calls(FNDecl *caller, char *callee) {
+	bool calls = false;
+	LinkedList *sites = FNDecl_call_sites(caller);
+	LLIterator *sites_iter = LLIterator_init(sites);
+	while(!LLIterator_ended(sites_iter) && !calls) {
+		calls = str_equal(((FNCall *)LLIterator_get_current(sites_iter))->name,
+			callee);
+		LLIterator_advance(sites_iter);
+	}
+	free(sites_iter);
+	LinkedList_free(sites);
+	return calls;
+}
+
+/*
+ * Returns where code compiled from a function should be placed: after the code
+ * of the most frequently called function that it calls or is called by, which
+ * is likely to be running at the same time. Returns NULL if none of those
+ * functions has been compiled.
+ */
+static void *jit_affinity(FNDecl *func, Program *prog) {
+	JITFunction *partner = NULL;
+	int partner_calls = -1;
+
+	LLIterator *fn_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(fn_iter)) {
+		FNDecl *other = (FNDecl *)LLIterator_get_current(fn_iter);
+		JITFunction *code = other->compiled ? other->compiled : other->baseline;
+
+		if(code && other->exec_count > partner_calls &&
+			!str_equal(other->name, func->name) &&
+			(jit_calls(func, other->name) || jit_calls(other, func->name))) {
+
+			partner = code;
+			partner_calls = other->exec_count;
+		}
+		LLIterator_advance(fn_iter);
+	}
+	free(fn_iter);
+
+	return partner ? partner->code + partner->len : NULL;
+}
+
+/*
+ * Copies the cold part of some code into its own memory, and adjusts the jumps
+ * into it from the rest of the code, which has been copied into place through
+ * the given writable view. The jumps must be able to reach the cold code, so it
+ * goes after the rest of the code if the cold chunks are too far away.
+ */
+static void jit_install_cold(JITFunction *jf, ArrLen *code, byte *writable) {
+	void *cold_writable;
+	jf->cold = execmem_alloc(jf->cold_len, true, NULL, &cold_writable);
+	long shift = jf->cold - (jf->code + jf->len);
+	if(shift < INT_MIN / 2 || shift > INT_MAX / 2) {
+		execmem_free(jf->cold, jf->cold_len);
+		jf->cold = execmem_alloc(jf->cold_len, false, jf->code + jf->len,
+			&cold_writable);
+		shift = jf->cold - (jf->code + jf->len);
+	}
+	memcpy(cold_writable, code->arr + jf->len, jf->cold_len);
+
+	jf->cold_jump_count = LinkedList_length(code->cold_jumps);
+	jf->cold_jumps = safe_alloc(sizeof(int) * (jf->cold_jump_count + 1));
+	LLIterator *jumps_iter = LLIterator_init(code->cold_jumps);
+	while(!LLIterator_ended(jumps_iter)) {
+		int offset = (int)(long)LLIterator_get_current(jumps_iter);
+		int displacement;
+		memcpy(&displacement, code->arr + offset, sizeof(int));
+		put_int_as_bytes(writable, offset, displacement + (int)shift);
+
+		jf->cold_jumps[LLIterator_current_index(jumps_iter)] = offset;
+		LLIterator_advance(jumps_iter);
+	}
+	free(jumps_iter);
+}
+
+/*
+ * Creates a JITFunction from machine code compiled from the given function, by
+ * copying the code into executable memory (see execmem.h) and building its
+ * constant pool. The code is placed near the code of the functions it is most
+ * closely related to, and its cold part, if it has one, apart from it. The code
+ * is given the name that profilers and debuggers know it by.
+ */
+static JITFunction *jit_install(ArrLen *code, FNDecl *func, Program *prog,
+	char *name) {
+
+	JITFunction *jf = safe_alloc(sizeof(JITFunction));
+
+	void *writable;
+	jf->len = code->len - code->cold_len;
+	jf->code = execmem_alloc(jf->len, false, jit_affinity(func, prog),
+		&writable);
+	memcpy(writable, code->arr, jf->len);
+	jf->entry = (int (*)(int *, void **))jf->code;
+	jf->pool = jit_build_pool(func, prog);
+
+	jf->cold = NULL;
+	jf->cold_len = code->cold_len;
+	jf->cold_jumps = NULL;
+	jf->cold_jump_count = 0;
+	if(code->cold_len > 0) jit_install_cold(jf, code, writable);
+
+	// Name the code for profilers and debuggers. Line information is only
+	// available for code compiled in this process, as the JIT cache does not
+	// store CodeMarks.
+	perfmap_register(jf->code, jf->len, name);
+	jf->debug_entry =
+		gdbjit_register(jf->code, jf->len, name, func, code->marks);
+	if(jf->cold) {
+		char *cold_name = str_concat_2(name, "'cold");
+		perfmap_register(jf->cold, jf->cold_len, cold_name);
+		free(cold_name);
+	}
+
+	jf->source = NULL;
+	jf->guarded = NULL;
+	jf->guard_values = NULL;
+	jf->guard_failures = 0;
+	jf->compile_ns = 0;
+	jf->executions = 0;
+	jf->moved_executions = 0;
+
+	jf->owner = func;
+	jf->running = 0;
+	jit_push_newest(jf);
+	code_memory_used += jit_memory_size(jf);
+
+	return jf;
+}
+
+/*
+ * Creates a JITFunction from machine code compiled from the given function by
+ * jitcode_function(), either in this process or read from the JIT cache
+ */
+JITFunction *JITFunction_init(ArrLen *code, FNDecl *func, Program *prog) {
+	char *name = jit_code_name(func, prog);
+	JITFunction *jf = jit_install(code, func, prog, name);
+	free(name);
+	return jf;
+}
+
+/*
+ * Returns a copy of the code of a JITFunction as it was compiled, with its cold
+ * part directly after the rest, so that it can be installed again
+ */
+ArrLen *JITFunction_code(JITFunction *jf) {
+	byte *arr = safe_alloc(jf->len + jf->cold_len);
+	memcpy(arr, jf->code, jf->len);
+	ArrLen *code = ArrLen_init(arr, jf->len + jf->cold_len);
+	if(!jf->cold) return code;
+
+	memcpy(arr + jf->len, jf->cold, jf->cold_len);
+	code->cold_len = jf->cold_len;
+	code->cold_jumps = LinkedList_init();
+
+	long shift = jf->cold - (jf->code + jf->len);
+	int i;
+	for(i = 0; i < jf->cold_jump_count; i++) {
+		int displacement;
+		memcpy(&displacement, arr + jf->cold_jumps[i], sizeof(int));
+		put_int_as_bytes(arr, jf->cold_jumps[i], displacement - (int)shift);
+		LinkedList_append(code->cold_jumps, (void *)(long)jf->cold_jumps[i]);
+	}
+
+	return code;
+}
+
+/*
+ * Installs code compiled from a function under the given name, recording the
+ * time taken to compile it and reporting the result if JIT debugging is
+ * enabled. The ArrLen is freed.
+ */
+static JITFunction *jit_finish(ArrLen *code, FNDecl *func, Program *prog,
+	char *name, long compile_ns) {
+
+	JITFunction *jf = jit_install(code, func, prog, name);
+	jf->compile_ns = compile_ns;
+
+	if(jitdebug_enabled()) jitdebug_report_compilation(jf, name, code->marks);
+	ArrLen_free(code);
+
+	return jf;
+}
+
+/*
+ * Compiles a function into executable memory with the given compiler, under
+ * the given name (see jit_finish()). The function's stack offsets are generated
+ * first if that has not already been done.
+ */
+static JITFunction *jit_compile_with(ArrLen *(*compiler)(FNDecl *, Program *),
+	FNDecl *func, Program *prog, char *name) {
+
+	long start = jit_time_ns();
+	if(func->variable_count == -1) FNDecl_generate_offsets(func);
+
+	ArrLen *code = compiler(func, prog);
+	return jit_finish(code, func, prog, name, jit_time_ns() - start);
+}
+
+/*
+ * Compiles a function into executable memory with the optimising compiler
+ * (see jitcode_function())
+ */
+JITFunction *jitcompile_function(FNDecl *func, Program *prog) {
+	char *name = jit_code_name(func, prog);
+	JITFunction *jf = jit_compile_with(jitcode_function, func, prog, name);
+	free(name);
+	return jf;
+}
+
+/*
+ * Compiles a function into executable memory with the baseline compiler (see
+ * stencil.h), which is much faster than the optimising compiler
+ */
+JITFunction *jitcompile_baseline(FNDecl *func, Program *prog) {
+	char *general = jit_code_name(func, prog);
+	char *name = str_concat_2(general, "'baseline");
+	JITFunction *jf = jit_compile_with(stencilcode_function, func, prog, name);
+	free(general);
+	free(name);
+	return jf;
+}
+
+/*
+ * Makes the copy of a function that its specialised code is compiled from (see
+ * FNDecl_specialise()), with its stack offsets generated. Sets guarded to
+ * whether each argument is guarded, and guard_values to the values that the
+ * guard must check for. Returns NULL if no argument has been passed a constant
+ * value that can be specialised on.
+ */
+static FNDecl *jit_specialise(FNDecl *func, bool **guarded,
+	int **guard_values) {
+
+	int arg_count = LinkedList_length(func->args);
+
+	*guarded = safe_alloc(sizeof(bool) * (arg_count + 1));
+	FNDecl *specialised = FNDecl_specialise(func, *guarded);
+	if(!specialised) {
+		free(*guarded);
+		return NULL;
+	}
+	FNDecl_generate_offsets(specialised);
+
+	*guard_values = safe_alloc(sizeof(int) * (arg_count + 1));
+	int i;
+	for(i = 0; i < arg_count; i++) {
+		(*guard_values)[i] = func->arg_profile[i].value;
+	}
+
+	return specialised;
+}
+
+/*
+ * Gives code compiled from a specialised copy of a function the information
+ * that its guard needs, and makes it belong to the original function
+ */
+static void jit_set_specialisation(JITFunction *jf, FNDecl *func,
+	FNDecl *specialised, bool *guarded, int *guard_values) {
+
+	jf->owner = func;
+	jf->source = specialised;
+	jf->guarded = guarded;
+	jf->guard_values = guard_values;
+}
+
+/*
+ * Compiles a version of a function that is specialised to the argument values
+ * recorded in its argument profile (see FNDecl_specialise()). The returned code
+ * may only be run with arguments that pass JITFunction_guard(). Returns NULL if
+ * no argument has been passed a constant value that can be specialised on.
+ */
+JITFunction *jitcompile_specialised(FNDecl *func, Program *prog) {
+	bool *guarded;
+	int *guard_values;
+	FNDecl *specialised = jit_specialise(func, &guarded, &guard_values);
+	if(!specialised) return NULL;
+
+	JITFunction *jf = jitcompile_function(specialised, prog);
+	jit_set_specialisation(jf, func, specialised, guarded, guard_values);
+	return jf;
+}
+
+/*
+ * A function waiting to be compiled by the worker threads, or that has been
+ * compiled by them and is waiting to be installed. Everything the compiler
+ * changes in the AST, such as the stack offsets, is set up before the job is
+ * queued, so the workers only read the AST while the interpreter carries on
+ * running the program. They do not read the counts that the interpreter keeps
+ * updating in it either (see IRFunction_build()). Installing the code is left
+ * to the interpreter's thread.
+ */
+typedef struct JITJob JITJob;
+struct JITJob {
+	FNDecl *func;
+	Program *prog;
+
+	// The specialised copy of the function, and its guard, if there is one
+	FNDecl *specialised;
+	bool *guarded;
+	int *guard_values;
+
+	// The compiled code, and the time taken to compile it, once the job has
+	// been done
+	ArrLen *code;
+	ArrLen *specialised_code;
+	long compile_ns;
+	long specialised_ns;
+
+	JITJob *next;
+};
+
+/*
+ * The worker threads, the jobs queued for them in order, the jobs they have
+ * finished in reverse order, and the number of jobs that are queued or being
+ * worked on. The lock protects everything but worker_count, which is only
+ * used by the interpreter's thread, and jobs_finished, which is also read
+ * without the lock to check for finished jobs cheaply.
+ */
+static int worker_count = 0;
+static pthread_t *workers = NULL;
+static bool workers_stopping = false;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobs_done = PTHREAD_COND_INITIALIZER;
+static JITJob *queue_head = NULL;
+static JITJob *queue_tail = NULL;
+static JITJob *finished_jobs = NULL;
+static int jobs_pending = 0;
+static int jobs_finished = 0;
+
+/*
+ * Compiles the code for a job
+ */
+static void jit_do_job(JITJob *job) {
+	long start = jit_time_ns();
+	job->code = jitcode_function(job->func, job->prog);
+	job->compile_ns = jit_time_ns() - start;
+
+	if(job->specialised) {
+		start = jit_time_ns();
+		job->specialised_code = jitcode_function(job->specialised, job->prog);
+		job->specialised_ns = jit_time_ns() - start;
+	}
+}
+
+/*
+ * The loop run by each worker thread, which does jobs from the queue until the
+ * workers are stopped
+ */
+static void *jit_worker(void *unused) {
+	pthread_mutex_lock(&jobs_lock);
+	while(true) {
+		while(!queue_head && !workers_stopping) {
+			pthread_cond_wait(&jobs_queued, &jobs_lock);
+		}
+		if(!queue_head) break;
+
+		JITJob *job = queue_head;
+		queue_head = job->next;
+		if(!queue_head) queue_tail = NULL;
+		pthread_mutex_unlock(&jobs_lock);
+
+		jit_do_job(job);
+
+		pthread_mutex_lock(&jobs_lock);
+		job->next = finished_jobs;
+		finished_jobs = job;
+		jobs_pending--;
+		__atomic_store_n(&jobs_finished, jobs_finished + 1, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&jobs_done);
+	}
+	pthread_mutex_unlock(&jobs_lock);
+
+	return NULL;
+}
+
+/*
+ * Installs the code compiled for a job as its function's compiled and
+ * specialised code, and stores it in the JIT cache
+ */
+static void jit_install_job(JITJob *job) {
+	FNDecl *func = job->func;
+
+	char *name = jit_code_name(func, job->prog);
+	func->compiled =
+		jit_finish(job->code, func, job->prog, name, job->compile_ns);
+	free(name);
+
+	if(job->specialised) {
+		name = jit_code_name(job->specialised, job->prog);
+		func->specialised = jit_finish(job->specialised_code,
+			job->specialised, job->prog, name, job->specialised_ns);
+		jit_set_specialisation(func->specialised, func, job->specialised,
+			job->guarded, job->guard_values);
+		free(name);
+	}
+
+	func->compiling = false;
+	jitcache_store(func);
+	free(job);
+}
+
+/*
+ * Sets the number of worker threads that jitcompile() compiles functions on.
+ * With no workers, functions are compiled straight away on the interpreter's
+ * thread. Any existing workers finish the jobs queued for them and stop, and
+ * the code they have compiled is installed. New workers are started when a
+ * function is next compiled.
+ */
+void jitcode_set_workers(int count) {
+	if(workers) {
+		pthread_mutex_lock(&jobs_lock);
+		workers_stopping = true;
+		pthread_cond_broadcast(&jobs_queued);
+		pthread_mutex_unlock(&jobs_lock);
+
+		int i;
+		for(i = 0; i < worker_count; i++) pthread_join(workers[i], NULL);
+		free(workers);
+		workers = NULL;
+		workers_stopping = false;
+		jitcode_install_finished();
+	}
+	worker_count = count > 0 ? count : 0;
+}
+
+/*
+ * Queues a function to be compiled by the worker threads, starting them if
+ * they are not running
+ */
+static void jit_queue(FNDecl *func, Program *prog) {
+	if(!workers) {
+		workers = safe_alloc(sizeof(pthread_t) * worker_count);
+		int i;
+		for(i = 0; i < worker_count; i++) {
+			if(pthread_create(&workers[i], NULL, jit_worker, NULL) != 0) {
+				printf("Could not start JIT compiler thread\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	JITJob *job = safe_alloc(sizeof(JITJob));
+	job->func = func;
+	job->prog = prog;
+	if(func->variable_count == -1) FNDecl_generate_offsets(func);
+	job->specialised = jit_specialise(func, &job->guarded, &job->guard_values);
+	job->code = NULL;
+	job->specialised_code = NULL;
+	job->next = NULL;
+	func->compiling = true;
+
+	pthread_mutex_lock(&jobs_lock);
+	if(queue_tail) queue_tail->next = job;
+	else queue_head = job;
+	queue_tail = job;
+	jobs_pending++;
+	pthread_cond_signal(&jobs_queued);
+	pthread_mutex_unlock(&jobs_lock);
+}
+
+/*
+ * Installs the code for any functions that the worker threads have finished
+ * compiling, in the order they were compiled, then evicts code if that has
+ * taken the JIT over its code budget. Should be called regularly by the
+ * interpreter's thread, at a point where no function's fields are in the
+ * middle of being filled in.
+ */
+void jitcode_install_finished() {
+	if(!__atomic_load_n(&jobs_finished, __ATOMIC_ACQUIRE)) return;
+
+	pthread_mutex_lock(&jobs_lock);
+	JITJob *finished = finished_jobs;
+	finished_jobs = NULL;
+	jobs_finished = 0;
+	pthread_mutex_unlock(&jobs_lock);
+
+	// Reverse the list to install the code in the order it was compiled
+	JITJob *in_order = NULL;
+	while(finished) {
+		JITJob *next = finished->next;
+		finished->next = in_order;
+		in_order = finished;
+		finished = next;
+	}
+	while(in_order) {
+		JITJob *next = in_order->next;
+		jit_install_job(in_order);
+		in_order = next;
+	}
+
+	jitcode_evict();
+}
+
+/*
+ * Waits for the worker threads to compile every function queued for them, and
+ * installs the code
+ */
+void jitcode_wait() {
+	pthread_mutex_lock(&jobs_lock);
+	while(jobs_pending > 0) pthread_cond_wait(&jobs_done, &jobs_lock);
+	pthread_mutex_unlock(&jobs_lock);
+
+	jitcode_install_finished();
+}
+
+/*
+ * Compiles a function, recording the general compiled code in the function's
+ * compiled field, and, if the function's argument profile allows it, a
+ * specialised version in its specialised field. If there are worker threads
+ * (see jitcode_set_workers()), the function is queued to be compiled by them
+ * instead, and its fields are filled in by jitcode_install_finished() once
+ * they have finished.
+ */
+void jitcompile(FNDecl *func, Program *prog) {
+	if(worker_count > 0) {
+		jit_queue(func, prog);
+		return;
+	}
+
+	func->compiled = jitcompile_function(func, prog);
+	func->specialised = jitcompile_specialised(func, prog);
+}
+
+/*
+ * Checks whether specialised code may be run with the given argument values
+ */
+bool JITFunction_guard(JITFunction *jf, int *args) {
+	int i;
+	for(i = 0; i < LinkedList_length(jf->source->args); i++) {
+		if(jf->guarded[i] && args[i] != jf->guard_values[i]) return false;
+	}
+	return true;
+}
+
+/*
+ * Runs the compiled code of a function with the given argument values. The
+ * specialised code is used when its guard passes, and the general code
+ * otherwise, or the baseline code if the function has not been optimised yet.
+ * Once the guard has failed JIT_MAX_GUARD_FAILURES times, the specialisation
+ * is assumed to be unprofitable and is no longer tried. It is not freed, as it
+ * may still be running further up the call stack.
+ */
+int jitexec_function(FNDecl *func, LinkedList *arg_vals) {
+
+	// Copy the argument values into the array that compiled code expects
+	int arg_count = LinkedList_length(arg_vals);
+	int *args = safe_alloc(sizeof(int) * (arg_count + 1));
+	LLIterator *args_iter = LLIterator_init(arg_vals);
+	while(!LLIterator_ended(args_iter)) {
+		args[LLIterator_current_index(args_iter)] =
+			(int)(long)LLIterator_get_current(args_iter);
+		LLIterator_advance(args_iter);
+	}
+	free(args_iter);
+
+	// Decide which version of the code to run
+	JITFunction *code = func->compiled ? func->compiled : func->baseline;
+	JITFunction *spec = func->specialised;
+	if(spec && spec->guard_failures < JIT_MAX_GUARD_FAILURES) {
+		if(JITFunction_guard(spec, args)) code = spec;
+		else spec->guard_failures++;
+	}
+
+	int result = JITFunction_run(code, args);
+
+	free(args);
+	return result;
+}
+
+/*
+ * Runs compiled code with the given argument values, counting the execution
+ * and moving the code to the front of the list of installed code
+ */
+int JITFunction_run(JITFunction *jf, int *args) {
+	jf->executions++;
+	jf->moved_executions = jf->executions;
+	if(newest_code != jf) {
+		jit_unlink(jf);
+		jit_push_newest(jf);
+	}
+
+	jf->running++;
+	int result = jf->entry(args, jf->pool);
+	jf->running--;
+
+	return result;
+}
+
+/*
+ * Frees a JITFunction, unmapping its code and freeing its constant pool and any
+ * specialised copy of the FNDecl it was compiled from
+ */
+void JITFunction_free(JITFunction *jf) {
+	jit_unlink(jf);
+	code_memory_used -= jit_memory_size(jf);
+
+	gdbjit_unregister(jf->debug_entry);
+	execmem_free(jf->code, jf->len);
+	if(jf->cold) execmem_free(jf->cold, jf->cold_len);
+	free(jf->cold_jumps);
+	free(jf->pool);
+	if(jf->source) FNDecl_free(jf->source);
+	free(jf->guarded);
+	free(jf->guard_values);
+	free(jf);
+}
+
+/*
+ * Sets the limit on the executable memory taken up by the code compiled for
+ * functions, in bytes. Code is only evicted to keep within the limit when
+ * jitcode_evict() is called.
+ */
+void jitcode_set_budget(long bytes) {
+	code_budget = bytes;
+}
+
+/*
+ * Returns the number of bytes of executable memory taken up by the code
+ * compiled for functions that has not yet been freed
+ */
+long jitcode_memory_used() {
+	return code_memory_used;
+}
+
+/*
+ * Returns the field of its owner that code is installed in, or NULL if it is
+ * not installed in one
+ */
+static JITFunction **jit_owner_field(JITFunction *jf) {
+	FNDecl *owner = jf->owner;
+	if(owner->baseline == jf) return &(owner->baseline);
+	if(owner->compiled == jf) return &(owner->compiled);
+	if(owner->specialised == jf) return &(owner->specialised);
+	return NULL;
+}
+
+/*
+ * Checks whether code can be evicted. The specialised code is only used
+ * alongside the general code, so evicting the general code evicts both, and
+ * neither may be running.
+ */
+static bool jit_evictable(JITFunction *jf) {
+	if(jf->running > 0 || !jit_owner_field(jf)) return false;
+
+	JITFunction *specialised = jf->owner->specialised;
+	return jf != jf->owner->compiled || !specialised
+		|| specialised->running == 0;
+}
+
+/*
+ * Frees code and removes it from its owner, which falls back to being
+ * interpreted, or to its baseline code, until it is called often enough to be
+ * compiled again
+ */
+static void jit_evict(JITFunction *jf) {
+	FNDecl *owner = jf->owner;
+
+	if(jf == owner->compiled && owner->specialised) {
+		JITFunction_free(owner->specialised);
+		owner->specialised = NULL;
+	}
+	*jit_owner_field(jf) = NULL;
+	JITFunction_free(jf);
+
+	owner->evicted_at = owner->exec_count;
+}
+
+/*
+ * Frees the least recently run code that can be evicted until the code
+ * compiled for functions fits within the budget set by jitcode_set_budget(),
+ * or there is no more code that can be evicted. Code that has been called
+ * directly by other compiled code since it was last moved to the front of the
+ * list has run more recently than its place in the list shows, so it is moved
+ * to the front rather than evicted. Should only be called when no function's
+ * fields are in the middle of being filled in, such as after the interpreter
+ * has compiled a function.
+ */
+void jitcode_evict() {
+	JITFunction *jf = oldest_code;
+	while(jf && code_memory_used > code_budget) {
+		if(!jit_evictable(jf)) {
+			jf = jf->newer;
+			continue;
+		}
+
+		// Nothing runs while code is evicted, so code that is moved is only
+		// moved once, and may be evicted when the search reaches it again
+		if(jf->executions != jf->moved_executions) {
+			JITFunction *newer = jf->newer;
+			jf->moved_executions = jf->executions;
+			jit_unlink(jf);
+			jit_push_newest(jf);
+			jf = newer ? newer : oldest_code;
+			continue;
+		}
+
+		// Evicting general code may also evict the specialised code that
+		// would be visited next, so the search starts again from the oldest
+		jit_evict(jf);
+		jf = oldest_code;
+	}
+}
+
+/*
+ * Frees all the compiled code belonging to the functions in a program,
+ * including the traces of their loops and the code from the C tier. Should be
+ * called before Program_free() on any program that has been interpreted.
+ */
+void jitcode_release(Program *prog) {
+	jitcode_wait();
+	trace_release(prog);
+	ccode_release(prog);
+
+	LLIterator *fn_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(fn_iter)) {
+		FNDecl *func = (FNDecl *)LLIterator_get_current(fn_iter);
+
+		if(func->baseline) JITFunction_free(func->baseline);
+		if(func->compiled) JITFunction_free(func->compiled);
+		if(func->specialised) JITFunction_free(func->specialised);
+		func->baseline = NULL;
+		func->compiled = NULL;
+		func->specialised = NULL;
+
+		LLIterator_advance(fn_iter);
+	}
+	free(fn_iter);
 }
\ No newline at end of file
@@ -1,18 +1,173 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
 #ifndef JITCODE
 #define JITCODE
 
 #include <stdint.h>
 #define byte uint8_t
 
+/*
+ * The version of the JIT compiler, which is part of the key under which
+ * compiled code is stored in the JIT cache. It must be changed whenever the
+ * machine code generated for a function changes, so that code produced by an
+ * older version of the compiler is not loaded.
+ */
+#define JIT_VERSION "minty-jit-7"
+
+/*
+ * The number of times a specialised function's guard may fail before the
+ * specialised code is abandoned in favour of the general code
+ */
+#define JIT_MAX_GUARD_FAILURES 10
+
+/*
+ * Code compiled by jitcode_function() calls other such code directly rather
+ * than through the interpreter, at an internal entry point JIT_DIRECT_ENTRY
+ * bytes into the callee's code. It takes the first JIT_REGISTER_ARGS arguments
+ * in registers, any others on the stack, and the callee's constant pool in
+ * %r10.
+ */
+#define JIT_REGISTER_ARGS 6
+#define JIT_DIRECT_ENTRY 5
+
+/*
+ * The default limit on the executable memory taken up by the code compiled for
+ * functions, in bytes (see jitcode_set_budget())
+ */
+#define JIT_DEFAULT_CODE_BUDGET (64 * 1024 * 1024)
+
+/*
+ * Compiled code contains no absolute addresses, so that it can be written to
+ * and read from the JIT cache. Everything it needs the address of is instead
+ * loaded from its constant pool - an array of pointers that is passed to the
+ * function's entry point (and kept in %r13 by code from jitcode_function()).
+ * The pool is built from the function and the program when the code is
+ * installed (see JITFunction_init()), which serves as the relocation step for
+ * cached code. The slots are:
+ */
+#define POOL_JIT_CALL 0
+#define POOL_JIT_PRINT 1
+#define POOL_JIT_MISSING_RETURN 2
+#define POOL_PROGRAM 3
+#define POOL_FUNCTION 4
+#define POOL_JIT_CALL_FRAME 5
+#define POOL_CALL_LIMIT 6
+
+/*
+ * ...followed by two slots for each call site in the function: the FNCall
+ * object, then the FNDecl it calls (or NULL if there is no such function, or
+ * it takes a different number of arguments)
+ */
+#define POOL_CALL_SITES 7
+#define POOL_CALL_SITE(call_index) (POOL_CALL_SITES + (2 * (call_index)))
+#define POOL_CALLEE(call_index) (POOL_CALL_SITES + (2 * (call_index)) + 1)
+
+/*
+ * Records that a range of bytes in an ArrLen holds the code generated for a
+ * statement or, when JIT debugging is enabled (see jitdebug.h), an expression,
+ * so that compiled code can be mapped back to the source. Exactly one of stmt
+ * and expr is non-NULL.
+ */
+typedef struct {
+	int offset;
+	int len;
+	Statement *stmt;
+	Expression *expr;
+} CodeMark;
+
 /*
  * Struct storing an array and its length in bytes, useful for handling machine
- * code.
+ * code. The CodeMarks for any statements and expressions compiled into the
+ * array are kept in marks, which is NULL if there are none. They are moved
+ * along with the code when ArrLens are concatenated.
+ *
+ * The code for a whole function may end with cold code, which is only run to
+ * report an error, and is placed in memory away from the rest of the code (see
+ * execmem.h). cold_len is its length, and cold_jumps lists the offsets of the
+ * 32 bit displacements in the rest of the code that jump into it, which are
+ * relative to the cold code directly following the rest. It is NULL if there
+ * are none.
  */
 typedef struct {
 	byte *arr;
 	int len;
+	LinkedList *marks;
+	int cold_len;
+	LinkedList *cold_jumps;
 } ArrLen;
 
+/*
+ * A function that has been compiled into executable memory. The entry point
+ * follows the C calling convention, taking a pointer to an array that holds the
+ * values of the function's arguments, in order, and a pointer to the code's
+ * constant pool. It should be called through JITFunction_run().
+ *
+ * Specialised functions are compiled from a copy of the FNDecl in which some
+ * arguments have been replaced with constants. They keep that copy in source,
+ * and may only be called when, for every i where guarded[i] is true, argument i
+ * equals guard_values[i].
+ */
+typedef struct JITFunction JITFunction;
+struct JITFunction {
+	// The executable memory containing the code, and its length in bytes
+	byte *code;
+	int len;
+
+	// The cold part of the code, NULL if there is none, which is allocated
+	// separately, and the offsets of the displacements in the code that jump
+	// into it (see ArrLen)
+	byte *cold;
+	int cold_len;
+	int *cold_jumps;
+	int cold_jump_count;
+
+	// The entry point of the code, and the constant pool that it loads
+	// addresses from
+	int (*entry)(int *args, void **pool);
+	void **pool;
+
+	// The code's registration with gdb (see gdbjit.h), NULL if not registered
+	struct jit_code_entry *debug_entry;
+
+	// The time taken to compile the code in nanoseconds (0 if it was loaded
+	// from the JIT cache), and the number of times it has been run
+	long compile_ns;
+	long executions;
+
+	// Specialisation information - all NULL/0 for general code
+	FNDecl *source;
+	bool *guarded;
+	int *guard_values;
+	int guard_failures;
+
+	// The function that the code belongs to. The code may only be evicted
+	// (see jitcode_evict()) while it is installed in one of the function's
+	// fields and none of the calls to it are still running.
+	FNDecl *owner;
+	int running;
+
+	// The neighbouring code in the list of all installed code, ordered from
+	// the most to the least recently run, and the executions when the code was
+	// last moved to the front of the list. Calls from other compiled code
+	// count executions without moving the code, which jitcode_evict() does
+	// instead.
+	JITFunction *newer;
+	JITFunction *older;
+	long moved_executions;
+};
+
+void put_int_as_bytes(byte *buffer, int offset, int value);
+
 ArrLen *ArrLen_init(byte *arr, int len);
 
 ArrLen *ArrLen_copy(ArrLen *original);
@@ -21,8 +176,52 @@ ArrLen *ArrLen_concat_2(ArrLen *al1, ArrLen *al2);
 
 ArrLen *ArrLen_concat(int count, ...);
 
+void ArrLen_free(ArrLen *al);
+
+void ArrLen_mark(ArrLen *al, Statement *stmt, Expression *expr);
+
 ArrLen *jitcode_expression(Expression *expr, Program *prog);
 
+ArrLen *jitcode_statement_list(LinkedList *stmts, Program *prog);
+
+ArrLen *jitcode_statement(Statement *stmt, Program *prog);
+
+ArrLen *jitcode_function(FNDecl *func, Program *prog);
+
 int jitexec_expression(ArrLen *expr_code);
 
-#endif // JITCODE
\ No newline at end of file
+JITFunction *JITFunction_init(ArrLen *code, FNDecl *func, Program *prog);
+
+ArrLen *JITFunction_code(JITFunction *jf);
+
+JITFunction *jitcompile_function(FNDecl *func, Program *prog);
+
+JITFunction *jitcompile_baseline(FNDecl *func, Program *prog);
+
+JITFunction *jitcompile_specialised(FNDecl *func, Program *prog);
+
+void jitcompile(FNDecl *func, Program *prog);
+
+void jitcode_set_workers(int count);
+
+void jitcode_install_finished();
+
+void jitcode_wait();
+
+bool JITFunction_guard(JITFunction *jf, int *args);
+
+int JITFunction_run(JITFunction *jf, int *args);
+
+int jitexec_function(FNDecl *func, LinkedList *arg_vals);
+
+void JITFunction_free(JITFunction *jf);
+
+void jitcode_set_budget(long bytes);
+
+long jitcode_memory_used();
+
+void jitcode_evict();
+
+void jitcode_release(Program *prog);
+
+#endif // JITCODE
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "minty_util.h"
+#include "AST.h"
+#include "jitcode.h"
+#include "jitdebug.h"
+
+/*
+ * The stream that reports are written to, NULL when JIT debugging is disabled
+ */
+static FILE *debug_out = NULL;
+
+/*
+ * The names of the types of AST node that code can be produced for, indexed by
+ * node_type(). Code outside every node is the function's prologue and
+ * epilogue.
+ */
+#define NODE_TYPE_COUNT 13
+static char *node_type_names[NODE_TYPE_COUNT] = {
+	"BooleanExpr", "ArithmeticExpr", "Identifier", "IntegerLiteral", "FNCall",
+	"Ternary", "For", "While", "If", "Print", "Assignment", "Return",
+	"(function entry/exit)"
+};
+
+/*
+ * One instruction of a disassembly produced by objdump
+ */
+typedef struct {
+	int offset;
+	char *bytes;
+	char *text;
+} DisasmLine;
+
+/*
+ * Starts reporting compilations to the given stream
+ */
+void jitdebug_enable(FILE *out) {
+	debug_out = out;
+}
+
+/*
+ * Returns true if compilations are being reported
+ */
+bool jitdebug_enabled() {
+	return debug_out != NULL;
+}
+
+/*
+ * Stops reporting compilations
+ */
+void jitdebug_disable() {
+	debug_out = NULL;
+}
+
+/*
+ * Returns the index into node_type_names of the node that a mark is for, where
+ * NULL stands for code outside every node
+ */
+static int node_type(CodeMark *mark) {
+	if(!mark) return NODE_TYPE_COUNT - 1;
+	if(mark->expr) return mark->expr->type;
+	return expr_Ternary + 1 + mark->stmt->type;
+}
+
+/*
+ * Returns a string describing a statement in roughly the form it was written.
+ * Nested statement lists are left out, as they are described separately.
+ */
+static char *Statement_summary(Statement *stmt) {
+	char *str;
+
+	switch(stmt->type) {
+		case stmt_For: {
+			char *assignment = Statement_summary(stmt->stmt->_for->assignment);
+			char *bool_expr = Expression_str(stmt->stmt->_for->bool_expr);
+			char *incrementor = Statement_summary(stmt->stmt->_for->incrementor);
+			str = str_concat(6, "for ", assignment, ", ", bool_expr, ", ",
+				incrementor);
+			free(assignment);
+			free(bool_expr);
+			free(incrementor);
+			break;
+		}
+
+		case stmt_While: {
+			char *bool_expr = Expression_str(stmt->stmt->_while->bool_expr);
+			str = str_concat_2("while ", bool_expr);
+			free(bool_expr);
+			break;
+		}
+
+		case stmt_If: {
+			char *bool_expr = Expression_str(stmt->stmt->_if->bool_expr);
+			str = str_concat_2("if ", bool_expr);
+			free(bool_expr);
+			break;
+		}
+
+		case stmt_Print: {
+			char *expr = Expression_str(stmt->stmt->_print->expr);
+			str = str_concat_2("print ", expr);
+			free(expr);
+			break;
+		}
+
+		case stmt_Assignment: {
+			char *ident = Expression_str(stmt->stmt->_assignment->ident);
+			char *expr = Expression_str(stmt->stmt->_assignment->expr);
+			str = str_concat(3, ident, " <- ", expr);
+			free(ident);
+			free(expr);
+			break;
+		}
+
+		case stmt_Return: {
+			char *expr = Expression_str(stmt->stmt->_return->expr);
+			str = str_concat_2("return ", expr);
+			free(expr);
+			break;
+		}
+
+		default:
+			printf("Invalid statement type in AST\n");
+			exit(EXIT_FAILURE);
+	}
+
+	return str;
+}
+
+/*
+ * Returns a newly allocated string describing the node that a mark is for, as
+ * used to label code in listings. NULL stands for code outside every node.
+ */
+char *jitdebug_node_str(CodeMark *mark) {
+	if(!mark) return safe_strdup(node_type_names[NODE_TYPE_COUNT - 1]);
+	if(mark->expr) return Expression_str(mark->expr);
+	return Statement_summary(mark->stmt);
+}
+
+/*
+ * Returns the mark for the innermost node whose code contains the byte at the
+ * given offset, or NULL if there is none. Marks for nested nodes come after the
+ * marks for the nodes that contain them, so of two marks of the same length
+ * the later one is innermost.
+ */
+static CodeMark *innermost_mark(LinkedList *marks, int offset) {
+	CodeMark *innermost = NULL;
+	if(!marks) return NULL;
+
+	LLIterator *marks_iter = LLIterator_init(marks);
+	while(!LLIterator_ended(marks_iter)) {
+		CodeMark *mark = (CodeMark *)LLIterator_get_current(marks_iter);
+
+		if(mark->offset <= offset && offset < mark->offset + mark->len &&
+			(!innermost || mark->len <= innermost->len)) {
+
+			innermost = mark;
+		}
+
+		LLIterator_advance(marks_iter);
+	}
+	free(marks_iter);
+
+	return innermost;
+}
+
+/*
+ * Disassembles machine code by running objdump on it. Returns a list of
+ * DisasmLines, or NULL if objdump could not be run.
+ */
+static LinkedList *disassemble(byte *code, int len) {
+	char filename[] = "/tmp/minty-jitdebug-XXXXXX";
+	int fd = mkstemp(filename);
+	if(fd == -1) return NULL;
+	bool written = write(fd, code, len) == len;
+	close(fd);
+	if(!written) {
+		remove(filename);
+		return NULL;
+	}
+
+	char *command = str_concat(3, "objdump -D -b binary -m i386:x86-64 "
+		"-M intel --insn-width=16 ", filename, " 2>/dev/null");
+	FILE *objdump = popen(command, "r");
+	free(command);
+	if(!objdump) {
+		remove(filename);
+		return NULL;
+	}
+
+	// Instructions are listed as '<offset>:\t<bytes>\t<instruction>', any other
+	// lines are headers
+	LinkedList *lines = LinkedList_init();
+	char line[256];
+	while(fgets(line, sizeof(line), objdump)) {
+		unsigned int offset;
+		int consumed = -1;
+		sscanf(line, " %x:%n", &offset, &consumed);
+		if(consumed == -1 || line[consumed] != '\t') continue;
+
+		char *bytes = line + consumed + 1;
+		char *text = strchr(bytes, '\t');
+		if(!text) continue;
+		*text++ = '\0';
+
+		int i;
+		for(i = strlen(bytes) - 1; i >= 0 && bytes[i] == ' '; i--) {
+			bytes[i] = '\0';
+		}
+		text[strcspn(text, "\n")] = '\0';
+
+		DisasmLine *disasm = safe_alloc(sizeof(DisasmLine));
+		disasm->offset = offset;
+		disasm->bytes = safe_strdup(bytes);
+		disasm->text = safe_strdup(text);
+		LinkedList_append(lines, disasm);
+	}
+	pclose(objdump);
+	remove(filename);
+
+	if(LinkedList_length(lines) == 0) {
+		LinkedList_free(lines);
+		return NULL;
+	}
+	return lines;
+}
+
+/*
+ * Writes a label for the node that a mark is for
+ */
+static void print_label(CodeMark *mark) {
+	char *label = jitdebug_node_str(mark);
+	fprintf(debug_out, "        ; %s\n", label);
+	free(label);
+}
+
+/*
+ * Writes a listing of machine code, labelling each run of instructions with the
+ * innermost node that produced it. The code starts at offset base in the code
+ * that the marks refer to. Without objdump, the bytes are listed without being
+ * disassembled.
+ */
+static void print_listing(byte *code, int len, int base, LinkedList *marks) {
+	LinkedList *lines = disassemble(code, len);
+
+	if(lines) {
+		CodeMark *current = NULL;
+		LLIterator *lines_iter = LLIterator_init(lines);
+		while(!LLIterator_ended(lines_iter)) {
+			DisasmLine *line = (DisasmLine *)LLIterator_get_current(lines_iter);
+
+			CodeMark *mark = innermost_mark(marks, base + line->offset);
+			if(LLIterator_current_index(lines_iter) == 0 || mark != current) {
+				print_label(mark);
+			}
+			current = mark;
+
+			fprintf(debug_out, "  %4x:  %-30s  %s\n",
+				line->offset, line->bytes, line->text);
+
+			free(line->bytes);
+			free(line->text);
+			free(line);
+			LLIterator_advance(lines_iter);
+		}
+		free(lines_iter);
+		LinkedList_free(lines);
+		return;
+	}
+
+	int offset = 0;
+	while(offset < len) {
+		CodeMark *mark = innermost_mark(marks, base + offset);
+		print_label(mark);
+
+		// List the run of bytes produced by the node, 8 to a line
+		int run_start = offset;
+		while(offset < len && innermost_mark(marks, base + offset) == mark) {
+			if((offset - run_start) % 8 == 0) {
+				if(offset > run_start) fprintf(debug_out, "\n");
+				fprintf(debug_out, "  %4x: ", offset);
+			}
+			fprintf(debug_out, " %02x", code[offset]);
+			offset++;
+		}
+		fprintf(debug_out, "\n");
+	}
+}
+
+/*
+ * Reports a compiled function: its compile time, a listing of its code, and the
+ * number of bytes of code that each type of node produced. Bytes are counted
+ * against the innermost node that contains them, so an expression's total does
+ * not include the code for its sub-expressions. Does nothing if JIT debugging
+ * is disabled.
+ */
+void jitdebug_report_compilation(JITFunction *jf, char *name, LinkedList *marks) {
+	if(!debug_out) return;
+
+	fprintf(debug_out, "%s: compiled in %ld ns, %d bytes",
+		name, jf->compile_ns, jf->len + jf->cold_len);
+	if(jf->cold) fprintf(debug_out, " (%d cold)", jf->cold_len);
+	fprintf(debug_out, "\n");
+	print_listing(jf->code, jf->len, 0, marks);
+	if(jf->cold) {
+		fprintf(debug_out, "%s: cold code\n", name);
+		print_listing(jf->cold, jf->cold_len, jf->len, marks);
+	}
+
+	int sizes[NODE_TYPE_COUNT] = {0};
+	int counts[NODE_TYPE_COUNT] = {0};
+
+	int offset;
+	for(offset = 0; offset < jf->len + jf->cold_len; offset++) {
+		sizes[node_type(innermost_mark(marks, offset))]++;
+	}
+	counts[NODE_TYPE_COUNT - 1] = 1;
+	if(marks) {
+		LLIterator *marks_iter = LLIterator_init(marks);
+		while(!LLIterator_ended(marks_iter)) {
+			counts[node_type((CodeMark *)LLIterator_get_current(marks_iter))]++;
+			LLIterator_advance(marks_iter);
+		}
+		free(marks_iter);
+	}
+
+	fprintf(debug_out, "%s: code size by node type\n", name);
+	int i;
+	for(i = 0; i < NODE_TYPE_COUNT; i++) {
+		if(counts[i] == 0) continue;
+		fprintf(debug_out, "  %-22s %6d bytes in %d node%s\n",
+			node_type_names[i], sizes[i], counts[i], counts[i] == 1 ? "" : "s");
+	}
+	fflush(debug_out);
+}
+
+/*
+ * Writes a line describing how often a version of a function's compiled code
+ * was run
+ */
+static void print_executions(char *name, JITFunction *jf) {
+	fprintf(debug_out, "  %s: compiled code run %ld times, ", name,
+		jf->executions);
+	if(jf->compile_ns) {
+		fprintf(debug_out, "compiled in %ld ns\n", jf->compile_ns);
+	}
+	else fprintf(debug_out, "loaded from the JIT cache\n");
+}
+
+/*
+ * Reports the number of times each function in a program was called, and how
+ * often each version of its compiled code was run. Must be called before the
+ * compiled code is released. Does nothing if JIT debugging is disabled.
+ */
+void jitdebug_report_executions(Program *prog) {
+	if(!debug_out) return;
+
+	fprintf(debug_out, "JIT execution counts\n");
+
+	LLIterator *fn_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(fn_iter)) {
+		FNDecl *func = (FNDecl *)LLIterator_get_current(fn_iter);
+
+		fprintf(debug_out, "minty:%s: called %d times\n",
+			func->name, func->exec_count);
+		if(func->baseline) print_executions("baseline", func->baseline);
+		if(func->compiled) print_executions("general", func->compiled);
+		if(func->specialised) {
+			print_executions("specialised", func->specialised);
+		}
+
+		LLIterator_advance(fn_iter);
+	}
+	free(fn_iter);
+
+	fflush(debug_out);
+}
@@ -0,0 +1,41 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef JITCODE
+#include "jitcode.h"
+#endif // JITCODE
+
+#ifndef JITDEBUG
+#define JITDEBUG
+
+#include <stdio.h>
+
+/*
+ * A debugging mode for the JIT compiler. When enabled, every function compiled
+ * is reported with a listing of its machine code, disassembled by objdump if it
+ * is installed, where each run of instructions is labelled with the expression
+ * or statement that produced it. The report also gives the time taken to
+ * compile the function and the number of bytes of code produced for each type
+ * of AST node. At the end of the program, jitdebug_report_executions() gives
+ * the number of times each function was called and how often its compiled code
+ * was run.
+ */
+
+void jitdebug_enable(FILE *out);
+
+bool jitdebug_enabled();
+
+void jitdebug_disable();
+
+char *jitdebug_node_str(CodeMark *mark);
+
+void jitdebug_report_compilation(JITFunction *jf, char *name, LinkedList *marks);
+
+void jitdebug_report_executions(Program *prog);
+
+#endif // JITDEBUG
@@ -263,6 +263,19 @@ static TupleIntToken *get_next_token(char *input) {
 	return TupleIntToken_init(next_token, chars_processed);
 } 
 
+/*
+ * Advances the given input pointer past any whitespace, returning the number of
+ * newlines skipped so that the lexer can keep track of the current line
+ */
+static int skip_whitespace(char **input) {
+	int newlines = 0;
+	while(isspace(**input)) {
+		if(**input == '\n') newlines++;
+		*input += sizeof(char);
+	}
+	return newlines;
+}
+
 /*
  * Lexical analyser function - takes a pointer to a string, which is the
  * program on which to perform lexical analysis, and returns a linked-list of
@@ -272,8 +285,15 @@ LinkedList *lex(char *input) {
 	// If the input is an empty string, return NULL
 	if(*input == '\0') return NULL;
 
+	// The line that the next token is on. Whitespace is skipped here rather
+	// than in get_next_token() so that newlines can be counted, and so that
+	// trailing whitespace does not produce a token.
+	int line = 1 + skip_whitespace(&input);
+	if(*input == '\0') return NULL;
+
 	// Get the first token & the number of chars processed in retrieving it
 	TupleIntToken *tuple = get_next_token(input);
+	tuple->token->line = line;
 
 	// Construct a root TokenNode
 	LinkedList *tokens = LinkedList_init();
@@ -287,26 +307,32 @@ LinkedList *lex(char *input) {
 
 	// Again we must check that there is input left before getting the next
 	// token
+	line += skip_whitespace(&input);
 	if(*input == '\0') return tokens;
 
 	// Get the next (token, chars_processed), Put the new token in a TokenNode,
 	// Advance the input pointer
 	tuple = get_next_token(input);
+	tuple->token->line = line;
 	LinkedList_append(tokens, tuple->token);
 	input += tuple->chars_processed;
 	free(tuple);
+	line += skip_whitespace(&input);
 
 	// Repeatedly get a new token and add it to the linked list in the above
 	// way, until there is no input left
 	while(*input != '\0') {
 
 		tuple = get_next_token(input);
+		tuple->token->line = line;
 
 		LinkedList_append(tokens, tuple->token);
 
 		input += tuple->chars_processed;
 
 		free(tuple);
+
+		line += skip_whitespace(&input);
 	}
 
 	// Return the root node
@@ -1,13 +1,29 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
+#include <unistd.h>
 #include "minty_util.h"
 #include "token.h"
 #include "lexer.h"
 #include "parser.h"
 #include "AST.h"
 #include "interpreter.h"
+#include "codegen.h"
+#include "objcode.h"
+#include "jitcode.h"
+#include "jitcache.h"
+#include "perfmap.h"
+#include "gdbjit.h"
+#include "jitdebug.h"
+#include "profile.h"
+#include "ccode.h"
 
-int evaluate_program(char *source_code, LinkedList *args) {
+/*
+ * Runs a program, returning the value its main function returns. If
+ * profile_file is not NULL, the program is profiled as it runs (see
+ * interpreter_set_profiling()), and its profile written to the file afterwards.
+ */
+int evaluate_program(char *source_code, LinkedList *args, char *profile_file) {
 
 	// Lex the program to obtain the token list
 	LinkedList *tokens = lex(source_code);
@@ -23,26 +39,279 @@ int evaluate_program(char *source_code, LinkedList *args) {
 	LinkedList_free(tokens);
 
 	// Evaluate the program and store the result
+	interpreter_set_profiling(profile_file != NULL);
 	int result = interpret_program(ast, args);
+	if(profile_file) profile_write(ast, profile_file);
 
-	// Now we have the result, we can free the AST
+	// Now we have the result, we can report how often compiled code was run,
+	// then free the AST and any code compiled from it
+	jitdebug_report_executions(ast);
+	jitcode_release(ast);
 	Program_free(ast);
 
 	// Finally return the result of the program
 	return result;
 }
 
-int main() {
+/*
+ * Compiles a program ahead of time, writing its assembly code to the file with
+ * the given name instead of running it. The code can be linked into an
+ * executable with the system's C compiler, e.g. cc <file>. If profile_file is
+ * not NULL, the compiler uses the profile in it (see profile.h).
+ */
+void compile_program(char *source_code, char *filename, char *profile_file) {
+	LinkedList *tokens = lex(source_code);
+	Program *ast = parse_program(tokens);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	if(profile_file) profile_read(ast, profile_file);
+
+	FILE *file = fopen(filename, "w");
+	if(!file) {
+		printf("Could not open file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	Emitter *out = Emitter_init(file);
+	emit_program(out, ast);
+	Emitter_finish(out);
+
+	if(fclose(file)) {
+		printf("Could not write file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	Program_free(ast);
+}
+
+/*
+ * Compiles a program ahead of time into a relocatable object file with the
+ * given name, which can be linked into an executable with the system's C
+ * compiler in the same way as the assembly code from compile_program()
+ */
+void compile_program_object(char *source_code, char *filename,
+	char *profile_file) {
+
+	LinkedList *tokens = lex(source_code);
+	Program *ast = parse_program(tokens);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	if(profile_file) profile_read(ast, profile_file);
+
+	objcode_write(ast, filename);
+	Program_free(ast);
+}
+
+/*
+ * Compiles a program ahead of time as a library (see objcode.h), writing a
+ * shared object to shared_file and a C header declaring its functions to
+ * header_file, either of which may be NULL
+ */
+void compile_library(char *source_code, char *shared_file, char *header_file,
+	char *profile_file) {
+
+	LinkedList *tokens = lex(source_code);
+	Program *ast = parse_program(tokens);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	ast->library = true;
+	if(profile_file) profile_read(ast, profile_file);
+
+	if(shared_file) objcode_write_shared(ast, shared_file);
+	if(header_file) objcode_write_header(ast, header_file);
+	Program_free(ast);
+}
+
+/*
+ * Reads the whole of a file into a newly allocated string. Exits if the file
+ * cannot be read.
+ */
+static char *read_file(char *filename) {
+	FILE *file = fopen(filename, "rb");
+	if(!file) {
+		printf("Could not open file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char *contents = safe_alloc(size + 1);
+	if(fread(contents, 1, size, file) != size) {
+		printf("Could not read file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	contents[size] = '\0';
+
+	fclose(file);
+	return contents;
+}
+
+/*
+ * Runs a minty program:
+ *     minty [<option> ...] <source file> [<argument> ...]
+ * The arguments are passed to the program's main function as integers, and the
+ * value it returns is printed. The options are:
+ *     --jit-cache <directory>  save code compiled for hot functions in the
+ *                              directory, and load it again in later runs
+ *     --perf-map               name compiled code for perf in
+ *                              /tmp/perf-<pid>.map
+ *     --jitdump                also write compiled code to jit-<pid>.dump
+ *     --no-gdb-jit             do not describe compiled code to gdb
+ *     --jit-debug              list the code compiled for each function on
+ *                              stderr, with compile times, code sizes and
+ *                              execution counts
+ *     --jit-budget <bytes>     limit the executable memory used by compiled
+ *                              functions, evicting the least recently run
+ *                              (64 MiB by default)
+ *     --jit-threads <count>    compile hot functions on this many worker
+ *                              threads, or on the interpreter's thread if 0
+ *                              (one fewer than the number of cores by
+ *                              default)
+ *     --c-tier                 compile very hot programs into C with the
+ *                              system's C compiler (see ccode.h)
+ *     --emit-asm <file>        compile the program ahead of time, writing
+ *                              x86-64 assembly code to the file instead of
+ *                              running it (see compile_program())
+ *     --emit-obj <file>        compile the program ahead of time into an ELF
+ *                              object file instead of running it
+ *     --emit-shared <file>     compile the program ahead of time into a
+ *                              shared library instead of running it, exporting
+ *                              each function to C (see objcode.h)
+ *     --emit-header <file>     write a C header declaring the functions that
+ *                              the shared library exports, and the function
+ *                              that sets its error handler
+ *     --aot-threads <count>    compile functions ahead of time on this many
+ *                              threads (the number of cores by default)
+ *     --profile-generate <file>
+ *                              run the program in the interpreter only,
+ *                              writing a profile of it to the file
+ *     --profile-use <file>     compile the program ahead of time using the
+ *                              profile in the file (see profile.h)
+ */
+int main(int argc, char **argv) {
+	int arg_index = 1;
+	char *asm_file = NULL;
+	char *obj_file = NULL;
+	char *shared_file = NULL;
+	char *header_file = NULL;
+	char *profile_out = NULL;
+	char *profile_in = NULL;
+	jitcode_set_workers(sysconf(_SC_NPROCESSORS_ONLN) - 1);
+	codegen_set_threads(sysconf(_SC_NPROCESSORS_ONLN));
+
+	while(arg_index < argc && argv[arg_index][0] == '-') {
+		if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--jit-cache")) {
+
+			jitcache_set_directory(argv[++arg_index]);
+		}
+		else if(str_equal(argv[arg_index], "--perf-map")) {
+			perfmap_enable(false);
+		}
+		else if(str_equal(argv[arg_index], "--jitdump")) {
+			perfmap_enable(true);
+		}
+		else if(str_equal(argv[arg_index], "--no-gdb-jit")) {
+			gdbjit_set_enabled(false);
+		}
+		else if(str_equal(argv[arg_index], "--jit-debug")) {
+			jitdebug_enable(stderr);
+		}
+		else if(str_equal(argv[arg_index], "--c-tier")) {
+			ccode_set_enabled(true);
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--jit-budget")) {
+
+			jitcode_set_budget(atol(argv[++arg_index]));
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--jit-threads")) {
+
+			jitcode_set_workers(atoi(argv[++arg_index]));
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--aot-threads")) {
+
+			codegen_set_threads(atoi(argv[++arg_index]));
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--emit-asm")) {
+
+			asm_file = argv[++arg_index];
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--emit-obj")) {
+
+			obj_file = argv[++arg_index];
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--emit-shared")) {
+
+			shared_file = argv[++arg_index];
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--emit-header")) {
+
+			header_file = argv[++arg_index];
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--profile-generate")) {
+
+			profile_out = argv[++arg_index];
+		}
+		else if(arg_index + 1 < argc &&
+			str_equal(argv[arg_index], "--profile-use")) {
+
+			profile_in = argv[++arg_index];
+		}
+		else break;
+
+		arg_index++;
+	}
+
+	if(arg_index >= argc) {
+		printf("Usage: %s [--jit-cache <directory>] [--perf-map] "
+			"[--jitdump] [--no-gdb-jit] [--jit-debug] "
+			"[--jit-budget <bytes>] [--jit-threads <count>] [--c-tier] "
+			"[--emit-asm <file>] [--emit-obj <file>] "
+			"[--emit-shared <file>] [--emit-header <file>] "
+			"[--aot-threads <count>] [--profile-generate <file>] "
+			"[--profile-use <file>] "
+			"<source file> [<argument> ...]\n",
+			argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	gdbjit_set_source(argv[arg_index]);
+	char *source_code = read_file(argv[arg_index++]);
+
+	if(asm_file || obj_file || shared_file || header_file) {
+		if(asm_file) compile_program(source_code, asm_file, profile_in);
+		if(obj_file) {
+			compile_program_object(source_code, obj_file, profile_in);
+		}
+		if(shared_file || header_file) {
+			compile_library(source_code, shared_file, header_file,
+				profile_in);
+		}
+		free(source_code);
+		return 0;
+	}
+
 	LinkedList *args = LinkedList_init();
+	for(; arg_index < argc; arg_index++) {
+		LinkedList_append(args, (void *)(long)atoi(argv[arg_index]));
+	}
 
-	printf("%d\n", evaluate_program("\
-		fn main() {                  \
-			return hundred();        \
-		}                            \
-		fn hundred() {               \
-			return 100;              \
-		}", args));
+	printf("%d\n", evaluate_program(source_code, args, profile_out));
 
-	free(args);
+	LinkedList_free(args);
+	free(source_code);
+	jitcache_set_directory(NULL);
+	perfmap_disable();
+	gdbjit_set_source(NULL);
+	jitdebug_disable();
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <elf.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "optimiser.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "jitcode.h"
+#include "codegen.h"
+#include "gdbjit.h"
+#include "objcode.h"
+
+/*
+ * The sections of the object file, in order
+ */
+#define SECTION_NULL 0
+#define SECTION_TEXT 1
+#define SECTION_RODATA 2
+#define SECTION_BSS 3
+#define SECTION_RELA_TEXT 4
+#define SECTION_SYMTAB 5
+#define SECTION_STRTAB 6
+#define SECTION_NOTE_GNU_STACK 7
+#define SECTION_SHSTRTAB 8
+#define SECTION_COUNT 9
+
+/*
+ * The local symbols, which ELF requires to come before the global ones: the
+ * null symbol, and the .text, .rodata and .bss sections, which code in .text
+ * refers to through relocations
+ */
+#define SYMBOL_TEXT 1
+#define SYMBOL_RODATA 2
+#define SYMBOL_BSS 3
+#define FIRST_GLOBAL_SYMBOL 4
+
+/*
+ * The x86-64 register numbers that the first REGISTER_ARGS arguments are passed
+ * in: %edi, %esi, %edx, %ecx, %r8d and %r9d
+ */
+static byte arg_registers[REGISTER_ARGS] = { 7, 6, 2, 1, 8, 9 };
+
+/*
+ * The contents of a section, in a buffer that doubles in size whenever it is
+ * full, in the same way as an Emitter's (see codegen.h)
+ */
+typedef struct {
+	byte *data;
+	int len;
+	int capacity;
+} Section;
+
+/*
+ * The symbol of a function defined in the object file, in a table sorted by
+ * name so that calls can be resolved with a binary search
+ */
+typedef struct {
+	char *name;
+	int symbol;
+} FunctionSymbol;
+
+/*
+ * The object file being written: the contents of its sections, its symbols,
+ * and the offsets of the strings that the code uses in .rodata. A library's
+ * functions report errors through its error handler, a pointer in .bss which
+ * is passed to the routine at error_routine in .text (see objcode_errors()).
+ */
+typedef struct {
+	Section text;
+	Section rodata;
+	Section rela_text;
+	Section strtab;
+	int bss_len;
+
+	Elf64_Sym *symbols;
+	int symbol_count;
+	int symbol_capacity;
+
+	FunctionSymbol *functions;
+	int function_count;
+
+	int printf_str;
+	int missing_return_str;
+	int arg_count_str;
+
+	bool library;
+	int error_handler;
+	int error_routine;
+	int missing_return_error;
+	int division_error;
+} ObjFile;
+
+/*
+ * The jumps between the blocks of a function, whose 32 bit displacements are
+ * filled in once every block has been placed: the offset of each displacement
+ * in .text, and the id of the block it should land on
+ */
+typedef struct {
+	int *offsets;
+	int *targets;
+	int count;
+} BlockJumps;
+
+/*
+ * Appends bytes to a section, returning the offset that they were written at
+ */
+static int section_append(Section *section, void *data, int len) {
+	int offset = section->len;
+
+	if(section->len + len > section->capacity) {
+		if(section->capacity == 0) section->capacity = 4096;
+		while(section->len + len > section->capacity) section->capacity *= 2;
+		section->data = realloc(section->data, section->capacity);
+		if(!section->data) {
+			printf("Could not allocate memory for object code\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(section->data + section->len, data, len);
+	section->len += len;
+
+	return offset;
+}
+
+static int section_append_string(Section *section, char *str) {
+	return section_append(section, str, strlen(str) + 1);
+}
+
+/*
+ * Pads a section with the given byte until its length is a multiple of align
+ */
+static void section_align(Section *section, int align, byte padding) {
+	while(section->len % align) section_append(section, &padding, 1);
+}
+
+/*
+ * Appends the given bytes of code to .text
+ */
+static void put_bytes(ObjFile *obj, int count, ...) {
+	byte instr[16];
+
+	va_list bytes;
+	va_start(bytes, count);
+	int i;
+	for(i = 0; i < count; i++) instr[i] = (byte) va_arg(bytes, int);
+	va_end(bytes);
+
+	section_append(&(obj->text), instr, count);
+}
+
+/*
+ * Appends a 32 bit value to .text, returning the offset that it was written at
+ */
+static int put_int(ObjFile *obj, int value) {
+	byte bytes[4];
+	put_int_as_bytes(bytes, 0, value);
+	return section_append(&(obj->text), bytes, 4);
+}
+
+/*
+ * Adds a symbol to the object file, returning its index
+ */
+static int add_symbol(ObjFile *obj, char *name, int info, int section) {
+	if(obj->symbol_count == obj->symbol_capacity) {
+		obj->symbol_capacity *= 2;
+		obj->symbols = realloc(obj->symbols,
+			sizeof(Elf64_Sym) * obj->symbol_capacity);
+		if(!obj->symbols) {
+			printf("Could not allocate memory for object code\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	Elf64_Sym *symbol = &(obj->symbols[obj->symbol_count]);
+	memset(symbol, 0, sizeof(Elf64_Sym));
+	symbol->st_name = name ? section_append_string(&(obj->strtab), name) : 0;
+	symbol->st_info = info;
+	symbol->st_shndx = section;
+
+	return obj->symbol_count++;
+}
+
+static int compare_function_symbols(const void *a, const void *b) {
+	return strcmp(((FunctionSymbol *)a)->name, ((FunctionSymbol *)b)->name);
+}
+
+/*
+ * Returns the index of the global symbol with the given name, which is added
+ * as an undefined symbol, for the linker to resolve, if the object file does
+ * not define it
+ */
+static int global_symbol(ObjFile *obj, char *name) {
+	FunctionSymbol key = { name, 0 };
+	FunctionSymbol *found = bsearch(&key, obj->functions, obj->function_count,
+		sizeof(FunctionSymbol), compare_function_symbols);
+	if(found) return found->symbol;
+
+	int i;
+	for(i = FIRST_GLOBAL_SYMBOL; i < obj->symbol_count; i++) {
+		if(obj->symbols[i].st_shndx == SHN_UNDEF &&
+			str_equal((char *)obj->strtab.data + obj->symbols[i].st_name,
+				name)) {
+
+			return i;
+		}
+	}
+
+	return add_symbol(obj, name, ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE),
+		SHN_UNDEF);
+}
+
+/*
+ * Records that the 32 bit field at the given offset in .text refers to a
+ * symbol
+ */
+static void add_relocation(ObjFile *obj, int offset, int symbol, int type,
+	int addend) {
+
+	Elf64_Rela rela;
+	rela.r_offset = offset;
+	rela.r_info = ELF64_R_INFO(symbol, type);
+	rela.r_addend = addend;
+	section_append(&(obj->rela_text), &rela, sizeof(Elf64_Rela));
+}
+
+/*
+ * Appends a call to the function with the given symbol name: call <name>
+ */
+static void put_call(ObjFile *obj, char *name) {
+	put_bytes(obj, 1, 0xE8);
+	int offset = put_int(obj, 0);
+	add_relocation(obj, offset, global_symbol(obj, name), R_X86_64_PLT32, -4);
+}
+
+/*
+ * Appends a call to a minty function, whose symbol has SYMBOL_PREFIX before its
+ * name
+ */
+static void put_minty_call(ObjFile *obj, char *name) {
+	char *symbol = str_concat_2(SYMBOL_PREFIX, name);
+	put_call(obj, symbol);
+	free(symbol);
+}
+
+/*
+ * Loads the address of the string at the given offset in .rodata into %rdi
+ * (reg 7) or %rsi (reg 6): leaq <offset>(%rip), %rdi/%rsi
+ */
+static void put_string_address(ObjFile *obj, int offset, byte reg) {
+	put_bytes(obj, 3, 0x48, 0x8D, 0x05 | (reg << 3));
+	int field = put_int(obj, 0);
+	add_relocation(obj, field, SYMBOL_RODATA, R_X86_64_PC32, offset - 4);
+}
+
+/*
+ * Appends the code that reports an error in a library function to its error
+ * handler: leaq <name>(%rip), %rdi; leaq <error>(%rip), %rsi;
+ * call error_routine. The name of the function is written to .rodata the first
+ * time that it is needed, and its offset kept in name.
+ */
+static void put_library_error(ObjFile *obj, FNDecl *func, int *name,
+	int error) {
+
+	if(*name == -1) *name = section_append_string(&(obj->rodata), func->name);
+	put_string_address(obj, *name, 7);
+	put_string_address(obj, error, 6);
+	put_bytes(obj, 1, 0xE8);
+	put_int(obj, obj->error_routine - (obj->text.len + 4));
+}
+
+/*
+ * The code for a function is generated from its SSA form (see ir.h), following
+ * the calling convention, the register allocation (see regalloc.h) and the
+ * stack frame of emit_function() (see codegen.h), with the same choice of
+ * instructions. Values that are not in registers are in stack slots, which
+ * are addressed with 32 bit displacements from %rbp.
+ */
+
+/*
+ * The r/m operand of an instruction that is a stack slot rather than a
+ * register
+ */
+#define RM_FRAME -1
+
+/*
+ * Appends an instruction with a one or two byte opcode, whose operands are the
+ * register reg (or an opcode extension) and either the register rm or, if rm
+ * is RM_FRAME, the stack slot at disp(%rbp): [REX] <opcode> <ModRM> [<disp>]
+ */
+static void put_instruction(ObjFile *obj, int opcode, byte reg, int rm,
+	int disp) {
+
+	byte rex = 0x40 | (reg >= 8 ? 0x04 : 0) | (rm >= 8 ? 0x01 : 0);
+	if(rex != 0x40) put_bytes(obj, 1, rex);
+	if(opcode > 0xFF) put_bytes(obj, 1, opcode >> 8);
+
+	if(rm == RM_FRAME) {
+		put_bytes(obj, 2, opcode & 0xFF, 0x85 | ((reg & 7) << 3));
+		put_int(obj, disp);
+	}
+	else put_bytes(obj, 2, opcode & 0xFF, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/*
+ * Appends an instruction whose r/m operand is a value that is not a constant
+ */
+static void put_value_instruction(ObjFile *obj, RegAllocation *ra, int opcode,
+	byte reg, IRValue *value) {
+
+	if(ra->registers[value->id] >= 0) {
+		put_instruction(obj, opcode, reg, ra->registers[value->id], 0);
+	}
+	else {
+		put_instruction(obj, opcode, reg, RM_FRAME,
+			RegAllocation_slot_offset(ra, value));
+	}
+}
+
+/*
+ * Loads a value into a register, given its number: movl $<value>, <reg> for a
+ * constant, or movl <value>, <reg>
+ */
+static void put_load_value(ObjFile *obj, RegAllocation *ra, IRValue *value,
+	byte reg) {
+
+	if(value->op == ir_Constant) {
+		if(reg >= 8) put_bytes(obj, 1, 0x41);
+		put_bytes(obj, 1, 0xB8 + (reg & 7));
+		put_int(obj, value->value);
+	}
+	else if(ra->registers[value->id] != reg) {
+		put_value_instruction(obj, ra, 0x8B, reg, value);
+	}
+}
+
+/*
+ * Stores a register into a value: movl <reg>, <value>
+ */
+static void put_store_value(ObjFile *obj, RegAllocation *ra, byte reg,
+	IRValue *value) {
+
+	if(ra->registers[value->id] != reg) {
+		put_value_instruction(obj, ra, 0x89, reg, value);
+	}
+}
+
+/*
+ * Moves one value into another, through %eax if both are in memory
+ */
+static void put_move(ObjFile *obj, RegAllocation *ra, IRValue *source,
+	IRValue *dest) {
+
+	if(RegAllocation_same(ra, source, dest)) return;
+
+	if(ra->registers[dest->id] >= 0) {
+		put_load_value(obj, ra, source, ra->registers[dest->id]);
+	}
+	else if(source->op == ir_Constant) {
+
+		// movl $<value>, <dest>
+		put_value_instruction(obj, ra, 0xC7, 0, dest);
+		put_int(obj, source->value);
+	}
+	else if(ra->registers[source->id] >= 0) {
+		put_store_value(obj, ra, ra->registers[source->id], dest);
+	}
+	else {
+		put_load_value(obj, ra, source, 0);
+		put_store_value(obj, ra, 0, dest);
+	}
+}
+
+/*
+ * Applies an operation to a register, with a value as its second operand:
+ * addl/subl/imull/cmpl <value>, <reg>, with the immediate forms for constants
+ */
+static void put_operation(ObjFile *obj, RegAllocation *ra, int operator,
+	byte reg, IRValue *value) {
+
+	if(value->op == ir_Constant) {
+		if(operator == MULTIPLY) put_instruction(obj, 0x69, reg, reg, 0);
+		else {
+			byte extension = operator == PLUS ? 0 : operator == MINUS ? 5 : 7;
+			put_instruction(obj, 0x81, extension, reg, 0);
+		}
+		put_int(obj, value->value);
+		return;
+	}
+
+	int opcode;
+	     if(operator ==     PLUS) opcode = 0x03;
+	else if(operator ==    MINUS) opcode = 0x2B;
+	else if(operator == MULTIPLY) opcode = 0x0FAF;
+	else                          opcode = 0x3B;
+	put_value_instruction(obj, ra, opcode, reg, value);
+}
+
+/*
+ * Generates the code for a value. Phis, constants and undefined values have no
+ * code of their own, and arguments are put where they belong on entry to the
+ * function. The name of the function is kept in name, as by objcode_exit().
+ */
+static void objcode_value(ObjFile *obj, RegAllocation *ra, FNDecl *func,
+	IRValue *value, int *name) {
+
+	int i;
+
+	switch(value->op) {
+		case ir_Arithmetic: {
+			IRValue *lhs = value->args[0];
+			IRValue *rhs = value->args[1];
+
+			// cltd; idivl %ecx, leaving the quotient in %eax and the remainder
+			// in %edx
+			if(value->operator == DIVIDE || value->operator == MODULO) {
+				put_load_value(obj, ra, rhs, 1);
+				put_load_value(obj, ra, lhs, 0);
+
+				// A library reports a division that would fault before it is
+				// made, then makes a division by zero, which faults in the
+				// same way: testl %ecx, %ecx; je <error>; cmpl $-1, %ecx;
+				// jne <divide>; cmpl $INT_MIN, %eax; jne <divide>;
+				// <error>: <report>; xorl %ecx, %ecx; <divide>:
+				if(obj->library) {
+					put_bytes(obj, 14, 0x85, 0xC9, 0x74, 0x0C, 0x83, 0xF9,
+						0xFF, 0x75, 0x1C, 0x3D, 0x00, 0x00, 0x00, 0x80);
+					put_bytes(obj, 2, 0x75, 0x15);
+					put_library_error(obj, func, name, obj->division_error);
+					put_bytes(obj, 2, 0x31, 0xC9);
+				}
+				put_bytes(obj, 3, 0x99, 0xF7, 0xF9);
+				put_store_value(obj, ra, value->operator == DIVIDE ? 0 : 2,
+					value);
+				break;
+			}
+
+			// The result is worked out where it is kept, unless that would
+			// overwrite the right-hand side before it is used, which the
+			// operands of an addition or multiplication are swapped to avoid
+			if((value->operator == PLUS || value->operator == MULTIPLY) &&
+				rhs->op != ir_Constant && RegAllocation_same(ra, value, rhs)) {
+
+				rhs = lhs;
+				lhs = value->args[1];
+			}
+			int reg = ra->registers[value->id];
+			if(reg >= 0 && (rhs->op == ir_Constant ||
+				!RegAllocation_same(ra, value, rhs))) {
+
+				put_move(obj, ra, lhs, value);
+				put_operation(obj, ra, value->operator, reg, rhs);
+			}
+			else {
+				put_load_value(obj, ra, lhs, 0);
+				put_operation(obj, ra, value->operator, 0, rhs);
+				put_store_value(obj, ra, 0, value);
+			}
+			break;
+		}
+
+		case ir_Compare: {
+			// cmpl <rhs>, <lhs>, through %eax if the left-hand side is not in
+			// a register
+			IRValue *lhs = value->args[0];
+			int reg = lhs->op == ir_Constant ? -1 : ra->registers[lhs->id];
+			if(reg < 0) {
+				put_load_value(obj, ra, lhs, 0);
+				reg = 0;
+			}
+			put_operation(obj, ra, EQUAL, reg, value->args[1]);
+
+			int setcc;
+			switch(value->operator) {
+				case EQUAL: setcc = 0x94; break;
+				case NOT_EQUAL: setcc = 0x95; break;
+				case LESS_THAN: setcc = 0x9C; break;
+				case GREATER_THAN: setcc = 0x9F; break;
+				case LESS_OR_EQUAL: setcc = 0x9E; break;
+				default: setcc = 0x9D; break;
+			}
+
+			// set<cc> %al; movzbl %al, <reg>, through %eax if the value is in
+			// memory
+			put_bytes(obj, 3, 0x0F, setcc, 0xC0);
+			if(ra->registers[value->id] >= 0) {
+				put_instruction(obj, 0x0FB6, ra->registers[value->id], 0, 0);
+			}
+			else {
+				put_instruction(obj, 0x0FB6, 0, 0, 0);
+				put_store_value(obj, ra, 0, value);
+			}
+			break;
+		}
+
+		case ir_Call: {
+
+			// Arguments after the sixth are pushed from last to first, with 8
+			// bytes of padding first if there are an odd number of them
+			// (subq $8, %rsp), as in emit_function()
+			int stack_args = value->arg_count > REGISTER_ARGS ?
+				value->arg_count - REGISTER_ARGS : 0;
+			int padding = 8 * (stack_args % 2);
+
+			if(padding) put_bytes(obj, 4, 0x48, 0x83, 0xEC, 0x08);
+			for(i = value->arg_count - 1; i >= REGISTER_ARGS; i--) {
+
+				// pushq %rax
+				put_load_value(obj, ra, value->args[i], 0);
+				put_bytes(obj, 1, 0x50);
+			}
+			for(i = 0; i < value->arg_count && i < REGISTER_ARGS; i++) {
+				put_load_value(obj, ra, value->args[i], arg_registers[i]);
+			}
+
+			// addq $<size>, %rsp
+			put_minty_call(obj, value->call->name);
+			if(stack_args) {
+				put_bytes(obj, 3, 0x48, 0x81, 0xC4);
+				put_int(obj, (8 * stack_args) + padding);
+			}
+			put_store_value(obj, ra, 0, value);
+			break;
+		}
+
+		case ir_Print:
+
+			// movl <value>, %esi; leaq printf_str(%rip), %rdi;
+			// xorl %eax, %eax; call printf
+			put_load_value(obj, ra, value->args[0], 6);
+			put_string_address(obj, obj->printf_str, 7);
+			put_bytes(obj, 2, 0x31, 0xC0);
+			put_call(obj, "printf");
+			break;
+
+		case ir_Argument:
+
+			// movl <reg>, <value>, or movl <offset>(%rbp), %eax and
+			// movl %eax, <value> for an argument passed on the stack
+			if(value->value < REGISTER_ARGS) {
+				put_store_value(obj, ra, arg_registers[value->value], value);
+			}
+			else {
+				put_instruction(obj, 0x8B, 0, RM_FRAME,
+					16 + (8 * (value->value - REGISTER_ARGS)));
+				put_store_value(obj, ra, 0, value);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/*
+ * Generates the code that gives a block's phis their values on entry from
+ * pred. If one phi is kept where another's value is, all the values are
+ * pushed before any phi is written.
+ */
+static void objcode_phi_moves(ObjFile *obj, RegAllocation *ra, IRBlock *pred,
+	IRBlock *block) {
+
+	int index = IRBlock_pred_index(block, pred);
+
+	int i;
+	if(!RegAllocation_phi_moves_overlap(ra, block, index)) {
+		for(i = 0; i < block->value_count; i++) {
+			IRValue *phi = block->values[i];
+			if(phi->op == ir_Phi) put_move(obj, ra, phi->args[index], phi);
+		}
+		return;
+	}
+
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *phi = block->values[i];
+		if(phi->op != ir_Phi || RegAllocation_same(ra, phi->args[index], phi)) {
+			continue;
+		}
+
+		// pushq %rax
+		put_load_value(obj, ra, phi->args[index], 0);
+		put_bytes(obj, 1, 0x50);
+	}
+
+	for(i = block->value_count - 1; i >= 0; i--) {
+		IRValue *phi = block->values[i];
+		if(phi->op != ir_Phi || RegAllocation_same(ra, phi->args[index], phi)) {
+			continue;
+		}
+
+		// popq %rax
+		put_bytes(obj, 1, 0x58);
+		put_store_value(obj, ra, 0, phi);
+	}
+}
+
+/*
+ * Records a jump to a block, whose displacement has just been written at the
+ * end of .text
+ */
+static void BlockJumps_add(BlockJumps *jumps, ObjFile *obj, IRBlock *target) {
+	jumps->offsets[jumps->count] = obj->text.len - 4;
+	jumps->targets[jumps->count] = target->id;
+	jumps->count++;
+}
+
+/*
+ * Generates the code that leaves a block, where next is the block placed after
+ * it (or NULL if it is the last block). The name of the function is written to
+ * .rodata the first time that it is needed, and its offset kept in name.
+ */
+static void objcode_exit(ObjFile *obj, RegAllocation *ra, FNDecl *func,
+	IRBlock *block, IRBlock *next, BlockJumps *jumps, int *name) {
+
+	int i;
+
+	switch(block->exit) {
+		case ir_Jump:
+
+			// jmp <block>
+			objcode_phi_moves(obj, ra, block, block->succs[0]);
+			if(block->succs[0] != next) {
+				put_bytes(obj, 1, 0xE9);
+				put_int(obj, 0);
+				BlockJumps_add(jumps, obj, block->succs[0]);
+			}
+			break;
+
+		case ir_Branch: {
+			IRBlock *if_true = block->succs[0];
+			IRBlock *if_false = block->succs[1];
+			bool false_moves = RegAllocation_has_phi_moves(ra, block, if_false);
+
+			// testl <reg>, <reg>, through %eax if the condition is not in a
+			// register; je <if_false>
+			IRValue *condition = block->exit_value;
+			int reg = condition->op == ir_Constant ? -1 :
+				ra->registers[condition->id];
+			if(reg < 0) {
+				put_load_value(obj, ra, condition, 0);
+				reg = 0;
+			}
+			put_instruction(obj, 0x85, reg, reg, 0);
+
+			// If if_false comes next, and if_true needs no phi moves, the
+			// branch can go the other way and fall through to if_false:
+			// jne <if_true>
+			if(if_false == next &&
+				!RegAllocation_has_phi_moves(ra, block, if_true)) {
+
+				put_bytes(obj, 2, 0x0F, 0x85);
+				put_int(obj, 0);
+				BlockJumps_add(jumps, obj, if_true);
+				objcode_phi_moves(obj, ra, block, if_false);
+				break;
+			}
+
+			put_bytes(obj, 2, 0x0F, 0x84);
+			int false_jump = put_int(obj, 0);
+
+			objcode_phi_moves(obj, ra, block, if_true);
+			if(if_true != next || false_moves) {
+				put_bytes(obj, 1, 0xE9);
+				put_int(obj, 0);
+				BlockJumps_add(jumps, obj, if_true);
+			}
+
+			// If phis must be given values on the way to if_false, the je lands
+			// on code that does so
+			if(false_moves) {
+				put_int_as_bytes(obj->text.data, false_jump,
+					obj->text.len - (false_jump + 4));
+				objcode_phi_moves(obj, ra, block, if_false);
+				put_bytes(obj, 1, 0xE9);
+				put_int(obj, 0);
+				BlockJumps_add(jumps, obj, if_false);
+			}
+			else {
+				jumps->offsets[jumps->count] = false_jump;
+				jumps->targets[jumps->count] = if_false->id;
+				jumps->count++;
+			}
+			break;
+		}
+
+		case ir_Return:
+
+			// Restore the saved registers: movq <offset>(%rbp), <reg>; then
+			// leave; ret
+			put_load_value(obj, ra, block->exit_value, 0);
+			for(i = 0; i < ra->saved_count; i++) {
+				byte reg = ra->saved[i];
+				put_bytes(obj, 3, reg >= 8 ? 0x4C : 0x48, 0x8B,
+					0x85 | ((reg & 7) << 3));
+				put_int(obj, -8 * (i + 1));
+			}
+			put_bytes(obj, 2, 0xC9, 0xC3);
+			break;
+
+		case ir_MissingReturn:
+
+			// A library reports the error to its error handler first
+			if(obj->library) {
+				put_library_error(obj, func, name, obj->missing_return_error);
+			}
+
+			// Report the error in the same way as the interpreter, and exit:
+			// leaq missing_return_str(%rip), %rdi; leaq <name>(%rip), %rsi;
+			// xorl %eax, %eax; call printf; movl $1, %edi; call exit
+			if(*name == -1) {
+				*name = section_append_string(&(obj->rodata), func->name);
+			}
+			put_string_address(obj, obj->missing_return_str, 7);
+			put_string_address(obj, *name, 6);
+			put_bytes(obj, 2, 0x31, 0xC0);
+			put_call(obj, "printf");
+			put_bytes(obj, 5, 0xBF, 0x01, 0x00, 0x00, 0x00);
+			put_call(obj, "exit");
+			break;
+	}
+}
+
+/*
+ * The functions of a program, with their optimised SSA forms and register
+ * allocations, which are worked out for every function in parallel before any
+ * code is written (see codegen_parallel() in codegen.h), in the same way as
+ * emit_function()
+ */
+typedef struct {
+	FNDecl **funcs;
+	IRFunction **irs;
+	RegAllocation **allocations;
+	Program *prog;
+} ProgramFunctions;
+
+static void objcode_prepare_function(int index, void *data) {
+	ProgramFunctions *functions = (ProgramFunctions *)data;
+	IRFunction *ir = IRFunction_build(functions->funcs[index], true);
+	ir_sccp(ir);
+	ir_gvn(ir);
+	ir_dce(ir);
+	ir_inline_calls(ir, functions->prog);
+	functions->irs[index] = ir;
+	functions->allocations[index] = regalloc_function(ir);
+	ir_layout(ir);
+}
+
+/*
+ * Generates the code for a function at the end of .text from its SSA form and
+ * register allocation, and fills in the value and size of its symbol
+ */
+static void objcode_function(ObjFile *obj, FNDecl *func, IRFunction *ir,
+	RegAllocation *ra, int symbol) {
+
+	// Functions start on a 16 byte boundary, padded with nops
+	section_align(&(obj->text), 16, 0x90);
+	int start = obj->text.len;
+
+	// pushq %rbp; movq %rsp, %rbp; pushq <reg> for each saved register;
+	// subq $<frame_size>, %rsp
+	int frame_size = RegAllocation_frame_size(ra);
+	put_bytes(obj, 4, 0x55, 0x48, 0x89, 0xE5);
+
+	int i, j;
+	for(i = 0; i < ra->saved_count; i++) {
+		if(ra->saved[i] >= 8) put_bytes(obj, 1, 0x41);
+		put_bytes(obj, 1, 0x50 + (ra->saved[i] & 7));
+	}
+	if(frame_size) {
+		put_bytes(obj, 3, 0x48, 0x81, 0xEC);
+		put_int(obj, frame_size);
+	}
+
+	// Each block can end with up to two jumps to other blocks
+	int *block_offsets = safe_alloc(sizeof(int) * (ir->next_block_id + 1));
+	BlockJumps jumps;
+	jumps.offsets = safe_alloc(sizeof(int) * ((2 * ir->block_count) + 1));
+	jumps.targets = safe_alloc(sizeof(int) * ((2 * ir->block_count) + 1));
+	jumps.count = 0;
+	int name = -1;
+
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		IRBlock *next = i + 1 < ir->block_count ? ir->blocks[i + 1] : NULL;
+
+		block_offsets[block->id] = obj->text.len;
+		for(j = 0; j < block->value_count; j++) {
+			objcode_value(obj, ra, func, block->values[j], &name);
+		}
+		objcode_exit(obj, ra, func, block, next, &jumps, &name);
+	}
+
+	for(i = 0; i < jumps.count; i++) {
+		put_int_as_bytes(obj->text.data, jumps.offsets[i],
+			block_offsets[jumps.targets[i]] - (jumps.offsets[i] + 4));
+	}
+
+	obj->symbols[symbol].st_value = start;
+	obj->symbols[symbol].st_size = obj->text.len - start;
+
+	free(block_offsets);
+	free(jumps.offsets);
+	free(jumps.targets);
+}
+
+/*
+ * Generates the program's entry point, the C main() function, which behaves in
+ * the same way as the one generated by emit_program() (see emit_entry() in
+ * codegen.c), with the same stack frame
+ */
+static void objcode_entry(ObjFile *obj, FNDecl *main_func, int symbol) {
+	int arg_count = LinkedList_length(main_func->args);
+	int stack_args = arg_count > REGISTER_ARGS ? arg_count - REGISTER_ARGS : 0;
+
+	section_align(&(obj->text), 16, 0x90);
+	int start = obj->text.len;
+
+	// pushq %rbp; movq %rsp, %rbp; pushq %rbx; pushq %r12;
+	// subq $<size>, %rsp
+	put_bytes(obj, 10, 0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54,
+		0x48, 0x81, 0xEC);
+	put_int(obj, ((4 * arg_count) + 15) & ~15);
+
+	// movl %edi, %ebx; movq %rsi, %r12
+	put_bytes(obj, 5, 0x89, 0xFB, 0x49, 0x89, 0xF4);
+
+	// leal -1(%rbx), %edx; cmpl $<arg_count>, %edx; je <args>
+	put_bytes(obj, 5, 0x8D, 0x53, 0xFF, 0x81, 0xFA);
+	put_int(obj, arg_count);
+	put_bytes(obj, 2, 0x0F, 0x84);
+	int args_jump = put_int(obj, 0);
+
+	// Report the wrong number of arguments and exit:
+	// leaq arg_count_str(%rip), %rdi; movl $<arg_count>, %esi;
+	// xorl %eax, %eax; call printf; movl $1, %edi; call exit
+	put_string_address(obj, obj->arg_count_str, 7);
+	put_bytes(obj, 1, 0xBE);
+	put_int(obj, arg_count);
+	put_bytes(obj, 2, 0x31, 0xC0);
+	put_call(obj, "printf");
+	put_bytes(obj, 5, 0xBF, 0x01, 0x00, 0x00, 0x00);
+	put_call(obj, "exit");
+	put_int_as_bytes(obj->text.data, args_jump,
+		obj->text.len - (args_jump + 4));
+
+	// Convert argument i from argv[i + 1]: movq <8 * (i + 1)>(%r12), %rdi;
+	// call atoi; movl %eax, <slot>(%rbp)
+	int i;
+	for(i = 0; i < arg_count; i++) {
+		put_bytes(obj, 4, 0x49, 0x8B, 0xBC, 0x24);
+		put_int(obj, 8 * (i + 1));
+		put_call(obj, "atoi");
+		put_bytes(obj, 2, 0x89, 0x85);
+		put_int(obj, -(20 + (4 * i)));
+	}
+
+	// Pass the arguments in the same way as a call from a minty function:
+	// movl <slot>(%rbp), %eax; pushq %rax for those on the stack, and
+	// movl <slot>(%rbp), <reg> for the rest
+	if(stack_args % 2) put_bytes(obj, 4, 0x48, 0x83, 0xEC, 0x08);
+	for(i = arg_count - 1; i >= REGISTER_ARGS; i--) {
+		put_bytes(obj, 2, 0x8B, 0x85);
+		put_int(obj, -(20 + (4 * i)));
+		put_bytes(obj, 1, 0x50);
+	}
+	for(i = 0; i < arg_count && i < REGISTER_ARGS; i++) {
+		byte reg = arg_registers[i];
+		if(reg >= 8) put_bytes(obj, 1, 0x44);
+		put_bytes(obj, 2, 0x8B, 0x85 | ((reg & 7) << 3));
+		put_int(obj, -(20 + (4 * i)));
+	}
+	put_minty_call(obj, "main");
+
+	// Print the result and exit successfully: movl %eax, %esi;
+	// leaq printf_str(%rip), %rdi; xorl %eax, %eax; call printf;
+	// xorl %eax, %eax; movq -8(%rbp), %rbx; movq -16(%rbp), %r12; leave; ret
+	put_bytes(obj, 2, 0x89, 0xC6);
+	put_string_address(obj, obj->printf_str, 7);
+	put_bytes(obj, 2, 0x31, 0xC0);
+	put_call(obj, "printf");
+	put_bytes(obj, 12, 0x31, 0xC0, 0x48, 0x8B, 0x5D, 0xF8, 0x4C, 0x8B, 0x65,
+		0xF0, 0xC9, 0xC3);
+
+	obj->symbols[symbol].st_value = start;
+	obj->symbols[symbol].st_size = obj->text.len - start;
+}
+
+/*
+ * Generates the error reporting of a library: the routine that its functions
+ * call with their name and an error in %rdi and %rsi, which passes them on to
+ * the error handler, if one is set, and the function that sets the handler,
+ * whose symbol is given. If the handler returns, the function that called the
+ * routine carries on to fail in the same way as a compiled program.
+ */
+static void objcode_errors(ObjFile *obj, int symbol) {
+	obj->error_handler = obj->bss_len;
+	obj->bss_len += 8;
+	obj->missing_return_error = section_append_string(&(obj->rodata),
+		"reached end of function without return statement");
+	obj->division_error = section_append_string(&(obj->rodata),
+		"division by zero or overflow");
+
+	// movq <handler>(%rip), %rax; testq %rax, %rax; je <return>;
+	// subq $8, %rsp; call *%rax; addq $8, %rsp; <return>: ret
+	section_align(&(obj->text), 16, 0x90);
+	obj->error_routine = obj->text.len;
+	put_bytes(obj, 3, 0x48, 0x8B, 0x05);
+	int field = put_int(obj, 0);
+	add_relocation(obj, field, SYMBOL_BSS, R_X86_64_PC32,
+		obj->error_handler - 4);
+	put_bytes(obj, 16, 0x48, 0x85, 0xC0, 0x74, 0x0A, 0x48, 0x83, 0xEC, 0x08,
+		0xFF, 0xD0, 0x48, 0x83, 0xC4, 0x08, 0xC3);
+
+	// movq %rdi, <handler>(%rip); ret
+	section_align(&(obj->text), 16, 0x90);
+	int start = obj->text.len;
+	put_bytes(obj, 3, 0x48, 0x89, 0x3D);
+	field = put_int(obj, 0);
+	add_relocation(obj, field, SYMBOL_BSS, R_X86_64_PC32,
+		obj->error_handler - 4);
+	put_bytes(obj, 1, 0xC3);
+
+	obj->symbols[symbol].st_value = start;
+	obj->symbols[symbol].st_size = obj->text.len - start;
+}
+
+/*
+ * Lays out the sections of an object file after its ELF header, and writes the
+ * section headers and the ELF header. Returns the contents of the file.
+ */
+static Section objcode_elf(ObjFile *obj) {
+	Section elf = { NULL, 0, 0 };
+
+	// Reserve space for the ELF header, which is written last
+	Elf64_Ehdr ehdr;
+	memset(&ehdr, 0, sizeof(Elf64_Ehdr));
+	section_append(&elf, &ehdr, sizeof(Elf64_Ehdr));
+
+	Section shstrtab = { NULL, 0, 0 };
+	int section_names[SECTION_COUNT];
+	char *names[SECTION_COUNT] = { "", ".text", ".rodata", ".bss",
+		".rela.text", ".symtab", ".strtab", ".note.GNU-stack", ".shstrtab" };
+	int i;
+	for(i = 0; i < SECTION_COUNT; i++) {
+		section_names[i] = section_append_string(&shstrtab, names[i]);
+	}
+
+	// Write the contents of each section, aligned, recording where they were
+	// put
+	section_align(&elf, 16, 0);
+	int text_offset = section_append(&elf, obj->text.data, obj->text.len);
+	int rodata_offset = section_append(&elf, obj->rodata.data, obj->rodata.len);
+	section_align(&elf, 8, 0);
+	int rela_text_offset =
+		section_append(&elf, obj->rela_text.data, obj->rela_text.len);
+	int symtab_offset = section_append(&elf, obj->symbols,
+		sizeof(Elf64_Sym) * obj->symbol_count);
+	int strtab_offset = section_append(&elf, obj->strtab.data, obj->strtab.len);
+	int shstrtab_offset = section_append(&elf, shstrtab.data, shstrtab.len);
+	section_align(&elf, 8, 0);
+
+	Elf64_Shdr shdrs[SECTION_COUNT];
+	memset(shdrs, 0, sizeof(shdrs));
+	gdbjit_section_header(&shdrs[SECTION_TEXT], section_names[SECTION_TEXT],
+		SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0, text_offset,
+		obj->text.len, 0, 0, 16, 0);
+	gdbjit_section_header(&shdrs[SECTION_RODATA],
+		section_names[SECTION_RODATA], SHT_PROGBITS, SHF_ALLOC, 0,
+		rodata_offset, obj->rodata.len, 0, 0, 1, 0);
+	gdbjit_section_header(&shdrs[SECTION_BSS], section_names[SECTION_BSS],
+		SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 0, rodata_offset, obj->bss_len, 0,
+		0, 8, 0);
+	gdbjit_section_header(&shdrs[SECTION_RELA_TEXT],
+		section_names[SECTION_RELA_TEXT], SHT_RELA, SHF_INFO_LINK, 0,
+		rela_text_offset, obj->rela_text.len, SECTION_SYMTAB, SECTION_TEXT,
+		8, sizeof(Elf64_Rela));
+	gdbjit_section_header(&shdrs[SECTION_SYMTAB],
+		section_names[SECTION_SYMTAB], SHT_SYMTAB, 0, 0, symtab_offset,
+		sizeof(Elf64_Sym) * obj->symbol_count, SECTION_STRTAB,
+		FIRST_GLOBAL_SYMBOL, 8, sizeof(Elf64_Sym));
+	gdbjit_section_header(&shdrs[SECTION_STRTAB],
+		section_names[SECTION_STRTAB], SHT_STRTAB, 0, 0, strtab_offset,
+		obj->strtab.len, 0, 0, 1, 0);
+	gdbjit_section_header(&shdrs[SECTION_NOTE_GNU_STACK],
+		section_names[SECTION_NOTE_GNU_STACK], SHT_PROGBITS, 0, 0,
+		shstrtab_offset, 0, 0, 0, 1, 0);
+	gdbjit_section_header(&shdrs[SECTION_SHSTRTAB],
+		section_names[SECTION_SHSTRTAB], SHT_STRTAB, 0, 0, shstrtab_offset,
+		shstrtab.len, 0, 0, 1, 0);
+	int shdrs_offset = section_append(&elf, shdrs, sizeof(shdrs));
+
+	// Now the layout is known, write the ELF header
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+	ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	ehdr.e_type = ET_REL;
+	ehdr.e_machine = EM_X86_64;
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_shoff = shdrs_offset;
+	ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+	ehdr.e_shentsize = sizeof(Elf64_Shdr);
+	ehdr.e_shnum = SECTION_COUNT;
+	ehdr.e_shstrndx = SECTION_SHSTRTAB;
+	memcpy(elf.data, &ehdr, sizeof(Elf64_Ehdr));
+
+	free(shstrtab.data);
+	return elf;
+}
+
+/*
+ * Compiles an entire program into a relocatable ELF object file, returning its
+ * contents and storing its length in obj_len. The result should be freed with
+ * free(). A library (see Program) is compiled without the C main() function,
+ * so it does not need a main function of its own.
+ */
+char *objcode_program(Program *prog, int *obj_len) {
+	if(LinkedList_length(prog->function_list) < 1) {
+		printf("Error: empty program object given to objcode_program()\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Optimise the program and calculate its offsets in the same way as
+	// emit_program(). Optimising can add and remove functions.
+	Program_optimise(prog);
+	Program_generate_offsets(prog);
+	int function_count = LinkedList_length(prog->function_list);
+	FNDecl *main_func =
+		prog->library ? NULL : Program_get_FNDecl(prog, "main");
+
+	// A library's function that sets its error handler would have the same
+	// symbol as a function with its name
+	if(prog->library && Program_find_FNDecl(prog, ERROR_HANDLER_NAME)) {
+		printf("Error: a library cannot have a function named '%s'\n",
+			ERROR_HANDLER_NAME);
+		exit(EXIT_FAILURE);
+	}
+
+	ObjFile obj;
+	memset(&obj, 0, sizeof(ObjFile));
+	section_append_string(&(obj.strtab), "");
+	obj.symbol_capacity = 16;
+	obj.symbols = safe_alloc(sizeof(Elf64_Sym) * obj.symbol_capacity);
+	add_symbol(&obj, NULL, 0, SHN_UNDEF);
+	add_symbol(&obj, NULL, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), SECTION_TEXT);
+	add_symbol(&obj, NULL, ELF64_ST_INFO(STB_LOCAL, STT_SECTION),
+		SECTION_RODATA);
+	add_symbol(&obj, NULL, ELF64_ST_INFO(STB_LOCAL, STT_SECTION),
+		SECTION_BSS);
+	obj.library = prog->library;
+
+	// Strings used by implementation
+	obj.printf_str = section_append_string(&(obj.rodata), "%d\n");
+	obj.missing_return_str = section_append_string(&(obj.rodata),
+		"Reached end of function '%s' without return statement\n");
+	obj.arg_count_str = section_append_string(&(obj.rodata),
+		"Function: 'main' takes %d arguments, %d given");
+
+	// Every function's symbol is created before any code is generated, so that
+	// calls to functions that come later can be resolved
+	int main_symbol = main_func ? add_symbol(&obj, "main",
+		ELF64_ST_INFO(STB_GLOBAL, STT_FUNC), SECTION_TEXT) : 0;
+	obj.functions = safe_alloc(sizeof(FunctionSymbol) * function_count);
+	int *symbols = safe_alloc(sizeof(int) * function_count);
+	ProgramFunctions functions;
+	functions.funcs = safe_alloc(sizeof(FNDecl *) * function_count);
+	functions.irs = safe_alloc(sizeof(IRFunction *) * function_count);
+	functions.allocations =
+		safe_alloc(sizeof(RegAllocation *) * function_count);
+	functions.prog = prog;
+
+	int i = 0;
+	LLIterator *function_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(function_iter)) {
+		functions.funcs[i++] = (FNDecl *)LLIterator_get_current(function_iter);
+		LLIterator_advance(function_iter);
+	}
+	free(function_iter);
+	codegen_order_functions(functions.funcs, function_count);
+
+	for(i = 0; i < function_count; i++) {
+		FNDecl *func = functions.funcs[i];
+		char *name = str_concat_2(SYMBOL_PREFIX, func->name);
+		symbols[i] = add_symbol(&obj, name,
+			ELF64_ST_INFO(STB_GLOBAL, STT_FUNC), SECTION_TEXT);
+		obj.functions[i].name = name;
+		obj.functions[i].symbol = symbols[i];
+	}
+	obj.function_count = function_count;
+	qsort(obj.functions, function_count, sizeof(FunctionSymbol),
+		compare_function_symbols);
+
+	if(obj.library) {
+		objcode_errors(&obj, add_symbol(&obj,
+			SYMBOL_PREFIX ERROR_HANDLER_NAME,
+			ELF64_ST_INFO(STB_GLOBAL, STT_FUNC), SECTION_TEXT));
+	}
+	if(main_func) objcode_entry(&obj, main_func, main_symbol);
+
+	// Generate the code for each function, in the order given by
+	// codegen_order_functions()
+	codegen_parallel(function_count, objcode_prepare_function, &functions);
+	for(i = 0; i < function_count; i++) {
+		objcode_function(&obj, functions.funcs[i], functions.irs[i],
+			functions.allocations[i], symbols[i]);
+		RegAllocation_free(functions.allocations[i]);
+		IRFunction_free(functions.irs[i]);
+	}
+	free(functions.funcs);
+	free(functions.irs);
+	free(functions.allocations);
+
+	Section elf = objcode_elf(&obj);
+
+	for(i = 0; i < function_count; i++) free(obj.functions[i].name);
+	free(obj.functions);
+	free(symbols);
+	free(obj.symbols);
+	free(obj.text.data);
+	free(obj.rodata.data);
+	free(obj.rela_text.data);
+	free(obj.strtab.data);
+
+	*obj_len = elf.len;
+	return (char *)elf.data;
+}
+
+/*
+ * Compiles an entire program into a relocatable ELF object file with the given
+ * name, which can be linked into an executable with the system's C compiler,
+ * e.g. cc <file>
+ */
+void objcode_write(Program *prog, char *filename) {
+	int len;
+	char *contents = objcode_program(prog, &len);
+
+	FILE *file = fopen(filename, "wb");
+	if(!file) {
+		printf("Could not open file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	if(fwrite(contents, 1, len, file) != len || fclose(file)) {
+		printf("Could not write file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	free(contents);
+}
+
+/*
+ * Compiles a program as a library into a shared object with the given name,
+ * by linking its object file with SHARED_LINKER. The program is marked as a
+ * library, which must be done before anything optimises it, e.g. reading a
+ * profile with profile_read(), so that every function is kept as it was
+ * declared. The linker is run directly rather than through the shell, so the
+ * name is passed to it as it is. Exits if the shared object cannot be linked.
+ */
+void objcode_write_shared(Program *prog, char *filename) {
+	prog->library = true;
+
+	char object[] = "/tmp/minty-shared-XXXXXX.o";
+	int fd = mkstemps(object, 2);
+	if(fd == -1) {
+		printf("Could not create a temporary object file\n");
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+	objcode_write(prog, object);
+
+	char *argv[] = { SHARED_LINKER, object, "-o", filename, NULL };
+	int status = -1;
+	pid_t pid = fork();
+	if(pid == 0) {
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	if(pid > 0) waitpid(pid, &status, 0);
+	bool success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	unlink(object);
+
+	if(!success) {
+		printf("Could not link shared library '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Writes a C header declaring the functions of a library to the file with the
+ * given name. Each function is declared with its symbol (see SYMBOL_PREFIX),
+ * taking an int for each of its arguments and returning an int, after the
+ * function that sets the library's error handler, and the header guard is made
+ * from the file's name.
+ */
+void objcode_write_header(Program *prog, char *filename) {
+	FILE *file = fopen(filename, "w");
+	if(!file) {
+		printf("Could not open file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	char *base = strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
+	char *guard = str_concat_2("MINTY_", base);
+	int i;
+	for(i = 0; guard[i]; i++) {
+		guard[i] = isalnum(guard[i]) ? toupper(guard[i]) : '_';
+	}
+	fprintf(file, "#ifndef %s\n#define %s\n\n", guard, guard);
+	fprintf(file, "#ifdef __cplusplus\nextern \"C\" {\n#endif\n");
+	free(guard);
+
+	// The error handler is documented where it is declared, for the library's
+	// users
+	fprintf(file, "\n"
+		"/*\n"
+		" * Errors in the functions below, reaching the end of a function "
+		"without a\n"
+		" * return statement or a division by zero or that overflows, are "
+		"reported to\n"
+		" * the handler set here, with the name of the function and a "
+		"description of\n"
+		" * the error. The handler may leave the function with longjmp(). "
+		"If it\n"
+		" * returns, or no handler is set, the error exits the process, or "
+		"raises\n"
+		" * SIGFPE for a division, as it would in a compiled minty program.\n"
+		" */\n"
+		"void " SYMBOL_PREFIX ERROR_HANDLER_NAME "(\n"
+		"\tvoid (*handler)(const char *function, const char *error));\n");
+
+	LLIterator *function_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(function_iter)) {
+		FNDecl *func = (FNDecl *)LLIterator_get_current(function_iter);
+		int arg_count = LinkedList_length(func->args);
+
+		// The argument names are only given in a comment, as they may be C
+		// keywords
+		fprintf(file, "\n/* %s(", func->name);
+		for(i = 0; i < arg_count; i++) {
+			Expression *arg = (Expression *)LinkedList_get(func->args, i);
+			fprintf(file, i > 0 ? ", %s" : "%s",
+				arg->expr->ident->name);
+		}
+		fprintf(file, ") */\nint " SYMBOL_PREFIX "%s(", func->name);
+		for(i = 0; i < arg_count; i++) fprintf(file, i > 0 ? ", int" : "int");
+		fprintf(file, arg_count > 0 ? ");\n" : "void);\n");
+
+		LLIterator_advance(function_iter);
+	}
+	free(function_iter);
+
+	fprintf(file, "\n#ifdef __cplusplus\n}\n#endif\n\n#endif\n");
+	if(fclose(file)) {
+		printf("Could not write file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
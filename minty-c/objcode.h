@@ -0,0 +1,61 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef OBJCODE
+#define OBJCODE
+
+/*
+ * Ahead-of-time compilation straight to machine code, without going through
+ * the assembler. A program is compiled into a relocatable ELF64 object file
+ * holding the same code as the assembly code from emit_program() (see
+ * codegen.h), with the instructions encoded in the same way as by the JIT
+ * compiler (see jitcode.h). The object file defines a symbol for each function
+ * and the C main() function, and refers to the C library through relocations,
+ * so it is linked into an executable by the system's C compiler.
+ *
+ * A library is linked into a shared object instead, without main(). Its
+ * functions can be called from C through their symbols, as declared by the
+ * header from objcode_write_header(), by code that has no interpreter, parser
+ * or JIT compiler of its own. They follow the System V calling convention
+ * (see codegen.h). Internal calls are bound to the library's own functions
+ * when it is linked, rather than going through the PLT.
+ *
+ * An error in a library function, reaching the end of the function without a
+ * return statement or a division by zero or that overflows, is reported to
+ * the error handler that the host has set with the library's
+ * minty_set_error_handler(), which is given the name of the function and a
+ * description of the error. The handler may leave the function with longjmp().
+ * If it returns, or no handler is set, the error exits the process or raises
+ * SIGFPE, as it would in a compiled program.
+ */
+
+/*
+ * The command that links a library's object file into a shared object, as the
+ * first arguments of the linker's argument vector
+ */
+#define SHARED_LINKER "cc", "-shared", "-Wl,-Bsymbolic"
+
+/*
+ * The name of the library function that sets its error handler, which is given
+ * SYMBOL_PREFIX like the functions of the program
+ */
+#define ERROR_HANDLER_NAME "set_error_handler"
+
+char *objcode_program(Program *prog, int *obj_len);
+
+void objcode_write(Program *prog, char *filename);
+
+void objcode_write_shared(Program *prog, char *filename);
+
+void objcode_write_header(Program *prog, char *filename);
+
+#endif // OBJCODE
@@ -0,0 +1,1950 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "optimiser.h"
+
+/*
+ * Determines whether or not a single statement (or any statement nested within
+ * it) assigns to the variable with the given name
+ */
+static bool Statement_assigns(Statement *stmt, char *name) {
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			return Statement_assigns(stmt->stmt->_for->assignment, name) ||
+				Statement_assigns(stmt->stmt->_for->incrementor, name) ||
+				stmt_list_assigns(stmt->stmt->_for->stmts, name);
+
+		case stmt_While:
+			return stmt_list_assigns(stmt->stmt->_while->stmts, name);
+
+		case stmt_If:
+			return stmt_list_assigns(stmt->stmt->_if->true_stmts, name) ||
+				stmt_list_assigns(stmt->stmt->_if->false_stmts, name);
+
+		case stmt_Assignment:
+			return str_equal(
+				stmt->stmt->_assignment->ident->expr->ident->name, name);
+
+		case stmt_Print:
+		case stmt_Return:
+			return false;
+	}
+	printf("Invalid statement type given to Statement_assigns()\n");
+	exit(EXIT_FAILURE);
+	return false;
+}
+
+/*
+ * Determines whether or not any statement in the given list assigns to the
+ * variable with the given name. Variables that are never assigned to keep the
+ * value they were given on entry to the function for the whole function.
+ */
+bool stmt_list_assigns(LinkedList *stmts, char *name) {
+	bool assigns = false;
+
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter) && !assigns) {
+		assigns = Statement_assigns(
+			(Statement *)LLIterator_get_current(stmts_iter), name);
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+
+	return assigns;
+}
+
+/*
+ * Determines whether a for loop has the canonical counted shape
+ *
+ *     for i <- start, i < limit, i += step { ... }
+ *
+ * or the same with <=, where the step is a positive integer literal and the
+ * limit is an integer literal or a variable other than i. Neither i nor the
+ * limit may be assigned to in the loop's body, so the loop counts i up from
+ * start towards a limit that does not change once the loop has begun, and can
+ * be run as a native counter loop. If it can, the step is stored in step.
+ */
+bool For_is_counted(For *loop, int *step) {
+	char *counter =
+		loop->assignment->stmt->_assignment->ident->expr->ident->name;
+
+	// The condition must compare the counter with the limit
+	if(loop->bool_expr->type != expr_BooleanExpr) return false;
+	BooleanExpr *cond = loop->bool_expr->expr->blean;
+	if(cond->op != LESS_THAN && cond->op != LESS_OR_EQUAL) return false;
+	if(cond->lhs->type != expr_Identifier ||
+		!str_equal(cond->lhs->expr->ident->name, counter)) {
+
+		return false;
+	}
+	if(cond->rhs->type == expr_Identifier) {
+		char *limit = cond->rhs->expr->ident->name;
+		if(str_equal(limit, counter) || stmt_list_assigns(loop->stmts, limit)) {
+			return false;
+		}
+	}
+	else if(cond->rhs->type != expr_IntegerLiteral) return false;
+
+	// The incrementor must add a positive literal to the counter
+	if(loop->incrementor->type != stmt_Assignment) return false;
+	Assignment *inc = loop->incrementor->stmt->_assignment;
+	if(!str_equal(inc->ident->expr->ident->name, counter)) return false;
+	if(inc->expr->type != expr_ArithmeticExpr) return false;
+	ArithmeticExpr *sum = inc->expr->expr->arith;
+	if(sum->op != PLUS || sum->lhs->type != expr_Identifier ||
+		!str_equal(sum->lhs->expr->ident->name, counter) ||
+		sum->rhs->type != expr_IntegerLiteral || sum->rhs->expr->intgr < 1) {
+
+		return false;
+	}
+
+	if(stmt_list_assigns(loop->stmts, counter)) return false;
+
+	*step = sum->rhs->expr->intgr;
+	return true;
+}
+
+/*
+ * Frees the containers of a binary (boolean or arithmetic) expression whose
+ * operands have already been dealt with, and returns an integer literal with
+ * the given value to replace it
+ */
+static Expression *replace_with_literal(Expression *expr, int value) {
+	Expression_free(expr);
+	return IntegerLiteral_init(value);
+}
+
+/*
+ * Folds constant sub-expressions of the given expression into integer literals,
+ * for example (2 * 3) + x becomes 6 + x. The given expression is consumed: the
+ * returned expression should be used in its place. Divisions and modulos by
+ * zero are left in place so that they fail at runtime as they would have done
+ * without folding.
+ */
+Expression *Expression_fold(Expression *expr) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr: {
+			BooleanExpr *blean = expr->expr->blean;
+			blean->lhs = Expression_fold(blean->lhs);
+			blean->rhs = Expression_fold(blean->rhs);
+
+			// If either side is still not constant, there is nothing to fold
+			if(blean->lhs->type != expr_IntegerLiteral ||
+				blean->rhs->type != expr_IntegerLiteral) return expr;
+
+			int lhs = blean->lhs->expr->intgr;
+			int rhs = blean->rhs->expr->intgr;
+
+			if(blean->op == EQUAL)
+				return replace_with_literal(expr, lhs == rhs);
+			if(blean->op == NOT_EQUAL)
+				return replace_with_literal(expr, lhs != rhs);
+			if(blean->op == LESS_THAN)
+				return replace_with_literal(expr, lhs < rhs);
+			if(blean->op == GREATER_THAN)
+				return replace_with_literal(expr, lhs > rhs);
+			if(blean->op == LESS_OR_EQUAL)
+				return replace_with_literal(expr, lhs <= rhs);
+			if(blean->op == GREATER_OR_EQUAL)
+				return replace_with_literal(expr, lhs >= rhs);
+			return expr;
+		}
+
+		case expr_ArithmeticExpr: {
+			ArithmeticExpr *arith = expr->expr->arith;
+			arith->lhs = Expression_fold(arith->lhs);
+			arith->rhs = Expression_fold(arith->rhs);
+
+			if(arith->lhs->type != expr_IntegerLiteral ||
+				arith->rhs->type != expr_IntegerLiteral) return expr;
+
+			// Unsigned arithmetic is used so that overflow wraps around in the
+			// same way that it does in the machine code
+			unsigned int lhs = arith->lhs->expr->intgr;
+			unsigned int rhs = arith->rhs->expr->intgr;
+
+			if(arith->op == PLUS)
+				return replace_with_literal(expr, (int)(lhs + rhs));
+			if(arith->op == MINUS)
+				return replace_with_literal(expr, (int)(lhs - rhs));
+			if(arith->op == MULTIPLY)
+				return replace_with_literal(expr, (int)(lhs * rhs));
+
+			// Leave division by zero, and the one division that overflows, to
+			// be evaluated at runtime
+			if(rhs == 0 || ((int)lhs == -2147483647 - 1 && (int)rhs == -1))
+				return expr;
+
+			if(arith->op == DIVIDE)
+				return replace_with_literal(expr, (int)lhs / (int)rhs);
+			if(arith->op == MODULO)
+				return replace_with_literal(expr, (int)lhs % (int)rhs);
+			return expr;
+		}
+
+		case expr_Identifier:
+		case expr_IntegerLiteral:
+			return expr;
+
+		case expr_FNCall: {
+			// Fold each argument, building a new argument list as we go
+			LinkedList *folded_args = LinkedList_init();
+			LinkedList *args = expr->expr->fncall->args;
+			while(LinkedList_length(args) > 0) {
+				LinkedList_append(folded_args,
+					Expression_fold((Expression *)LinkedList_pop(args)));
+			}
+			LinkedList_free(args);
+			expr->expr->fncall->args = folded_args;
+			return expr;
+		}
+
+		case expr_Ternary: {
+			Ternary *trnry = expr->expr->trnry;
+			trnry->bool_expr = Expression_fold(trnry->bool_expr);
+			trnry->true_expr = Expression_fold(trnry->true_expr);
+			trnry->false_expr = Expression_fold(trnry->false_expr);
+
+			if(trnry->bool_expr->type != expr_IntegerLiteral) return expr;
+
+			// The condition is constant, so keep only the chosen expression
+			Expression *chosen;
+			if(trnry->bool_expr->expr->intgr) {
+				chosen = trnry->true_expr;
+				Expression_free(trnry->false_expr);
+			}
+			else {
+				chosen = trnry->false_expr;
+				Expression_free(trnry->true_expr);
+			}
+			Expression_free(trnry->bool_expr);
+			free(trnry);
+			free(expr->expr);
+			free(expr);
+			return chosen;
+		}
+	}
+	printf("Invalid expression type given to Expression_fold()\n");
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
+/*
+ * Replaces every use of the variable with the given name in the given
+ * expression with an integer literal of the given value, and folds the
+ * constants that result. As with Expression_fold(), the given expression is
+ * consumed and the returned expression should be used in its place.
+ */
+Expression *Expression_substitute(Expression *expr, char *name, int value) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr:
+			expr->expr->blean->lhs =
+				Expression_substitute(expr->expr->blean->lhs, name, value);
+			expr->expr->blean->rhs =
+				Expression_substitute(expr->expr->blean->rhs, name, value);
+			break;
+
+		case expr_ArithmeticExpr:
+			expr->expr->arith->lhs =
+				Expression_substitute(expr->expr->arith->lhs, name, value);
+			expr->expr->arith->rhs =
+				Expression_substitute(expr->expr->arith->rhs, name, value);
+			break;
+
+		case expr_Identifier:
+			if(str_equal(expr->expr->ident->name, name)) {
+				Expression_free(expr);
+				return IntegerLiteral_init(value);
+			}
+			break;
+
+		case expr_IntegerLiteral:
+			break;
+
+		case expr_FNCall: {
+			LinkedList *new_args = LinkedList_init();
+			LinkedList *args = expr->expr->fncall->args;
+			while(LinkedList_length(args) > 0) {
+				LinkedList_append(new_args, Expression_substitute(
+					(Expression *)LinkedList_pop(args), name, value));
+			}
+			LinkedList_free(args);
+			expr->expr->fncall->args = new_args;
+			break;
+		}
+
+		case expr_Ternary:
+			expr->expr->trnry->bool_expr = Expression_substitute(
+				expr->expr->trnry->bool_expr, name, value);
+			expr->expr->trnry->true_expr = Expression_substitute(
+				expr->expr->trnry->true_expr, name, value);
+			expr->expr->trnry->false_expr = Expression_substitute(
+				expr->expr->trnry->false_expr, name, value);
+			break;
+	}
+	return Expression_fold(expr);
+}
+
+static LinkedList *substitute_stmt_list(LinkedList *stmts, char *name,
+	int value, bool flatten);
+
+/*
+ * Applies Expression_substitute() to every expression in a single statement,
+ * and substitute_stmt_list() to the statement lists nested within it. The
+ * statement itself is kept.
+ */
+static void Statement_substitute(Statement *stmt, char *name, int value,
+	bool flatten) {
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			Statement_substitute(stmt->stmt->_for->assignment, name, value,
+				flatten);
+			stmt->stmt->_for->bool_expr = Expression_substitute(
+				stmt->stmt->_for->bool_expr, name, value);
+			Statement_substitute(stmt->stmt->_for->incrementor, name, value,
+				flatten);
+			stmt->stmt->_for->stmts = substitute_stmt_list(
+				stmt->stmt->_for->stmts, name, value, flatten);
+			break;
+
+		case stmt_While:
+			stmt->stmt->_while->bool_expr = Expression_substitute(
+				stmt->stmt->_while->bool_expr, name, value);
+			stmt->stmt->_while->stmts = substitute_stmt_list(
+				stmt->stmt->_while->stmts, name, value, flatten);
+			break;
+
+		case stmt_If:
+			stmt->stmt->_if->bool_expr = Expression_substitute(
+				stmt->stmt->_if->bool_expr, name, value);
+			stmt->stmt->_if->true_stmts = substitute_stmt_list(
+				stmt->stmt->_if->true_stmts, name, value, flatten);
+			stmt->stmt->_if->false_stmts = substitute_stmt_list(
+				stmt->stmt->_if->false_stmts, name, value, flatten);
+			break;
+
+		case stmt_Print:
+			stmt->stmt->_print->expr = Expression_substitute(
+				stmt->stmt->_print->expr, name, value);
+			break;
+
+		case stmt_Assignment:
+			stmt->stmt->_assignment->expr = Expression_substitute(
+				stmt->stmt->_assignment->expr, name, value);
+			break;
+
+		case stmt_Return:
+			stmt->stmt->_return->expr = Expression_substitute(
+				stmt->stmt->_return->expr, name, value);
+			break;
+	}
+}
+
+/*
+ * Does the work of stmt_list_substitute(). If-statements are only replaced by
+ * their branches if flatten is true, so that with flatten false the nesting
+ * levels of the statements, and so the scopes of their variables when
+ * interpreted, are kept.
+ */
+static LinkedList *substitute_stmt_list(LinkedList *stmts, char *name,
+	int value, bool flatten) {
+
+	LinkedList *new_stmts = LinkedList_init();
+
+	while(LinkedList_length(stmts) > 0) {
+		Statement *stmt = (Statement *)LinkedList_pop(stmts);
+		Statement_substitute(stmt, name, value, flatten);
+
+		// If-statements with a constant condition are replaced by the chosen
+		// branch
+		if(flatten && stmt->type == stmt_If &&
+			stmt->stmt->_if->bool_expr->type == expr_IntegerLiteral) {
+
+			LinkedList *chosen, *discarded;
+			if(stmt->stmt->_if->bool_expr->expr->intgr) {
+				chosen = stmt->stmt->_if->true_stmts;
+				discarded = stmt->stmt->_if->false_stmts;
+			}
+			else {
+				chosen = stmt->stmt->_if->false_stmts;
+				discarded = stmt->stmt->_if->true_stmts;
+			}
+
+			while(LinkedList_length(chosen) > 0)
+				LinkedList_append(new_stmts, LinkedList_pop(chosen));
+
+			LLMAP(discarded, Statement *, Statement_free);
+			LinkedList_free(discarded);
+			LinkedList_free(chosen);
+			Expression_free(stmt->stmt->_if->bool_expr);
+			free(stmt->stmt->_if);
+			free(stmt->stmt);
+			free(stmt);
+		}
+
+		// While-loops that are never entered are removed
+		else if(stmt->type == stmt_While &&
+			stmt->stmt->_while->bool_expr->type == expr_IntegerLiteral &&
+			!stmt->stmt->_while->bool_expr->expr->intgr) {
+
+			Statement_free(stmt);
+		}
+
+		else LinkedList_append(new_stmts, stmt);
+	}
+
+	LinkedList_free(stmts);
+	return new_stmts;
+}
+
+/*
+ * Replaces every use of the variable with the given name in a list of
+ * statements with an integer literal of the given value, folding the constants
+ * that result. If-statements whose conditions become constant are replaced by
+ * the statements of the branch that would be taken, and while-loops whose
+ * conditions become false are removed. The given list is consumed, and the
+ * returned list should be used in its place.
+ *
+ * Replacing an if-statement with its branch removes the nesting level that the
+ * branch would have had, so the result is intended for compilation, where
+ * nesting levels do not exist, rather than for interpretation.
+ */
+LinkedList *stmt_list_substitute(LinkedList *stmts, char *name, int value) {
+	return substitute_stmt_list(stmts, name, value, true);
+}
+
+/*
+ * Creates a copy of the given function in which every argument i for which
+ * guarded[i] is true is replaced by the constant values[i]. The copy's stack
+ * offsets should be generated again before it is compiled, as substitution can
+ * remove variables and calls from it.
+ */
+FNDecl *FNDecl_substitute_args(FNDecl *func, bool *guarded, int *values) {
+	FNDecl *copy = FNDecl_copy(func);
+
+	int i;
+	for(i = 0; i < LinkedList_length(func->args); i++) {
+		if(!guarded[i]) continue;
+
+		Expression *arg = (Expression *)LinkedList_get(func->args, i);
+		copy->stmts = stmt_list_substitute(copy->stmts,
+			arg->expr->ident->name, values[i]);
+	}
+
+	return copy;
+}
+
+/*
+ * Creates a copy of the given function that is specialised to the values that
+ * its argument profile shows it is always called with. An argument is only
+ * specialised if every call seen so far has passed the same value for it, and
+ * the function never assigns to it, so that the value is fixed for the whole
+ * function.
+ *
+ * The guarded parameter must point to space for one bool per argument. On
+ * return, guarded[i] is true if the copy assumes that argument i has the value
+ * func->arg_profile[i].value - callers must check that this is the case before
+ * using the copy. If no argument can be specialised, NULL is returned.
+ */
+FNDecl *FNDecl_specialise(FNDecl *func, bool *guarded) {
+	bool any_guarded = false;
+
+	// Decide which arguments can be specialised
+	int i;
+	for(i = 0; i < LinkedList_length(func->args); i++) {
+		Expression *arg = (Expression *)LinkedList_get(func->args, i);
+
+		guarded[i] = func->arg_profile[i].state == arg_Constant &&
+			!stmt_list_assigns(func->stmts, arg->expr->ident->name);
+
+		if(guarded[i]) any_guarded = true;
+	}
+
+	if(!any_guarded) return NULL;
+
+	// Substitute the constant values into a copy of the function
+	int arg_count = LinkedList_length(func->args);
+	int *values = safe_alloc(sizeof(int) * (arg_count + 1));
+	for(i = 0; i < arg_count; i++) values[i] = func->arg_profile[i].value;
+
+	FNDecl *copy = FNDecl_substitute_args(func, guarded, values);
+
+	free(values);
+	return copy;
+}
+
+/*
+ * Determines whether or not a single statement (or any statement nested within
+ * it) prints anything
+ */
+static bool Statement_prints(Statement *stmt) {
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			return stmt_list_prints(stmt->stmt->_for->stmts);
+
+		case stmt_While:
+			return stmt_list_prints(stmt->stmt->_while->stmts);
+
+		case stmt_If:
+			return stmt_list_prints(stmt->stmt->_if->true_stmts) ||
+				stmt_list_prints(stmt->stmt->_if->false_stmts);
+
+		case stmt_Print:
+			return true;
+
+		case stmt_Assignment:
+		case stmt_Return:
+			return false;
+	}
+	printf("Invalid statement type given to Statement_prints()\n");
+	exit(EXIT_FAILURE);
+	return false;
+}
+
+/*
+ * Determines whether or not any statement in the given list prints anything
+ */
+bool stmt_list_prints(LinkedList *stmts) {
+	bool prints = false;
+
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter) && !prints) {
+		prints = Statement_prints(
+			(Statement *)LLIterator_get_current(stmts_iter));
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+
+	return prints;
+}
+
+/*
+ * Works out which functions in a program are pure, recording it in their pure
+ * fields. A pure function never prints, and only calls pure functions, so a
+ * call to it does nothing but produce its result (or fail, or never return),
+ * and gives the same result whenever it is passed the same arguments. Every
+ * function is assumed to be pure until it is found to print or to call a
+ * function that is not, so that recursive functions can be pure.
+ */
+void Program_find_pure_functions(Program *prog) {
+	int func_count = LinkedList_length(prog->function_list);
+
+	int i;
+	for(i = 0; i < func_count; i++) {
+		FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, i);
+		func->pure = !stmt_list_prints(func->stmts);
+	}
+
+	bool changed = true;
+	while(changed) {
+		changed = false;
+
+		for(i = 0; i < func_count; i++) {
+			FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, i);
+			if(!func->pure) continue;
+
+			LinkedList *sites = FNDecl_call_sites(func);
+			LLIterator *sites_iter = LLIterator_init(sites);
+			while(!LLIterator_ended(sites_iter) && func->pure) {
+				FNCall *call = (FNCall *)LLIterator_get_current(sites_iter);
+				FNDecl *callee = Program_find_FNDecl(prog, call->name);
+				if(!callee || !callee->pure) {
+					func->pure = false;
+					changed = true;
+				}
+				LLIterator_advance(sites_iter);
+			}
+			free(sites_iter);
+			LinkedList_free(sites);
+		}
+	}
+}
+
+/*
+ * Determines whether or not an expression gives the same value every time it is
+ * evaluated during a loop: it only uses variables that the loop never assigns
+ * to, and only calls pure functions (see Program_find_pure_functions())
+ */
+static bool Expression_invariant(Expression *expr, Statement *loop,
+	Program *prog) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr:
+			return Expression_invariant(expr->expr->blean->lhs, loop, prog) &&
+				Expression_invariant(expr->expr->blean->rhs, loop, prog);
+
+		case expr_ArithmeticExpr:
+			return Expression_invariant(expr->expr->arith->lhs, loop, prog) &&
+				Expression_invariant(expr->expr->arith->rhs, loop, prog);
+
+		case expr_Identifier:
+			return !Statement_assigns(loop, expr->expr->ident->name);
+
+		case expr_IntegerLiteral:
+			return true;
+
+		case expr_FNCall: {
+			FNDecl *callee = Program_find_FNDecl(prog,
+				expr->expr->fncall->name);
+			bool invariant = callee && callee->pure;
+
+			LLIterator *args_iter = LLIterator_init(expr->expr->fncall->args);
+			while(!LLIterator_ended(args_iter) && invariant) {
+				invariant = Expression_invariant(
+					(Expression *)LLIterator_get_current(args_iter),
+					loop, prog);
+				LLIterator_advance(args_iter);
+			}
+			free(args_iter);
+
+			return invariant;
+		}
+
+		case expr_Ternary: {
+			Ternary *ternary = expr->expr->trnry;
+			return Expression_invariant(ternary->bool_expr, loop, prog) &&
+				Expression_invariant(ternary->true_expr, loop, prog) &&
+				Expression_invariant(ternary->false_expr, loop, prog);
+		}
+	}
+	printf("Invalid expression type given to Expression_invariant()\n");
+	exit(EXIT_FAILURE);
+	return false;
+}
+
+/*
+ * Determines whether or not evaluating an expression could do anything other
+ * than produce a value: it contains a call, which may print or fail, or a
+ * division that may fail
+ */
+static bool Expression_may_fail(Expression *expr) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr:
+			return Expression_may_fail(expr->expr->blean->lhs) ||
+				Expression_may_fail(expr->expr->blean->rhs);
+
+		case expr_ArithmeticExpr: {
+			Expression *rhs = expr->expr->arith->rhs;
+			bool safe_divisor = rhs->type == expr_IntegerLiteral &&
+				rhs->expr->intgr != 0 && rhs->expr->intgr != -1;
+
+			return ((expr->expr->arith->op == DIVIDE ||
+					expr->expr->arith->op == MODULO) && !safe_divisor) ||
+				Expression_may_fail(expr->expr->arith->lhs) ||
+				Expression_may_fail(rhs);
+		}
+
+		case expr_Identifier:
+		case expr_IntegerLiteral:
+			return false;
+
+		case expr_FNCall:
+			return true;
+
+		case expr_Ternary:
+			return Expression_may_fail(expr->expr->trnry->bool_expr) ||
+				Expression_may_fail(expr->expr->trnry->true_expr) ||
+				Expression_may_fail(expr->expr->trnry->false_expr);
+	}
+	printf("Invalid expression type given to Expression_may_fail()\n");
+	exit(EXIT_FAILURE);
+	return false;
+}
+
+/*
+ * The state of loop-invariant code motion in a function: the loop whose
+ * condition is being hoisted from, the list that the assignments of the hoisted
+ * expressions are added to, whether anything that may fail has been left in
+ * the condition so far, and the number of variables created for the function
+ */
+typedef struct {
+	Program *prog;
+	Statement *loop;
+	LinkedList *hoisted;
+	bool blocked;
+	int variable_count;
+} Hoister;
+
+/*
+ * Hoists the invariant parts of an expression in a loop condition out of the
+ * loop, visiting them in the order the interpreter evaluates them. Each one is
+ * assigned to a new variable before the loop, and replaced by that variable.
+ * Parts that may fail are only hoisted if nothing that may fail is evaluated
+ * before them, so that the program's output and errors stay in the same order,
+ * and the branches of ternaries are never hoisted, as they may not be
+ * evaluated at all. The given expression is consumed, and the returned one
+ * should be used in its place.
+ */
+static Expression *hoist_expression(Hoister *h, Expression *expr) {
+
+	if(expr->type != expr_Identifier && expr->type != expr_IntegerLiteral &&
+		Expression_invariant(expr, h->loop, h->prog) &&
+		!(h->blocked && Expression_may_fail(expr))) {
+
+		// The names of the new variables are not valid identifiers, so they
+		// can not clash with the program's own variables
+		char name[32];
+		sprintf(name, "'invariant%d", h->variable_count++);
+
+		Statement *assignment = Assignment_init(safe_strdup(name), expr);
+		assignment->line = h->loop->line;
+		LinkedList_append(h->hoisted, assignment);
+
+		return Identifier_init(safe_strdup(name));
+	}
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr:
+			expr->expr->blean->lhs =
+				hoist_expression(h, expr->expr->blean->lhs);
+			expr->expr->blean->rhs =
+				hoist_expression(h, expr->expr->blean->rhs);
+			break;
+
+		case expr_ArithmeticExpr:
+			expr->expr->arith->lhs =
+				hoist_expression(h, expr->expr->arith->lhs);
+			expr->expr->arith->rhs =
+				hoist_expression(h, expr->expr->arith->rhs);
+			break;
+
+		case expr_FNCall: {
+			LinkedList *args = expr->expr->fncall->args;
+			LinkedList *new_args = LinkedList_init();
+			while(LinkedList_length(args) > 0) {
+				LinkedList_append(new_args,
+					hoist_expression(h, (Expression *)LinkedList_pop(args)));
+			}
+			LinkedList_free(args);
+			expr->expr->fncall->args = new_args;
+			break;
+		}
+
+		case expr_Ternary:
+			expr->expr->trnry->bool_expr =
+				hoist_expression(h, expr->expr->trnry->bool_expr);
+			break;
+
+		case expr_Identifier:
+		case expr_IntegerLiteral:
+			break;
+	}
+
+	// Whatever is left of the expression is evaluated in the loop
+	h->blocked = h->blocked || Expression_may_fail(expr);
+	return expr;
+}
+
+static LinkedList *hoist_stmt_list(Hoister *h, LinkedList *stmts);
+
+/*
+ * Hoists the invariant parts of the conditions of a statement's loops out of
+ * them, appending the statement to the given list after the assignments of
+ * any expressions hoisted from it
+ */
+static void hoist_statement(Hoister *h, Statement *stmt, LinkedList *stmts) {
+
+	switch(stmt->type) {
+
+		case stmt_For: {
+			For *for_stmt = stmt->stmt->_for;
+			for_stmt->stmts = hoist_stmt_list(h, for_stmt->stmts);
+
+			// The hoisted expressions are evaluated before the loop variable
+			// is initialised, rather than after
+			h->loop = stmt;
+			h->hoisted = stmts;
+			h->blocked = Expression_may_fail(
+				for_stmt->assignment->stmt->_assignment->expr);
+			for_stmt->bool_expr = hoist_expression(h, for_stmt->bool_expr);
+			break;
+		}
+
+		case stmt_While: {
+			While *while_stmt = stmt->stmt->_while;
+			while_stmt->stmts = hoist_stmt_list(h, while_stmt->stmts);
+
+			h->loop = stmt;
+			h->hoisted = stmts;
+			h->blocked = false;
+			while_stmt->bool_expr = hoist_expression(h, while_stmt->bool_expr);
+			break;
+		}
+
+		case stmt_If:
+			stmt->stmt->_if->true_stmts =
+				hoist_stmt_list(h, stmt->stmt->_if->true_stmts);
+			stmt->stmt->_if->false_stmts =
+				hoist_stmt_list(h, stmt->stmt->_if->false_stmts);
+			break;
+
+		case stmt_Print:
+		case stmt_Assignment:
+		case stmt_Return:
+			break;
+	}
+
+	LinkedList_append(stmts, stmt);
+}
+
+/*
+ * Hoists the invariant parts of the conditions of the loops in a list of
+ * statements out of them. The given list is consumed, and the returned list
+ * should be used in its place.
+ */
+static LinkedList *hoist_stmt_list(Hoister *h, LinkedList *stmts) {
+	LinkedList *new_stmts = LinkedList_init();
+
+	while(LinkedList_length(stmts) > 0) {
+		hoist_statement(h, (Statement *)LinkedList_pop(stmts), new_stmts);
+	}
+
+	LinkedList_free(stmts);
+	return new_stmts;
+}
+
+/*
+ * Loop-invariant code motion. The parts of each loop condition in a function
+ * that give the same value on every iteration, including calls to pure
+ * functions with invariant arguments, are evaluated once before the loop
+ * instead of on every iteration (see hoist_expression()). A loop's condition
+ * is always evaluated when the loop is reached, so this never evaluates
+ * anything that would not otherwise have been evaluated.
+ */
+static void FNDecl_hoist_invariants(FNDecl *func, Program *prog) {
+	Hoister h = {prog, NULL, NULL, false, 0};
+	func->stmts = hoist_stmt_list(&h, func->stmts);
+}
+
+/*
+ * The largest magnitude that the induction variable, bound and step of a
+ * counting loop may have for the loop to be evaluated in closed form. Within
+ * it, neither the loop nor the closed form can overflow while counting.
+ */
+#define CLOSED_FORM_LIMIT (1 << 29)
+
+/*
+ * An expression that is an affine function of a loop's induction variable:
+ * coefficient times the variable, plus offset, which is NULL if it is zero
+ */
+typedef struct {
+	int coefficient;
+	Expression *offset;
+} Affine;
+
+/*
+ * Adds or subtracts the offsets of two affine expressions, either of which may
+ * be NULL for zero. The offsets are consumed.
+ */
+static Expression *offset_combine(Expression *lhs, token_type op,
+	Expression *rhs) {
+
+	if(!rhs) return lhs;
+	if(!lhs && op == PLUS) return rhs;
+	if(!lhs) lhs = IntegerLiteral_init(0);
+	return ArithmeticExpr_init(lhs, op, rhs);
+}
+
+/*
+ * Works out whether an expression in the body of a loop is an affine function
+ * of the loop's induction variable, whose offset is invariant and can be
+ * evaluated before the loop without any risk of failing. On success, result
+ * is set to the function, and its offset is a new expression.
+ */
+static bool Expression_affine(Expression *expr, char *var, Statement *loop,
+	Program *prog, Affine *result) {
+
+	result->coefficient = 0;
+	result->offset = NULL;
+
+	if(expr->type == expr_Identifier &&
+		str_equal(expr->expr->ident->name, var)) {
+
+		result->coefficient = 1;
+		return true;
+	}
+	if(Expression_invariant(expr, loop, prog) && !Expression_may_fail(expr)) {
+		result->offset = Expression_copy(expr);
+		return true;
+	}
+	if(expr->type != expr_ArithmeticExpr) return false;
+
+	ArithmeticExpr *arith = expr->expr->arith;
+	Affine lhs, rhs;
+	if(!Expression_affine(arith->lhs, var, loop, prog, &lhs)) return false;
+	if(!Expression_affine(arith->rhs, var, loop, prog, &rhs)) {
+		if(lhs.offset) Expression_free(lhs.offset);
+		return false;
+	}
+
+	// Coefficients wrap around on overflow, as the loop's arithmetic does
+	if(arith->op == PLUS || arith->op == MINUS) {
+		result->coefficient = arith->op == PLUS
+			? (int)((unsigned)lhs.coefficient + rhs.coefficient)
+			: (int)((unsigned)lhs.coefficient - rhs.coefficient);
+		result->offset = offset_combine(lhs.offset, arith->op, rhs.offset);
+		return true;
+	}
+
+	// Multiplying by a constant scales the other side
+	if(arith->op == MULTIPLY) {
+		Affine *scaled = NULL, *constant = NULL;
+		if(rhs.coefficient == 0 && rhs.offset &&
+			rhs.offset->type == expr_IntegerLiteral) {
+
+			scaled = &lhs;
+			constant = &rhs;
+		}
+		else if(lhs.coefficient == 0 && lhs.offset &&
+			lhs.offset->type == expr_IntegerLiteral) {
+
+			scaled = &rhs;
+			constant = &lhs;
+		}
+
+		if(scaled) {
+			int factor = constant->offset->expr->intgr;
+			result->coefficient =
+				(int)((unsigned)scaled->coefficient * factor);
+			result->offset = scaled->offset ? ArithmeticExpr_init(
+				scaled->offset, MULTIPLY, constant->offset) : NULL;
+			if(!scaled->offset) Expression_free(constant->offset);
+			return true;
+		}
+	}
+
+	if(lhs.offset) Expression_free(lhs.offset);
+	if(rhs.offset) Expression_free(rhs.offset);
+	return false;
+}
+
+/*
+ * Returns the comparison operator that gives the same result with its operands
+ * swapped
+ */
+static token_type mirror_operator(token_type op) {
+	if(op == LESS_THAN) return GREATER_THAN;
+	if(op == GREATER_THAN) return LESS_THAN;
+	if(op == LESS_OR_EQUAL) return GREATER_OR_EQUAL;
+	if(op == GREATER_OR_EQUAL) return LESS_OR_EQUAL;
+	return op;
+}
+
+/*
+ * A counting loop: its condition is `var op bound`, for an invariant bound
+ * that is a variable or a constant, and each iteration assigns var <- var +
+ * step or var <- var - step, for an invariant step, once. The loop's other
+ * statements are accumulations (see Accumulation).
+ */
+typedef struct {
+	char *var;
+	token_type op;
+	Expression *bound;
+	Expression *step;
+	bool subtract;
+} CountingLoop;
+
+/*
+ * An assignment in the body of a counting loop of the form var <- var + value
+ * or var <- var - value, for an affine function value of the induction
+ * variable. after is true if it comes after the induction variable is updated
+ * in the body.
+ */
+typedef struct {
+	char *var;
+	bool subtract;
+	Affine value;
+	bool after;
+} Accumulation;
+
+/*
+ * Determines whether an expression is a variable or a constant that does not
+ * change during a loop
+ */
+static bool simple_invariant(Expression *expr, Statement *loop) {
+	return expr->type == expr_IntegerLiteral ||
+		(expr->type == expr_Identifier &&
+			!Statement_assigns(loop, expr->expr->ident->name));
+}
+
+/*
+ * Determines whether a loop condition compares an induction variable with an
+ * invariant bound, recording them in counting
+ */
+static bool counting_condition(Expression *cond, Statement *loop,
+	CountingLoop *counting) {
+
+	if(cond->type != expr_BooleanExpr) return false;
+
+	Expression *var = cond->expr->blean->lhs;
+	Expression *bound = cond->expr->blean->rhs;
+	token_type op = cond->expr->blean->op;
+	if(op != LESS_THAN && op != GREATER_THAN &&
+		op != LESS_OR_EQUAL && op != GREATER_OR_EQUAL) return false;
+
+	if(!simple_invariant(bound, loop)) {
+		Expression *temp = var;
+		var = bound;
+		bound = temp;
+		op = mirror_operator(op);
+	}
+	if(var->type != expr_Identifier || !simple_invariant(bound, loop)) {
+		return false;
+	}
+
+	counting->var = var->expr->ident->name;
+	counting->op = op;
+	counting->bound = bound;
+	return true;
+}
+
+/*
+ * Determines whether an assignment adds an invariant step to the induction
+ * variable, or subtracts one from it, recording the step in counting
+ */
+static bool counting_update(Statement *stmt, Statement *loop, Program *prog,
+	CountingLoop *counting) {
+
+	Assignment *assignment = stmt->stmt->_assignment;
+	if(stmt->type != stmt_Assignment || !str_equal(
+		assignment->ident->expr->ident->name, counting->var)) return false;
+
+	Expression *expr = assignment->expr;
+	if(expr->type != expr_ArithmeticExpr) return false;
+	Expression *lhs = expr->expr->arith->lhs;
+	Expression *rhs = expr->expr->arith->rhs;
+	token_type op = expr->expr->arith->op;
+
+	bool lhs_var = lhs->type == expr_Identifier &&
+		str_equal(lhs->expr->ident->name, counting->var);
+	bool rhs_var = rhs->type == expr_Identifier &&
+		str_equal(rhs->expr->ident->name, counting->var);
+
+	if(op == PLUS && rhs_var) counting->step = lhs;
+	else if((op == PLUS || op == MINUS) && lhs_var) counting->step = rhs;
+	else return false;
+	counting->subtract = op == MINUS;
+
+	return Expression_invariant(counting->step, loop, prog);
+}
+
+/*
+ * Determines whether an assignment in the body of a counting loop accumulates
+ * an affine function of the induction variable, recording it in accumulation
+ */
+static bool accumulation(Statement *stmt, Statement *loop, Program *prog,
+	CountingLoop *counting, Accumulation *accumulation) {
+
+	if(stmt->type != stmt_Assignment) return false;
+	char *var = stmt->stmt->_assignment->ident->expr->ident->name;
+	Expression *expr = stmt->stmt->_assignment->expr;
+	if(str_equal(var, counting->var) || expr->type != expr_ArithmeticExpr) {
+		return false;
+	}
+
+	Expression *lhs = expr->expr->arith->lhs;
+	Expression *rhs = expr->expr->arith->rhs;
+	token_type op = expr->expr->arith->op;
+
+	Expression *value;
+	if(op == PLUS && rhs->type == expr_Identifier &&
+		str_equal(rhs->expr->ident->name, var)) value = lhs;
+	else if((op == PLUS || op == MINUS) && lhs->type == expr_Identifier &&
+		str_equal(lhs->expr->ident->name, var)) value = rhs;
+	else return false;
+
+	accumulation->var = var;
+	accumulation->subtract = op == MINUS;
+	return Expression_affine(
+		value, counting->var, loop, prog, &(accumulation->value));
+}
+
+/*
+ * Returns a new expression reading the variable with the given name
+ */
+static Expression *variable(char *name) {
+	return Identifier_init(safe_strdup(name));
+}
+
+/*
+ * Returns the expression cond ? expr : 0
+ */
+static Expression *guarded(Expression *cond, Expression *expr) {
+	return Ternary_init(cond, expr, IntegerLiteral_init(0));
+}
+
+/*
+ * Returns an expression checking that an expression's value is within
+ * CLOSED_FORM_LIMIT, wrapping the given expression in it
+ */
+static Expression *guarded_range(Expression *value, Expression *expr) {
+	return guarded(BooleanExpr_init(Expression_copy(value), GREATER_OR_EQUAL,
+			IntegerLiteral_init(-CLOSED_FORM_LIMIT)),
+		guarded(BooleanExpr_init(Expression_copy(value), LESS_THAN,
+			IntegerLiteral_init(CLOSED_FORM_LIMIT)), expr));
+}
+
+/*
+ * Returns an expression for the sum of the values that an accumulation adds
+ * over count iterations, where the induction variable starts at start and
+ * changes by delta each iteration. The sum of i from 0 to count - 1 (or 1 to
+ * count, if the accumulation comes after the update) is count * (count - 1) / 2
+ * (or count * (count + 1) / 2), which is calculated by halving whichever of
+ * its factors is even, so that it wraps around on overflow exactly as adding
+ * the values up one at a time does. Returns NULL if the sum is always zero.
+ */
+static Expression *accumulated_sum(Accumulation *acc, char *count,
+	Expression *start, Expression *delta) {
+
+	Affine *value = &(acc->value);
+	Expression *sum = NULL;
+
+	// count * (coefficient * start + offset)
+	Expression *first = value->offset;
+	if(value->coefficient != 0) {
+		first = offset_combine(ArithmeticExpr_init(
+			IntegerLiteral_init(value->coefficient), MULTIPLY,
+			Expression_copy(start)), PLUS, first);
+	}
+	if(first) sum = ArithmeticExpr_init(variable(count), MULTIPLY, first);
+
+	// coefficient * delta * (the sum of the iteration numbers)
+	if(value->coefficient != 0) {
+		token_type op = acc->after ? PLUS : MINUS;
+		Expression *other = ArithmeticExpr_init(
+			variable(count), op, IntegerLiteral_init(1));
+		Expression *iterations = Ternary_init(
+			BooleanExpr_init(ArithmeticExpr_init(variable(count), MODULO,
+				IntegerLiteral_init(2)), EQUAL, IntegerLiteral_init(0)),
+			ArithmeticExpr_init(ArithmeticExpr_init(variable(count), DIVIDE,
+				IntegerLiteral_init(2)), MULTIPLY, Expression_copy(other)),
+			ArithmeticExpr_init(variable(count), MULTIPLY, ArithmeticExpr_init(
+				other, DIVIDE, IntegerLiteral_init(2))));
+
+		sum = offset_combine(sum, PLUS, ArithmeticExpr_init(
+			ArithmeticExpr_init(IntegerLiteral_init(value->coefficient),
+				MULTIPLY, Expression_copy(delta)), MULTIPLY, iterations));
+	}
+
+	value->offset = NULL;
+	return sum ? Expression_fold(sum) : NULL;
+}
+
+/*
+ * The state of closed-form loop evaluation in a function: the number of
+ * variables it has created
+ */
+typedef struct {
+	Program *prog;
+	int variable_count;
+} Closer;
+
+/*
+ * Returns the name of a new variable for the closed form of a loop
+ */
+static char *closed_form_name(Closer *c, char *kind) {
+	char name[32];
+	sprintf(name, "'%s%d", kind, c->variable_count++);
+	return safe_strdup(name);
+}
+
+/*
+ * Appends an assignment made before a loop to a list of statements, returning
+ * the name assigned to
+ */
+static char *assign_before(LinkedList *stmts, Statement *loop, char *name,
+	Expression *expr) {
+
+	Statement *assignment = Assignment_init(name, expr);
+	assignment->line = loop->line;
+	LinkedList_append(stmts, assignment);
+	return name;
+}
+
+/*
+ * Evaluates a counting loop in closed form, if it is one. The number of
+ * iterations the loop would make is calculated, then each accumulation is
+ * applied that many times at once, using the formula for the sum of an
+ * arithmetic sequence, and the induction variable is set to its final value.
+ * The statements doing so are appended to stmts, before the loop, which is
+ * kept: it makes no iterations after the closed form, and runs as before if
+ * the closed form can not be used because the values involved are too large
+ * to rule out overflow.
+ *
+ * A step that is not constant is evaluated before the loop, but only if the
+ * loop would run, so that it is evaluated exactly when the loop would have
+ * first evaluated it.
+ */
+static void close_loop(Closer *c, Statement *loop, LinkedList *stmts) {
+	CountingLoop counting;
+	Expression *cond;
+	LinkedList *body;
+	if(loop->type == stmt_For) {
+		cond = loop->stmt->_for->bool_expr;
+		body = loop->stmt->_for->stmts;
+	}
+	else {
+		cond = loop->stmt->_while->bool_expr;
+		body = loop->stmt->_while->stmts;
+	}
+	if(!counting_condition(cond, loop, &counting)) return;
+
+	// Find the update of the induction variable and the accumulations
+	int body_length = LinkedList_length(body);
+	Accumulation *accs = safe_alloc(sizeof(Accumulation) * (body_length + 1));
+	int acc_count = 0;
+	bool updated = false, valid = true;
+
+	if(loop->type == stmt_For) {
+		Statement *assignment = loop->stmt->_for->assignment;
+		updated = str_equal(counting.var,
+				assignment->stmt->_assignment->ident->expr->ident->name) &&
+			counting_update(
+				loop->stmt->_for->incrementor, loop, c->prog, &counting);
+		valid = updated;
+	}
+
+	LLIterator *body_iter = LLIterator_init(body);
+	while(valid && !LLIterator_ended(body_iter)) {
+		Statement *stmt = (Statement *)LLIterator_get_current(body_iter);
+
+		if(loop->type == stmt_While && !updated &&
+			counting_update(stmt, loop, c->prog, &counting)) updated = true;
+
+		else if(accumulation(
+			stmt, loop, c->prog, &counting, &accs[acc_count])) {
+
+			accs[acc_count].after = updated && loop->type == stmt_While;
+
+			// Each variable may only be accumulated once
+			int i;
+			for(i = 0; i < acc_count; i++) {
+				if(str_equal(accs[i].var, accs[acc_count].var)) valid = false;
+			}
+			acc_count++;
+		}
+		else valid = false;
+
+		LLIterator_advance(body_iter);
+	}
+	free(body_iter);
+
+	// The loop must count towards its bound
+	bool descending = counting.op == GREATER_THAN ||
+		counting.op == GREATER_OR_EQUAL;
+	long magnitude = 1;
+	if(valid && updated && counting.step->type == expr_IntegerLiteral) {
+		long step = counting.step->expr->intgr;
+		magnitude = descending == counting.subtract ? step : -step;
+		valid = magnitude >= 1 && magnitude < CLOSED_FORM_LIMIT;
+	}
+
+	// Constants must be small enough to rule out overflow
+	Expression *start = loop->type == stmt_For
+		? loop->stmt->_for->assignment->stmt->_assignment->expr
+		: NULL;
+	Expression *limited[] = {counting.bound, start};
+	int i;
+	for(i = 0; i < 2; i++) {
+		if(limited[i] && limited[i]->type == expr_IntegerLiteral) {
+			int value = limited[i]->expr->intgr;
+			if(value < -CLOSED_FORM_LIMIT || value >= CLOSED_FORM_LIMIT) {
+				valid = false;
+			}
+		}
+	}
+
+	if(!valid || !updated) {
+		for(i = 0; i < acc_count; i++) {
+			if(accs[i].value.offset) Expression_free(accs[i].value.offset);
+		}
+		free(accs);
+		return;
+	}
+
+	// The value the induction variable starts at, which a for-loop's start
+	// is evaluated into first unless it is simple
+	if(loop->type == stmt_For && !simple_invariant(start, loop)) {
+		Expression *start_var = variable(assign_before(stmts, loop,
+			closed_form_name(c, "start"), start));
+		loop->stmt->_for->assignment->stmt->_assignment->expr = start_var;
+		start = start_var;
+	}
+	else if(loop->type == stmt_While) start = variable(counting.var);
+
+	Expression *first_cond = BooleanExpr_init(Expression_copy(start),
+		counting.op, Expression_copy(counting.bound));
+
+	// The step, and how far it moves the induction variable towards the bound
+	Expression *delta, *distance;
+	if(counting.step->type == expr_IntegerLiteral) {
+		delta = IntegerLiteral_init(descending ? -magnitude : magnitude);
+		distance = IntegerLiteral_init(magnitude);
+	}
+	else {
+		char *step = assign_before(stmts, loop, closed_form_name(c, "step"),
+			Ternary_init(Expression_copy(first_cond),
+				Expression_copy(counting.step), IntegerLiteral_init(0)));
+		delta = counting.subtract
+			? ArithmeticExpr_init(IntegerLiteral_init(0), MINUS, variable(step))
+			: variable(step);
+		distance = descending == counting.subtract ? variable(step) :
+			ArithmeticExpr_init(IntegerLiteral_init(0), MINUS, variable(step));
+	}
+
+	// The number of iterations the loop would make
+	Expression *gap = descending
+		? ArithmeticExpr_init(Expression_copy(start), MINUS,
+			Expression_copy(counting.bound))
+		: ArithmeticExpr_init(Expression_copy(counting.bound), MINUS,
+			Expression_copy(start));
+	Expression *count_expr;
+	if(counting.op == LESS_OR_EQUAL || counting.op == GREATER_OR_EQUAL) {
+		count_expr = ArithmeticExpr_init(ArithmeticExpr_init(gap, DIVIDE,
+			Expression_copy(distance)), PLUS, IntegerLiteral_init(1));
+	}
+	else {
+		count_expr = ArithmeticExpr_init(ArithmeticExpr_init(gap, PLUS,
+			ArithmeticExpr_init(Expression_copy(distance), MINUS,
+				IntegerLiteral_init(1))), DIVIDE, Expression_copy(distance));
+	}
+
+	if(counting.step->type != expr_IntegerLiteral) {
+		count_expr = guarded(BooleanExpr_init(Expression_copy(distance),
+				GREATER_OR_EQUAL, IntegerLiteral_init(1)),
+			guarded(BooleanExpr_init(Expression_copy(distance), LESS_THAN,
+				IntegerLiteral_init(CLOSED_FORM_LIMIT)), count_expr));
+	}
+	if(counting.bound->type != expr_IntegerLiteral) {
+		count_expr = guarded_range(counting.bound, count_expr);
+	}
+	if(start->type != expr_IntegerLiteral) {
+		count_expr = guarded_range(start, count_expr);
+	}
+	count_expr = guarded(first_cond, count_expr);
+	char *count = assign_before(stmts, loop, closed_form_name(c, "count"),
+		Expression_fold(count_expr));
+
+	// Apply the accumulations, then move the induction variable to its final
+	// value
+	LinkedList *closed = LinkedList_init();
+	for(i = 0; i < acc_count; i++) {
+		Expression *sum = accumulated_sum(&accs[i], count, start, delta);
+		if(!sum) continue;
+
+		Statement *assignment = Assignment_init(safe_strdup(accs[i].var),
+			ArithmeticExpr_init(variable(accs[i].var),
+				accs[i].subtract ? MINUS : PLUS, sum));
+		assignment->line = loop->line;
+		LinkedList_append(closed, assignment);
+	}
+
+	Expression *final = ArithmeticExpr_init(Expression_copy(start), PLUS,
+		ArithmeticExpr_init(variable(count), MULTIPLY, delta));
+	if(loop->type == stmt_For) {
+		loop->stmt->_for->assignment->stmt->_assignment->expr = final;
+	}
+	else {
+		Statement *assignment =
+			Assignment_init(safe_strdup(counting.var), final);
+		assignment->line = loop->line;
+		LinkedList_append(closed, assignment);
+	}
+
+	if(LinkedList_length(closed) > 0) {
+		Statement *if_stmt = If_init(BooleanExpr_init(variable(count),
+			GREATER_THAN, IntegerLiteral_init(0)), closed, LinkedList_init());
+		if_stmt->line = loop->line;
+		LinkedList_append(stmts, if_stmt);
+	}
+	else LinkedList_free(closed);
+
+	Expression_free(start);
+	Expression_free(distance);
+	free(accs);
+}
+
+static LinkedList *close_stmt_list(Closer *c, LinkedList *stmts);
+
+/*
+ * Evaluates the counting loops in a statement in closed form, appending the
+ * statement to the given list after any statements that do so
+ */
+static void close_statement(Closer *c, Statement *stmt, LinkedList *stmts) {
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			stmt->stmt->_for->stmts =
+				close_stmt_list(c, stmt->stmt->_for->stmts);
+			close_loop(c, stmt, stmts);
+			break;
+
+		case stmt_While:
+			stmt->stmt->_while->stmts =
+				close_stmt_list(c, stmt->stmt->_while->stmts);
+			close_loop(c, stmt, stmts);
+			break;
+
+		case stmt_If:
+			stmt->stmt->_if->true_stmts =
+				close_stmt_list(c, stmt->stmt->_if->true_stmts);
+			stmt->stmt->_if->false_stmts =
+				close_stmt_list(c, stmt->stmt->_if->false_stmts);
+			break;
+
+		case stmt_Print:
+		case stmt_Assignment:
+		case stmt_Return:
+			break;
+	}
+
+	LinkedList_append(stmts, stmt);
+}
+
+/*
+ * Evaluates the counting loops in a list of statements in closed form. The
+ * given list is consumed, and the returned list should be used in its place.
+ */
+static LinkedList *close_stmt_list(Closer *c, LinkedList *stmts) {
+	LinkedList *new_stmts = LinkedList_init();
+
+	while(LinkedList_length(stmts) > 0) {
+		close_statement(c, (Statement *)LinkedList_pop(stmts), new_stmts);
+	}
+
+	LinkedList_free(stmts);
+	return new_stmts;
+}
+
+/*
+ * Induction variable analysis. Loops that count an induction variable towards
+ * an invariant bound by an invariant step, and whose bodies only accumulate
+ * affine functions of the induction variable into other variables, such as
+ * `while a > 5 { a -= 5; }` or `for i <- 0, i < n, i++ { total += i * 2; }`,
+ * are evaluated in closed form, in constant time (see close_loop()).
+ */
+static void FNDecl_close_loops(FNDecl *func, Program *prog) {
+	Closer c = {prog, 0};
+	func->stmts = close_stmt_list(&c, func->stmts);
+}
+
+/*
+ * The most clones that are made of a single function for calls that pass it
+ * different constants (see FNDecl_clone_for_calls())
+ */
+#define MAX_CLONES 4
+
+/*
+ * A copy of a function made for the calls that pass it the same constants:
+ * argument i of the original function is replaced by values[i] in the clone,
+ * which does not take it, if constant[i] is true
+ */
+typedef struct {
+	FNDecl *clone;
+	FNDecl *original;
+	bool *constant;
+	int *values;
+} Clone;
+
+/*
+ * Folds the constants in each argument of a call (see Expression_fold())
+ */
+static void fold_call_args(FNCall *call) {
+	LinkedList *folded_args = LinkedList_init();
+	while(LinkedList_length(call->args) > 0) {
+		LinkedList_append(folded_args,
+			Expression_fold((Expression *)LinkedList_pop(call->args)));
+	}
+	LinkedList_free(call->args);
+	call->args = folded_args;
+}
+
+/*
+ * Folds the arguments of each call that a function makes to the function with
+ * the given name. Folding a call's arguments can free the calls in the branch
+ * of a constant ternary that is not chosen, so the calls are collected again
+ * after each one is folded, and the one after those already folded is taken
+ * next.
+ */
+static void fold_calls_to(FNDecl *caller, char *name) {
+	int folded = 0;
+	bool found = true;
+
+	while(found) {
+		LinkedList *sites = FNDecl_call_sites(caller);
+		int seen = 0;
+		found = false;
+
+		LLIterator *sites_iter = LLIterator_init(sites);
+		while(!LLIterator_ended(sites_iter) && !found) {
+			FNCall *call = (FNCall *)LLIterator_get_current(sites_iter);
+			if(str_equal(call->name, name) && seen++ == folded) {
+				fold_call_args(call);
+				folded++;
+				found = true;
+			}
+			LLIterator_advance(sites_iter);
+		}
+		free(sites_iter);
+		LinkedList_free(sites);
+	}
+}
+
+/*
+ * Returns the calls in a program to the given function, with their arguments
+ * folded, appending the function that makes each call to callers. Returns NULL
+ * if a call can not be changed, because it passes the wrong number of
+ * arguments, so must fail as it would have done, or because the stack offsets
+ * of the function making it have already been generated.
+ */
+static LinkedList *calls_to(Program *prog, FNDecl *func, LinkedList *callers) {
+	LinkedList *calls = LinkedList_init();
+	bool changeable = true;
+
+	LLIterator *funcs_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(funcs_iter) && changeable) {
+		FNDecl *caller = (FNDecl *)LLIterator_get_current(funcs_iter);
+		fold_calls_to(caller, func->name);
+		LinkedList *sites = FNDecl_call_sites(caller);
+
+		LLIterator *sites_iter = LLIterator_init(sites);
+		while(!LLIterator_ended(sites_iter) && changeable) {
+			FNCall *call = (FNCall *)LLIterator_get_current(sites_iter);
+			if(str_equal(call->name, func->name)) {
+				changeable = caller->variable_count == -1 &&
+					LinkedList_length(call->args) ==
+					LinkedList_length(func->args);
+				LinkedList_append(calls, call);
+				LinkedList_append(callers, caller);
+			}
+			LLIterator_advance(sites_iter);
+		}
+		free(sites_iter);
+		LinkedList_free(sites);
+		LLIterator_advance(funcs_iter);
+	}
+	free(funcs_iter);
+
+	if(!changeable) {
+		LinkedList_free(calls);
+		return NULL;
+	}
+	return calls;
+}
+
+/*
+ * Frees and removes each expression in a list of arguments for which
+ * constant[i] is true
+ */
+static void remove_args(LinkedList *args, bool *constant) {
+	int i;
+	for(i = LinkedList_length(args) - 1; i >= 0; i--) {
+		if(!constant[i]) continue;
+		Expression_free((Expression *)LinkedList_get(args, i));
+		LinkedList_remove(args, i);
+	}
+}
+
+/*
+ * Replaces each argument of a function for which constant[i] is true by the
+ * constant values[i] throughout the function, and removes it from the
+ * function's arguments. The nesting levels of the function's statements are
+ * kept, so that it is interpreted as before (see substitute_stmt_list()).
+ */
+static void FNDecl_bind_args(FNDecl *func, bool *constant, int *values) {
+	int i;
+	for(i = 0; i < LinkedList_length(func->args); i++) {
+		if(!constant[i]) continue;
+
+		Expression *arg = (Expression *)LinkedList_get(func->args, i);
+		func->stmts = substitute_stmt_list(func->stmts,
+			arg->expr->ident->name, values[i], false);
+	}
+	remove_args(func->args, constant);
+}
+
+/*
+ * Returns true for each argument of a function that it never assigns to, so
+ * that a constant passed for it holds throughout the function
+ */
+static bool *unassigned_args(FNDecl *func) {
+	int arg_count = LinkedList_length(func->args);
+	bool *unassigned = safe_alloc(sizeof(bool) * (arg_count + 1));
+
+	int i;
+	for(i = 0; i < arg_count; i++) {
+		Expression *arg = (Expression *)LinkedList_get(func->args, i);
+		unassigned[i] = !stmt_list_assigns(func->stmts, arg->expr->ident->name);
+	}
+	return unassigned;
+}
+
+/*
+ * Substitutes the constant that every call to a function passes for one of its
+ * arguments into the function, if it never assigns to the argument, and
+ * removes the argument from the function and from the calls. A recursive call
+ * that passes the argument on unchanged passes the same constant. Returns true
+ * if any argument was removed.
+ */
+static bool FNDecl_propagate_args(Program *prog, FNDecl *func) {
+	LinkedList *callers = LinkedList_init();
+	LinkedList *calls = calls_to(prog, func, callers);
+	if(!calls || LinkedList_length(calls) == 0) {
+		if(calls) LinkedList_free(calls);
+		LinkedList_free(callers);
+		return false;
+	}
+
+	int arg_count = LinkedList_length(func->args);
+	bool *constant = unassigned_args(func);
+	int *values = safe_alloc(sizeof(int) * (arg_count + 1));
+	bool any_constant = false;
+
+	int i, j;
+	for(i = 0; i < arg_count; i++) {
+		Expression *param = (Expression *)LinkedList_get(func->args, i);
+		bool seen = false;
+
+		for(j = 0; j < LinkedList_length(calls) && constant[i]; j++) {
+			FNCall *call = (FNCall *)LinkedList_get(calls, j);
+			Expression *arg = (Expression *)LinkedList_get(call->args, i);
+
+			if(arg->type == expr_IntegerLiteral) {
+				if(seen && arg->expr->intgr != values[i]) constant[i] = false;
+				values[i] = arg->expr->intgr;
+				seen = true;
+			}
+			else {
+				constant[i] = LinkedList_get(callers, j) == func &&
+					arg->type == expr_Identifier &&
+					str_equal(arg->expr->ident->name,
+						param->expr->ident->name);
+			}
+		}
+
+		constant[i] = constant[i] && seen;
+		if(constant[i]) any_constant = true;
+	}
+
+	// The calls' arguments are removed before the constants are bound, as
+	// binding them replaces the arguments of the recursive calls
+	if(any_constant) {
+		LLIterator *calls_iter = LLIterator_init(calls);
+		while(!LLIterator_ended(calls_iter)) {
+			remove_args(((FNCall *)LLIterator_get_current(calls_iter))->args,
+				constant);
+			LLIterator_advance(calls_iter);
+		}
+		free(calls_iter);
+		FNDecl_bind_args(func, constant, values);
+	}
+
+	free(constant);
+	free(values);
+	LinkedList_free(calls);
+	LinkedList_free(callers);
+	return any_constant;
+}
+
+/*
+ * Returns the clone in a list of clones of the given function that binds the
+ * given constants, or NULL if there is none
+ */
+static Clone *find_clone(LinkedList *clones, FNDecl *original, bool *constant,
+	int *values) {
+
+	int arg_count = LinkedList_length(original->args);
+	Clone *found = NULL;
+
+	LLIterator *clones_iter = LLIterator_init(clones);
+	while(!LLIterator_ended(clones_iter) && !found) {
+		Clone *clone = (Clone *)LLIterator_get_current(clones_iter);
+		bool same = clone->original == original;
+
+		int i;
+		for(i = 0; i < arg_count && same; i++) {
+			same = clone->constant[i] == constant[i] &&
+				(!constant[i] || clone->values[i] == values[i]);
+		}
+		if(same) found = clone;
+		LLIterator_advance(clones_iter);
+	}
+	free(clones_iter);
+
+	return found;
+}
+
+/*
+ * Returns the function that the given function is a clone of, or NULL if it is
+ * not a clone
+ */
+static FNDecl *clone_original(LinkedList *clones, FNDecl *func) {
+	FNDecl *original = NULL;
+
+	LLIterator *clones_iter = LLIterator_init(clones);
+	while(!LLIterator_ended(clones_iter) && !original) {
+		Clone *clone = (Clone *)LLIterator_get_current(clones_iter);
+		if(clone->clone == func) original = clone->original;
+		LLIterator_advance(clones_iter);
+	}
+	free(clones_iter);
+
+	return original;
+}
+
+/*
+ * Returns the number of clones that have been made of the given function
+ */
+static int count_clones(LinkedList *clones, FNDecl *func) {
+	int count = 0;
+
+	LLIterator *clones_iter = LLIterator_init(clones);
+	while(!LLIterator_ended(clones_iter)) {
+		if(((Clone *)LLIterator_get_current(clones_iter))->original == func)
+			count++;
+		LLIterator_advance(clones_iter);
+	}
+	free(clones_iter);
+
+	return count;
+}
+
+/*
+ * Makes a clone of a function with the given constants bound to its arguments
+ * (see FNDecl_bind_args()), adding it to the program and to the list of clones
+ */
+static Clone *make_clone(Program *prog, LinkedList *clones, FNDecl *func,
+	int number, bool *constant, int *values) {
+
+	int arg_count = LinkedList_length(func->args);
+	Clone *clone = safe_alloc(sizeof(Clone));
+	clone->original = func;
+	clone->constant = safe_alloc(sizeof(bool) * (arg_count + 1));
+	clone->values = safe_alloc(sizeof(int) * (arg_count + 1));
+	memcpy(clone->constant, constant, sizeof(bool) * arg_count);
+	memcpy(clone->values, values, sizeof(int) * arg_count);
+
+	clone->clone = FNDecl_copy(func);
+	char name[32];
+	sprintf(name, ".constprop.%d", number);
+	free(clone->clone->name);
+	clone->clone->name = str_concat_2(func->name, name);
+	FNDecl_bind_args(clone->clone, constant, values);
+
+	LinkedList_append(prog->function_list, clone->clone);
+	LinkedList_append(clones, clone);
+	return clone;
+}
+
+/*
+ * Redirects the calls to a function that pass constants for arguments it never
+ * assigns to, to clones of the function that have those constants bound to
+ * them (see FNDecl_bind_args()). Calls that pass the same constants share a
+ * clone, and at most MAX_CLONES are made of a function. Clones are not cloned
+ * again, and calls that the function and its clones make to it are left
+ * alone, so that recursion can not make clones without end. Returns true if
+ * any call was redirected.
+ */
+static bool FNDecl_clone_for_calls(Program *prog, FNDecl *func,
+	LinkedList *clones) {
+
+	if(clone_original(clones, func)) return false;
+
+	LinkedList *callers = LinkedList_init();
+	LinkedList *calls = calls_to(prog, func, callers);
+	if(!calls) {
+		LinkedList_free(callers);
+		return false;
+	}
+
+	int clone_count = count_clones(clones, func);
+	int arg_count = LinkedList_length(func->args);
+	bool *unassigned = unassigned_args(func);
+	bool *constant = safe_alloc(sizeof(bool) * (arg_count + 1));
+	int *values = safe_alloc(sizeof(int) * (arg_count + 1));
+	bool redirected = false;
+
+	int i, j;
+	for(j = 0; j < LinkedList_length(calls); j++) {
+		FNCall *call = (FNCall *)LinkedList_get(calls, j);
+		FNDecl *caller = (FNDecl *)LinkedList_get(callers, j);
+		if(caller == func || clone_original(clones, caller) == func) continue;
+
+		// Find the constants that the call passes
+		bool any_constant = false;
+		for(i = 0; i < arg_count; i++) {
+			Expression *arg = (Expression *)LinkedList_get(call->args, i);
+			constant[i] = unassigned[i] && arg->type == expr_IntegerLiteral;
+			values[i] = constant[i] ? arg->expr->intgr : 0;
+			if(constant[i]) any_constant = true;
+		}
+		if(!any_constant) continue;
+
+		Clone *clone = find_clone(clones, func, constant, values);
+		if(!clone && clone_count < MAX_CLONES) {
+			clone = make_clone(prog, clones, func, clone_count++, constant,
+				values);
+		}
+		if(!clone) continue;
+
+		free(call->name);
+		call->name = safe_strdup(clone->clone->name);
+		remove_args(call->args, constant);
+		redirected = true;
+	}
+
+	free(unassigned);
+	free(constant);
+	free(values);
+	LinkedList_free(calls);
+	LinkedList_free(callers);
+	return redirected;
+}
+
+/*
+ * Determines whether or not a list contains the given element
+ */
+static bool list_contains(LinkedList *list, void *element) {
+	bool found = false;
+
+	LLIterator *iter = LLIterator_init(list);
+	while(!LLIterator_ended(iter) && !found) {
+		found = LLIterator_get_current(iter) == element;
+		LLIterator_advance(iter);
+	}
+	free(iter);
+
+	return found;
+}
+
+/*
+ * Removes the functions of a program that can not be reached by calls from its
+ * main function, so that they are neither optimised nor compiled
+ */
+static void Program_remove_unreachable(Program *prog, FNDecl *main_func) {
+	LinkedList *reached = LinkedList_init_with(main_func);
+
+	int i;
+	for(i = 0; i < LinkedList_length(reached); i++) {
+		LinkedList *sites = FNDecl_call_sites(
+			(FNDecl *)LinkedList_get(reached, i));
+
+		LLIterator *sites_iter = LLIterator_init(sites);
+		while(!LLIterator_ended(sites_iter)) {
+			FNDecl *callee = Program_find_FNDecl(prog,
+				((FNCall *)LLIterator_get_current(sites_iter))->name);
+			if(callee && !list_contains(reached, callee))
+				LinkedList_append(reached, callee);
+			LLIterator_advance(sites_iter);
+		}
+		free(sites_iter);
+		LinkedList_free(sites);
+	}
+
+	LinkedList *function_list = LinkedList_init();
+	while(LinkedList_length(prog->function_list) > 0) {
+		FNDecl *func = (FNDecl *)LinkedList_pop(prog->function_list);
+		if(list_contains(reached, func)) LinkedList_append(function_list, func);
+		else FNDecl_free(func);
+	}
+	LinkedList_free(prog->function_list);
+	prog->function_list = function_list;
+
+	LinkedList_free(reached);
+}
+
+/*
+ * Interprocedural constant propagation, for programs with a main function
+ * that are not libraries.
+ * Functions that main can not reach are removed, then the constants that
+ * functions are called with are bound to their arguments: an argument that
+ * every call passes the same constant for is replaced by it in the function
+ * (see FNDecl_propagate_args()), and calls that pass other constants are
+ * redirected to clones of the function (see FNDecl_clone_for_calls()).
+ * Binding constants in a function can make its own calls pass constants, so
+ * this is repeated until nothing changes. Finally the functions that are no
+ * longer called, such as those whose calls all went to clones, are removed.
+ */
+static void Program_propagate_constants(Program *prog) {
+	FNDecl *main_func = Program_find_FNDecl(prog, "main");
+	if(!main_func || prog->library) return;
+
+	Program_remove_unreachable(prog, main_func);
+
+	LinkedList *clones = LinkedList_init();
+	bool changed = true;
+	while(changed) {
+		changed = false;
+
+		int i;
+		for(i = 0; i < LinkedList_length(prog->function_list); i++) {
+			FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, i);
+			if(func == main_func || func->variable_count != -1 ||
+				LinkedList_length(func->args) == 0) continue;
+
+			// The arguments of a function that has been cloned are kept, as
+			// its clones record which of them they bind
+			if(count_clones(clones, func) == 0 &&
+				FNDecl_propagate_args(prog, func)) changed = true;
+			else if(FNDecl_clone_for_calls(prog, func, clones)) changed = true;
+		}
+	}
+
+	while(LinkedList_length(clones) > 0) {
+		Clone *clone = (Clone *)LinkedList_pop(clones);
+		free(clone->constant);
+		free(clone->values);
+		free(clone);
+	}
+	LinkedList_free(clones);
+
+	Program_remove_unreachable(prog, main_func);
+}
+
+/*
+ * Optimises the functions of a program before it is run, by propagating
+ * constants between functions and removing those that are never called, then
+ * hoisting loop-invariant code out of loops, then evaluating counting loops in
+ * closed form. Every tier benefits, as they all run the transformed AST. A
+ * program is only optimised once, and functions whose stack offsets have
+ * already been generated are left alone, as new variables would invalidate
+ * them.
+ */
+void Program_optimise(Program *prog) {
+	if(prog->optimised) return;
+	prog->optimised = true;
+
+	Program_propagate_constants(prog);
+	Program_find_pure_functions(prog);
+
+	LLIterator *funcs_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(funcs_iter)) {
+		FNDecl *func = (FNDecl *)LLIterator_get_current(funcs_iter);
+
+		if(func->variable_count == -1) {
+			FNDecl_hoist_invariants(func, prog);
+			FNDecl_close_loops(func, prog);
+		}
+		LLIterator_advance(funcs_iter);
+	}
+	free(funcs_iter);
+}
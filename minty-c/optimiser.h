@@ -0,0 +1,41 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef OPTIMISER
+#define OPTIMISER
+
+/*
+ * Optimisation functions - these transform ASTs into equivalent ASTs that can
+ * be executed or compiled more efficiently
+ */
+
+bool stmt_list_assigns(LinkedList *stmts, char *name);
+
+bool For_is_counted(For *loop, int *step);
+
+Expression *Expression_fold(Expression *expr);
+
+Expression *Expression_substitute(Expression *expr, char *name, int value);
+
+LinkedList *stmt_list_substitute(LinkedList *stmts, char *name, int value);
+
+FNDecl *FNDecl_substitute_args(FNDecl *func, bool *guarded, int *values);
+
+FNDecl *FNDecl_specialise(FNDecl *func, bool *guarded);
+
+bool stmt_list_prints(LinkedList *stmts);
+
+void Program_find_pure_functions(Program *prog);
+
+void Program_optimise(Program *prog);
+
+#endif // OPTIMISER
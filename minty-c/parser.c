@@ -364,7 +364,7 @@ Expression *parse_expression(LinkedList *tokens) {
  * types of statement, each of which is handled differently, but in each case
  * a Statement object is returned.
  */
-Statement *parse_statement(LinkedList *tokens) {
+static Statement *parse_statement_contents(LinkedList *tokens) {
 
 	// Retrieve the next token, and check that it's valid, i.e. if it's in the
 	// list: ['print', 'for', 'return', 'if', 'while', 'ID']
@@ -501,7 +501,7 @@ Statement *parse_statement(LinkedList *tokens) {
 			Assignment_init(
 				assignee,
 				ArithmeticExpr_init(
-					Identifier_init(assignee),
+					Identifier_init(safe_strdup(assignee)),
 					PLUS,
 					IntegerLiteral_init(1)));
 
@@ -509,7 +509,7 @@ Statement *parse_statement(LinkedList *tokens) {
 			Assignment_init(
 				assignee,
 				ArithmeticExpr_init(
-					Identifier_init(assignee),
+					Identifier_init(safe_strdup(assignee)),
 					MINUS,
 					IntegerLiteral_init(1)));
 
@@ -517,7 +517,7 @@ Statement *parse_statement(LinkedList *tokens) {
 			Assignment_init(
 				assignee,
 				ArithmeticExpr_init(
-					Identifier_init(assignee),
+					Identifier_init(safe_strdup(assignee)),
 					PLUS,
 					parse_expression(tokens)));
 
@@ -525,7 +525,7 @@ Statement *parse_statement(LinkedList *tokens) {
 			Assignment_init(
 				assignee,
 				ArithmeticExpr_init(
-					Identifier_init(assignee),
+					Identifier_init(safe_strdup(assignee)),
 					MINUS,
 					parse_expression(tokens)));
 
@@ -546,6 +546,17 @@ Statement *parse_statement(LinkedList *tokens) {
 	}
 }
 
+/*
+ * Parses a statement, recording the line of its first token as the line of the
+ * statement
+ */
+Statement *parse_statement(LinkedList *tokens) {
+	int line = ((Token *)LinkedList_get(tokens, 0))->line;
+	Statement *stmt = parse_statement_contents(tokens);
+	stmt->line = line;
+	return stmt;
+}
+
 /*
  * Parses a block of statements encased in curly brackets. Returns a list that
  * contains a Statement object for each statement in the block, by calling
@@ -613,6 +624,7 @@ FNDecl *parse_function(LinkedList *tokens) {
 	// Retrieve the first token, check that it's an FN
 	Token *next_token = (Token *)LinkedList_pop(tokens);
 	check_valid_single(FN, next_token->type);
+	int line = next_token->line;
 
 	// Retrieve the next token, check that it's an ID
 	next_token = (Token *)LinkedList_pop(tokens);
@@ -651,7 +663,9 @@ FNDecl *parse_function(LinkedList *tokens) {
 	LinkedList *statements = parse_statement_block(tokens);
 
 	// Construct & return the function object
-	return FNDecl_init(function_name, args, statements);
+	FNDecl *func = FNDecl_init(function_name, args, statements);
+	func->line = line;
+	return func;
 }
 
 /*
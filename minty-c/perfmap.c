@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "minty_util.h"
+#include "perfmap.h"
+
+/*
+ * The open perf map and jitdump files, NULL when not in use
+ */
+static FILE *perf_map = NULL;
+static FILE *jitdump = NULL;
+
+/*
+ * The jitdump file is mapped into memory so that the mapping shows up in perf's
+ * record of the process - this is how 'perf inject' finds the file
+ */
+static void *jitdump_marker = NULL;
+
+/*
+ * The number of pieces of code recorded in the jitdump file
+ */
+static uint64_t jitdump_code_index = 0;
+
+/*
+ * The header at the start of a jitdump file
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t total_size;
+	uint32_t elf_mach;
+	uint32_t pad1;
+	uint32_t pid;
+	uint64_t timestamp;
+	uint64_t flags;
+} JitdumpHeader;
+
+/*
+ * The header at the start of every record in a jitdump file
+ */
+typedef struct {
+	uint32_t id;
+	uint32_t total_size;
+	uint64_t timestamp;
+} JitdumpRecordHeader;
+
+/*
+ * A code load record, which is followed in the file by the null-terminated
+ * name of the code, then the code itself
+ */
+typedef struct {
+	JitdumpRecordHeader header;
+	uint32_t pid;
+	uint32_t tid;
+	uint64_t vma;
+	uint64_t code_addr;
+	uint64_t code_size;
+	uint64_t code_index;
+} JitdumpCodeLoad;
+
+/*
+ * Returns the time used to order jitdump records. perf must be run with
+ * '-k mono' to use the same clock.
+ */
+static uint64_t jitdump_timestamp() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/*
+ * Opens the jitdump file and writes its header. Failure to create the file is
+ * reported, but is not fatal, as profiling is not needed to run the program.
+ */
+static void jitdump_open() {
+	char filename[32];
+	sprintf(filename, "jit-%d.dump", (int)getpid());
+
+	jitdump = fopen(filename, "w+");
+	if(!jitdump) {
+		printf("Could not create jitdump file '%s'\n", filename);
+		return;
+	}
+
+	JitdumpHeader header;
+	header.magic = JITDUMP_MAGIC;
+	header.version = JITDUMP_VERSION;
+	header.total_size = sizeof(JitdumpHeader);
+	header.elf_mach = JITDUMP_ELF_MACH_X86_64;
+	header.pad1 = 0;
+	header.pid = getpid();
+	header.timestamp = jitdump_timestamp();
+	header.flags = 0;
+	fwrite(&header, sizeof(JitdumpHeader), 1, jitdump);
+	fflush(jitdump);
+
+	jitdump_marker = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC,
+		MAP_PRIVATE, fileno(jitdump), 0);
+	if(jitdump_marker == MAP_FAILED) jitdump_marker = NULL;
+}
+
+/*
+ * Starts recording compiled code in the perf map, and in the jitdump file if
+ * jitdump is true
+ */
+void perfmap_enable(bool use_jitdump) {
+	if(!perf_map) {
+		char filename[32];
+		sprintf(filename, "/tmp/perf-%d.map", (int)getpid());
+
+		perf_map = fopen(filename, "w");
+		if(!perf_map) printf("Could not create perf map '%s'\n", filename);
+	}
+
+	if(use_jitdump && !jitdump) jitdump_open();
+}
+
+/*
+ * Returns true if compiled code is being recorded
+ */
+bool perfmap_enabled() {
+	return perf_map != NULL || jitdump != NULL;
+}
+
+/*
+ * Records a piece of compiled code under the given name. Does nothing if
+ * recording is not enabled.
+ */
+void perfmap_register(void *code, int len, char *name) {
+	if(perf_map) {
+		fprintf(perf_map, "%lx %x %s\n", (unsigned long)code, len, name);
+		fflush(perf_map);
+	}
+
+	if(jitdump) {
+		JitdumpCodeLoad record;
+		record.header.id = JITDUMP_CODE_LOAD;
+		record.header.total_size =
+			sizeof(JitdumpCodeLoad) + strlen(name) + 1 + len;
+		record.header.timestamp = jitdump_timestamp();
+		record.pid = getpid();
+		record.tid = syscall(SYS_gettid);
+		record.vma = (uint64_t)code;
+		record.code_addr = (uint64_t)code;
+		record.code_size = len;
+		record.code_index = jitdump_code_index++;
+
+		fwrite(&record, sizeof(JitdumpCodeLoad), 1, jitdump);
+		fwrite(name, 1, strlen(name) + 1, jitdump);
+		fwrite(code, 1, len, jitdump);
+		fflush(jitdump);
+	}
+}
+
+/*
+ * Stops recording compiled code, closing the files. The perf map is left in
+ * place for perf to read.
+ */
+void perfmap_disable() {
+	if(perf_map) fclose(perf_map);
+	perf_map = NULL;
+
+	if(jitdump) {
+		JitdumpRecordHeader close;
+		close.id = JITDUMP_CODE_CLOSE;
+		close.total_size = sizeof(JitdumpRecordHeader);
+		close.timestamp = jitdump_timestamp();
+		fwrite(&close, sizeof(JitdumpRecordHeader), 1, jitdump);
+
+		if(jitdump_marker) munmap(jitdump_marker, sysconf(_SC_PAGESIZE));
+		fclose(jitdump);
+	}
+	jitdump = NULL;
+	jitdump_marker = NULL;
+}
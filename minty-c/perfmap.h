@@ -0,0 +1,34 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef PERFMAP
+#define PERFMAP
+
+/*
+ * Support for profiling compiled code with perf. When enabled, every piece of
+ * code produced by the JIT compiler is recorded in /tmp/perf-<pid>.map, which
+ * perf reads to name the addresses it samples. Optionally it is also recorded
+ * in a jitdump file, jit-<pid>.dump in the working directory, which includes
+ * the code itself so that perf can annotate it (after 'perf inject --jit').
+ */
+
+/*
+ * Values used in the jitdump file format, see tools/perf/Documentation/
+ * jitdump-specification.txt in the Linux source
+ */
+#define JITDUMP_MAGIC 0x4A695444
+#define JITDUMP_VERSION 1
+#define JITDUMP_CODE_LOAD 0
+#define JITDUMP_CODE_CLOSE 3
+#define JITDUMP_ELF_MACH_X86_64 62
+
+void perfmap_enable(bool use_jitdump);
+
+bool perfmap_enabled();
+
+void perfmap_register(void *code, int len, char *name);
+
+void perfmap_disable();
+
+#endif // PERFMAP
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "optimiser.h"
+#include "profile.h"
+
+/*
+ * A profile is a text file that starts with this line. Each function that was
+ * called then has a line
+ *     function <name> <calls>
+ * followed by a line for each if statement and loop in the function that ran,
+ * numbered in the order they appear in the source (see branch_statements()),
+ *     branch <number> <executions> <taken>
+ * and a line for each call in the function that was made, numbered in the order
+ * given by FNDecl_call_sites(),
+ *     call <number> <executions>
+ */
+#define PROFILE_HEADER "minty-profile 1"
+
+/*
+ * Longest function name that can be read from a profile
+ */
+#define PROFILE_MAX_NAME 255
+
+/*
+ * Appends the if statements and loops in a list of statements to branches, in
+ * the order they appear in the source, each followed by those nested in it
+ */
+static void branch_statements(LinkedList *stmts, LinkedList *branches) {
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter)) {
+		Statement *stmt = (Statement *)LLIterator_get_current(stmts_iter);
+
+		switch(stmt->type) {
+			case stmt_For:
+				LinkedList_append(branches, stmt);
+				branch_statements(stmt->stmt->_for->stmts, branches);
+				break;
+			case stmt_While:
+				LinkedList_append(branches, stmt);
+				branch_statements(stmt->stmt->_while->stmts, branches);
+				break;
+			case stmt_If:
+				LinkedList_append(branches, stmt);
+				branch_statements(stmt->stmt->_if->true_stmts, branches);
+				branch_statements(stmt->stmt->_if->false_stmts, branches);
+				break;
+			default:
+				break;
+		}
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+}
+
+/*
+ * Writes the profile of a program that has been run by the interpreter to the
+ * file with the given name. Exits if the file cannot be written.
+ */
+void profile_write(Program *prog, char *filename) {
+	FILE *file = fopen(filename, "w");
+	if(!file) {
+		printf("Could not open file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	fprintf(file, PROFILE_HEADER "\n");
+
+	LLIterator *function_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(function_iter)) {
+		FNDecl *func = (FNDecl *)LLIterator_get_current(function_iter);
+		LLIterator_advance(function_iter);
+		if(func->exec_count == 0) continue;
+
+		fprintf(file, "function %s %d\n", func->name, func->exec_count);
+
+		LinkedList *branches = LinkedList_init();
+		branch_statements(func->stmts, branches);
+		LLIterator *iter = LLIterator_init(branches);
+		while(!LLIterator_ended(iter)) {
+			Statement *stmt = (Statement *)LLIterator_get_current(iter);
+			if(stmt->exec_count > 0) {
+				fprintf(file, "branch %d %d %d\n",
+					LLIterator_current_index(iter), stmt->exec_count,
+					stmt->taken_count);
+			}
+			LLIterator_advance(iter);
+		}
+		free(iter);
+		LinkedList_free(branches);
+
+		LinkedList *sites = FNDecl_call_sites(func);
+		iter = LLIterator_init(sites);
+		while(!LLIterator_ended(iter)) {
+			FNCall *call = (FNCall *)LLIterator_get_current(iter);
+			if(call->exec_count > 0) {
+				fprintf(file, "call %d %d\n", LLIterator_current_index(iter),
+					call->exec_count);
+			}
+			LLIterator_advance(iter);
+		}
+		free(iter);
+		LinkedList_free(sites);
+	}
+	free(function_iter);
+
+	if(fclose(file)) {
+		printf("Could not write file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void profile_corrupt(char *filename) {
+	printf("Profile '%s' is corrupt\n", filename);
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Reads the profile in the file with the given name into a program's AST. The
+ * program is optimised first (see Program_optimise()), as the interpreter
+ * optimises a program before running it, so that its statements are numbered
+ * as they were when the profile was written. Exits if the file cannot be read
+ * or is not a profile.
+ */
+void profile_read(Program *prog, char *filename) {
+	FILE *file = fopen(filename, "r");
+	if(!file) {
+		printf("Could not open file '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	char header[sizeof(PROFILE_HEADER) + 1];
+	if(!fgets(header, sizeof(header), file) ||
+		strcmp(header, PROFILE_HEADER "\n") != 0) {
+		profile_corrupt(filename);
+	}
+
+	Program_optimise(prog);
+
+	// The statements and calls of the function whose entries are being read,
+	// which are NULL if the program has no function of that name
+	LinkedList *branches = NULL;
+	LinkedList *sites = NULL;
+
+	char keyword[16];
+	char name[PROFILE_MAX_NAME + 1];
+	int index, count, taken;
+	while(fscanf(file, "%15s", keyword) == 1) {
+		if(str_equal(keyword, "function")) {
+			if(fscanf(file, "%255s %d", name, &count) != 2) {
+				profile_corrupt(filename);
+			}
+
+			if(branches) LinkedList_free(branches);
+			if(sites) LinkedList_free(sites);
+			branches = NULL;
+			sites = NULL;
+
+			FNDecl *func = Program_find_FNDecl(prog, name);
+			if(func) {
+				func->exec_count = count;
+				branches = LinkedList_init();
+				branch_statements(func->stmts, branches);
+				sites = FNDecl_call_sites(func);
+			}
+		}
+		else if(str_equal(keyword, "branch")) {
+			if(fscanf(file, "%d %d %d", &index, &count, &taken) != 3) {
+				profile_corrupt(filename);
+			}
+			if(branches && index >= 0 &&
+				index < LinkedList_length(branches)) {
+
+				Statement *stmt = (Statement *)LinkedList_get(branches, index);
+				stmt->exec_count = count;
+				stmt->taken_count = taken;
+			}
+		}
+		else if(str_equal(keyword, "call")) {
+			if(fscanf(file, "%d %d", &index, &count) != 2) {
+				profile_corrupt(filename);
+			}
+			if(sites && index >= 0 && index < LinkedList_length(sites)) {
+				((FNCall *)LinkedList_get(sites, index))->exec_count = count;
+			}
+		}
+		else profile_corrupt(filename);
+	}
+
+	if(branches) LinkedList_free(branches);
+	if(sites) LinkedList_free(sites);
+	fclose(file);
+}
@@ -0,0 +1,34 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef PROFILE
+#define PROFILE
+
+/*
+ * Profiles record how often each part of a program ran when it was
+ * interpreted, so that the ahead-of-time compilers (see codegen.h and
+ * objcode.h) can lay the program out for the way it is actually used. A
+ * profile is written after running the program in the interpreter with
+ * profiling enabled (see interpreter_set_profiling()), and read back into the
+ * program's AST before it is compiled: the number of times each function was
+ * called, each call was made, and each if statement and loop ran and took its
+ * branch (the exec_count and taken_count fields of the AST).
+ *
+ * A profile only describes the program it was written for. Entries that do not
+ * match anything in the program are ignored.
+ */
+
+void profile_write(Program *prog, char *filename);
+
+void profile_read(Program *prog, char *filename);
+
+#endif // PROFILE
@@ -0,0 +1,833 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "ir.h"
+#include "regalloc.h"
+
+/*
+ * The registers that values can be allocated, in order of preference. %r10 and
+ * %r11, which calls may overwrite, come first, so that values that are not live
+ * across calls do not use up the registers that would have to be saved.
+ */
+int allocatable_registers[ALLOCATABLE_REGISTERS] = {
+	10, 11, 3, 12, 13, 14, 15
+};
+
+/*
+ * The sets of registers that a value may be allocated, as bitmasks of indices
+ * into allocatable_registers
+ */
+#define ANY_REGISTER 0x7F
+#define CALLEE_SAVED_REGISTERS 0x7C
+
+/*
+ * The loop depth beyond which uses are not weighted any more heavily, so that
+ * spill costs can not overflow
+ */
+#define MAX_LOOP_WEIGHT_DEPTH 8
+
+/*
+ * Checks whether calls preserve the contents of a register
+ */
+bool regalloc_callee_saved(int reg) {
+	return reg == 3 || (reg >= 12 && reg <= 15);
+}
+
+/*
+ * Checks whether a value needs a register or slot to hold its result
+ */
+static bool allocated(IRValue *value) {
+	return value->op != ir_Constant && value->op != ir_Print;
+}
+
+/*
+ * Sets of values, as bitsets indexed by value id
+ */
+#define SET_BITS (8 * sizeof(unsigned long))
+
+static bool set_has(unsigned long *set, int id) {
+	return (set[id / SET_BITS] >> (id % SET_BITS)) & 1;
+}
+
+static void set_add(unsigned long *set, int id) {
+	set[id / SET_BITS] |= 1UL << (id % SET_BITS);
+}
+
+static void set_remove(unsigned long *set, int id) {
+	set[id / SET_BITS] &= ~(1UL << (id % SET_BITS));
+}
+
+/*
+ * The interference graph is kept as a hash set of edges, for checking whether
+ * two values interfere, and a list of each value's neighbours. Lists may hold a
+ * neighbour more than once after values have been coalesced.
+ */
+typedef struct {
+	long *keys;
+	int capacity;
+	int count;
+	int node_count;
+} EdgeSet;
+
+typedef struct {
+	IRFunction *ir;
+	int words;
+
+	// Liveness: the values live on entry to and exit from each block, indexed
+	// by position in ir->blocks
+	unsigned long **live_in;
+	unsigned long **live_out;
+	int *depth;
+
+	// The interference graph
+	EdgeSet edges;
+	int **adjacent;
+	int *adjacent_count;
+	int *adjacent_capacity;
+
+	// Per value: whether it is in the function and needs a location, the
+	// value it has been coalesced into, the registers it may use, and the
+	// cost of keeping it in memory
+	bool *nodes;
+	int *parent;
+	int *allowed;
+	double *cost;
+} Allocator;
+
+/*
+ * A copy from a value into a phi, weighted by how often it runs
+ */
+typedef struct {
+	int phi;
+	int arg;
+	double weight;
+} Copy;
+
+static long edge_key(EdgeSet *set, int a, int b) {
+	return a < b ? ((long)a * set->node_count) + b :
+		((long)b * set->node_count) + a;
+}
+
+static int edge_slot(EdgeSet *set, long key) {
+	unsigned long hash = (unsigned long)key * 0x9E3779B97F4A7C15UL;
+	int slot = (int)((hash >> 17) % set->capacity);
+	while(set->keys[slot] != -1 && set->keys[slot] != key) {
+		slot = (slot + 1) % set->capacity;
+	}
+	return slot;
+}
+
+static void EdgeSet_init(EdgeSet *set, int node_count) {
+	set->capacity = 1024;
+	set->count = 0;
+	set->node_count = node_count;
+	set->keys = safe_alloc(sizeof(long) * set->capacity);
+	memset(set->keys, 0xFF, sizeof(long) * set->capacity);
+}
+
+static bool EdgeSet_has(EdgeSet *set, int a, int b) {
+	long key = edge_key(set, a, b);
+	return set->keys[edge_slot(set, key)] == key;
+}
+
+/*
+ * Adds an edge to the set, doubling the table when it is half full. Returns
+ * false if the edge was already there.
+ */
+static bool EdgeSet_add(EdgeSet *set, int a, int b) {
+	long key = edge_key(set, a, b);
+	int slot = edge_slot(set, key);
+	if(set->keys[slot] == key) return false;
+
+	set->keys[slot] = key;
+	set->count++;
+
+	if(2 * set->count > set->capacity) {
+		long *old_keys = set->keys;
+		int old_capacity = set->capacity;
+
+		set->capacity *= 2;
+		set->keys = safe_alloc(sizeof(long) * set->capacity);
+		memset(set->keys, 0xFF, sizeof(long) * set->capacity);
+
+		int i;
+		for(i = 0; i < old_capacity; i++) {
+			if(old_keys[i] != -1) {
+				set->keys[edge_slot(set, old_keys[i])] = old_keys[i];
+			}
+		}
+		free(old_keys);
+	}
+
+	return true;
+}
+
+static void add_adjacent(Allocator *ra, int a, int b) {
+	if(ra->adjacent_count[a] == ra->adjacent_capacity[a]) {
+		ra->adjacent_capacity[a] = ra->adjacent_capacity[a] ?
+			2 * ra->adjacent_capacity[a] : 8;
+		ra->adjacent[a] = realloc(ra->adjacent[a],
+			sizeof(int) * ra->adjacent_capacity[a]);
+		if(!ra->adjacent[a]) {
+			printf("Could not allocate memory for register allocation\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	ra->adjacent[a][ra->adjacent_count[a]++] = b;
+}
+
+/*
+ * Records that two values interfere
+ */
+static void interfere(Allocator *ra, int a, int b) {
+	if(a == b || !EdgeSet_add(&(ra->edges), a, b)) return;
+	add_adjacent(ra, a, b);
+	add_adjacent(ra, b, a);
+}
+
+/*
+ * Records that a value interferes with every value in a set
+ */
+static void interfere_with_set(Allocator *ra, int id, unsigned long *set) {
+	int i, j;
+	for(i = 0; i < ra->words; i++) {
+		if(!set[i]) continue;
+		for(j = 0; j < SET_BITS; j++) {
+			if((set[i] >> j) & 1) interfere(ra, id, (i * SET_BITS) + j);
+		}
+	}
+}
+
+/*
+ * Returns the value that a value has been coalesced into
+ */
+static int find(Allocator *ra, int id) {
+	while(ra->parent[id] != id) {
+		ra->parent[id] = ra->parent[ra->parent[id]];
+		id = ra->parent[id];
+	}
+	return id;
+}
+
+static int count_bits(int mask) {
+	int count = 0;
+	while(mask) {
+		count += mask & 1;
+		mask >>= 1;
+	}
+	return count;
+}
+
+/*
+ * Finds the values live on entry to and exit from each block, by iterating
+ * the dataflow equations backwards until they settle. A phi's arguments are
+ * live at the end of the predecessors they come from, rather than at the start
+ * of the phi's block.
+ */
+static void liveness(Allocator *ra) {
+	IRFunction *ir = ra->ir;
+	int count = ir->block_count;
+	unsigned long **uses = safe_alloc(sizeof(unsigned long *) * count);
+	unsigned long **defs = safe_alloc(sizeof(unsigned long *) * count);
+	unsigned long *out = safe_alloc(sizeof(unsigned long) * ra->words);
+	int *position = safe_alloc(sizeof(int) * (ir->next_block_id + 1));
+
+	int i, j, k, w;
+	for(i = 0; i < count; i++) {
+		IRBlock *block = ir->blocks[i];
+		position[block->id] = i;
+		uses[i] = calloc(ra->words, sizeof(unsigned long));
+		defs[i] = calloc(ra->words, sizeof(unsigned long));
+		ra->live_in[i] = calloc(ra->words, sizeof(unsigned long));
+		ra->live_out[i] = calloc(ra->words, sizeof(unsigned long));
+
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			if(value->op != ir_Phi) {
+				for(k = 0; k < value->arg_count; k++) {
+					IRValue *arg = value->args[k];
+					if(allocated(arg) && !set_has(defs[i], arg->id)) {
+						set_add(uses[i], arg->id);
+					}
+				}
+			}
+			if(allocated(value)) set_add(defs[i], value->id);
+		}
+
+		IRValue *exit_value = block->exit_value;
+		if(exit_value && (block->exit == ir_Branch ||
+			block->exit == ir_Return) && allocated(exit_value) &&
+			!set_has(defs[i], exit_value->id)) {
+
+			set_add(uses[i], exit_value->id);
+		}
+	}
+
+	bool changed = true;
+	while(changed) {
+		changed = false;
+
+		for(i = count - 1; i >= 0; i--) {
+			IRBlock *block = ir->blocks[i];
+			memset(out, 0, sizeof(unsigned long) * ra->words);
+
+			for(j = 0; j < 2; j++) {
+				IRBlock *succ = block->succs[j];
+				if(!succ || (j == 1 && block->exit != ir_Branch) ||
+					(j == 0 && block->exit != ir_Jump &&
+					block->exit != ir_Branch)) continue;
+
+				unsigned long *succ_in = ra->live_in[position[succ->id]];
+				for(w = 0; w < ra->words; w++) out[w] |= succ_in[w];
+
+				int index = IRBlock_pred_index(succ, block);
+				for(k = 0; k < succ->value_count; k++) {
+					IRValue *phi = succ->values[k];
+					if(phi->op != ir_Phi) continue;
+					if(allocated(phi->args[index])) {
+						set_add(out, phi->args[index]->id);
+					}
+				}
+			}
+
+			for(w = 0; w < ra->words; w++) {
+				unsigned long in = uses[i][w] | (out[w] & ~defs[i][w]);
+				if(in != ra->live_in[i][w] || out[w] != ra->live_out[i][w]) {
+					changed = true;
+				}
+				ra->live_in[i][w] = in;
+				ra->live_out[i][w] = out[w];
+			}
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		free(uses[i]);
+		free(defs[i]);
+	}
+	free(uses);
+	free(defs);
+	free(out);
+	free(position);
+}
+
+/*
+ * Finds the loop depth of each block. The blocks are in reverse postorder, so
+ * an edge to a block that does not come later is a loop's back edge, and the
+ * loop's body is every block that reaches the edge without passing through the
+ * loop's header.
+ */
+static void loop_depths(Allocator *ra) {
+	IRFunction *ir = ra->ir;
+	int count = ir->block_count;
+	int *position = safe_alloc(sizeof(int) * (ir->next_block_id + 1));
+	bool *in_loop = safe_alloc(sizeof(bool) * count);
+	int *work = safe_alloc(sizeof(int) * count);
+
+	int i, j, k;
+	for(i = 0; i < count; i++) {
+		position[ir->blocks[i]->id] = i;
+		ra->depth[i] = 0;
+	}
+
+	for(i = 0; i < count; i++) {
+		IRBlock *latch = ir->blocks[i];
+		int succ_count = latch->exit == ir_Branch ? 2 :
+			latch->exit == ir_Jump ? 1 : 0;
+
+		for(j = 0; j < succ_count; j++) {
+			int header = position[latch->succs[j]->id];
+			if(header > i) continue;
+
+			memset(in_loop, 0, sizeof(bool) * count);
+			in_loop[header] = true;
+			int work_count = 0;
+			if(!in_loop[i]) {
+				in_loop[i] = true;
+				work[work_count++] = i;
+			}
+			while(work_count > 0) {
+				IRBlock *block = ir->blocks[work[--work_count]];
+				for(k = 0; k < block->pred_count; k++) {
+					int pred = position[block->preds[k]->id];
+					if(!in_loop[pred]) {
+						in_loop[pred] = true;
+						work[work_count++] = pred;
+					}
+				}
+			}
+
+			for(k = 0; k < count; k++) ra->depth[k] += in_loop[k];
+		}
+	}
+
+	free(position);
+	free(in_loop);
+	free(work);
+}
+
+/*
+ * The weight of a use or definition in a block: 10 to the power of the
+ * block's loop depth
+ */
+static double block_weight(Allocator *ra, int position) {
+	double weight = 1;
+	int i;
+	for(i = 0; i < ra->depth[position] && i < MAX_LOOP_WEIGHT_DEPTH; i++) {
+		weight *= 10;
+	}
+	return weight;
+}
+
+/*
+ * Builds the interference graph by walking backwards through each block from
+ * the values live at its end, and works out the cost of spilling each value.
+ * Values live across a call may only use registers that calls preserve. The
+ * copies into phis are stored in copies, and their number returned.
+ */
+static int build_graph(Allocator *ra, Copy *copies) {
+	IRFunction *ir = ra->ir;
+	unsigned long *live = safe_alloc(sizeof(unsigned long) * ra->words);
+	int copy_count = 0;
+
+	int i, j, k, w;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		double weight = block_weight(ra, i);
+		memcpy(live, ra->live_out[i], sizeof(unsigned long) * ra->words);
+
+		IRValue *exit_value = block->exit_value;
+		if(exit_value && (block->exit == ir_Branch ||
+			block->exit == ir_Return) && allocated(exit_value)) {
+
+			ra->cost[exit_value->id] += weight;
+			set_add(live, exit_value->id);
+		}
+
+		for(j = 0; j < 2; j++) {
+			IRBlock *succ = block->succs[j];
+			if(!succ || (j == 1 && block->exit != ir_Branch) ||
+				(j == 0 && block->exit != ir_Jump &&
+				block->exit != ir_Branch)) continue;
+
+			int index = IRBlock_pred_index(succ, block);
+			for(k = 0; k < succ->value_count; k++) {
+				IRValue *phi = succ->values[k];
+				if(phi->op != ir_Phi || !allocated(phi->args[index])) continue;
+
+				ra->cost[phi->args[index]->id] += weight;
+				copies[copy_count].phi = phi->id;
+				copies[copy_count].arg = phi->args[index]->id;
+				copies[copy_count].weight = weight;
+				copy_count++;
+			}
+		}
+
+		for(j = block->value_count - 1; j >= 0; j--) {
+			IRValue *value = block->values[j];
+			if(value->op == ir_Phi) break;
+
+			if(allocated(value)) {
+				set_remove(live, value->id);
+				interfere_with_set(ra, value->id, live);
+				ra->cost[value->id] += weight;
+			}
+
+			if(value->op == ir_Call || value->op == ir_Print) {
+				for(w = 0; w < ra->words * SET_BITS; w++) {
+					if(w < ir->value_count && set_has(live, w)) {
+						ra->allowed[w] &= CALLEE_SAVED_REGISTERS;
+					}
+				}
+			}
+
+			for(k = 0; k < value->arg_count; k++) {
+				IRValue *arg = value->args[k];
+				if(!allocated(arg)) continue;
+				ra->cost[arg->id] += weight;
+				set_add(live, arg->id);
+			}
+		}
+
+		// The phis are all defined at once, at the start of the block
+		for(j = 0; j < block->value_count; j++) {
+			if(block->values[j]->op == ir_Phi) {
+				set_add(live, block->values[j]->id);
+			}
+		}
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *phi = block->values[j];
+			if(phi->op != ir_Phi) break;
+			interfere_with_set(ra, phi->id, live);
+			ra->cost[phi->id] += weight;
+		}
+	}
+
+	free(live);
+	return copy_count;
+}
+
+static int compare_copies(const void *a, const void *b) {
+	double wa = ((Copy *)a)->weight;
+	double wb = ((Copy *)b)->weight;
+	return wa < wb ? 1 : wa > wb ? -1 : 0;
+}
+
+/*
+ * Coalesces each phi with the values copied into it, most frequently run
+ * copies first, where they do not interfere and Briggs' test shows that the
+ * combined value can still be coloured: it must have fewer neighbours of
+ * significant degree than it has registers to choose from.
+ */
+static void coalesce(Allocator *ra, Copy *copies, int copy_count) {
+	int *seen = safe_alloc(sizeof(int) * (ra->ir->value_count + 1));
+	int stamp = 0;
+	qsort(copies, copy_count, sizeof(Copy), compare_copies);
+
+	int i, j, k;
+	for(i = 0; i < copy_count; i++) {
+		int a = find(ra, copies[i].phi);
+		int b = find(ra, copies[i].arg);
+		int allowed = ra->allowed[a] & ra->allowed[b];
+		if(a == b || !allowed || EdgeSet_has(&(ra->edges), a, b)) continue;
+
+		stamp++;
+		int significant = 0;
+		int pair[2] = { a, b };
+		for(j = 0; j < 2; j++) {
+			for(k = 0; k < ra->adjacent_count[pair[j]]; k++) {
+				int n = find(ra, ra->adjacent[pair[j]][k]);
+				if(n == a || n == b || seen[n] == stamp) continue;
+				seen[n] = stamp;
+				if(ra->adjacent_count[n] >= count_bits(ra->allowed[n])) {
+					significant++;
+				}
+			}
+		}
+		if(significant >= count_bits(allowed)) continue;
+
+		ra->parent[b] = a;
+		ra->allowed[a] = allowed;
+		ra->cost[a] += ra->cost[b];
+		for(k = 0; k < ra->adjacent_count[b]; k++) {
+			int n = find(ra, ra->adjacent[b][k]);
+			if(n != a) interfere(ra, a, n);
+		}
+	}
+
+	free(seen);
+}
+
+/*
+ * Colours the coalesced graph. Values that have fewer neighbours than
+ * registers they may use are removed from the graph first, as they can always
+ * be coloured. When there are none, the value that is cheapest to spill for
+ * the number of neighbours it has is removed, optimistically, in case its
+ * neighbours end up sharing registers. The values are then given registers in
+ * the reverse of the order they were removed, or stack slots if none are left.
+ */
+static void colour(Allocator *ra, RegAllocation *result) {
+	int count = ra->ir->value_count;
+	int *colours = safe_alloc(sizeof(int) * count);
+	int *slots = safe_alloc(sizeof(int) * count);
+	int *degree = safe_alloc(sizeof(int) * count);
+	bool *removed = safe_alloc(sizeof(bool) * count);
+	int *stack = safe_alloc(sizeof(int) * count);
+	int *low = safe_alloc(sizeof(int) * count);
+	int stack_count = 0, low_count = 0, remaining = 0;
+
+	// Build the graph between the values that others were coalesced into
+	EdgeSet edges;
+	EdgeSet_init(&edges, count);
+	int **adjacent = safe_alloc(sizeof(int *) * count);
+	int *adjacent_count = safe_alloc(sizeof(int) * count);
+	int i, j;
+	for(i = 0; i < count; i++) {
+		colours[i] = -1;
+		slots[i] = -1;
+		adjacent[i] = NULL;
+		adjacent_count[i] = 0;
+	}
+	for(i = 0; i < ra->edges.capacity; i++) {
+		long key = ra->edges.keys[i];
+		if(key == -1) continue;
+		int a = find(ra, (int)(key / count));
+		int b = find(ra, (int)(key % count));
+		if(a != b && EdgeSet_add(&edges, a, b)) {
+			adjacent_count[a]++;
+			adjacent_count[b]++;
+		}
+	}
+	for(i = 0; i < count; i++) {
+		if(adjacent_count[i]) {
+			adjacent[i] = safe_alloc(sizeof(int) * adjacent_count[i]);
+		}
+		degree[i] = 0;
+	}
+	for(i = 0; i < edges.capacity; i++) {
+		long key = edges.keys[i];
+		if(key == -1) continue;
+		int a = (int)(key / count);
+		int b = (int)(key % count);
+		adjacent[a][degree[a]++] = b;
+		adjacent[b][degree[b]++] = a;
+	}
+
+	for(i = 0; i < count; i++) {
+		removed[i] = !ra->nodes[i] || find(ra, i) != i;
+		if(removed[i]) continue;
+		remaining++;
+		if(degree[i] < count_bits(ra->allowed[i])) low[low_count++] = i;
+	}
+
+	while(remaining > 0) {
+		int next = -1;
+		while(low_count > 0 && next == -1) {
+			next = low[--low_count];
+			if(removed[next]) next = -1;
+		}
+
+		if(next == -1) {
+			double best = 0;
+			for(i = 0; i < count; i++) {
+				if(removed[i]) continue;
+				double ratio = ra->cost[i] / (degree[i] + 1);
+				if(next == -1 || ratio < best) {
+					next = i;
+					best = ratio;
+				}
+			}
+		}
+
+		removed[next] = true;
+		remaining--;
+		stack[stack_count++] = next;
+		for(j = 0; j < adjacent_count[next]; j++) {
+			int n = adjacent[next][j];
+			if(removed[n]) continue;
+			degree[n]--;
+			if(degree[n] == count_bits(ra->allowed[n]) - 1) {
+				low[low_count++] = n;
+			}
+		}
+	}
+
+	bool *slot_used = safe_alloc(sizeof(bool) * (stack_count + 1));
+	result->slot_count = 0;
+	while(stack_count > 0) {
+		int node = stack[--stack_count];
+
+		int used = 0;
+		for(j = 0; j < adjacent_count[node]; j++) {
+			int n = adjacent[node][j];
+			if(colours[n] >= 0) used |= 1 << colours[n];
+		}
+		for(i = 0; i < ALLOCATABLE_REGISTERS; i++) {
+			if(((ra->allowed[node] & ~used) >> i) & 1) {
+				colours[node] = i;
+				break;
+			}
+		}
+		if(colours[node] >= 0) continue;
+
+		// Spilled values that do not interfere can share a slot
+		memset(slot_used, 0, sizeof(bool) * (result->slot_count + 1));
+		for(j = 0; j < adjacent_count[node]; j++) {
+			int n = adjacent[node][j];
+			if(slots[n] >= 0) slot_used[slots[n]] = true;
+		}
+		slots[node] = 0;
+		while(slot_used[slots[node]]) slots[node]++;
+		if(slots[node] == result->slot_count) result->slot_count++;
+	}
+
+	bool used[ALLOCATABLE_REGISTERS] = { false };
+	for(i = 0; i < count; i++) {
+		result->registers[i] = -1;
+		result->slots[i] = -1;
+		if(!ra->nodes[i]) continue;
+
+		int node = find(ra, i);
+		if(colours[node] >= 0) {
+			result->registers[i] = allocatable_registers[colours[node]];
+			used[colours[node]] = true;
+		}
+		else result->slots[i] = slots[node];
+	}
+
+	result->saved_count = 0;
+	for(i = 0; i < ALLOCATABLE_REGISTERS; i++) {
+		if(used[i] && regalloc_callee_saved(allocatable_registers[i])) {
+			result->saved[result->saved_count++] = allocatable_registers[i];
+		}
+	}
+
+	for(i = 0; i < count; i++) free(adjacent[i]);
+	free(adjacent);
+	free(adjacent_count);
+	free(edges.keys);
+	free(colours);
+	free(slots);
+	free(degree);
+	free(removed);
+	free(stack);
+	free(low);
+	free(slot_used);
+}
+
+/*
+ * Allocates registers and stack slots for the values of a function, which must
+ * have been through ir_dce() (see ir.h), so that its blocks are in reverse
+ * postorder. The result should be freed with RegAllocation_free().
+ */
+RegAllocation *regalloc_function(IRFunction *ir) {
+	int count = ir->value_count;
+
+	Allocator ra;
+	ra.ir = ir;
+	ra.words = (count + SET_BITS - 1) / SET_BITS + 1;
+	ra.live_in = safe_alloc(sizeof(unsigned long *) * (ir->block_count + 1));
+	ra.live_out = safe_alloc(sizeof(unsigned long *) * (ir->block_count + 1));
+	ra.depth = safe_alloc(sizeof(int) * (ir->block_count + 1));
+	EdgeSet_init(&(ra.edges), count);
+	ra.adjacent = calloc(count + 1, sizeof(int *));
+	ra.adjacent_count = calloc(count + 1, sizeof(int));
+	ra.adjacent_capacity = calloc(count + 1, sizeof(int));
+	ra.nodes = calloc(count + 1, sizeof(bool));
+	ra.parent = safe_alloc(sizeof(int) * (count + 1));
+	ra.allowed = safe_alloc(sizeof(int) * (count + 1));
+	ra.cost = calloc(count + 1, sizeof(double));
+
+	int i, j, copy_count = 0;
+	for(i = 0; i < count; i++) {
+		ra.parent[i] = i;
+		ra.allowed[i] = ANY_REGISTER;
+	}
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *value = block->values[j];
+			ra.nodes[value->id] = allocated(value);
+			if(value->op == ir_Phi) copy_count += value->arg_count;
+		}
+	}
+
+	liveness(&ra);
+	loop_depths(&ra);
+	Copy *copies = safe_alloc(sizeof(Copy) * (copy_count + 1));
+	copy_count = build_graph(&ra, copies);
+	coalesce(&ra, copies, copy_count);
+
+	RegAllocation *result = safe_alloc(sizeof(RegAllocation));
+	result->registers = safe_alloc(sizeof(int) * (count + 1));
+	result->slots = safe_alloc(sizeof(int) * (count + 1));
+	colour(&ra, result);
+
+	for(i = 0; i < ir->block_count; i++) {
+		free(ra.live_in[i]);
+		free(ra.live_out[i]);
+	}
+	for(i = 0; i < count; i++) free(ra.adjacent[i]);
+	free(ra.live_in);
+	free(ra.live_out);
+	free(ra.depth);
+	free(ra.edges.keys);
+	free(ra.adjacent);
+	free(ra.adjacent_count);
+	free(ra.adjacent_capacity);
+	free(ra.nodes);
+	free(ra.parent);
+	free(ra.allowed);
+	free(ra.cost);
+	free(copies);
+
+	return result;
+}
+
+/*
+ * Checks whether two values are kept in the same place
+ */
+bool RegAllocation_same(RegAllocation *ra, IRValue *v1, IRValue *v2) {
+	if(ra->registers[v1->id] >= 0) {
+		return ra->registers[v1->id] == ra->registers[v2->id];
+	}
+	return ra->slots[v1->id] >= 0 && ra->slots[v1->id] == ra->slots[v2->id];
+}
+
+/*
+ * Returns the offset from %rbp of a spilled value's stack slot, in the stack
+ * frame that both ahead-of-time compilers lay out (see emit_function() in
+ * codegen.c): the saved registers are pushed below %rbp, and the stack slots
+ * follow them
+ */
+int RegAllocation_slot_offset(RegAllocation *ra, IRValue *value) {
+	return -((8 * ra->saved_count) + (4 * (ra->slots[value->id] + 1)));
+}
+
+/*
+ * Returns the number of bytes to reserve below the saved registers for the
+ * stack slots, which keeps the stack 16 byte aligned for calls
+ */
+int RegAllocation_frame_size(RegAllocation *ra) {
+	int saved_size = 8 * ra->saved_count;
+	return ((saved_size + (4 * ra->slot_count) + 15) & ~15) - saved_size;
+}
+
+/*
+ * Determines whether any of a block's phis need to be given values on entry
+ * from pred, which they do not if they are kept in the same place as the
+ * values they take
+ */
+bool RegAllocation_has_phi_moves(RegAllocation *ra, IRBlock *pred,
+	IRBlock *block) {
+
+	int index = IRBlock_pred_index(block, pred);
+
+	int i;
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *phi = block->values[i];
+		if(phi->op == ir_Phi &&
+			!RegAllocation_same(ra, phi->args[index], phi)) {
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Checks whether giving one of a block's phis its value on entry from the
+ * predecessor numbered index would overwrite the value another phi takes, so
+ * that the moves can not be made one after another
+ */
+bool RegAllocation_phi_moves_overlap(RegAllocation *ra, IRBlock *block,
+	int index) {
+
+	int i, j;
+	for(i = 0; i < block->value_count; i++) {
+		IRValue *phi = block->values[i];
+		if(phi->op != ir_Phi) continue;
+
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *other = block->values[j];
+			if(i != j && other->op == ir_Phi &&
+				!RegAllocation_same(ra, other->args[index], other) &&
+				RegAllocation_same(ra, other->args[index], phi)) {
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void RegAllocation_free(RegAllocation *ra) {
+	free(ra->registers);
+	free(ra->slots);
+	free(ra);
+}
@@ -0,0 +1,68 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef IR
+#include "ir.h"
+#endif // IR
+
+#ifndef REGALLOC
+#define REGALLOC
+
+/*
+ * Register allocation for the ahead-of-time compilers (see codegen.h and
+ * objcode.h), which decides where each value of a function in SSA form (see
+ * ir.h) is kept while the function runs: in a register, or in a 4 byte slot in
+ * its stack frame.
+ *
+ * The allocator is a graph-colouring allocator in the style of Chaitin and
+ * Briggs. Liveness analysis finds which values are live at each point in the
+ * function, and two values interfere, and so may not share a register, if one
+ * is defined where the other is live. Values that are copied into phis are
+ * coalesced with them, so that no move is needed, unless that could make the
+ * graph harder to colour (Briggs' conservative test). The graph is then
+ * coloured optimistically: values that can not be given a register are those
+ * that are cheapest to keep in memory, weighing each use and definition by
+ * 10 to the power of its loop depth. Spilled values share stack slots in the
+ * same way as colouring shares registers.
+ *
+ * Values are only allocated registers that the code generators do not use for
+ * anything else. Values that are live across a call must be in registers that
+ * calls preserve, so the function must save and restore any such registers
+ * that it uses (listed in saved).
+ *
+ * Registers are numbered as in x86-64 machine code: %rax is 0, %rbx is 3, %r8
+ * is 8, and so on. Constants, and values that produce no result, have neither
+ * a register nor a slot.
+ */
+#define ALLOCATABLE_REGISTERS 7
+
+extern int allocatable_registers[ALLOCATABLE_REGISTERS];
+
+typedef struct {
+	int *registers;
+	int *slots;
+	int slot_count;
+	int saved[ALLOCATABLE_REGISTERS];
+	int saved_count;
+} RegAllocation;
+
+bool regalloc_callee_saved(int reg);
+
+RegAllocation *regalloc_function(IRFunction *ir);
+
+bool RegAllocation_same(RegAllocation *ra, IRValue *v1, IRValue *v2);
+
+int RegAllocation_slot_offset(RegAllocation *ra, IRValue *value);
+
+int RegAllocation_frame_size(RegAllocation *ra);
+
+bool RegAllocation_has_phi_moves(RegAllocation *ra, IRBlock *pred,
+	IRBlock *block);
+
+bool RegAllocation_phi_moves_overlap(RegAllocation *ra, IRBlock *block,
+	int index);
+
+void RegAllocation_free(RegAllocation *ra);
+
+#endif // REGALLOC
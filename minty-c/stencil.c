@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "jitcode.h"
+#include "jitdebug.h"
+#include "stencil.h"
+#include "stencil_data.h"
+
+/*
+ * The state of the compilation of a function: the slot number of the first
+ * temporary slot, which follow the function's variables in the frame, and the
+ * number of slots that the frame needs so far
+ */
+typedef struct {
+	int temps;
+	int frame_size;
+} StencilCompiler;
+
+/*
+ * Where the value of an expression can be found: in the frame slot at byte
+ * offset value, or, if constant is true, value itself
+ */
+typedef struct {
+	bool constant;
+	int value;
+} Operand;
+
+/*
+ * Returns the byte offset in the frame of the given slot number
+ */
+static int slot_offset(int slot) {
+	return 4 * slot;
+}
+
+/*
+ * Returns the byte offset in the frame of the slot numbered temps + temp,
+ * making sure that the frame is large enough to hold it
+ */
+static int temp_offset(StencilCompiler *sc, int temp) {
+	if(sc->temps + temp + 1 > sc->frame_size) {
+		sc->frame_size = sc->temps + temp + 1;
+	}
+	return slot_offset(sc->temps + temp);
+}
+
+/*
+ * Copies a stencil, filling in its holes. holes holds the value of each hole,
+ * indexed by stencil_hole - for the holes that refer to code, the position of
+ * the code relative to the start of the stencil. hole_Continue is filled in
+ * here, as the code that follows the stencil.
+ */
+static ArrLen *stencil_emit_holes(const Stencil *st, int *holes) {
+	byte *code = malloc(sizeof(byte) * (st->len + 1));
+	memcpy(code, st->code, st->len);
+	holes[hole_Continue] = st->len;
+
+	int i;
+	for(i = 0; i < st->patch_count; i++) {
+		const StencilPatch *patch = &(st->patches[i]);
+		int value = holes[patch->hole] + patch->addend;
+		if(patch->relative) value -= patch->offset;
+		put_int_as_bytes(code, patch->offset, value);
+	}
+
+	return ArrLen_init(code, st->len);
+}
+
+/*
+ * Copies a stencil that stores into the slot at byte offset dest, with the
+ * operands a and b. b may be a constant, for the stencils that take one.
+ */
+static ArrLen *stencil_emit(const Stencil *st, int dest, int a, int b) {
+	int holes[STENCIL_HOLE_COUNT] = {0};
+	holes[hole_Dest] = dest;
+	holes[hole_A] = a;
+	holes[hole_B] = b;
+	holes[hole_Value] = b;
+	return stencil_emit_holes(st, holes);
+}
+
+/*
+ * Copies a stencil that jumps, where jump is the position of the code it jumps
+ * to relative to the end of the stencil
+ */
+static ArrLen *stencil_emit_jump(const Stencil *st, int a, int b, int jump) {
+	int holes[STENCIL_HOLE_COUNT] = {0};
+	holes[hole_A] = a;
+	holes[hole_B] = b;
+	holes[hole_Value] = b;
+	holes[hole_Jump] = st->len + jump;
+	return stencil_emit_holes(st, holes);
+}
+
+/*
+ * Appends code to the end of out, freeing both, and returns the result
+ */
+static ArrLen *stencil_append(ArrLen *out, ArrLen *code) {
+	ArrLen *temp = ArrLen_concat_2(out, code);
+	ArrLen_free(out);
+	ArrLen_free(code);
+	return temp;
+}
+
+/*
+ * Returns the stencil for an arithmetic operator, taking a constant right hand
+ * side if value is true
+ */
+static const Stencil *arithmetic_stencil(token_type op, bool value) {
+	switch(op) {
+		case PLUS: return value ? &stencil_plus_value : &stencil_plus;
+		case MINUS: return value ? &stencil_minus_value : &stencil_minus;
+		case MULTIPLY:
+			return value ? &stencil_multiply_value : &stencil_multiply;
+		case DIVIDE: return value ? &stencil_divide_value : &stencil_divide;
+		default: return value ? &stencil_modulo_value : &stencil_modulo;
+	}
+}
+
+/*
+ * Returns the stencil for a comparison operator, taking a constant right hand
+ * side if value is true. If unless is true, the stencil jumps when the
+ * comparison is false, otherwise it stores the result.
+ */
+static const Stencil *comparison_stencil(token_type op, bool value,
+	bool unless) {
+
+	// The stencils for each operator, in the order: stores, stores with a
+	// constant, jumps, jumps with a constant
+	const Stencil *stencils[4];
+
+	switch(op) {
+		case EQUAL:
+			stencils[0] = &stencil_equal;
+			stencils[1] = &stencil_equal_value;
+			stencils[2] = &stencil_unless_equal;
+			stencils[3] = &stencil_unless_equal_value;
+			break;
+		case NOT_EQUAL:
+			stencils[0] = &stencil_not_equal;
+			stencils[1] = &stencil_not_equal_value;
+			stencils[2] = &stencil_unless_not_equal;
+			stencils[3] = &stencil_unless_not_equal_value;
+			break;
+		case LESS_THAN:
+			stencils[0] = &stencil_less_than;
+			stencils[1] = &stencil_less_than_value;
+			stencils[2] = &stencil_unless_less_than;
+			stencils[3] = &stencil_unless_less_than_value;
+			break;
+		case GREATER_THAN:
+			stencils[0] = &stencil_greater_than;
+			stencils[1] = &stencil_greater_than_value;
+			stencils[2] = &stencil_unless_greater_than;
+			stencils[3] = &stencil_unless_greater_than_value;
+			break;
+		case LESS_OR_EQUAL:
+			stencils[0] = &stencil_less_or_equal;
+			stencils[1] = &stencil_less_or_equal_value;
+			stencils[2] = &stencil_unless_less_or_equal;
+			stencils[3] = &stencil_unless_less_or_equal_value;
+			break;
+		default:
+			stencils[0] = &stencil_greater_or_equal;
+			stencils[1] = &stencil_greater_or_equal_value;
+			stencils[2] = &stencil_unless_greater_or_equal;
+			stencils[3] = &stencil_unless_greater_or_equal_value;
+			break;
+	}
+
+	return stencils[(unless ? 2 : 0) + (value ? 1 : 0)];
+}
+
+/*
+ * Returns the comparison operator that gives the same result as op when its
+ * operands are swapped
+ */
+static token_type mirror_comparison(token_type op) {
+	switch(op) {
+		case LESS_THAN: return GREATER_THAN;
+		case GREATER_THAN: return LESS_THAN;
+		case LESS_OR_EQUAL: return GREATER_OR_EQUAL;
+		case GREATER_OR_EQUAL: return LESS_OR_EQUAL;
+		default: return op;
+	}
+}
+
+static ArrLen *stencilcode_into(StencilCompiler *sc, Expression *expr,
+	int dest, int temp);
+
+/*
+ * Generates the code that makes an expression's value available as an operand,
+ * using the temporary slots numbered temp and above if it has to be computed.
+ * Constants and variables need no code.
+ */
+static ArrLen *stencilcode_operand(StencilCompiler *sc, Expression *expr,
+	int temp, Operand *operand) {
+
+	if(expr->type == expr_IntegerLiteral) {
+		operand->constant = true;
+		operand->value = expr->expr->intgr;
+		return ArrLen_init(NULL, 0);
+	}
+
+	operand->constant = false;
+	if(expr->type == expr_Identifier) {
+		operand->value = expr->expr->ident->stack_offset;
+		return ArrLen_init(NULL, 0);
+	}
+
+	operand->value = temp_offset(sc, temp);
+	return stencilcode_into(sc, expr, operand->value, temp + 1);
+}
+
+/*
+ * Generates the code for the operands of a binary operation, using the
+ * temporary slots numbered temp and above. The left hand side is always left
+ * in a slot, but the right hand side may be a constant. If the left hand side
+ * is a constant and the right is not, they are swapped if swap is true, and
+ * swapped is set.
+ */
+static ArrLen *stencilcode_operands(StencilCompiler *sc, Expression *lhs,
+	Expression *rhs, int temp, bool swap, Operand *a, Operand *b,
+	bool *swapped) {
+
+	ArrLen *out = stencilcode_operand(sc, lhs, temp, a);
+	out = stencil_append(out, stencilcode_operand(sc, rhs, temp + 1, b));
+
+	*swapped = false;
+	if(a->constant && !b->constant && swap) {
+		Operand operand = *a;
+		*a = *b;
+		*b = operand;
+		*swapped = true;
+	}
+	else if(a->constant) {
+		int offset = temp_offset(sc, temp);
+		out = stencil_append(out,
+			stencil_emit(&stencil_constant, offset, 0, a->value));
+		a->constant = false;
+		a->value = offset;
+	}
+
+	return out;
+}
+
+/*
+ * Generates the code that falls through if a condition is true, and otherwise
+ * jumps to the code skip bytes past its end
+ */
+static ArrLen *stencilcode_condition(StencilCompiler *sc, Expression *cond,
+	int temp, int skip) {
+
+	ArrLen *out;
+	if(cond->type == expr_BooleanExpr) {
+		Operand a, b;
+		bool swapped;
+		out = stencilcode_operands(sc, cond->expr->blean->lhs,
+			cond->expr->blean->rhs, temp, true, &a, &b, &swapped);
+
+		token_type op = cond->expr->blean->op;
+		if(swapped) op = mirror_comparison(op);
+		out = stencil_append(out, stencil_emit_jump(
+			comparison_stencil(op, b.constant, true), a.value, b.value, skip));
+	}
+	else {
+		Operand a;
+		out = stencilcode_operand(sc, cond, temp, &a);
+		if(a.constant) {
+			if(!a.value) {
+				out = stencil_append(out,
+					stencil_emit_jump(&stencil_jump, 0, 0, skip));
+			}
+		}
+		else {
+			out = stencil_append(out,
+				stencil_emit_jump(&stencil_unless, a.value, 0, skip));
+		}
+	}
+
+	if(jitdebug_enabled()) ArrLen_mark(out, NULL, cond);
+	return out;
+}
+
+/*
+ * Generates the code that evaluates an expression into the slot at byte offset
+ * dest, using the temporary slots numbered temp and above
+ */
+static ArrLen *stencilcode_into(StencilCompiler *sc, Expression *expr,
+	int dest, int temp) {
+
+	ArrLen *out;
+	Operand a, b;
+	bool swapped;
+	int i;
+
+	switch(expr->type) {
+		case expr_IntegerLiteral:
+			out = stencil_emit(&stencil_constant, dest, 0, expr->expr->intgr);
+			break;
+
+		case expr_Identifier:
+			if(expr->expr->ident->stack_offset == dest) {
+				out = ArrLen_init(NULL, 0);
+			}
+			else {
+				out = stencil_emit(&stencil_copy, dest,
+					expr->expr->ident->stack_offset, 0);
+			}
+			break;
+
+		case expr_ArithmeticExpr: {
+			token_type op = expr->expr->arith->op;
+			out = stencilcode_operands(sc, expr->expr->arith->lhs,
+				expr->expr->arith->rhs, temp, op == PLUS || op == MULTIPLY,
+				&a, &b, &swapped);
+			out = stencil_append(out, stencil_emit(
+				arithmetic_stencil(op, b.constant), dest, a.value, b.value));
+			break;
+		}
+
+		case expr_BooleanExpr: {
+			out = stencilcode_operands(sc, expr->expr->blean->lhs,
+				expr->expr->blean->rhs, temp, true, &a, &b, &swapped);
+
+			token_type op = expr->expr->blean->op;
+			if(swapped) op = mirror_comparison(op);
+			out = stencil_append(out, stencil_emit(
+				comparison_stencil(op, b.constant, false),
+				dest, a.value, b.value));
+			break;
+		}
+
+		case expr_FNCall: {
+			FNCall *call = expr->expr->fncall;
+			if(call->call_index < 0) {
+				printf("Call to '%s' has no call index - cannot jit\n",
+					call->name);
+				exit(EXIT_FAILURE);
+			}
+
+			// Evaluate the arguments into consecutive temporary slots
+			int arg_count = LinkedList_length(call->args);
+			int args = temp_offset(sc, temp);
+			out = ArrLen_init(NULL, 0);
+			for(i = 0; i < arg_count; i++) {
+				out = stencil_append(out, stencilcode_into(sc,
+					(Expression *)LinkedList_get(call->args, i),
+					temp_offset(sc, temp + i), temp + arg_count));
+			}
+
+			int holes[STENCIL_HOLE_COUNT] = {0};
+			holes[hole_Dest] = dest;
+			holes[hole_A] = args;
+			holes[hole_Site] =
+				sizeof(void *) * POOL_CALL_SITE(call->call_index);
+			out = stencil_append(out,
+				stencil_emit_holes(&stencil_call, holes));
+			break;
+		}
+
+		default: {
+			Ternary *ternary = expr->expr->trnry;
+			ArrLen *if_false =
+				stencilcode_into(sc, ternary->false_expr, dest, temp);
+			ArrLen *if_true =
+				stencilcode_into(sc, ternary->true_expr, dest, temp);
+			if_true = stencil_append(if_true,
+				stencil_emit_jump(&stencil_jump, 0, 0, if_false->len));
+
+			out = stencilcode_condition(sc, ternary->bool_expr, temp,
+				if_true->len);
+			out = stencil_append(out, if_true);
+			out = stencil_append(out, if_false);
+			break;
+		}
+	}
+
+	if(jitdebug_enabled()) ArrLen_mark(out, NULL, expr);
+	return out;
+}
+
+static ArrLen *stencilcode_statement(StencilCompiler *sc, Statement *stmt);
+
+static ArrLen *stencilcode_statement_list(StencilCompiler *sc,
+	LinkedList *stmts);
+
+/*
+ * Generates the code for a loop: the condition, the body and then the
+ * incrementor (which may be NULL), and a jump back to the condition
+ */
+static ArrLen *stencilcode_loop(StencilCompiler *sc, Expression *cond,
+	LinkedList *stmts, Statement *incrementor) {
+
+	ArrLen *body = stencilcode_statement_list(sc, stmts);
+	if(incrementor) {
+		body = stencil_append(body, stencilcode_statement(sc, incrementor));
+	}
+
+	// The condition's jump must skip the body and the jump back to the
+	// condition, and the jump back must skip back over both
+	int skip = body->len + stencil_jump.len;
+	ArrLen *out = stencilcode_condition(sc, cond, 0, skip);
+	out = stencil_append(out, body);
+	return stencil_append(out, stencil_emit_jump(&stencil_jump, 0, 0,
+		-(out->len + stencil_jump.len)));
+}
+
+/*
+ * Generates the code for a statement
+ */
+static ArrLen *stencilcode_statement(StencilCompiler *sc, Statement *stmt) {
+	ArrLen *out;
+	Operand a;
+
+	switch(stmt->type) {
+		case stmt_For: {
+			For *_for = stmt->stmt->_for;
+			out = stencilcode_statement(sc, _for->assignment);
+			out = stencil_append(out, stencilcode_loop(sc, _for->bool_expr,
+				_for->stmts, _for->incrementor));
+			break;
+		}
+
+		case stmt_While:
+			out = stencilcode_loop(sc, stmt->stmt->_while->bool_expr,
+				stmt->stmt->_while->stmts, NULL);
+			break;
+
+		case stmt_If: {
+			If *_if = stmt->stmt->_if;
+			ArrLen *if_true = stencilcode_statement_list(sc, _if->true_stmts);
+			ArrLen *if_false =
+				stencilcode_statement_list(sc, _if->false_stmts);
+			if(if_false->len > 0) {
+				if_true = stencil_append(if_true,
+					stencil_emit_jump(&stencil_jump, 0, 0, if_false->len));
+			}
+
+			out = stencilcode_condition(sc, _if->bool_expr, 0, if_true->len);
+			out = stencil_append(out, if_true);
+			out = stencil_append(out, if_false);
+			break;
+		}
+
+		case stmt_Print:
+			out = stencilcode_operand(sc, stmt->stmt->_print->expr, 0, &a);
+			if(a.constant) {
+				int offset = temp_offset(sc, 0);
+				out = stencil_append(out,
+					stencil_emit(&stencil_constant, offset, 0, a.value));
+				a.value = offset;
+			}
+			out = stencil_append(out,
+				stencil_emit(&stencil_print, 0, a.value, 0));
+			break;
+
+		case stmt_Assignment:
+			out = stencilcode_into(sc, stmt->stmt->_assignment->expr,
+				stmt->stmt->_assignment->ident->expr->ident->stack_offset, 0);
+			break;
+
+		default:
+			out = stencilcode_operand(sc, stmt->stmt->_return->expr, 0, &a);
+			out = stencil_append(out, a.constant
+				? stencil_emit(&stencil_return_value, 0, 0, a.value)
+				: stencil_emit(&stencil_return, 0, a.value, 0));
+			break;
+	}
+
+	ArrLen_mark(out, stmt, NULL);
+	return out;
+}
+
+/*
+ * Generates the code for a list of statements
+ */
+static ArrLen *stencilcode_statement_list(StencilCompiler *sc,
+	LinkedList *stmts) {
+
+	ArrLen *out = ArrLen_init(NULL, 0);
+
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter)) {
+		out = stencil_append(out, stencilcode_statement(sc,
+			(Statement *)LLIterator_get_current(stmts_iter)));
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+
+	return out;
+}
+
+/*
+ * Generates machine code for a function by copying and patching stencils (see
+ * stencil.h). The code has the same entry point as code generated by
+ * jitcode_function(), and uses the same constant pool. The function's stack
+ * offsets must have been generated.
+ */
+ArrLen *stencilcode_function(FNDecl *func, Program *prog) {
+	StencilCompiler sc;
+	sc.temps = func->variable_count;
+	sc.frame_size = func->variable_count > 0 ? func->variable_count : 1;
+
+	// If the end of the function is reached without returning, report the
+	// error in the same way as the interpreter
+	ArrLen *body = stencilcode_statement_list(&sc, func->stmts);
+	body = stencil_append(body, stencil_emit(&stencil_missing_return, 0, 0, 0));
+
+	int holes[STENCIL_HOLE_COUNT] = {0};
+	holes[hole_FrameSize] = sc.frame_size;
+	holes[hole_ArgCount] = LinkedList_length(func->args);
+	holes[hole_Body] = stencil_function.len;
+	ArrLen *out = stencil_emit_holes(&stencil_function, holes);
+
+	return stencil_append(out, body);
+}
@@ -0,0 +1,94 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef JITCODE
+#include "jitcode.h"
+#endif // JITCODE
+
+#ifndef STENCIL
+#define STENCIL
+
+/*
+ * The baseline JIT compiler, which compiles functions by copy-and-patch. Each
+ * kind of AST node has a stencil: a small C function in stencils.c, compiled
+ * ahead of time with the rest of minty, whose operands and continuation are
+ * left as holes - references to undefined symbols. The stencils are extracted
+ * from the object file into stencil_data.h by stencilgen at build time, along
+ * with the relocations that mark where the holes are. Compiling a function
+ * then only involves copying the stencils for its nodes one after another and
+ * writing each hole's value into it, which is far cheaper than the optimising
+ * compiler (see ir.h and jitcode.h) while producing code of similar quality to
+ * it for straight-line code.
+ *
+ * A compiled function keeps its variables and intermediate values in an array
+ * of ints, the frame, which the stencils take a pointer to along with the
+ * constant pool. Each stencil ends with a tail call to the stencil that follows
+ * it, which becomes a jump to the next stencil copied - or nothing at all, if
+ * the call was the stencil's last instruction. So that the code can be cached
+ * and relocated like other compiled code, it contains no absolute addresses.
+ * Holes are either 32 bit values or 32 bit displacements between two places in
+ * the code.
+ */
+
+/*
+ * The holes that stencils may have. In stencils.c, each is an undefined symbol
+ * named HOLE_<name>, and its value is the symbol's address:
+ *     hole_Dest       the byte offset in the frame of the slot to store into
+ *     hole_A          the byte offset in the frame of the first operand
+ *     hole_B          the byte offset in the frame of the second operand
+ *     hole_Value      a constant operand
+ *     hole_Site       the byte offset in the constant pool of a call site
+ *     hole_FrameSize  the number of slots in the frame
+ *     hole_ArgCount   the number of arguments the function takes
+ * and the following are called as functions, to continue with the code at:
+ *     hole_Continue   the next stencil
+ *     hole_Jump       a stencil somewhere else in the function
+ *     hole_Body       the start of the function's body
+ */
+typedef enum {
+	hole_Dest,
+	hole_A,
+	hole_B,
+	hole_Value,
+	hole_Site,
+	hole_FrameSize,
+	hole_ArgCount,
+	hole_Continue,
+	hole_Jump,
+	hole_Body
+} stencil_hole;
+
+#define STENCIL_HOLE_COUNT 10
+
+/*
+ * A place in a stencil's code where a hole's value must be written, plus the
+ * addend. Relative patches hold the displacement from the patch to the code
+ * the hole refers to.
+ */
+typedef struct {
+	int offset;
+	stencil_hole hole;
+	bool relative;
+	int addend;
+} StencilPatch;
+
+typedef struct {
+	const char *name;
+	const byte *code;
+	int len;
+	const StencilPatch *patches;
+	int patch_count;
+} Stencil;
+
+ArrLen *stencilcode_function(FNDecl *func, Program *prog);
+
+#endif // STENCIL
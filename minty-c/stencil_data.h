@@ -0,0 +1,575 @@
+/*
+ * Generated from stencils.o by stencilgen - do not edit
+ */
+
+static const StencilPatch stencil_function_patches[] = {
+	{2, hole_FrameSize, false, 0},
+	{25, hole_ArgCount, false, 0},
+	{51, hole_ArgCount, false, 0},
+	{61, hole_Body, true, -4},
+};
+static const byte stencil_function_code[] = {
+	0x55, 0xB8, 0x00, 0x00, 0x00, 0x00, 0x48, 0x8D, 0x04, 0x85, 0x0F, 0x00,
+	0x00, 0x00, 0x48, 0x83, 0xE0, 0xF0, 0x48, 0x89, 0xE5, 0x48, 0x29, 0xC4,
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x48, 0x89, 0xE1, 0x48, 0x85, 0xC0, 0x7E,
+	0x14, 0x31, 0xC0, 0x8B, 0x14, 0x87, 0x89, 0x14, 0x81, 0x48, 0x83, 0xC0,
+	0x01, 0x48, 0x3D, 0x00, 0x00, 0x00, 0x00, 0x75, 0xEE, 0x48, 0x89, 0xCF,
+	0xE8, 0x00, 0x00, 0x00, 0x00, 0xC9, 0xC3
+};
+static const Stencil stencil_function = {
+	"function", stencil_function_code, 67, stencil_function_patches, 4
+};
+
+static const StencilPatch stencil_constant_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_Dest, false, 0},
+};
+static const byte stencil_constant_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_constant = {
+	"constant", stencil_constant_code, 11, stencil_constant_patches, 2
+};
+
+static const StencilPatch stencil_copy_patches[] = {
+	{2, hole_A, false, 0},
+	{8, hole_Dest, false, 0},
+};
+static const byte stencil_copy_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_copy = {
+	"copy", stencil_copy_code, 12, stencil_copy_patches, 2
+};
+
+static const StencilPatch stencil_plus_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{14, hole_Dest, false, 0},
+};
+static const byte stencil_plus_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x03, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_plus = {
+	"plus", stencil_plus_code, 18, stencil_plus_patches, 3
+};
+
+static const StencilPatch stencil_plus_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{13, hole_Dest, false, 0},
+};
+static const byte stencil_plus_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x03, 0x87, 0x00, 0x00, 0x00, 0x00, 0x89,
+	0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_plus_value = {
+	"plus_value", stencil_plus_value_code, 17, stencil_plus_value_patches, 3
+};
+
+static const StencilPatch stencil_minus_patches[] = {
+	{2, hole_A, false, 0},
+	{8, hole_B, false, 0},
+	{14, hole_Dest, false, 0},
+};
+static const byte stencil_minus_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x2B, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_minus = {
+	"minus", stencil_minus_code, 18, stencil_minus_patches, 3
+};
+
+static const StencilPatch stencil_minus_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{9, hole_A, false, 0},
+	{17, hole_Dest, false, 0},
+};
+static const byte stencil_minus_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x10, 0x8B, 0x87, 0x00, 0x00, 0x00,
+	0x00, 0x29, 0xD0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_minus_value = {
+	"minus_value", stencil_minus_value_code, 21, stencil_minus_value_patches, 3
+};
+
+static const StencilPatch stencil_multiply_patches[] = {
+	{2, hole_A, false, 0},
+	{9, hole_B, false, 0},
+	{15, hole_Dest, false, 0},
+};
+static const byte stencil_multiply_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F, 0xAF, 0x87, 0x00, 0x00, 0x00,
+	0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_multiply = {
+	"multiply", stencil_multiply_code, 19, stencil_multiply_patches, 3
+};
+
+static const StencilPatch stencil_multiply_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{8, hole_A, false, 0},
+	{14, hole_Dest, false, 0},
+};
+static const byte stencil_multiply_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x0F, 0xAF, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_multiply_value = {
+	"multiply_value", stencil_multiply_value_code, 18, stencil_multiply_value_patches, 3
+};
+
+static const StencilPatch stencil_divide_patches[] = {
+	{2, hole_A, false, 0},
+	{9, hole_B, false, 0},
+	{15, hole_Dest, false, 0},
+};
+static const byte stencil_divide_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x99, 0xF7, 0xBF, 0x00, 0x00, 0x00,
+	0x00, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_divide = {
+	"divide", stencil_divide_code, 19, stencil_divide_patches, 3
+};
+
+static const StencilPatch stencil_divide_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{9, hole_A, false, 0},
+	{18, hole_Dest, false, 0},
+};
+static const byte stencil_divide_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x08, 0x8B, 0x87, 0x00, 0x00, 0x00,
+	0x00, 0x99, 0xF7, 0xF9, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_divide_value = {
+	"divide_value", stencil_divide_value_code, 22, stencil_divide_value_patches, 3
+};
+
+static const StencilPatch stencil_modulo_patches[] = {
+	{2, hole_A, false, 0},
+	{9, hole_B, false, 0},
+	{15, hole_Dest, false, 0},
+};
+static const byte stencil_modulo_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x99, 0xF7, 0xBF, 0x00, 0x00, 0x00,
+	0x00, 0x89, 0x97, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_modulo = {
+	"modulo", stencil_modulo_code, 19, stencil_modulo_patches, 3
+};
+
+static const StencilPatch stencil_modulo_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{9, hole_A, false, 0},
+	{18, hole_Dest, false, 0},
+};
+static const byte stencil_modulo_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x8D, 0x08, 0x8B, 0x87, 0x00, 0x00, 0x00,
+	0x00, 0x99, 0xF7, 0xF9, 0x89, 0x97, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_modulo_value = {
+	"modulo_value", stencil_modulo_value_code, 22, stencil_modulo_value_patches, 3
+};
+
+static const StencilPatch stencil_equal_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{20, hole_Dest, false, 0},
+};
+static const byte stencil_equal_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_equal = {
+	"equal", stencil_equal_code, 24, stencil_equal_patches, 3
+};
+
+static const StencilPatch stencil_equal_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{19, hole_Dest, false, 0},
+};
+static const byte stencil_equal_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F,
+	0x94, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_equal_value = {
+	"equal_value", stencil_equal_value_code, 23, stencil_equal_value_patches, 3
+};
+
+static const StencilPatch stencil_unless_equal_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{15, hole_Jump, true, -4},
+};
+static const byte stencil_unless_equal_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x74, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_equal = {
+	"unless_equal", stencil_unless_equal_code, 19, stencil_unless_equal_patches, 3
+};
+
+static const StencilPatch stencil_unless_equal_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{14, hole_Jump, true, -4},
+};
+static const byte stencil_unless_equal_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x74,
+	0x05, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_equal_value = {
+	"unless_equal_value", stencil_unless_equal_value_code, 18, stencil_unless_equal_value_patches, 3
+};
+
+static const StencilPatch stencil_not_equal_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{20, hole_Dest, false, 0},
+};
+static const byte stencil_not_equal_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x0F, 0x95, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_not_equal = {
+	"not_equal", stencil_not_equal_code, 24, stencil_not_equal_patches, 3
+};
+
+static const StencilPatch stencil_not_equal_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{19, hole_Dest, false, 0},
+};
+static const byte stencil_not_equal_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F,
+	0x95, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_not_equal_value = {
+	"not_equal_value", stencil_not_equal_value_code, 23, stencil_not_equal_value_patches, 3
+};
+
+static const StencilPatch stencil_unless_not_equal_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{15, hole_Continue, true, -4},
+	{20, hole_Jump, true, -4},
+};
+static const byte stencil_unless_not_equal_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x74, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_not_equal = {
+	"unless_not_equal", stencil_unless_not_equal_code, 24, stencil_unless_not_equal_patches, 4
+};
+
+static const StencilPatch stencil_unless_not_equal_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{14, hole_Continue, true, -4},
+	{19, hole_Jump, true, -4},
+};
+static const byte stencil_unless_not_equal_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x74,
+	0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_not_equal_value = {
+	"unless_not_equal_value", stencil_unless_not_equal_value_code, 23, stencil_unless_not_equal_value_patches, 4
+};
+
+static const StencilPatch stencil_less_than_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{20, hole_Dest, false, 0},
+};
+static const byte stencil_less_than_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x0F, 0x9C, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_less_than = {
+	"less_than", stencil_less_than_code, 24, stencil_less_than_patches, 3
+};
+
+static const StencilPatch stencil_less_than_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{19, hole_Dest, false, 0},
+};
+static const byte stencil_less_than_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F,
+	0x9C, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_less_than_value = {
+	"less_than_value", stencil_less_than_value_code, 23, stencil_less_than_value_patches, 3
+};
+
+static const StencilPatch stencil_unless_less_than_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{15, hole_Continue, true, -4},
+	{20, hole_Jump, true, -4},
+};
+static const byte stencil_unless_less_than_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x7D, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_less_than = {
+	"unless_less_than", stencil_unless_less_than_code, 24, stencil_unless_less_than_patches, 4
+};
+
+static const StencilPatch stencil_unless_less_than_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{14, hole_Continue, true, -4},
+	{19, hole_Jump, true, -4},
+};
+static const byte stencil_unless_less_than_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x7D,
+	0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_less_than_value = {
+	"unless_less_than_value", stencil_unless_less_than_value_code, 23, stencil_unless_less_than_value_patches, 4
+};
+
+static const StencilPatch stencil_greater_than_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{20, hole_Dest, false, 0},
+};
+static const byte stencil_greater_than_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x0F, 0x9F, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_greater_than = {
+	"greater_than", stencil_greater_than_code, 24, stencil_greater_than_patches, 3
+};
+
+static const StencilPatch stencil_greater_than_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{19, hole_Dest, false, 0},
+};
+static const byte stencil_greater_than_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F,
+	0x9F, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_greater_than_value = {
+	"greater_than_value", stencil_greater_than_value_code, 23, stencil_greater_than_value_patches, 3
+};
+
+static const StencilPatch stencil_unless_greater_than_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{15, hole_Continue, true, -4},
+	{20, hole_Jump, true, -4},
+};
+static const byte stencil_unless_greater_than_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x7E, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_greater_than = {
+	"unless_greater_than", stencil_unless_greater_than_code, 24, stencil_unless_greater_than_patches, 4
+};
+
+static const StencilPatch stencil_unless_greater_than_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{14, hole_Continue, true, -4},
+	{19, hole_Jump, true, -4},
+};
+static const byte stencil_unless_greater_than_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x7E,
+	0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_greater_than_value = {
+	"unless_greater_than_value", stencil_unless_greater_than_value_code, 23, stencil_unless_greater_than_value_patches, 4
+};
+
+static const StencilPatch stencil_less_or_equal_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{20, hole_Dest, false, 0},
+};
+static const byte stencil_less_or_equal_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x0F, 0x9E, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_less_or_equal = {
+	"less_or_equal", stencil_less_or_equal_code, 24, stencil_less_or_equal_patches, 3
+};
+
+static const StencilPatch stencil_less_or_equal_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{19, hole_Dest, false, 0},
+};
+static const byte stencil_less_or_equal_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F,
+	0x9E, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_less_or_equal_value = {
+	"less_or_equal_value", stencil_less_or_equal_value_code, 23, stencil_less_or_equal_value_patches, 3
+};
+
+static const StencilPatch stencil_unless_less_or_equal_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{15, hole_Continue, true, -4},
+	{20, hole_Jump, true, -4},
+};
+static const byte stencil_unless_less_or_equal_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x7F, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_less_or_equal = {
+	"unless_less_or_equal", stencil_unless_less_or_equal_code, 24, stencil_unless_less_or_equal_patches, 4
+};
+
+static const StencilPatch stencil_unless_less_or_equal_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{14, hole_Continue, true, -4},
+	{19, hole_Jump, true, -4},
+};
+static const byte stencil_unless_less_or_equal_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x7F,
+	0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_less_or_equal_value = {
+	"unless_less_or_equal_value", stencil_unless_less_or_equal_value_code, 23, stencil_unless_less_or_equal_value_patches, 4
+};
+
+static const StencilPatch stencil_greater_or_equal_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{20, hole_Dest, false, 0},
+};
+static const byte stencil_greater_or_equal_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x0F, 0x9D, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_greater_or_equal = {
+	"greater_or_equal", stencil_greater_or_equal_code, 24, stencil_greater_or_equal_patches, 3
+};
+
+static const StencilPatch stencil_greater_or_equal_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{19, hole_Dest, false, 0},
+};
+static const byte stencil_greater_or_equal_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0F,
+	0x9D, 0xC0, 0x0F, 0xB6, 0xC0, 0x89, 0x87, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_greater_or_equal_value = {
+	"greater_or_equal_value", stencil_greater_or_equal_value_code, 23, stencil_greater_or_equal_value_patches, 3
+};
+
+static const StencilPatch stencil_unless_greater_or_equal_patches[] = {
+	{2, hole_B, false, 0},
+	{8, hole_A, false, 0},
+	{15, hole_Continue, true, -4},
+	{20, hole_Jump, true, -4},
+};
+static const byte stencil_unless_greater_or_equal_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00,
+	0x7C, 0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_greater_or_equal = {
+	"unless_greater_or_equal", stencil_unless_greater_or_equal_code, 24, stencil_unless_greater_or_equal_patches, 4
+};
+
+static const StencilPatch stencil_unless_greater_or_equal_value_patches[] = {
+	{1, hole_Value, false, 0},
+	{7, hole_A, false, 0},
+	{14, hole_Continue, true, -4},
+	{19, hole_Jump, true, -4},
+};
+static const byte stencil_unless_greater_or_equal_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0x39, 0x87, 0x00, 0x00, 0x00, 0x00, 0x7C,
+	0x05, 0xE9, 0x00, 0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless_greater_or_equal_value = {
+	"unless_greater_or_equal_value", stencil_unless_greater_or_equal_value_code, 23, stencil_unless_greater_or_equal_value_patches, 4
+};
+
+static const StencilPatch stencil_unless_patches[] = {
+	{2, hole_A, false, 0},
+	{11, hole_Continue, true, -4},
+	{16, hole_Jump, true, -4},
+};
+static const byte stencil_unless_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0x85, 0xC0, 0x74, 0x05, 0xE9, 0x00,
+	0x00, 0x00, 0x00, 0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_unless = {
+	"unless", stencil_unless_code, 20, stencil_unless_patches, 3
+};
+
+static const StencilPatch stencil_jump_patches[] = {
+	{1, hole_Jump, true, -4},
+};
+static const byte stencil_jump_code[] = {
+	0xE9, 0x00, 0x00, 0x00, 0x00
+};
+static const Stencil stencil_jump = {
+	"jump", stencil_jump_code, 5, stencil_jump_patches, 1
+};
+
+static const StencilPatch stencil_print_patches[] = {
+	{14, hole_A, false, 0},
+};
+static const byte stencil_print_code[] = {
+	0x55, 0x48, 0x89, 0xF5, 0x53, 0x48, 0x89, 0xFB, 0x48, 0x83, 0xEC, 0x08,
+	0x8B, 0xBF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x56, 0x08, 0x48, 0x83, 0xC4,
+	0x08, 0x48, 0x89, 0xEE, 0x48, 0x89, 0xDF, 0x5B, 0x5D
+};
+static const Stencil stencil_print = {
+	"print", stencil_print_code, 33, stencil_print_patches, 1
+};
+
+static const StencilPatch stencil_call_patches[] = {
+	{4, hole_A, false, 0},
+	{22, hole_Site, false, 0},
+	{33, hole_Site, false, 8},
+	{48, hole_Dest, false, 0},
+};
+static const byte stencil_call_code[] = {
+	0x55, 0x48, 0x8D, 0x8F, 0x00, 0x00, 0x00, 0x00, 0x48, 0x89, 0xFD, 0x53,
+	0x48, 0x89, 0xF3, 0x48, 0x83, 0xEC, 0x08, 0x48, 0x8B, 0xBB, 0x00, 0x00,
+	0x00, 0x00, 0x48, 0x8B, 0x56, 0x18, 0x48, 0x8B, 0xB6, 0x00, 0x00, 0x00,
+	0x00, 0xFF, 0x53, 0x28, 0x48, 0x89, 0xDE, 0x48, 0x89, 0xEF, 0x89, 0x85,
+	0x00, 0x00, 0x00, 0x00, 0x48, 0x83, 0xC4, 0x08, 0x5B, 0x5D
+};
+static const Stencil stencil_call = {
+	"call", stencil_call_code, 58, stencil_call_patches, 4
+};
+
+static const StencilPatch stencil_return_patches[] = {
+	{2, hole_A, false, 0},
+};
+static const byte stencil_return_code[] = {
+	0x8B, 0x87, 0x00, 0x00, 0x00, 0x00, 0xC3
+};
+static const Stencil stencil_return = {
+	"return", stencil_return_code, 7, stencil_return_patches, 1
+};
+
+static const StencilPatch stencil_return_value_patches[] = {
+	{1, hole_Value, false, 0},
+};
+static const byte stencil_return_value_code[] = {
+	0xB8, 0x00, 0x00, 0x00, 0x00, 0xC3
+};
+static const Stencil stencil_return_value = {
+	"return_value", stencil_return_value_code, 6, stencil_return_value_patches, 1
+};
+
+static const byte stencil_missing_return_code[] = {
+	0x48, 0x83, 0xEC, 0x08, 0x48, 0x8B, 0x7E, 0x20, 0xFF, 0x56, 0x10, 0x31,
+	0xC0, 0x48, 0x83, 0xC4, 0x08, 0xC3
+};
+static const Stencil stencil_missing_return = {
+	"missing_return", stencil_missing_return_code, 18, NULL, 0
+};
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+/*
+ * Extracts the stencils used by the baseline JIT compiler (see stencil.h) from
+ * the object file that stencils.c is compiled into, and writes them out as C
+ * source code for stencil.c to include. This program is run as part of the
+ * build:
+ *
+ *     stencilgen <stencils.o> <stencil_data.h>
+ *
+ * The object file must have been compiled with each function in its own
+ * section (-ffunction-sections). The code of each function named stencil_<x>
+ * is written out as a Stencil named stencil_<x>, and each of the function's
+ * relocations as a patch, which must refer to one of the holes (symbols named
+ * HOLE_<name>). A tail call to the continuation at the very end of the code is
+ * removed, so that the stencil falls through into the next one instead.
+ */
+
+/*
+ * Reads a whole file into a newly allocated buffer
+ */
+static unsigned char *read_file(char *filename, long *len) {
+	FILE *file = fopen(filename, "rb");
+	if(!file) {
+		printf("Could not open '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	fseek(file, 0, SEEK_END);
+	*len = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	unsigned char *contents = malloc(*len);
+	if(!contents || fread(contents, 1, *len, file) != (size_t)*len) {
+		printf("Could not read '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	fclose(file);
+
+	return contents;
+}
+
+/*
+ * Writes out the patches for a stencil's relocations, returning the number
+ * written. len is the length of the stencil's code, and is reduced if a tail
+ * call to the continuation at the end is removed.
+ */
+static int write_patches(FILE *out, char *name, unsigned char *code, int *len,
+	Elf64_Rela *relas, int rela_count, Elf64_Sym *symbols, char *names) {
+
+	int count = 0;
+	int i;
+	for(i = 0; i < rela_count; i++) {
+		Elf64_Sym *symbol = &(symbols[ELF64_R_SYM(relas[i].r_info)]);
+		char *hole = names + symbol->st_name;
+		int type = ELF64_R_TYPE(relas[i].r_info);
+		int offset = (int)relas[i].r_offset;
+
+		if(strncmp(hole, "HOLE_", 5) != 0) {
+			printf("Stencil '%s' refers to '%s', which is not a hole\n",
+				name, hole);
+			exit(EXIT_FAILURE);
+		}
+		hole += 5;
+
+		char *relative;
+		if(type == R_X86_64_32 || type == R_X86_64_32S) relative = "false";
+		else if(type == R_X86_64_PC32 || type == R_X86_64_PLT32) {
+			relative = "true";
+		}
+		else {
+			printf("Stencil '%s' has an unsupported relocation type (%d)\n",
+				name, type);
+			exit(EXIT_FAILURE);
+		}
+
+		// Drop a jmp to the continuation that ends the code (e9 <rel32>)
+		if(strcmp(hole, "Continue") == 0 && offset == *len - 4
+			&& code[offset - 1] == 0xE9) {
+			*len -= 5;
+			continue;
+		}
+
+		if(count == 0) {
+			fprintf(out, "static const StencilPatch %s_patches[] = {\n", name);
+		}
+		fprintf(out, "\t{%d, hole_%s, %s, %ld},\n", offset, hole, relative,
+			(long)relas[i].r_addend);
+		count++;
+	}
+	if(count > 0) fprintf(out, "};\n");
+
+	return count;
+}
+
+int main(int argc, char **argv) {
+	if(argc != 3) {
+		printf("Usage: stencilgen <stencils.o> <stencil_data.h>\n");
+		exit(EXIT_FAILURE);
+	}
+
+	long file_len;
+	unsigned char *file = read_file(argv[1], &file_len);
+	Elf64_Ehdr *header = (Elf64_Ehdr *)file;
+	if(file_len < sizeof(Elf64_Ehdr)
+		|| memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+		|| header->e_ident[EI_CLASS] != ELFCLASS64
+		|| header->e_machine != EM_X86_64) {
+		printf("'%s' is not an x86-64 ELF object file\n", argv[1]);
+		exit(EXIT_FAILURE);
+	}
+
+	Elf64_Shdr *sections = (Elf64_Shdr *)(file + header->e_shoff);
+	char *section_names =
+		(char *)(file + sections[header->e_shstrndx].sh_offset);
+
+	// Find the symbol table, and the string table that names its symbols
+	Elf64_Sym *symbols = NULL;
+	char *symbol_names = NULL;
+	int i, j;
+	for(i = 0; i < header->e_shnum; i++) {
+		if(sections[i].sh_type == SHT_SYMTAB) {
+			symbols = (Elf64_Sym *)(file + sections[i].sh_offset);
+			symbol_names =
+				(char *)(file + sections[sections[i].sh_link].sh_offset);
+		}
+	}
+	if(!symbols) {
+		printf("'%s' has no symbol table\n", argv[1]);
+		exit(EXIT_FAILURE);
+	}
+
+	FILE *out = fopen(argv[2], "w");
+	if(!out) {
+		printf("Could not open '%s'\n", argv[2]);
+		exit(EXIT_FAILURE);
+	}
+	fprintf(out, "/*\n * Generated from %s by stencilgen - do not edit\n */\n",
+		argv[1]);
+
+	for(i = 0; i < header->e_shnum; i++) {
+		char *section_name = section_names + sections[i].sh_name;
+		if(strncmp(section_name, ".text.stencil_", 14) != 0) continue;
+
+		char *name = section_name + 6;
+		unsigned char *code = file + sections[i].sh_offset;
+		int len = (int)sections[i].sh_size;
+
+		// Find the section's relocations
+		Elf64_Rela *relas = NULL;
+		int rela_count = 0;
+		for(j = 0; j < header->e_shnum; j++) {
+			if(sections[j].sh_type == SHT_RELA && sections[j].sh_info == i) {
+				relas = (Elf64_Rela *)(file + sections[j].sh_offset);
+				rela_count = sections[j].sh_size / sizeof(Elf64_Rela);
+			}
+		}
+
+		fprintf(out, "\n");
+		int patch_count = write_patches(out, name, code, &len,
+			relas, rela_count, symbols, symbol_names);
+
+		fprintf(out, "static const byte %s_code[] = {", name);
+		for(j = 0; j < len; j++) {
+			fprintf(out, "%s0x%02X",
+				j == 0 ? "\n\t" : j % 12 == 0 ? ",\n\t" : ", ", code[j]);
+		}
+		fprintf(out, "\n};\n");
+
+		fprintf(out, "static const Stencil %s = {\n", name);
+		fprintf(out, "\t\"%s\", %s_code, %d, %s%s, %d\n", name + 8, name, len,
+			patch_count > 0 ? name : "NULL",
+			patch_count > 0 ? "_patches" : "", patch_count);
+		fprintf(out, "};\n");
+	}
+
+	if(fclose(out)) {
+		printf("Error closing file: '%s'\n", argv[2]);
+		exit(EXIT_FAILURE);
+	}
+	free(file);
+
+	return 0;
+}
@@ -0,0 +1,175 @@
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "jitcode.h"
+#include "stencil.h"
+
+/*
+ * The stencils used by the baseline JIT compiler (see stencil.h). This file is
+ * not linked into minty: it is compiled on its own, with the flags given to it
+ * in the Makefile, and the code of each function below is extracted from the
+ * object file by stencilgen. Each function's code is then copied by the
+ * compiler as the code for one operation.
+ *
+ * Stencils must only refer to the holes declared below, and to nothing else
+ * outside their own code - library functions and globals are reached through
+ * the constant pool instead.
+ */
+
+/*
+ * The holes. Only the addresses of these symbols are used.
+ */
+extern char HOLE_Dest[];
+extern char HOLE_A[];
+extern char HOLE_B[];
+extern char HOLE_Value[];
+extern char HOLE_Site[];
+extern char HOLE_FrameSize[];
+extern char HOLE_ArgCount[];
+extern int HOLE_Continue(int *frame, void **pool);
+extern int HOLE_Jump(int *frame, void **pool);
+extern int HOLE_Body(int *frame, void **pool);
+
+/*
+ * Accesses the frame slot at the byte offset given by a hole
+ */
+#define SLOT(hole) (*(int *)((char *)frame + (long)(hole)))
+
+/*
+ * The constant in hole_Value
+ */
+#define VALUE ((int)(long)HOLE_Value)
+
+/*
+ * Every stencil except those that end the function continues with the next
+ * stencil by tail calling it
+ */
+#define CONTINUE return HOLE_Continue(frame, pool)
+
+/*
+ * The entry point of a compiled function, which sets up the frame, copies the
+ * arguments into its first slots, then runs the body
+ */
+int stencil_function(int *args, void **pool) {
+	int frame[(long)HOLE_FrameSize];
+
+	long i;
+	for(i = 0; i < (long)HOLE_ArgCount; i++) frame[i] = args[i];
+
+	return HOLE_Body(frame, pool);
+}
+
+int stencil_constant(int *frame, void **pool) {
+	SLOT(HOLE_Dest) = VALUE;
+	CONTINUE;
+}
+
+int stencil_copy(int *frame, void **pool) {
+	SLOT(HOLE_Dest) = SLOT(HOLE_A);
+	CONTINUE;
+}
+
+/*
+ * Each arithmetic operation has a stencil for a variable right hand side, and
+ * one for a constant. Addition, subtraction and multiplication are done on
+ * unsigned values, so that overflow wraps around as it does in the other tiers.
+ */
+#define ARITHMETIC(name, operation) \
+	int stencil_##name(int *frame, void **pool) { \
+		SLOT(HOLE_Dest) = operation(SLOT(HOLE_A), SLOT(HOLE_B)); \
+		CONTINUE; \
+	} \
+	int stencil_##name##_value(int *frame, void **pool) { \
+		SLOT(HOLE_Dest) = operation(SLOT(HOLE_A), VALUE); \
+		CONTINUE; \
+	}
+
+#define PLUS_OP(lhs, rhs) ((int)((unsigned)(lhs) + (unsigned)(rhs)))
+#define MINUS_OP(lhs, rhs) ((int)((unsigned)(lhs) - (unsigned)(rhs)))
+#define MULTIPLY_OP(lhs, rhs) ((int)((unsigned)(lhs) * (unsigned)(rhs)))
+#define DIVIDE_OP(lhs, rhs) ((lhs) / (rhs))
+#define MODULO_OP(lhs, rhs) ((lhs) % (rhs))
+
+ARITHMETIC(plus, PLUS_OP)
+ARITHMETIC(minus, MINUS_OP)
+ARITHMETIC(multiply, MULTIPLY_OP)
+ARITHMETIC(divide, DIVIDE_OP)
+ARITHMETIC(modulo, MODULO_OP)
+
+/*
+ * Each comparison has stencils that store its result, and stencils that jump
+ * if it is false, for conditions - again, with variable and constant right hand
+ * sides
+ */
+#define COMPARISON(name, op) \
+	int stencil_##name(int *frame, void **pool) { \
+		SLOT(HOLE_Dest) = SLOT(HOLE_A) op SLOT(HOLE_B); \
+		CONTINUE; \
+	} \
+	int stencil_##name##_value(int *frame, void **pool) { \
+		SLOT(HOLE_Dest) = SLOT(HOLE_A) op VALUE; \
+		CONTINUE; \
+	} \
+	int stencil_unless_##name(int *frame, void **pool) { \
+		if(!(SLOT(HOLE_A) op SLOT(HOLE_B))) return HOLE_Jump(frame, pool); \
+		CONTINUE; \
+	} \
+	int stencil_unless_##name##_value(int *frame, void **pool) { \
+		if(!(SLOT(HOLE_A) op VALUE)) return HOLE_Jump(frame, pool); \
+		CONTINUE; \
+	}
+
+COMPARISON(equal, ==)
+COMPARISON(not_equal, !=)
+COMPARISON(less_than, <)
+COMPARISON(greater_than, >)
+COMPARISON(less_or_equal, <=)
+COMPARISON(greater_or_equal, >=)
+
+/*
+ * Jumps if the value in a slot is zero, for conditions that are not comparisons
+ */
+int stencil_unless(int *frame, void **pool) {
+	if(!SLOT(HOLE_A)) return HOLE_Jump(frame, pool);
+	CONTINUE;
+}
+
+int stencil_jump(int *frame, void **pool) {
+	return HOLE_Jump(frame, pool);
+}
+
+int stencil_print(int *frame, void **pool) {
+	((void (*)(int))pool[POOL_JIT_PRINT])(SLOT(HOLE_A));
+	CONTINUE;
+}
+
+/*
+ * Calls a function, whose arguments are in consecutive slots starting with the
+ * one at hole_A. hole_Site is the offset of the call site's pool slots, the
+ * first of which holds the FNCall and the second the callee.
+ */
+int stencil_call(int *frame, void **pool) {
+	void **site = (void **)((char *)pool + (long)HOLE_Site);
+
+	SLOT(HOLE_Dest) = ((int (*)(void *, void *, void *, int *))
+		pool[POOL_JIT_CALL_FRAME])(site[0], site[1], pool[POOL_PROGRAM],
+			&SLOT(HOLE_A));
+	CONTINUE;
+}
+
+/*
+ * Returning from the function returns from the call made to the body in
+ * stencil_function()
+ */
+int stencil_return(int *frame, void **pool) {
+	return SLOT(HOLE_A);
+}
+
+int stencil_return_value(int *frame, void **pool) {
+	return VALUE;
+}
+
+int stencil_missing_return(int *frame, void **pool) {
+	((void (*)(void *))pool[POOL_JIT_MISSING_RETURN])(pool[POOL_FUNCTION]);
+	return 0;
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
+#include "../jitcode.h"
+#include "../ccode.h"
+
+int tests_run = 0;
+
+/*
+ * fibonacci overflows for the argument 50, which the C code must wrap around
+ * in the same way as the interpreter
+ */
+char *test_source =
+	"fn collatz(n) {"
+	"	steps <- 0;"
+	"	while n != 1 {"
+	"		if (n % 2) = 0 { n <- n / 2; } else { n <- (3 * n) + 1; }"
+	"		steps++;"
+	"	}"
+	"	return steps;"
+	"}"
+	"fn fibonacci(n) {"
+	"	a <- 0;"
+	"	b <- 1;"
+	"	for i <- 0, i < n, i++ { t <- a + b; a <- b; b <- t; }"
+	"	return a;"
+	"}"
+	"fn main() {"
+	"	t <- 0;"
+	"	for i <- 1, i < 100, i++ { t <- t + collatz((i % 50) + 1); }"
+	"	return t;"
+	"}";
+
+char *test_ccode_write() {
+	Program *prog = parse_test_program(test_source);
+
+	char *code;
+	size_t size;
+	FILE *out = open_memstream(&code, &size);
+	ccode_write(out, prog);
+	fclose(out);
+
+	// Each function has an entry point, named by its index in the program
+	mu_assert(strstr(code, "int " CCODE_ENTRY_PREFIX "0(int *args)") &&
+		strstr(code, "int " CCODE_ENTRY_PREFIX "2(int *args)") &&
+		!strstr(code, CCODE_ENTRY_PREFIX "3"),
+		"test_ccode_write failed: entry points");
+	mu_assert(strstr(code, "minty_divide(") && strstr(code, "minty_modulo("),
+		"test_ccode_write failed: division");
+
+	free(code);
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_ccode_tier() {
+	Program *prog = parse_test_program(test_source);
+	FNDecl *collatz = Program_get_FNDecl(prog, "collatz");
+	FNDecl *fibonacci = Program_get_FNDecl(prog, "fibonacci");
+	ccode_set_enabled(true);
+
+	// The last of these calls makes collatz hot enough to compile the program
+	int i;
+	for(i = 0; i < CCODE_THRESHOLD; i++) {
+		call_function(collatz, (i % 50) + 1, prog);
+	}
+	ccode_wait();
+	mu_assert(collatz->native && fibonacci->native,
+		"test_ccode_tier failed: not compiled");
+
+	// From then on, calls run the C compiler's code
+	mu_assert(call_function(collatz, 27, prog) == 111,
+		"test_ccode_tier failed: collatz");
+	mu_assert(call_function(fibonacci, 50, prog) == -298632863,
+		"test_ccode_tier failed: fibonacci");
+	mu_assert(run_test_program(prog) == 2132,
+		"test_ccode_tier failed: main");
+
+	// Releasing the program unloads its code
+	jitcode_release(prog);
+	mu_assert(!collatz->native, "test_ccode_tier failed: release");
+
+	ccode_set_enabled(false);
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_ccode_direct_calls() {
+	Program *prog = parse_test_program(
+		"fn fib(n) {"
+		"	if n < 2 { return n; } else { return fib(n - 1) + fib(n - 2); }"
+		"}");
+	FNDecl *fib = Program_get_FNDecl(prog, "fib");
+	ccode_set_enabled(true);
+
+	// The calls that compiled code makes directly to itself count towards the
+	// threshold, so a single call from the interpreter compiles the program
+	mu_assert(call_function(fib, 25, prog) == 75025,
+		"test_ccode_direct_calls failed: fib");
+	ccode_wait();
+	mu_assert(fib->native && *ccode_call_limit() == 0,
+		"test_ccode_direct_calls failed: not compiled");
+	mu_assert(call_function(fib, 20, prog) == 6765,
+		"test_ccode_direct_calls failed: native fib");
+
+	ccode_set_enabled(false);
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_ccode_disabled() {
+	Program *prog = parse_test_program(test_source);
+	FNDecl *collatz = Program_get_FNDecl(prog, "collatz");
+
+	int i;
+	for(i = 0; i < CCODE_THRESHOLD; i++) call_function(collatz, 7, prog);
+	ccode_wait();
+	mu_assert(!collatz->native, "test_ccode_disabled failed");
+
+	free_test_program(prog);
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_ccode_write);
+	mu_run_test(test_ccode_tier);
+	mu_run_test(test_ccode_direct_calls);
+	mu_run_test(test_ccode_disabled);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
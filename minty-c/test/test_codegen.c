@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <malloc.h>
 #include <unistd.h>
@@ -12,7 +13,8 @@
 #include "../codegen.h"
 
 /*
- * Macro that writes the given string to a file with a given name
+ * Macro that writes the given assembly code to a file with a given name. As in
+ * emit_program(), the code is marked as not needing an executable stack
  */
 #define WRITE(name, string) \
 	do { \
@@ -22,6 +24,7 @@
 			exit(EXIT_FAILURE); \
 		} \
 		fprintf(fp, "%s\n", string); \
+		fprintf(fp, "\n.section .note.GNU-stack,\"\",@progbits\n"); \
 		if(fclose(fp)) { \
 			printf("Error closing file: '"#name"'\n"); \
 			exit(EXIT_FAILURE); \
@@ -134,6 +137,46 @@ char *test_file_io() {
 	return NULL;
 }
 
+/*
+ * Tests that code written to an Emitter is collected in order, both in its
+ * buffer, which must grow to hold it, and in a stream
+ */
+char *test_emitter() {
+
+	// Write enough code to make the buffer grow several times
+	Emitter *out = Emitter_init(NULL);
+	int i;
+	for(i = 0; i < 1000; i++) emitf(out, "movl $%d, %%eax\n", i);
+	emit(out, "ret\n");
+	char *code = Emitter_finish(out);
+
+	mu_assert(str_equal(code + strlen(code) - 20, "movl $999, %eax\nret\n"),
+		"test_emitter failed");
+	mu_assert(strncmp(code, "movl $0, %eax\nmovl $1, %eax\n", 28) == 0,
+		"test_emitter failed");
+
+	// Formatted code longer than the formatting buffer is not truncated
+	char *long_name = safe_alloc(sizeof(char) * 301);
+	memset(long_name, 'f', 300);
+	long_name[300] = '\0';
+
+	FILE *stream = tmpfile();
+	out = Emitter_init(stream);
+	emitf(out, "call %s\n", long_name);
+	mu_assert(Emitter_finish(out) == NULL, "test_emitter failed");
+
+	char read[320];
+	rewind(stream);
+	mu_assert(fgets(read, sizeof(read), stream) && strlen(read) == 306 &&
+		read[304] == 'f', "test_emitter failed");
+	fclose(stream);
+
+	free(code);
+	free(long_name);
+
+	return NULL;
+}
+
 /*
  * Test that ternary expressions give the correct result
  */
@@ -157,9 +200,7 @@ char *test_ternary() {
 		".globl main\n"
 		"main:\n",
 		code,
-		"movl %eax, %ebx\n"
-		"movl $1, %eax\n"
-		"int $0x80\n"
+		"ret\n"
 	);
 	
 	// Write the assembly file to disk, assemble it, test that it gives the
@@ -214,15 +255,14 @@ char *test_large_expression() {
 		".globl main\n"
 		"main:\n",
 		expr_code,
-		"movl %eax, %ebx\n"
-		"movl $1, %eax\n"
-		"int $0x80\n"
+		"ret\n"
 	);
 
 	// Test the code in the way used previously
 	WRITE("test/large_expr.s", testable_code);
 	build("test/large_expr.s", "test/large_expr");
-	bool success = checked_run("test/large_expr", expected_value);
+	// Only the low 8 bits of the result survive as the exit status
+	bool success = checked_run("test/large_expr", expected_value & 0xFF);
 	REMOVE("test/large_expr");
 	REMOVE("test/large_expr.s");
 
@@ -262,27 +302,22 @@ char *test_fibonacci() {
 	char *asm_function = codegen_function(fn, prog);
 	
 	char *asm_prog = str_concat_2(
-		
+
+		".section .rodata\n"
+		"printf_str: .asciz \"%d\\n\"\n"
+		"missing_return_str: .asciz \"Error: reached end of function\"\n"
 		".text\n"
-		
-		"printf_str: .asciz \"%d\"\n"
-		"error_str: .asciz \"Error: reached end of function without return\"\n"
-		
+
 		".globl main\n"
 		"main:\n"
-			
-			// Set up stack to call fibonacci
-			"movl $6, %eax\n"
-			"pushl %eax\n"
-			"addl $4, %esp\n"
-			"movl %esp, %ebp\n"
-
-			"call fibonacci\n"
-			
-			// Exit system call with result as exit status
-			"movl %eax, %ebx\n"
-			"movl $1, %eax\n"
-			"int $0x80\n",
+
+			// Keep the stack aligned to call fibonacci, and return its result
+			// as the exit status
+			"subq $8, %rsp\n"
+			"movl $6, %edi\n"
+			"call minty_fibonacci\n"
+			"addq $8, %rsp\n"
+			"ret\n",
 
 		asm_function
 	);
@@ -304,11 +339,207 @@ char *test_fibonacci() {
 	return NULL;
 }
 
+char *test_for() {
+	LinkedList *tokens = lex(
+		"fn f() {"                                  "\n"
+		"	total <- 0;"                            "\n"
+		"	n <- 12;"                               "\n"
+		"	for i <- 0, i < 10, i++ {"              "\n"
+		"		total += i;"                        "\n"
+		"	}"                                      "\n"
+		"	for j <- 3, j <= n, j += 3 {"           "\n"
+		"		total += j;"                        "\n"
+		"	}"                                      "\n"
+		"	for k <- 0, (k * k) < 50, k++ {"        "\n"
+		"		total += 1;"                        "\n"
+		"	}"                                      "\n"
+		"}"
+	);
+
+	FNDecl *fn = parse_function(tokens);
+	Program *prog = Program_init(LinkedList_init_with(fn));
+	Program_generate_offsets(prog);
+
+	// The first two loops are counted loops, the last is not
+	char *stmts = codegen_statement_list(fn->stmts, prog);
+	char *result = safe_alloc(sizeof(char) * 40);
+	sprintf(result, "movl %d(%%rbp), %%eax\n", ((Statement *)LinkedList_get(
+		fn->stmts, 0))->stmt->_assignment->ident->expr->ident->stack_offset);
+
+	char *testable_code = str_concat(4,
+		".globl main\n"
+		"main:\n"
+		"pushq %rbp\n"
+		"subq $64, %rsp\n"
+		"movq %rsp, %rbp\n",
+		stmts,
+		result,
+		"addq $64, %rsp\n"
+		"popq %rbp\n"
+		"ret\n"
+	);
+
+	WRITE("test/for.s", testable_code);
+	build("test/for.s", "test/for");
+	bool success = checked_run("test/for", 45 + 30 + 8);
+	REMOVE("test/for");
+	REMOVE("test/for.s");
+
+	free(stmts);
+	free(result);
+	free(testable_code);
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+
+	mu_assert(success, "test_for failed");
+
+	return NULL;
+}
+
+/*
+ * Tests that a whole program compiled ahead of time can be linked into an
+ * executable that takes its arguments from the command line and prints its
+ * result, with calls passing arguments both in registers and on the stack
+ */
+char *test_program() {
+	LinkedList *tokens = lex(
+		"fn main(a, b) {"                                    "\n"
+		"	total <- 0;"                                     "\n"
+		"	for i <- 0, i < a, i++ {"                        "\n"
+		"		total += sum(i, b, 1, 2, 3, 4, 5, 6);"       "\n"
+		"	}"                                               "\n"
+		"	print total;"                                    "\n"
+		"	return total - odd(b, 2, 3, 4, 5, 6, 7);"        "\n"
+		"}"                                                  "\n"
+		"fn sum(a, b, c, d, e, f, g, h) {"                   "\n"
+		"	return a + (b + (c + (d + (e + (f + (g - h))))));" "\n"
+		"}"                                                  "\n"
+		"fn odd(a, b, c, d, e, f, g) {"                      "\n"
+		"	return (a * g) + (f - (e + (d * (c - b))));"     "\n"
+		"}"
+	);
+	Program *prog = parse_program(tokens);
+
+	FILE *stream = fopen("test/program.s", "w");
+	Emitter *out = Emitter_init(stream);
+	emit_program(out, prog);
+	Emitter_finish(out);
+	fclose(stream);
+	build("test/program.s", "test/program");
+
+	// sum(i, b, ...) is i + b + 9 and odd(b, ...) is 7b - 3, so the program
+	// prints 4b + 42, then that minus 7b - 3
+	char output[64];
+	FILE *run = popen("./test/program 4 10", "r");
+	size_t len = fread(output, 1, sizeof(output) - 1, run);
+	output[len] = '\0';
+	bool success = pclose(run) == 0 && str_equal(output, "82\n15\n");
+
+	run = popen("./test/program 4 0", "r");
+	len = fread(output, 1, sizeof(output) - 1, run);
+	output[len] = '\0';
+	success = success && pclose(run) == 0 && str_equal(output, "42\n45\n");
+
+	// Like the interpreter, the program must be given the right number of
+	// arguments
+	run = popen("./test/program 4", "r");
+	len = fread(output, 1, sizeof(output) - 1, run);
+	output[len] = '\0';
+	success = success && pclose(run) != 0 &&
+		str_equal(output, "Function: 'main' takes 2 arguments, 1 given");
+
+	REMOVE("test/program");
+	REMOVE("test/program.s");
+
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+
+	mu_assert(success, "test_program failed");
+
+	return NULL;
+}
+
+/*
+ * Generates the code for a program with the given source code, on the given
+ * number of threads
+ */
+char *generate_program(char *source, int threads) {
+	LinkedList *tokens = lex(source);
+	Program *prog = parse_program(tokens);
+
+	codegen_set_threads(threads);
+	char *code = codegen_program(prog);
+	codegen_set_threads(1);
+
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	return code;
+}
+
+char *test_parallel() {
+
+	// A program with enough functions to keep every thread busy
+	char *source = str_concat_2("", "fn main(n) { return f0(n); }");
+	int i;
+	for(i = 0; i < 40; i++) {
+		char func[128];
+		char ret[16];
+		if(i < 39) sprintf(ret, "f%d(n + 1)", i + 1);
+		else sprintf(ret, "n");
+		sprintf(func,
+			"fn f%d(n) {"
+			"	while n > %d { n <- n - 1; }"
+			"	return %s;"
+			"}", i, i, ret);
+
+		char *next = str_concat_2(source, func);
+		free(source);
+		source = next;
+	}
+
+	// Each function is generated on its own, so the code must not depend on
+	// how many threads there are
+	char *serial = generate_program(source, 1);
+	char *parallel = generate_program(source, 4);
+	bool success = str_equal(serial, parallel);
+
+	free(source);
+	free(serial);
+	free(parallel);
+	mu_assert(success, "test_parallel failed: code differs");
+
+	// Labels are numbered separately for each Emitter
+	LinkedList *tokens = lex("fn f(n) { while n > 0 { n <- n - 1; } }");
+	Program *prog = parse_program(tokens);
+	Program_generate_offsets(prog);
+	Statement *stmt = (Statement *)LinkedList_get(
+		((FNDecl *)LinkedList_get(prog->function_list, 0))->stmts, 0);
+	char *first = codegen_statement(stmt, prog);
+	char *second = codegen_statement(stmt, prog);
+	success = str_equal(first, second) && strstr(first, "while_begin_0:");
+
+	free(first);
+	free(second);
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	mu_assert(success, "test_parallel failed: labels");
+
+	return NULL;
+}
+
 char *all_tests() {
 	mu_run_test(test_file_io);
+	mu_run_test(test_emitter);
 	mu_run_test(test_ternary);
 	mu_run_test(test_large_expression);
+	mu_run_test(test_for);
 	mu_run_test(test_fibonacci);
+	mu_run_test(test_program);
+	mu_run_test(test_parallel);
 
 	return NULL;
 }
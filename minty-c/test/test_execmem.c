@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include "minunit.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
+#include "../jitcode.h"
+#include "../execmem.h"
+
+int tests_run = 0;
+
+/*
+ * Finds the permissions of the mapping containing the given address in
+ * /proc/self/maps, writing them (e.g. "r-xs") into perms. Returns false if
+ * there is no such mapping.
+ */
+bool mapping_permissions(void *address, char *perms) {
+	FILE *maps = fopen("/proc/self/maps", "r");
+	char line[512];
+	bool found = false;
+
+	while(!found && fgets(line, sizeof(line), maps)) {
+		unsigned long start, end;
+		sscanf(line, "%lx-%lx %4s", &start, &end, perms);
+		found = (unsigned long)address >= start && (unsigned long)address < end;
+	}
+	fclose(maps);
+
+	return found;
+}
+
+/*
+ * Checks that no mapping in the process is both writable and executable
+ */
+bool no_writable_code() {
+	FILE *maps = fopen("/proc/self/maps", "r");
+	char line[512];
+	bool found = false;
+
+	while(!found && fgets(line, sizeof(line), maps)) {
+		unsigned long start, end;
+		char perms[5];
+		sscanf(line, "%lx-%lx %4s", &start, &end, perms);
+		found = perms[1] == 'w' && perms[2] == 'x';
+		if(found) printf("%s", line);
+	}
+	fclose(maps);
+
+	return !found;
+}
+
+char *test_execmem_copy() {
+
+	byte code[] = {
+
+		// movl $42, %eax
+		0xB8, 0x2A, 0x00, 0x00, 0x00,
+
+		// ret
+		0xC3
+	};
+
+	// The code should run from a mapping that can not be written to
+	int (*function)() = execmem_copy(code, sizeof(code));
+	mu_assert(function() == 42, "test_execmem_copy failed");
+
+	char perms[5];
+	mu_assert(mapping_permissions(function, perms), "test_execmem_copy failed");
+	mu_assert(str_equal(perms, "r-xs"), "test_execmem_copy failed");
+	mu_assert(no_writable_code(), "test_execmem_copy failed");
+
+	execmem_free(function, sizeof(code));
+
+	return NULL;
+}
+
+char *test_execmem_views() {
+
+	// Code written through the writable view should appear in the executable
+	// view straight away
+	void *writable;
+	byte *executable = execmem_alloc(6, false, NULL, &writable);
+	memcpy(writable, (byte []){0xB8, 0x07, 0x00, 0x00, 0x00, 0xC3}, 6);
+	mu_assert(((int (*)())executable)() == 7, "test_execmem_views failed");
+
+	((byte *)writable)[1] = 0x09;
+	mu_assert(executable[1] == 0x09, "test_execmem_views failed");
+	mu_assert(((int (*)())executable)() == 9, "test_execmem_views failed");
+
+	execmem_free(executable, 6);
+
+	return NULL;
+}
+
+char *test_execmem_placement() {
+	void *writable;
+	char perms[5];
+
+	// Chunks are aligned so that they can be backed by huge pages
+	byte *a = execmem_alloc(100, false, NULL, &writable);
+	mu_assert((unsigned long)a % EXECMEM_CHUNK_SIZE == 0,
+		"test_execmem_placement failed");
+
+	// Allocations are packed together, only rounded up to the alignment
+	byte *b = execmem_alloc(20, false, NULL, &writable);
+	byte *c = execmem_alloc(30, false, NULL, &writable);
+	mu_assert(b == a + execmem_size(100) && c == b + execmem_size(20),
+		"test_execmem_placement failed");
+	mu_assert(execmem_size(20) == 32, "test_execmem_placement failed");
+
+	// Freed space is reused by the first allocation that fits, unless the
+	// allocation is meant to be near some other code
+	execmem_free(b, 20);
+	byte *d = execmem_alloc(10, false, c + 32, &writable);
+	mu_assert(d == c + 32, "test_execmem_placement failed");
+	byte *e = execmem_alloc(10, false, NULL, &writable);
+	mu_assert(e == b, "test_execmem_placement failed");
+
+	// Cold code goes in a chunk of its own
+	byte *cold = execmem_alloc(10, true, NULL, &writable);
+	mu_assert(cold < a || cold >= a + EXECMEM_CHUNK_SIZE,
+		"test_execmem_placement failed");
+
+	// Code that does not fit in a chunk gets a larger chunk
+	byte *large = execmem_alloc(EXECMEM_CHUNK_SIZE + 1, false, NULL,
+		&writable);
+	memset(writable, 0xC3, EXECMEM_CHUNK_SIZE + 1);
+	mu_assert(large[EXECMEM_CHUNK_SIZE] == 0xC3,
+		"test_execmem_placement failed");
+
+	// A chunk is unmapped once all its code has been freed, unless it is the
+	// last of its kind
+	execmem_free(large, EXECMEM_CHUNK_SIZE + 1);
+	mu_assert(!mapping_permissions(large, perms),
+		"test_execmem_placement failed");
+	execmem_free(a, 100);
+	execmem_free(c, 30);
+	execmem_free(d, 10);
+	execmem_free(e, 10);
+	execmem_free(cold, 10);
+	mu_assert(mapping_permissions(a, perms), "test_execmem_placement failed");
+
+	// The first chunk is then used again
+	mu_assert(execmem_alloc(10, false, NULL, &writable) == a,
+		"test_execmem_placement failed");
+	execmem_free(a, 10);
+
+	return NULL;
+}
+
+char *test_execmem_jit() {
+
+	LinkedList *tokens = lex("                          \
+		fn main() {                                     \
+			total <- 0;                                 \
+			for i <- 0, i < 100, i++ {                  \
+				total += square(i);                     \
+			}                                           \
+			return total;                               \
+		}                                               \
+		fn square(x) {                                  \
+			return x * x;                               \
+		}");
+	Program *prog = parse_program(tokens);
+
+	// Every tier of the JIT compiler should be used without ever mapping
+	// memory that is both writable and executable
+	LinkedList *args = LinkedList_init();
+	mu_assert(interpret_program(prog, args) == 328350,
+		"test_execmem_jit failed");
+	mu_assert(Program_get_FNDecl(prog, "square")->compiled,
+		"test_execmem_jit failed");
+	mu_assert(no_writable_code(), "test_execmem_jit failed");
+
+	LinkedList_free(args);
+	jitcode_release(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_execmem_copy);
+	mu_run_test(test_execmem_views);
+	mu_run_test(test_execmem_placement);
+	mu_run_test(test_execmem_jit);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
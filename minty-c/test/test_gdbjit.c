@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <string.h>
+#include <elf.h>
+#include "minunit.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../jitcode.h"
+#include "../gdbjit.h"
+
+int tests_run = 0;
+
+char *test_gdbjit_register() {
+	LinkedList *tokens = lex(
+		"fn count(n) {\n"
+		"	total <- 0;\n"
+		"	while n > 0 {\n"
+		"		total += n;\n"
+		"		n--;\n"
+		"	}\n"
+		"	return total;\n"
+		"}\n");
+	Program *prog = parse_program(tokens);
+	FNDecl *count = Program_get_FNDecl(prog, "count");
+
+	// The parser should have recorded the source lines
+	mu_assert(count->line == 1, "test_gdbjit_register failed");
+	Statement *loop = (Statement *)LinkedList_get(count->stmts, 1);
+	mu_assert(loop->line == 3, "test_gdbjit_register failed");
+
+	// Compiling the function registers an ELF object describing it with gdb
+	gdbjit_set_source("count.minty");
+	JITFunction *jf = jitcompile_function(count, prog);
+	mu_assert(jf->debug_entry != NULL, "test_gdbjit_register failed");
+	mu_assert(__jit_debug_descriptor.first_entry == jf->debug_entry,
+		"test_gdbjit_register failed");
+	mu_assert(__jit_debug_descriptor.action_flag == JIT_REGISTER_FN,
+		"test_gdbjit_register failed");
+
+	const char *elf = jf->debug_entry->symfile_addr;
+	mu_assert(!memcmp(elf, ELFMAG, SELFMAG), "test_gdbjit_register failed");
+
+	// The .text section should be placed at the code
+	Elf64_Ehdr *ehdr = (Elf64_Ehdr *)elf;
+	Elf64_Shdr *shdrs = (Elf64_Shdr *)(elf + ehdr->e_shoff);
+	mu_assert(shdrs[1].sh_addr == (uint64_t)jf->code,
+		"test_gdbjit_register failed");
+	mu_assert(shdrs[1].sh_size == jf->len, "test_gdbjit_register failed");
+
+	// The function's symbol should be named and cover the code
+	Elf64_Sym *symbols = (Elf64_Sym *)(elf + shdrs[2].sh_offset);
+	const char *strtab = elf + shdrs[3].sh_offset;
+	mu_assert(str_equal((char *)strtab + symbols[2].st_name, "minty:count"),
+		"test_gdbjit_register failed");
+	mu_assert(symbols[2].st_size == jf->len, "test_gdbjit_register failed");
+
+	// Freeing the code unregisters it
+	JITFunction_free(jf);
+	mu_assert(__jit_debug_descriptor.first_entry == NULL,
+		"test_gdbjit_register failed");
+	mu_assert(__jit_debug_descriptor.action_flag == JIT_UNREGISTER_FN,
+		"test_gdbjit_register failed");
+
+	gdbjit_set_source(NULL);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_gdbjit_register);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
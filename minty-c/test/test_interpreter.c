@@ -1,12 +1,15 @@
 #include <stdio.h>
 #include <malloc.h>
 #include "minunit.h"
+#include "test_util.h"
 #include "../minty_util.h"
 #include "../token.h"
 #include "../lexer.h"
 #include "../AST.h"
 #include "../parser.h"
+#include "../optimiser.h"
 #include "../interpreter.h"
+#include "../jitcode.h"
 
 int tests_run = 0;
 
@@ -183,6 +186,7 @@ char *test_fibonacci() {
 	LinkedList_free(arg4);
 	LinkedList_free(arg5);
 	LinkedList_free(arg20);
+	jitcode_release(prog);
 	Program_free(prog);
 
 	return NULL;
@@ -209,6 +213,347 @@ char *test_while() {
 		Token_free(LinkedList_get(prog_tokens, i));
 	LinkedList_free(args);
 	LinkedList_free(prog_tokens);
+	jitcode_release(prog);
+	Program_free(prog);
+
+	return NULL;
+}
+
+/*
+ * Tests that a function called repeatedly with the same value is compiled with
+ * a specialisation for that value, and that calls with other values still give
+ * the correct result. The value is returned by a function, rather than passed
+ * as a literal, so that it is not propagated into the function before it runs.
+ */
+char *test_specialisation() {
+
+	LinkedList *prog_tokens = lex("       \
+		fn main(x) {                      \
+			return count_down(ten(), x);  \
+		}                                 \
+		fn ten() { return 10; }           \
+		fn count_down(limit, x) {         \
+			n <- 0;                       \
+			while n < limit {             \
+				n++;                      \
+			}                             \
+			return n + x;                 \
+		}");
+	Program *prog = parse_program(prog_tokens);
+	FNDecl *count_down = Program_get_FNDecl(prog, "count_down");
+
+	int i;
+	for(i = 0; i < JIT_THRESHOLD * 2; i++) {
+		LinkedList *args = LinkedList_init_with((void *)(long)i);
+		mu_assert(interpret_program(prog, args) == 10 + i,
+			"test_specialisation failed!");
+		LinkedList_free(args);
+	}
+
+	// count_down should have been compiled, specialised to limit = 10
+	mu_assert(count_down->compiled != NULL, "test_specialisation failed!");
+	mu_assert(count_down->specialised != NULL, "test_specialisation failed!");
+	mu_assert(count_down->specialised->guarded[0] &&
+		!count_down->specialised->guarded[1], "test_specialisation failed!");
+
+	// A call with a different limit must fail the guard and fall back
+	LinkedList *arg_vals = LinkedList_init();
+	LinkedList_append(arg_vals, (void *)5);
+	LinkedList_append(arg_vals, (void *)1);
+	mu_assert(interpret_function(count_down, arg_vals, prog) == 6,
+		"test_specialisation failed!");
+	mu_assert(count_down->specialised->guard_failures == 1,
+		"test_specialisation failed!");
+
+	// Free things
+	LLMAP(prog_tokens, Token *, Token_free);
+	LinkedList_free(arg_vals);
+	LinkedList_free(prog_tokens);
+	jitcode_release(prog);
+	Program_free(prog);
+
+	return NULL;
+}
+
+/*
+ * Tests that calls to pure functions in loop conditions are hoisted out of the
+ * loops, and that calls to functions that print, or whose arguments change in
+ * the loop, are not
+ */
+char *test_loop_invariants() {
+
+	LinkedList *prog_tokens = lex("                    \
+		fn main() {                                    \
+			total <- 0;                                \
+			n <- 0;                                    \
+			while n < limit() * 2 {                    \
+				n++;                                   \
+			}                                          \
+			for i <- 0, i < loud_limit(), i++ {        \
+				total += i;                            \
+			}                                          \
+			for i <- 0, i < (half(n) + limit()), i++ { \
+				total += half(i);                      \
+			}                                          \
+			while total > half(total) {                \
+				total -= 100;                          \
+			}                                          \
+			return total + n;                          \
+		}                                              \
+		fn limit() { return 5; }                       \
+		fn loud_limit() { print 3; return 3; }         \
+		fn half(x) { return x / 2; }");
+	Program *prog = parse_program(prog_tokens);
+	LinkedList *args = LinkedList_init();
+
+	mu_assert(interpret_program(prog, args) == -67,
+		"test_loop_invariants failed!");
+
+	// Only the functions that print are impure
+	mu_assert(Program_get_FNDecl(prog, "limit")->pure &&
+		Program_get_FNDecl(prog, "half")->pure &&
+		!Program_get_FNDecl(prog, "loud_limit")->pure,
+		"test_loop_invariants failed!");
+
+	// limit() is called once by each loop that uses it, loud_limit() on every
+	// iteration, and half() is only hoisted where its argument is invariant
+	mu_assert(Program_get_FNDecl(prog, "limit")->exec_count == 2,
+		"test_loop_invariants failed!");
+	mu_assert(Program_get_FNDecl(prog, "loud_limit")->exec_count == 4,
+		"test_loop_invariants failed!");
+	mu_assert(Program_get_FNDecl(prog, "half")->exec_count == 1 + 10 + 2,
+		"test_loop_invariants failed!");
+
+	// Free things
+	LLMAP(prog_tokens, Token *, Token_free);
+	LinkedList_free(args);
+	LinkedList_free(prog_tokens);
+	jitcode_release(prog);
+	Program_free(prog);
+
+	return NULL;
+}
+
+/*
+ * Returns the statement at the given position in a list of statements
+ */
+Statement *stmt_at(LinkedList *stmts, int index) {
+	return (Statement *)LinkedList_get(stmts, index);
+}
+
+/*
+ * Tests that counting loops are evaluated in closed form, giving the results
+ * that the loops would have given, and that loops whose values are too large
+ * to rule out overflow still run as before
+ */
+char *test_closed_form() {
+
+	LinkedList *prog_tokens = lex("                    \
+		fn main(n) {                                   \
+			a <- 104;                                  \
+			while a > 5 {                              \
+				a -= 5;                                \
+			}                                          \
+			total <- 0;                                \
+			for i <- a, i < n, i++ {                   \
+				total += (i * 3) + n;                  \
+			}                                          \
+			b <- 1000;                                 \
+			low <- 0;                                  \
+			high <- 0;                                 \
+			while b >= n {                             \
+				low -= b;                              \
+				b -= step();                           \
+				high += b * 2;                         \
+			}                                          \
+			c <- 600000000;                            \
+			while c > 0 {                              \
+				c -= 100000000;                        \
+			}                                          \
+			return (total * 100000) + high + low + c;  \
+		}                                              \
+		fn step() { return 3; }");
+	Program *prog = parse_program(prog_tokens);
+	LinkedList *args = LinkedList_init_with((void *)50);
+
+	// a counts down to 4, then total adds up (i * 3) + 50 for i from 4 to 49,
+	// and b counts down from 1000 to 49 in 317 steps
+	unsigned int total = (3 * (4 + 49) * 46) / 2 + (46 * 50);
+	unsigned int low = -((1000 + 52) * 317 / 2);
+	unsigned int high = (997 + 49) * 317;
+	mu_assert(interpret_program(prog, args) ==
+		(int)(total * 100000 + high + low), "test_closed_form failed!");
+
+	// The bodies of the counting loops never run, and step() is only called
+	// once, but c is too large to rule out overflow, so its loop still runs
+	FNDecl *main_func = Program_get_FNDecl(prog, "main");
+	int closed = 0, i;
+	for(i = 0; i < LinkedList_length(main_func->stmts); i++) {
+		Statement *stmt = stmt_at(main_func->stmts, i);
+		if(stmt->type == stmt_While &&
+			stmt_at(stmt->stmt->_while->stmts, 0)->exec_count == 0) closed++;
+		if(stmt->type == stmt_For &&
+			stmt_at(stmt->stmt->_for->stmts, 0)->exec_count == 0) closed++;
+	}
+	mu_assert(closed == 3, "test_closed_form failed!");
+	mu_assert(Program_get_FNDecl(prog, "step")->exec_count == 1,
+		"test_closed_form failed!");
+
+	// Free things
+	LLMAP(prog_tokens, Token *, Token_free);
+	LinkedList_free(args);
+	LinkedList_free(prog_tokens);
+	jitcode_release(prog);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *test_counted_for() {
+
+	LinkedList *prog_tokens = lex("                    \
+		fn main(n) {                                   \
+			total <- 0;                                \
+			for i <- 0, i < n, i++ {                   \
+				sq <- i * i;                           \
+				if (i % 3) = 0 {                       \
+					total += sq;                       \
+				}                                      \
+				else {                                 \
+					total -= i;                        \
+				}                                      \
+			}                                          \
+			for j <- 1, j <= n, j += 4 {               \
+				for k <- j, k < 12, k += 5 {           \
+					total += j * k;                    \
+				}                                      \
+			}                                          \
+			for m <- 0, m < 100, m++ {                 \
+				if (m * m) > n {                       \
+					return (total * 1000) + i + j + m; \
+				}                                      \
+				else {}                                \
+			}                                          \
+			for x <- 0, x < n, x++ {                   \
+				n -= 1;                                \
+			}                                          \
+			return 0;                                  \
+		}");
+	Program *prog = parse_program(prog_tokens);
+	LinkedList *stmts = Program_get_FNDecl(prog, "main")->stmts;
+	int step;
+
+	// Only the last loop changes its limit, so it can not be run natively
+	mu_assert(For_is_counted(stmt_at(stmts, 1)->stmt->_for, &step) &&
+		step == 1, "test_counted_for failed!");
+	mu_assert(For_is_counted(stmt_at(stmts, 2)->stmt->_for, &step) &&
+		step == 4, "test_counted_for failed!");
+	mu_assert(For_is_counted(stmt_at(stmts, 3)->stmt->_for, &step),
+		"test_counted_for failed!");
+	mu_assert(!For_is_counted(stmt_at(stmts, 4)->stmt->_for, &step),
+		"test_counted_for failed!");
+
+	// The counters are left at the values that ended their loops, including
+	// when the first loop is run by a compiled trace, and the variables created
+	// in the loop bodies are removed after every iteration
+	LinkedList *args = LinkedList_init_with((void *)40);
+	mu_assert(interpret_program(prog, args) == 7038088,
+		"test_counted_for failed!");
+
+	// Free things
+	LLMAP(prog_tokens, Token *, Token_free);
+	LinkedList_free(args);
+	LinkedList_free(prog_tokens);
+	jitcode_release(prog);
+	Program_free(prog);
+
+	return NULL;
+}
+
+/*
+ * Tests that constant arguments are propagated into the functions they are
+ * passed to, that functions called with differing constants are cloned, and
+ * that functions main never calls are removed
+ */
+char *test_constant_propagation() {
+
+	LinkedList *prog_tokens = lex("                      \
+		fn main(n) {                                     \
+			total <- scale(3, n) + scale(3, 1);          \
+			total += pad(n, 1) + pad(n, 2) + pad(n, 2);  \
+			return total + sum_to(n, 2);                 \
+		}                                                \
+		fn scale(factor, x) { return factor * x; }       \
+		fn pad(x, width) { return (x * 10) + width; }    \
+		fn sum_to(n, step) {                             \
+			if n < 1 {                                   \
+				return 0;                                \
+			}                                            \
+			else {                                       \
+				return step + sum_to(n - 1, step);       \
+			}                                            \
+		}                                                \
+		fn unused(x) { return x; }");
+	Program *prog = parse_program(prog_tokens);
+	LinkedList *args = LinkedList_init_with((void *)4);
+
+	mu_assert(interpret_program(prog, args) == 15 + 125 + 8,
+		"test_constant_propagation failed!");
+
+	// The arguments that are always the same are removed, including one that a
+	// recursive call passes on
+	mu_assert(LinkedList_length(Program_get_FNDecl(prog, "scale")->args) == 1,
+		"test_constant_propagation failed!");
+	mu_assert(LinkedList_length(Program_get_FNDecl(prog, "sum_to")->args) == 1,
+		"test_constant_propagation failed!");
+
+	// pad is replaced by a clone for each width, and unused is removed
+	FNDecl *pad_1 = Program_get_FNDecl(prog, "pad.constprop.0");
+	FNDecl *pad_2 = Program_get_FNDecl(prog, "pad.constprop.1");
+	mu_assert(LinkedList_length(pad_1->args) == 1 && pad_1->exec_count == 1 &&
+		LinkedList_length(pad_2->args) == 1 && pad_2->exec_count == 2,
+		"test_constant_propagation failed!");
+	mu_assert(!has_function(prog, "pad") && !has_function(prog, "unused"),
+		"test_constant_propagation failed!");
+
+	// Free things
+	LLMAP(prog_tokens, Token *, Token_free);
+	LinkedList_free(args);
+	LinkedList_free(prog_tokens);
+	jitcode_release(prog);
+	Program_free(prog);
+
+	return NULL;
+}
+
+/*
+ * Tests constant propagation into a function that calls itself inside both
+ * branches of a ternary with a constant condition, whose unchosen branch is
+ * freed when the arguments of the outer call are folded
+ */
+char *test_propagation_folds_ternary() {
+
+	LinkedList *prog_tokens = lex("                                   \
+		fn f2(a, b) {                                                 \
+			if a < 1 {                                                \
+				return b;                                             \
+			}                                                         \
+			else {                                                    \
+				return f2(a - 1, (13 > 9 ? f2(0, b) : f2(8, a)));     \
+			}                                                         \
+		}                                                             \
+		fn main(n) { return f2(n, 5); }");
+	Program *prog = parse_program(prog_tokens);
+	LinkedList *args = LinkedList_init_with((void *)3);
+
+	mu_assert(interpret_program(prog, args) == 5,
+		"test_propagation_folds_ternary failed!");
+
+	// Free things
+	LLMAP(prog_tokens, Token *, Token_free);
+	LinkedList_free(args);
+	LinkedList_free(prog_tokens);
+	jitcode_release(prog);
 	Program_free(prog);
 
 	return NULL;
@@ -222,6 +567,12 @@ char *all_tests() {
 	mu_run_test(test_print);
 	mu_run_test(test_fibonacci);
 	mu_run_test(test_while);
+	mu_run_test(test_specialisation);
+	mu_run_test(test_loop_invariants);
+	mu_run_test(test_closed_form);
+	mu_run_test(test_counted_for);
+	mu_run_test(test_constant_propagation);
+	mu_run_test(test_propagation_folds_ternary);
 	
 	return NULL;
 }
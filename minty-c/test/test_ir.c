@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "minunit.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../ir.h"
+
+int tests_run = 0;
+
+typedef void (*ir_pass)(IRFunction *);
+
+/*
+ * Builds the SSA form of the first function in the given source code, runs
+ * each pass in the NULL terminated array passes over it in turn, and returns
+ * true if it is then printed as expected
+ */
+bool ir_matches(char *source, ir_pass *passes, char *expected) {
+	LinkedList *tokens = lex(source);
+	Program *prog = parse_program(tokens);
+	FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, 0);
+
+	IRFunction *ir = IRFunction_build(func, true);
+	while(*passes) (*passes++)(ir);
+
+	char *str = IRFunction_str(ir);
+	bool matches = str_equal(str, expected);
+	if(!matches) printf("%s", str);
+
+	free(str);
+	IRFunction_free(ir);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return matches;
+}
+
+char *test_build() {
+	ir_pass passes[] = {NULL};
+
+	// The if statement's branches should meet at a phi for y, and the end of
+	// the function is left unreachable by the return
+	mu_assert(ir_matches(
+		"fn f(x) {"
+		"	y <- x + 1;"
+		"	if x < y { y <- y * 2; } else { y <- 0; }"
+		"	return y;"
+		"}", passes,
+		"fn f\n"
+		"b0:\n"
+		"  v0 = undefined\n"
+		"  v1 = argument 0\n"
+		"  v2 = 1\n"
+		"  v3 = v1 PLUS v2\n"
+		"  v4 = v1 LESS_THAN v3\n"
+		"  branch v4, b1, b2\n"
+		"b1: <- b0\n"
+		"  v5 = 2\n"
+		"  v6 = v3 MULTIPLY v5\n"
+		"  jump b3\n"
+		"b2: <- b0\n"
+		"  v7 = 0\n"
+		"  jump b3\n"
+		"b3: <- b1, b2\n"
+		"  v8 = phi(v6, v7)\n"
+		"  return v8\n"
+		"b4:\n"
+		"  missing return\n"), "test_build failed");
+
+	return NULL;
+}
+
+char *test_sccp() {
+	ir_pass passes[] = {ir_sccp, ir_dce, NULL};
+
+	// x stays 5 around the loop, so its phi becomes a constant, the if
+	// statement always takes its first branch and the other is removed
+	mu_assert(ir_matches(
+		"fn f(n) {"
+		"	x <- 5;"
+		"	i <- 0;"
+		"	while i < n { x <- x * 1; i++; }"
+		"	if x = 5 { return x + i; } else { return 0; }"
+		"}", passes,
+		"fn f\n"
+		"b0:\n"
+		"  v1 = argument 0\n"
+		"  v3 = 0\n"
+		"  jump b1\n"
+		"b1: <- b0, b2\n"
+		"  v4 = phi(v3, v11)\n"
+		"  v7 = 5\n"
+		"  v6 = v4 LESS_THAN v1\n"
+		"  branch v6, b2, b3\n"
+		"b2: <- b1\n"
+		"  v10 = 1\n"
+		"  v11 = v4 PLUS v10\n"
+		"  jump b1\n"
+		"b3: <- b1\n"
+		"  v14 = v7 PLUS v4\n"
+		"  return v14\n"), "test_sccp failed");
+
+	return NULL;
+}
+
+char *test_cse() {
+	ir_pass passes[] = {ir_sccp, ir_cse, ir_dce, NULL};
+
+	// Addition is commutative, so 1 + x is the same as x + 1
+	mu_assert(ir_matches(
+		"fn f(x) { a <- x + 1; b <- 1 + x; return a * b; }", passes,
+		"fn f\n"
+		"b0:\n"
+		"  v1 = argument 0\n"
+		"  v2 = 1\n"
+		"  v3 = v1 PLUS v2\n"
+		"  v6 = v3 MULTIPLY v3\n"
+		"  return v6\n"), "test_cse failed");
+
+	return NULL;
+}
+
+char *test_gvn() {
+	ir_pass passes[] = {ir_sccp, ir_gvn, ir_dce, NULL};
+
+	// i and j are always equal, which only global value numbering can see as
+	// it requires assuming that their phis are equal before proving it
+	mu_assert(ir_matches(
+		"fn f(n) { i <- 0; j <- 0; while i < n { i++; j++; } return j; }",
+		passes,
+		"fn f\n"
+		"b0:\n"
+		"  v1 = argument 0\n"
+		"  v2 = 0\n"
+		"  jump b1\n"
+		"b1: <- b0, b2\n"
+		"  v4 = phi(v2, v8)\n"
+		"  v6 = v4 LESS_THAN v1\n"
+		"  branch v6, b2, b3\n"
+		"b2: <- b1\n"
+		"  v7 = 1\n"
+		"  v8 = v4 PLUS v7\n"
+		"  jump b1\n"
+		"b3: <- b1\n"
+		"  return v4\n"), "test_gvn failed");
+
+	return NULL;
+}
+
+char *test_dce() {
+	ir_pass passes[] = {ir_sccp, ir_dce, NULL};
+
+	// The unused multiplication is removed, but not the division, as it would
+	// fail if x were zero
+	mu_assert(ir_matches(
+		"fn f(x) { y <- 10 / x; z <- x * 3; return 1; }", passes,
+		"fn f\n"
+		"b0:\n"
+		"  v1 = argument 0\n"
+		"  v2 = 10\n"
+		"  v3 = v2 DIVIDE v1\n"
+		"  v6 = 1\n"
+		"  return v6\n"), "test_dce failed");
+
+	return NULL;
+}
+
+/*
+ * Builds and optimises the SSA form of the first function in the given source
+ * code in the same way as the ahead-of-time compilers, after giving its calls
+ * the given profile counts in the order of FNDecl_call_sites() and its first
+ * statement the given counts, and returns true if it is then printed as
+ * expected
+ */
+bool profiled_ir_matches(char *source, int *call_counts, int exec_count,
+	int taken_count, char *expected) {
+
+	LinkedList *tokens = lex(source);
+	Program *prog = parse_program(tokens);
+	FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, 0);
+
+	LinkedList *sites = FNDecl_call_sites(func);
+	int i;
+	for(i = 0; i < LinkedList_length(sites); i++) {
+		((FNCall *)LinkedList_get(sites, i))->exec_count = call_counts[i];
+	}
+	LinkedList_free(sites);
+	Statement *stmt = (Statement *)LinkedList_get(func->stmts, 0);
+	stmt->exec_count = exec_count;
+	stmt->taken_count = taken_count;
+
+	IRFunction *ir = IRFunction_build(func, true);
+	ir_sccp(ir);
+	ir_gvn(ir);
+	ir_dce(ir);
+	ir_inline_calls(ir, prog);
+	ir_layout(ir);
+
+	char *str = IRFunction_str(ir);
+	bool matches = str_equal(str, expected);
+	if(!matches) printf("%s", str);
+
+	free(str);
+	IRFunction_free(ir);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return matches;
+}
+
+char *test_inline() {
+	int counts[] = {10, 5, 0};
+
+	// The calls that were made are inlined, and the one with a constant
+	// argument folds away completely, but the one that was never made is left
+	mu_assert(profiled_ir_matches(
+		"fn f(x) { return sq(x + 1) + (sq(3) + sq(x)); }"
+		"fn sq(y) { return y * y; }", counts, 0, 0,
+		"fn f\n"
+		"b0:\n"
+		"  v1 = argument 0\n"
+		"  v2 = 1\n"
+		"  v3 = v1 PLUS v2\n"
+		"  v10 = v3 MULTIPLY v3\n"
+		"  v11 = 9\n"
+		"  v7 = call sq(v1)\n"
+		"  v8 = v11 PLUS v7\n"
+		"  v9 = v10 PLUS v8\n"
+		"  return v9\n"), "test_inline failed");
+
+	return NULL;
+}
+
+char *test_layout() {
+	int counts[] = {0};
+
+	// The profile shows that the if statement's condition is never true, so
+	// the block that prints is moved to the end, out of the way
+	mu_assert(profiled_ir_matches(
+		"fn f(x) {"
+		"	if x < 0 { print x; x <- 0 - x; } else { x <- x + 1; }"
+		"	return x * 2;"
+		"}", counts, 100, 0,
+		"fn f\n"
+		"b0:\n"
+		"  v1 = argument 0\n"
+		"  v2 = 0\n"
+		"  v3 = v1 LESS_THAN v2\n"
+		"  branch v3, b1, b2\n"
+		"b2: <- b0\n"
+		"  v7 = 1\n"
+		"  v8 = v1 PLUS v7\n"
+		"  jump b3\n"
+		"b3: <- b1, b2\n"
+		"  v9 = phi(v6, v8)\n"
+		"  v10 = 2\n"
+		"  v11 = v9 MULTIPLY v10\n"
+		"  return v11\n"
+		"b1: <- b0\n"
+		"  print v1\n"
+		"  v6 = v2 MINUS v1\n"
+		"  jump b3\n"), "test_layout failed");
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_build);
+	mu_run_test(test_sccp);
+	mu_run_test(test_cse);
+	mu_run_test(test_gvn);
+	mu_run_test(test_dce);
+	mu_run_test(test_inline);
+	mu_run_test(test_layout);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
+#include "../jitcode.h"
+#include "../jitcache.h"
+
+int tests_run = 0;
+
+/*
+ * Main passes scale a constant through a call, rather than as a literal, so
+ * that the optimiser leaves it to be specialised by the JIT compiler
+ */
+char *program_source = "                   \
+	fn main(n) {                           \
+		total <- 0;                        \
+		for i <- 0, i < n, i++ {           \
+			total += scale(three(), i);    \
+		}                                  \
+		return total;                      \
+	}                                      \
+	fn three() {                           \
+		return 3;                          \
+	}                                      \
+	fn scale(factor, x) {                  \
+		return factor * x;                 \
+	}                                      \
+	fn times(y, z) {                       \
+		return y * z;                      \
+	}                                      \
+	fn plus(y, z) {                        \
+		return y + z;                      \
+	}";
+
+char *test_jitcache_key() {
+	Program *prog = parse_test_program(program_source);
+	Program_generate_offsets(prog);
+
+	char *scale_key = jitcache_key(Program_get_FNDecl(prog, "scale"));
+	char *times_key = jitcache_key(Program_get_FNDecl(prog, "times"));
+	char *plus_key = jitcache_key(Program_get_FNDecl(prog, "plus"));
+
+	// Functions that differ only in names share a key, others do not
+	mu_assert(str_equal(scale_key, times_key), "test_jitcache_key failed");
+	mu_assert(!str_equal(scale_key, plus_key), "test_jitcache_key failed");
+
+	free(scale_key);
+	free(times_key);
+	free(plus_key);
+	free_test_program(prog);
+
+	return NULL;
+}
+
+char *test_jitcache_store_load() {
+	char directory[] = "/tmp/minty-jitcache-XXXXXX";
+	mu_assert(mkdtemp(directory) != NULL, "test_jitcache_store_load failed");
+	jitcache_set_directory(directory);
+
+	// Run the program once, which compiles and stores scale, with a version
+	// specialised on factor being 3
+	Program *prog = parse_test_program(program_source);
+	LinkedList *args = LinkedList_init();
+	LinkedList_append(args, (void *)20);
+	mu_assert(interpret_program(prog, args) == 570,
+		"test_jitcache_store_load failed");
+	mu_assert(Program_get_FNDecl(prog, "scale")->specialised != NULL,
+		"test_jitcache_store_load failed");
+	free_test_program(prog);
+
+	// A fresh copy of the program loads the code for scale on its first call,
+	// and gives the same result
+	prog = parse_test_program(program_source);
+	FNDecl *scale = Program_get_FNDecl(prog, "scale");
+	mu_assert(jitcache_load(scale, prog), "test_jitcache_store_load failed");
+	mu_assert(scale->compiled && scale->specialised,
+		"test_jitcache_store_load failed");
+
+	int call_args[2] = { 3, 7 };
+	mu_assert(JITFunction_guard(scale->specialised, call_args),
+		"test_jitcache_store_load failed");
+	mu_assert(JITFunction_run(scale->specialised, call_args) == 21,
+		"test_jitcache_store_load failed");
+	call_args[0] = 5;
+	mu_assert(JITFunction_run(scale->compiled, call_args) == 35,
+		"test_jitcache_store_load failed");
+
+	// Functions that were never hot are not in the cache
+	mu_assert(!jitcache_load(Program_get_FNDecl(prog, "plus"), prog),
+		"test_jitcache_store_load failed");
+
+	mu_assert(interpret_program(prog, args) == 570,
+		"test_jitcache_store_load failed");
+	free_test_program(prog);
+	LinkedList_free(args);
+
+	// Clean up the cache directory
+	char command[64];
+	sprintf(command, "rm -rf %s", directory);
+	mu_assert(system(command) == 0, "test_jitcache_store_load failed");
+	jitcache_set_directory(NULL);
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_jitcache_key);
+	mu_run_test(test_jitcache_store_load);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
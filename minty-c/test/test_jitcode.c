@@ -3,8 +3,13 @@
 #include <malloc.h>
 #include <string.h>
 #include "minunit.h"
+#include "test_util.h"
 #include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
 #include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
 #include "../jitcode.h"
 
 int tests_run = 0;
@@ -215,6 +220,382 @@ char *test_jit_ternary() {
 	return NULL;
 }
 
+char *test_jit_function() {
+
+	LinkedList *tokens = lex("                              \
+		fn fibonacci(x) {                                   \
+			if x < 2 {                                      \
+				return x;                                   \
+			}                                               \
+			else {                                          \
+				return fibonacci(x - 1) + fibonacci(x - 2); \
+			}                                               \
+		}                                                   \
+		fn sum_to(n) {                                      \
+			total <- 0;                                     \
+			for i <- 1, i <= n, i++ {                       \
+				total += i;                                 \
+			}                                               \
+			while total > 1000 {                            \
+				total -= 1000;                              \
+			}                                               \
+			return total;                                   \
+		}");
+	Program *prog = parse_program(tokens);
+
+	// Compile each function directly, and call the compiled code
+	JITFunction *fib = jitcompile_function(
+		Program_get_FNDecl(prog, "fibonacci"), prog);
+	JITFunction *sum_to = jitcompile_function(
+		Program_get_FNDecl(prog, "sum_to"), prog);
+
+	int args[1];
+	args[0] = 15;
+	mu_assert(JITFunction_run(fib, args) == 610, "test_jit_function failed");
+	args[0] = 100;
+	mu_assert(JITFunction_run(sum_to, args) == 5050 % 1000,
+		"test_jit_function failed");
+	args[0] = 0;
+	mu_assert(JITFunction_run(sum_to, args) == 0, "test_jit_function failed");
+
+	JITFunction_free(fib);
+	JITFunction_free(sum_to);
+	jitcode_release(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *test_jit_specialised() {
+
+	LinkedList *tokens = lex("                  \
+		fn scale(factor, x) {                   \
+			if factor = 0 {                     \
+				return 0;                       \
+			}                                   \
+			else {                              \
+				return (factor * 2) * x;        \
+			}                                   \
+		}");
+	Program *prog = parse_program(tokens);
+	FNDecl *scale = Program_get_FNDecl(prog, "scale");
+
+	// Record calls where factor is always 3 and x varies
+	int i;
+	for(i = 0; i < 5; i++) {
+		LinkedList *arg_vals = LinkedList_init();
+		LinkedList_append(arg_vals, (void *)3);
+		LinkedList_append(arg_vals, (void *)(long)i);
+		profile_arguments(scale, arg_vals);
+		LinkedList_free(arg_vals);
+	}
+
+	// Only factor should be specialised on
+	JITFunction *spec = jitcompile_specialised(scale, prog);
+	mu_assert(spec != NULL, "test_jit_specialised failed");
+	mu_assert(spec->guarded[0] && !spec->guarded[1],
+		"test_jit_specialised failed");
+
+	// The guard should only pass when factor is 3
+	int args[2] = { 3, 7 };
+	mu_assert(JITFunction_guard(spec, args), "test_jit_specialised failed");
+	mu_assert(JITFunction_run(spec, args) == 42, "test_jit_specialised failed");
+	args[0] = 0;
+	mu_assert(!JITFunction_guard(spec, args), "test_jit_specialised failed");
+
+	JITFunction_free(spec);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *test_jit_budget() {
+
+	LinkedList *tokens = lex("                                  \
+		fn square(x) { return x * x; }                          \
+		fn twice(x) { return x + x; }                           \
+		fn fibonacci(x) {                                       \
+			if x < 2 {                                          \
+				return x;                                       \
+			}                                                   \
+			else {                                              \
+				return fibonacci(x - 1) + fibonacci(x - 2);     \
+			}                                                   \
+		}");
+	Program *prog = parse_program(tokens);
+	FNDecl *square = Program_get_FNDecl(prog, "square");
+	FNDecl *twice = Program_get_FNDecl(prog, "twice");
+	FNDecl *fibonacci = Program_get_FNDecl(prog, "fibonacci");
+
+	// Making both functions hot within a budget that is a byte too small for
+	// all of their code evicts the least recently run code, which is the
+	// baseline code for square
+	int i;
+	for(i = 1; i <= JIT_THRESHOLD; i++) call_function(square, i, prog);
+	long square_size = jitcode_memory_used();
+	for(i = 1; i <= JIT_THRESHOLD; i++) call_function(twice, i, prog);
+	long total_size = jitcode_memory_used();
+
+	jitcode_set_budget(total_size - 1);
+	jitcode_evict();
+	mu_assert(!square->baseline && square->compiled
+		&& twice->baseline && twice->compiled,
+		"test_jit_budget failed");
+	mu_assert(jitcode_memory_used() < total_size, "test_jit_budget failed");
+
+	// Evicted code falls back to the interpreter until it is hot again
+	jitcode_set_budget(total_size - square_size);
+	jitcode_evict();
+	mu_assert(!square->compiled && twice->compiled, "test_jit_budget failed");
+	mu_assert(call_function(square, 7, prog) == 49, "test_jit_budget failed");
+	mu_assert(!square->baseline, "test_jit_budget failed");
+	for(i = 1; i < BASELINE_THRESHOLD; i++) call_function(square, i, prog);
+	mu_assert(square->baseline, "test_jit_budget failed");
+
+	// Code that is still running further up the call stack is never evicted,
+	// even when nothing fits within the budget
+	jitcode_set_budget(0);
+	mu_assert(call_function(fibonacci, 20, prog) == 6765,
+		"test_jit_budget failed");
+	mu_assert(jitcode_memory_used() == 0, "test_jit_budget failed");
+
+	jitcode_set_budget(JIT_DEFAULT_CODE_BUDGET);
+	jitcode_release(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *test_jit_cold() {
+
+	LinkedList *tokens = lex("                          \
+		fn find(n) {                                    \
+			i <- 0;                                     \
+			while i < n {                               \
+				if i = 5 {                              \
+					return i * 10;                      \
+				}                                       \
+				else {                                  \
+					i++;                                \
+				}                                       \
+			}                                           \
+		}");
+	Program *prog = parse_program(tokens);
+	FNDecl *find = Program_get_FNDecl(prog, "find");
+
+	// The missing return at the end of the function is cold, so it should be
+	// placed apart from the rest of the code
+	JITFunction *jf = jitcompile_function(find, prog);
+	mu_assert(jf->cold && jf->cold_jump_count > 0, "test_jit_cold failed");
+	mu_assert(jf->cold < jf->code || jf->cold >= jf->code + jf->len,
+		"test_jit_cold failed");
+	int args[] = {10};
+	mu_assert(JITFunction_run(jf, args) == 50, "test_jit_cold failed");
+
+	// The code can be installed again somewhere else, as the JIT cache does
+	ArrLen *code = JITFunction_code(jf);
+	mu_assert(code->len == jf->len + jf->cold_len
+		&& code->cold_len == jf->cold_len, "test_jit_cold failed");
+	JITFunction *copy = JITFunction_init(code, find, prog);
+	mu_assert(copy->code != jf->code && copy->cold != jf->cold,
+		"test_jit_cold failed");
+	mu_assert(JITFunction_run(copy, args) == 50, "test_jit_cold failed");
+
+	ArrLen_free(code);
+	JITFunction_free(copy);
+	JITFunction_free(jf);
+	jitcode_release(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *test_jit_workers() {
+
+	LinkedList *tokens = lex("                                  \
+		fn square(x) { return x * x; }                          \
+		fn twice(x) { return x + x; }                           \
+		fn sum(x) {                                             \
+			total <- 0;                                         \
+			for i <- 1, i <= x, i++ {                           \
+				total += i;                                     \
+			}                                                   \
+			return total;                                       \
+		}");
+	Program *prog = parse_program(tokens);
+	FNDecl *funcs[] = {
+		Program_get_FNDecl(prog, "square"),
+		Program_get_FNDecl(prog, "twice"),
+		Program_get_FNDecl(prog, "sum")
+	};
+	int expected[] = {144, 24, 78};
+
+	// Functions that become hot together are compiled on the worker threads,
+	// and keep giving the right results while they wait to be installed
+	jitcode_set_workers(4);
+	int i, j;
+	for(i = 1; i <= JIT_THRESHOLD + 5; i++) {
+		for(j = 0; j < 3; j++) {
+			mu_assert(call_function(funcs[j], 12, prog) == expected[j],
+				"test_jit_workers failed");
+		}
+	}
+
+	// Once the workers have finished, the code is installed
+	jitcode_wait();
+	for(j = 0; j < 3; j++) {
+		mu_assert(funcs[j]->compiled && !funcs[j]->compiling,
+			"test_jit_workers failed");
+		mu_assert(call_function(funcs[j], 12, prog) == expected[j],
+			"test_jit_workers failed");
+	}
+
+	jitcode_set_workers(0);
+	jitcode_release(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+/*
+ * Calls rotate(n, 1, 2, 3, 4, 5, 6, start) through the interpreter
+ */
+int call_rotate(FNDecl *rotate, int n, int start, Program *prog) {
+	LinkedList *arg_vals = LinkedList_init();
+	LinkedList_append(arg_vals, (void *)(long)n);
+	int i;
+	for(i = 1; i <= 6; i++) LinkedList_append(arg_vals, (void *)(long)i);
+	LinkedList_append(arg_vals, (void *)(long)start);
+	int result = interpret_function(rotate, arg_vals, prog);
+	LinkedList_free(arg_vals);
+	return result;
+}
+
+char *test_jit_direct_calls() {
+
+	LinkedList *tokens = lex("                                          \
+		fn fibonacci(x) {                                               \
+			if x < 2 {                                                  \
+				return x;                                               \
+			}                                                           \
+			else {                                                      \
+				return fibonacci(x - 1) + fibonacci(x - 2);             \
+			}                                                           \
+		}                                                               \
+		fn even(n) {                                                    \
+			if n = 0 { return 1; } else { return odd(n - 1); }          \
+		}                                                               \
+		fn odd(n) {                                                     \
+			if n = 0 { return 0; } else { return even(n - 1); }         \
+		}                                                               \
+		fn rotate(n, a, b, c, d, e, f, g) {                             \
+			if n = 0 {                                                  \
+				return (a * 1000000) + (b * 100000) + (c * 10000)       \
+					+ (d * 1000) + (e * 100) + (f * 10) + g;            \
+			}                                                           \
+			else {                                                      \
+				return rotate(n - 1, g, a, b, c, d, e, f);              \
+			}                                                           \
+		}");
+	Program *prog = parse_program(tokens);
+	FNDecl *fibonacci = Program_get_FNDecl(prog, "fibonacci");
+	FNDecl *even = Program_get_FNDecl(prog, "even");
+	FNDecl *odd = Program_get_FNDecl(prog, "odd");
+	FNDecl *rotate = Program_get_FNDecl(prog, "rotate");
+
+	// Make each function hot, with arguments that vary so that none of them
+	// is specialised
+	int i;
+	for(i = 1; i <= JIT_THRESHOLD; i++) {
+		call_function(fibonacci, i, prog);
+		call_function(even, i, prog);
+		call_function(odd, i, prog);
+		call_rotate(rotate, 0, i, prog);
+	}
+	mu_assert(fibonacci->compiled && even->compiled && odd->compiled
+		&& rotate->compiled && !fibonacci->specialised && !even->specialised
+		&& !odd->specialised && !rotate->specialised,
+		"test_jit_direct_calls failed: compiled");
+
+	// Calls between compiled functions are made directly, and every one of
+	// them is still counted
+	int calls = fibonacci->exec_count;
+	long runs = fibonacci->compiled->executions;
+	mu_assert(call_function(fibonacci, 15, prog) == 610,
+		"test_jit_direct_calls failed: fibonacci");
+	mu_assert(fibonacci->exec_count - calls == 1973 &&
+		fibonacci->compiled->executions - runs == 1973 &&
+		fibonacci->compiled->running == 0,
+		"test_jit_direct_calls failed: fibonacci counts");
+
+	calls = odd->exec_count;
+	mu_assert(call_function(even, 101, prog) == 0,
+		"test_jit_direct_calls failed: even");
+	mu_assert(odd->exec_count - calls == 51 && odd->compiled->running == 0,
+		"test_jit_direct_calls failed: odd counts");
+
+	// Arguments beyond those passed in registers are passed on the stack
+	mu_assert(call_rotate(rotate, 3, 7, prog) == 5671234,
+		"test_jit_direct_calls failed: rotate");
+
+	jitcode_release(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *test_jit_direct_call_recency() {
+	Program *prog = parse_test_program(
+		"fn helper(x) { return (x * 3) + 1; }"
+		"fn outer(x) { return helper(x) - x; }"
+		"fn other(x) { return x - 1; }");
+	FNDecl *helper = Program_get_FNDecl(prog, "helper");
+	FNDecl *outer = Program_get_FNDecl(prog, "outer");
+	FNDecl *other = Program_get_FNDecl(prog, "other");
+
+	// Compile helper, then outer, which calls it directly, then other
+	int i;
+	for(i = 1; i <= BASELINE_THRESHOLD; i++) call_function(helper, i, prog);
+	long helper_baseline = jitcode_memory_used();
+	for(; i <= JIT_THRESHOLD; i++) call_function(helper, i, prog);
+	long before_outer = jitcode_memory_used();
+	for(i = 1; i <= BASELINE_THRESHOLD; i++) call_function(outer, i, prog);
+	long outer_baseline = jitcode_memory_used() - before_outer;
+	for(; i <= JIT_THRESHOLD; i++) call_function(outer, i, prog);
+	for(i = 1; i <= JIT_THRESHOLD; i++) call_function(other, i, prog);
+	mu_assert(helper->compiled && outer->compiled && other->compiled,
+		"test_jit_direct_call_recency failed: compiled");
+
+	// The baseline code of helper and outer is the least recently run, and
+	// helper's optimised code has since run through direct calls from outer,
+	// so it is more recently run than other's baseline code, which is evicted
+	// in its place
+	mu_assert(call_function(outer, 5, prog) == 11,
+		"test_jit_direct_call_recency failed: outer");
+	jitcode_set_budget(jitcode_memory_used() - helper_baseline -
+		outer_baseline - 1);
+	jitcode_evict();
+	mu_assert(!helper->baseline && helper->compiled && !outer->baseline &&
+		outer->compiled && !other->baseline && other->compiled,
+		"test_jit_direct_call_recency failed: evicted");
+
+	jitcode_set_budget(JIT_DEFAULT_CODE_BUDGET);
+	free_test_program(prog);
+	return NULL;
+}
+
 char *all_tests() {
 
 	mu_run_test(test_ArrLen_concat_2);
@@ -224,6 +605,13 @@ char *all_tests() {
 	mu_run_test(test_jit_add);
 	mu_run_test(test_jit_boolean);
 	mu_run_test(test_jit_ternary);
+	mu_run_test(test_jit_function);
+	mu_run_test(test_jit_specialised);
+	mu_run_test(test_jit_budget);
+	mu_run_test(test_jit_cold);
+	mu_run_test(test_jit_workers);
+	mu_run_test(test_jit_direct_calls);
+	mu_run_test(test_jit_direct_call_recency);
 
 	return NULL;
 }
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include "minunit.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../jitcode.h"
+#include "../jitdebug.h"
+
+int tests_run = 0;
+
+/*
+ * Reads everything that has been written to a temporary file into a newly
+ * allocated string
+ */
+char *read_tmpfile(FILE *file) {
+	long len = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char *contents = safe_alloc(len + 1);
+	len = fread(contents, 1, len, file);
+	contents[len] = '\0';
+
+	return contents;
+}
+
+char *test_call_str() {
+	LinkedList *tokens = lex("fn f(a, b) { return g(a, b + 1, 3); }");
+	Program *prog = parse_program(tokens);
+	Statement *ret = (Statement *)LinkedList_get(
+		Program_get_FNDecl(prog, "f")->stmts, 0);
+
+	char *str = Expression_str(ret->stmt->_return->expr);
+	mu_assert(str_equal(str, "g(a, (b PLUS 1), 3)"), "test_call_str failed");
+
+	free(str);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *test_report() {
+	FILE *out = tmpfile();
+	jitdebug_enable(out);
+
+	LinkedList *tokens = lex("fn double_it(x) { return x * 2; }");
+	Program *prog = parse_program(tokens);
+	FNDecl *func = Program_get_FNDecl(prog, "double_it");
+	func->compiled = jitcompile_function(func, prog);
+
+	int args[] = {21};
+	mu_assert(JITFunction_run(func->compiled, args) == 42, "test_report failed");
+	jitdebug_report_executions(prog);
+	jitdebug_disable();
+
+	// The listing should label code with the statements and expressions that
+	// produced it, and the sizes should be broken down by node type
+	char *report = read_tmpfile(out);
+	mu_assert(strstr(report, "minty:double_it: compiled in ") != NULL,
+		"test_report failed");
+	mu_assert(strstr(report, "; (function entry/exit)\n") != NULL,
+		"test_report failed");
+	mu_assert(strstr(report, "; return (x MULTIPLY 2)\n") != NULL,
+		"test_report failed");
+	mu_assert(strstr(report, "; (x MULTIPLY 2)\n") != NULL,
+		"test_report failed");
+	mu_assert(strstr(report, "; x\n") != NULL, "test_report failed");
+	mu_assert(strstr(report, "; 2\n") != NULL, "test_report failed");
+	mu_assert(strstr(report, "  ArithmeticExpr ") != NULL,
+		"test_report failed");
+	mu_assert(strstr(report, "  Return ") != NULL, "test_report failed");
+	mu_assert(strstr(report, "compiled code run 1 times") != NULL,
+		"test_report failed");
+
+	free(report);
+	fclose(out);
+	jitcode_release(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_call_str);
+	mu_run_test(test_report);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
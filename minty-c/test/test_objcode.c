@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <elf.h>
+#include <dlfcn.h>
+#include "minunit.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
+#include "../jitcode.h"
+#include "../objcode.h"
+
+int tests_run = 0;
+
+/*
+ * Compiles a program's AST into an object file, and links it into an
+ * executable with the given name
+ */
+void link_program(Program *prog, char *name) {
+	char *object = str_concat_2(name, ".o");
+	objcode_write(prog, object);
+
+	char *command = safe_alloc(sizeof(char) * 200);
+	sprintf(command, "gcc %s -o %s", object, name);
+	bool success = system(command) == 0;
+	sprintf(command, "rm %s", object);
+	if(system(command) == -1) success = false;
+	free(command);
+	free(object);
+
+	if(!success) {
+		printf("Failed to link '%s'\n", name);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Compiles a program into an object file, and links it into an executable
+ * with the given name
+ */
+void build_program(char *source, char *name) {
+	LinkedList *tokens = lex(source);
+	Program *prog = parse_program(tokens);
+	link_program(prog, name);
+
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+}
+
+/*
+ * Runs a shell command, storing what it prints in output, which must be large
+ * enough to hold it. Returns true if it exited successfully.
+ */
+bool run(char *command, char *output, int size) {
+	FILE *run = popen(command, "r");
+	size_t len = fread(output, 1, size - 1, run);
+	output[len] = '\0';
+	return pclose(run) == 0;
+}
+
+char *test_objcode_elf() {
+	LinkedList *tokens = lex("fn main() { return f(2); } fn f(x) { return x; }");
+	Program *prog = parse_program(tokens);
+
+	// The object file is relocatable x86-64 code, with section headers that
+	// lie within it
+	int len;
+	char *obj = objcode_program(prog, &len);
+	Elf64_Ehdr *ehdr = (Elf64_Ehdr *)obj;
+	mu_assert(len > sizeof(Elf64_Ehdr) && memcmp(obj, ELFMAG, SELFMAG) == 0,
+		"test_objcode_elf failed");
+	mu_assert(ehdr->e_type == ET_REL && ehdr->e_machine == EM_X86_64,
+		"test_objcode_elf failed");
+	mu_assert(ehdr->e_shoff + (ehdr->e_shnum * sizeof(Elf64_Shdr)) <= len,
+		"test_objcode_elf failed");
+
+	free(obj);
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+
+	return NULL;
+}
+
+char *test_objcode_program() {
+
+	// Calls pass arguments both in registers and on the stack
+	build_program(
+		"fn main(a, b) {"                                      "\n"
+		"	total <- 0;"                                       "\n"
+		"	for i <- 0, i < a, i++ {"                          "\n"
+		"		total += sum(i, b, 1, 2, 3, 4, 5, 6);"         "\n"
+		"	}"                                                 "\n"
+		"	print total;"                                      "\n"
+		"	return total - odd(b, 2, 3, 4, 5, 6, 7);"          "\n"
+		"}"                                                    "\n"
+		"fn sum(a, b, c, d, e, f, g, h) {"                     "\n"
+		"	return a + (b + (c + (d + (e + (f + (g - h))))));" "\n"
+		"}"                                                    "\n"
+		"fn odd(a, b, c, d, e, f, g) {"                        "\n"
+		"	return (a * g) + (f - (e + (d * (c - b))));"       "\n"
+		"}",
+		"test/objprog");
+
+	// sum(i, b, ...) is i + b + 9 and odd(b, ...) is 7b - 3, so the program
+	// prints 4b + 42, then that minus 7b - 3
+	char output[100];
+	bool success = run("./test/objprog 4 10", output, sizeof(output)) &&
+		str_equal(output, "82\n15\n");
+	success = success && run("./test/objprog 4 0", output, sizeof(output)) &&
+		str_equal(output, "42\n45\n");
+
+	// Like the interpreter, the program must be given the right number of
+	// arguments
+	success = success && !run("./test/objprog 4", output, sizeof(output)) &&
+		str_equal(output, "Function: 'main' takes 2 arguments, 1 given");
+
+	if(system("rm test/objprog") == -1) success = false;
+	mu_assert(success, "test_objcode_program failed");
+
+	return NULL;
+}
+
+char *test_objcode_missing_return() {
+	build_program(
+		"fn main(n) { return f(n); }"
+		"fn f(x) { if x < 3 { return x * 2; } else { } }",
+		"test/objmissing");
+
+	char output[100];
+	bool success = run("./test/objmissing 2", output, sizeof(output)) &&
+		str_equal(output, "4\n");
+	success = success && !run("./test/objmissing 5", output, sizeof(output)) &&
+		str_equal(output,
+			"Reached end of function 'f' without return statement\n");
+
+	if(system("rm test/objmissing") == -1) success = false;
+	mu_assert(success, "test_objcode_missing_return failed");
+
+	return NULL;
+}
+
+char *test_objcode_interpreter() {
+	char *source =
+		"fn main(n) {"                                         "\n"
+		"	a <- 0;"                                           "\n"
+		"	b <- 1;"                                           "\n"
+		"	while n > 0 {"                                     "\n"
+		"		t <- (a + b) % 1000007;"                       "\n"
+		"		a <- b;"                                       "\n"
+		"		b <- t;"                                       "\n"
+		"		n -= 1;"                                       "\n"
+		"	}"                                                 "\n"
+		"	return (a = b ? 0 - 1 : (a * 3) / (fib(12) - 140));" "\n"
+		"}"                                                    "\n"
+		"fn fib(x) {"                                          "\n"
+		"	return (x < 2 ? x : fib(x - 1) + fib(x - 2));"     "\n"
+		"}";
+
+	// The compiled program gives the same result as the interpreter
+	LinkedList *tokens = lex(source);
+	Program *prog = parse_program(tokens);
+	LinkedList *args = LinkedList_init_with((void *)(long)1000);
+	char expected[100];
+	sprintf(expected, "%d\n", interpret_program(prog, args));
+
+	build_program(source, "test/objinterp");
+	char output[100];
+	bool success = run("./test/objinterp 1000", output, sizeof(output)) &&
+		str_equal(output, expected);
+
+	if(system("rm test/objinterp") == -1) success = false;
+	LinkedList_free(args);
+	jitcode_release(prog);
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+
+	mu_assert(success, "test_objcode_interpreter failed");
+
+	return NULL;
+}
+
+char *test_objcode_profile() {
+	char *source =
+		"fn main(n) {"                                         "\n"
+		"	t <- 0;"                                           "\n"
+		"	i <- 0;"                                           "\n"
+		"	while i < n {"                                     "\n"
+		"		if (i % 97) = 0 { t <- t - i; }"               "\n"
+		"		else { t <- (t + step(i, t)) % 1000007; }"     "\n"
+		"		i++;"                                          "\n"
+		"	}"                                                 "\n"
+		"	return t + (fix(t) + step(n, 0 - n));"             "\n"
+		"}"                                                    "\n"
+		"fn step(x, y) {"                                      "\n"
+		"	if (x % 3) = 0 { return x * 2; }"                  "\n"
+		"	else { return y; }"                                "\n"
+		"}"                                                    "\n"
+		"fn fix(x) {"                                          "\n"
+		"	while x > 1000 { x <- x / 7; }"                    "\n"
+		"	return (x < 0 ? 0 - x : x);"                       "\n"
+		"}";
+
+	// Compiled with the profile of a run, in which calls are inlined and the
+	// rarely run blocks moved out of the way, the program still gives the
+	// same results as the interpreter
+	LinkedList *tokens = lex(source);
+	Program *prog = parse_program(tokens);
+	LinkedList *args = LinkedList_init_with((void *)(long)1000);
+	interpreter_set_profiling(true);
+	char expected[100];
+	sprintf(expected, "%d\n", interpret_program(prog, args));
+	interpreter_set_profiling(false);
+
+	link_program(prog, "test/objprofile");
+	char output[100];
+	bool success = run("./test/objprofile 1000", output, sizeof(output)) &&
+		str_equal(output, expected);
+
+	if(system("rm test/objprofile") == -1) success = false;
+	LinkedList_free(args);
+	jitcode_release(prog);
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+
+	mu_assert(success, "test_objcode_profile failed");
+
+	return NULL;
+}
+
+/*
+ * The error handler given to a shared library, which records the function
+ * that failed and returns to the test through error_jump
+ */
+jmp_buf error_jump;
+const char *error_function;
+
+void record_error(const char *function, const char *error) {
+	error_function = function;
+	longjmp(error_jump, 1);
+}
+
+char *test_objcode_shared() {
+	LinkedList *tokens = lex(
+		"fn scale(k, x) { return k * x; }"
+		"fn twice(x) { return scale(2, x); }"
+		"fn sum(a, b, c, d, e, f, g, h) {"
+		"	return a + (b + (c + (d + (e + (f + (g - h))))));"
+		"}"
+		"fn ratio(a, b) { return a / b; }"
+		"fn sign(x) { if x > 0 { return 1; } else { x <- 0; } }"
+		"fn main() { return twice(4); }");
+	Program *prog = parse_program(tokens);
+	objcode_write_shared(prog, "test/objlib.so");
+	objcode_write_header(prog, "test/objlib.h");
+
+	// Every function of a library keeps the arguments it was declared with,
+	// even though the program itself only ever calls scale with k = 2
+	void *lib = dlopen("./test/objlib.so", RTLD_NOW);
+	mu_assert(lib != NULL, "test_objcode_shared failed: dlopen");
+	int (*scale)(int, int) = (int (*)(int, int))dlsym(lib, "minty_scale");
+	int (*twice)(int) = (int (*)(int))dlsym(lib, "minty_twice");
+	int (*sum)(int, int, int, int, int, int, int, int) =
+		(int (*)(int, int, int, int, int, int, int, int))dlsym(lib,
+			"minty_sum");
+	int (*main_func)(void) = (int (*)(void))dlsym(lib, "minty_main");
+	mu_assert(scale && twice && sum && main_func && !dlsym(lib, "main"),
+		"test_objcode_shared failed: symbols");
+	mu_assert(scale(3, 4) == 12 && twice(5) == 10 && main_func() == 8 &&
+		sum(1, 2, 3, 4, 5, 6, 7, 8) == 20,
+		"test_objcode_shared failed: calls");
+
+	// Errors are reported to the error handler, which can return to the host
+	void (*set_handler)(void (*)(const char *, const char *)) =
+		(void (*)(void (*)(const char *, const char *)))dlsym(lib,
+			"minty_set_error_handler");
+	int (*ratio)(int, int) = (int (*)(int, int))dlsym(lib, "minty_ratio");
+	int (*sign)(int) = (int (*)(int))dlsym(lib, "minty_sign");
+	mu_assert(set_handler && ratio && sign,
+		"test_objcode_shared failed: error symbols");
+	set_handler(record_error);
+	mu_assert(ratio(7, 2) == 3 && ratio(INT_MIN, 1) == INT_MIN &&
+		sign(5) == 1, "test_objcode_shared failed: no errors");
+	error_function = NULL;
+	if(!setjmp(error_jump)) ratio(7, 0);
+	mu_assert(error_function && str_equal((char *)error_function, "ratio"),
+		"test_objcode_shared failed: division by zero");
+	error_function = NULL;
+	if(!setjmp(error_jump)) ratio(INT_MIN, -1);
+	mu_assert(error_function && str_equal((char *)error_function, "ratio"),
+		"test_objcode_shared failed: division overflow");
+	error_function = NULL;
+	if(!setjmp(error_jump)) sign(-1);
+	mu_assert(error_function && str_equal((char *)error_function, "sign"),
+		"test_objcode_shared failed: missing return");
+	dlclose(lib);
+
+	char output[4000];
+	bool success = run("cat test/objlib.h", output, sizeof(output)) &&
+		strstr(output, "int minty_scale(int, int);\n") &&
+		strstr(output, "int minty_main(void);\n") &&
+		strstr(output, "void minty_set_error_handler(") &&
+		strstr(output, "extern \"C\"");
+
+	if(system("rm test/objlib.so test/objlib.h") == -1) success = false;
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+
+	mu_assert(success, "test_objcode_shared failed: header");
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_objcode_elf);
+	mu_run_test(test_objcode_program);
+	mu_run_test(test_objcode_missing_return);
+	mu_run_test(test_objcode_interpreter);
+	mu_run_test(test_objcode_profile);
+	mu_run_test(test_objcode_shared);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <string.h>
+#include <unistd.h>
+#include "minunit.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../jitcode.h"
+#include "../perfmap.h"
+
+int tests_run = 0;
+
+/*
+ * Reads the whole of a file into a newly allocated buffer, storing its length
+ * in len
+ */
+char *read_whole_file(char *filename, long *len) {
+	FILE *file = fopen(filename, "rb");
+	if(!file) return NULL;
+
+	fseek(file, 0, SEEK_END);
+	*len = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char *contents = safe_alloc(*len + 1);
+	*len = fread(contents, 1, *len, file);
+	contents[*len] = '\0';
+
+	fclose(file);
+	return contents;
+}
+
+char *test_perfmap() {
+	perfmap_enable(true);
+
+	LinkedList *tokens = lex("fn double_it(x) { return x * 2; }");
+	Program *prog = parse_program(tokens);
+	JITFunction *jf = jitcompile_function(
+		Program_get_FNDecl(prog, "double_it"), prog);
+
+	perfmap_disable();
+
+	// The perf map should name the function's code
+	char map_name[32];
+	sprintf(map_name, "/tmp/perf-%d.map", (int)getpid());
+	long len;
+	char *map = read_whole_file(map_name, &len);
+	mu_assert(map != NULL, "test_perfmap failed");
+
+	char expected[64];
+	sprintf(expected, "%lx %x minty:double_it\n",
+		(unsigned long)jf->code, jf->len);
+	mu_assert(strstr(map, expected) != NULL, "test_perfmap failed");
+
+	// The jitdump file should start with its header, followed by a code load
+	// record containing the name and the code
+	char dump_name[32];
+	sprintf(dump_name, "jit-%d.dump", (int)getpid());
+	char *dump = read_whole_file(dump_name, &len);
+	mu_assert(dump != NULL, "test_perfmap failed");
+	mu_assert(*(uint32_t *)dump == JITDUMP_MAGIC, "test_perfmap failed");
+
+	uint32_t header_size = *(uint32_t *)(dump + 8);
+	char *record = dump + header_size;
+	mu_assert(*(uint32_t *)record == JITDUMP_CODE_LOAD, "test_perfmap failed");
+
+	// The name follows the 56 byte fixed part of the record
+	mu_assert(str_equal(record + 56, "minty:double_it"), "test_perfmap failed");
+	mu_assert(!memcmp(record + 56 + strlen("minty:double_it") + 1,
+		jf->code, jf->len), "test_perfmap failed");
+
+	free(map);
+	free(dump);
+	remove(map_name);
+	remove(dump_name);
+	JITFunction_free(jf);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+	Program_free(prog);
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_perfmap);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
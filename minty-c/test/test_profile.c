@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <malloc.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
+#include "../jitcode.h"
+#include "../profile.h"
+
+int tests_run = 0;
+
+/*
+ * inc is called often enough to be compiled by the JIT compiler, unless the
+ * program is being profiled
+ */
+char *test_source =
+	"fn inc(x) { return x + 1; }"
+	"fn unused(x) { return x; }"
+	"fn main() {"
+	"	t <- 0;"
+	"	for i <- 0, i < 40, i++ {"
+	"		if i < 30 { t <- inc(t); } else { t <- t + 2; }"
+	"	}"
+	"	return t;"
+	"}";
+
+/*
+ * Returns the for loop in main, and stores the if statement in it in if_stmt
+ */
+Statement *find_loop(Program *prog, Statement **if_stmt) {
+	FNDecl *main_func = Program_get_FNDecl(prog, "main");
+	Statement *loop = (Statement *)LinkedList_get(main_func->stmts, 1);
+	*if_stmt = (Statement *)LinkedList_get(loop->stmt->_for->stmts, 0);
+	return loop;
+}
+
+/*
+ * Returns the call to inc in the if statement in main
+ */
+FNCall *find_call(Statement *if_stmt) {
+	Statement *assignment =
+		(Statement *)LinkedList_get(if_stmt->stmt->_if->true_stmts, 0);
+	return assignment->stmt->_assignment->expr->expr->fncall;
+}
+
+/*
+ * Checks that the program's counts are those of running main once. The
+ * function that main never calls is removed by the optimiser.
+ */
+bool has_test_counts(Program *prog) {
+	Statement *if_stmt;
+	Statement *loop = find_loop(prog, &if_stmt);
+
+	return Program_get_FNDecl(prog, "main")->exec_count == 1 &&
+		Program_get_FNDecl(prog, "inc")->exec_count == 30 &&
+		!has_function(prog, "unused") &&
+		loop->exec_count == 1 && loop->taken_count == 40 &&
+		if_stmt->exec_count == 40 && if_stmt->taken_count == 30 &&
+		find_call(if_stmt)->exec_count == 30;
+}
+
+char *test_profile_counts() {
+	Program *prog = parse_test_program(test_source);
+
+	// While profiling, every call and branch is counted
+	interpreter_set_profiling(true);
+	int result = run_test_program(prog);
+	interpreter_set_profiling(false);
+	mu_assert(result == 50, "test_profile_counts failed: result");
+	mu_assert(has_test_counts(prog), "test_profile_counts failed: counts");
+
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_profile_write_read() {
+	char filename[] = "/tmp/minty-profile-XXXXXX";
+	int fd = mkstemp(filename);
+	mu_assert(fd != -1, "test_profile_write_read failed: temporary file");
+	close(fd);
+
+	Program *prog = parse_test_program(test_source);
+	interpreter_set_profiling(true);
+	run_test_program(prog);
+	interpreter_set_profiling(false);
+	profile_write(prog, filename);
+	free_test_program(prog);
+
+	// The counts are read back into a newly parsed copy of the program
+	prog = parse_test_program(test_source);
+	profile_read(prog, filename);
+	mu_assert(has_test_counts(prog), "test_profile_write_read failed");
+	free_test_program(prog);
+
+	unlink(filename);
+	return NULL;
+}
+
+char *test_profile_mismatch() {
+	char filename[] = "/tmp/minty-profile-XXXXXX";
+	int fd = mkstemp(filename);
+	mu_assert(fd != -1, "test_profile_mismatch failed: temporary file");
+	FILE *file = fdopen(fd, "w");
+	fprintf(file,
+		"minty-profile 1\n"
+		"function missing 5\n"
+		"branch 0 5 5\n"
+		"function main 3\n"
+		"branch 1 8 2\n"
+		"branch 9 1 1\n"
+		"call 4 7\n");
+	fclose(file);
+
+	// Entries for functions, statements and calls that the program does not
+	// have are ignored
+	Program *prog = parse_test_program(test_source);
+	profile_read(prog, filename);
+	Statement *if_stmt;
+	Statement *loop = find_loop(prog, &if_stmt);
+	mu_assert(Program_get_FNDecl(prog, "main")->exec_count == 3 &&
+		loop->exec_count == 0 && if_stmt->exec_count == 8 &&
+		if_stmt->taken_count == 2 && find_call(if_stmt)->exec_count == 0,
+		"test_profile_mismatch failed");
+	free_test_program(prog);
+
+	unlink(filename);
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_profile_counts);
+	mu_run_test(test_profile_write_read);
+	mu_run_test(test_profile_mismatch);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
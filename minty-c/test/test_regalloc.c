@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../ir.h"
+#include "../regalloc.h"
+
+int tests_run = 0;
+
+Program *prog;
+
+/*
+ * Builds and optimises the SSA form of the function with the given name in
+ * the given source code, in the same way as the ahead-of-time compilers. The
+ * program is kept in prog until it is freed with free_test_program().
+ */
+IRFunction *build_function(char *source, char *name) {
+	prog = parse_test_program(source);
+
+	IRFunction *ir = IRFunction_build(Program_get_FNDecl(prog, name), true);
+	ir_sccp(ir);
+	ir_gvn(ir);
+	ir_dce(ir);
+	return ir;
+}
+
+/*
+ * Returns the function's value for the argument with the given index
+ */
+IRValue *find_argument(IRFunction *ir, int index) {
+	IRBlock *entry = ir->blocks[0];
+
+	int i;
+	for(i = 0; i < entry->value_count; i++) {
+		IRValue *value = entry->values[i];
+		if(value->op == ir_Argument && value->value == index) return value;
+	}
+	return NULL;
+}
+
+/*
+ * Checks that a value has been given exactly one place to be kept
+ */
+bool has_location(RegAllocation *ra, IRValue *value) {
+	return (ra->registers[value->id] >= 0) != (ra->slots[value->id] >= 0);
+}
+
+char *test_interference() {
+	IRFunction *ir = build_function(
+		"fn f(a, b, c) {"
+		"	x <- a + b;"
+		"	y <- b + c;"
+		"	return x * y;"
+		"}", "f");
+	RegAllocation *ra = regalloc_function(ir);
+
+	// All three arguments are live when x is computed, so none of them may
+	// share a register
+	IRValue *a = find_argument(ir, 0);
+	IRValue *b = find_argument(ir, 1);
+	IRValue *c = find_argument(ir, 2);
+	mu_assert(has_location(ra, a) && has_location(ra, b) &&
+		has_location(ra, c), "test_interference failed: no location");
+	mu_assert(!RegAllocation_same(ra, a, b) && !RegAllocation_same(ra, a, c) &&
+		!RegAllocation_same(ra, b, c), "test_interference failed: shared");
+
+	// There are registers enough for everything
+	mu_assert(ra->slot_count == 0, "test_interference failed: spilled");
+
+	RegAllocation_free(ra);
+	IRFunction_free(ir);
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_calls() {
+	IRFunction *ir = build_function(
+		"fn g(x) { return x; }"
+		"fn f(a, b) {"
+		"	c <- g(a);"
+		"	return b + c;"
+		"}", "f");
+	RegAllocation *ra = regalloc_function(ir);
+
+	// b is live across the call, so must be kept somewhere that the call
+	// leaves alone, which the function must save
+	IRValue *b = find_argument(ir, 1);
+	mu_assert(ra->registers[b->id] >= 0 &&
+		regalloc_callee_saved(ra->registers[b->id]),
+		"test_calls failed: register");
+	mu_assert(ra->saved_count == 1 &&
+		ra->saved[0] == ra->registers[b->id], "test_calls failed: saved");
+
+	RegAllocation_free(ra);
+	IRFunction_free(ir);
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_coalesce() {
+	IRFunction *ir = build_function(
+		"fn f(n, m) {"
+		"	i <- 0;"
+		"	while i < n { i <- i + m; }"
+		"	return i;"
+		"}", "f");
+	RegAllocation *ra = regalloc_function(ir);
+
+	// The loop's phi for i and the value added to it each time around should
+	// be kept in the same register, so that no moves are needed
+	int i, j, k, phis = 0;
+	for(i = 0; i < ir->block_count; i++) {
+		IRBlock *block = ir->blocks[i];
+		for(j = 0; j < block->value_count; j++) {
+			IRValue *phi = block->values[j];
+			if(phi->op != ir_Phi) continue;
+			phis++;
+
+			for(k = 0; k < phi->arg_count; k++) {
+				if(phi->args[k]->op == ir_Constant) continue;
+				mu_assert(RegAllocation_same(ra, phi, phi->args[k]),
+					"test_coalesce failed: not coalesced");
+			}
+		}
+	}
+	mu_assert(phis == 1, "test_coalesce failed: phi count");
+
+	RegAllocation_free(ra);
+	IRFunction_free(ir);
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_spill() {
+	IRFunction *ir = build_function(
+		"fn f(a, b, c, d, e, g, h, i, j, k, l, m) {"
+		"	return a - (b - (c - (d - (e - (g - (h - (i - (j - (k - (l - "
+		"		m))))))))));"
+		"}", "f");
+	RegAllocation *ra = regalloc_function(ir);
+
+	// All twelve arguments are live at once, so more than there are
+	// registers must be spilled, each to a different slot
+	int i, j, spilled = 0;
+	for(i = 0; i < 12; i++) {
+		IRValue *arg = find_argument(ir, i);
+		mu_assert(has_location(ra, arg), "test_spill failed: no location");
+		if(ra->slots[arg->id] >= 0) spilled++;
+
+		for(j = 0; j < i; j++) {
+			mu_assert(!RegAllocation_same(ra, arg, find_argument(ir, j)),
+				"test_spill failed: shared");
+		}
+	}
+	mu_assert(spilled >= 12 - ALLOCATABLE_REGISTERS &&
+		ra->slot_count == spilled, "test_spill failed: slots");
+
+	RegAllocation_free(ra);
+	IRFunction_free(ir);
+	free_test_program(prog);
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_interference);
+	mu_run_test(test_calls);
+	mu_run_test(test_coalesce);
+	mu_run_test(test_spill);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
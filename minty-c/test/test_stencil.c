@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
+#include "../jitcode.h"
+#include "../stencil.h"
+
+int tests_run = 0;
+
+/*
+ * Compiles the first function in the given source code with the baseline
+ * compiler, and returns the result of calling it with the given arguments
+ */
+int run_baseline(char *source, int *args) {
+	Program *prog = parse_test_program(source);
+	FNDecl *func = (FNDecl *)LinkedList_get(prog->function_list, 0);
+
+	JITFunction *baseline = jitcompile_baseline(func, prog);
+	int result = JITFunction_run(baseline, args);
+
+	JITFunction_free(baseline);
+	free_test_program(prog);
+
+	return result;
+}
+
+char *test_stencil_arithmetic() {
+	int args[] = {7, -3};
+
+	mu_assert(run_baseline("fn f(x, y) { return x + y * 2; }", args) == 1,
+		"test_stencil_arithmetic failed");
+	mu_assert(run_baseline("fn f(x, y) { return (x - y) / 3; }", args) == 3,
+		"test_stencil_arithmetic failed");
+	mu_assert(run_baseline("fn f(x, y) { return x % (0 - y); }", args) == 1,
+		"test_stencil_arithmetic failed");
+
+	// A constant on the left hand side is either swapped with the right hand
+	// side, or mirrored for comparisons, or loaded into a slot first
+	mu_assert(run_baseline("fn f(x, y) { return 10 * x; }", args) == 70,
+		"test_stencil_arithmetic failed");
+	mu_assert(run_baseline("fn f(x, y) { return 10 - x; }", args) == 3,
+		"test_stencil_arithmetic failed");
+	mu_assert(run_baseline("fn f(x, y) { return 10 > x; }", args) == 1,
+		"test_stencil_arithmetic failed");
+	mu_assert(run_baseline("fn f(x, y) { return 0 <= y; }", args) == 0,
+		"test_stencil_arithmetic failed");
+
+	// Overflow wraps around, as it does in the other tiers
+	args[0] = 2147483647;
+	mu_assert(run_baseline("fn f(x, y) { return x + 1; }", args)
+		== (int)2147483648u, "test_stencil_arithmetic failed");
+
+	return NULL;
+}
+
+char *test_stencil_control_flow() {
+	int args[] = {10};
+
+	mu_assert(run_baseline("                   \
+		fn f(n) {                              \
+			total <- 0;                        \
+			for i <- 1, i <= n, i++ {          \
+				if (i % 2) = 0 {               \
+					total += i;                \
+				}                              \
+				else {                         \
+					total -= 1;                \
+				}                              \
+			}                                  \
+			while total > 20 {                 \
+				total -= 7;                    \
+			}                                  \
+			return total;                      \
+		}", args) == 18, "test_stencil_control_flow failed");
+
+	mu_assert(run_baseline(
+		"fn f(n) { return n > 5 ? n * 2 : 0 - n; }", args) == 20,
+		"test_stencil_control_flow failed");
+	args[0] = 3;
+	mu_assert(run_baseline(
+		"fn f(n) { return n > 5 ? n * 2 : 0 - n; }", args) == -3,
+		"test_stencil_control_flow failed");
+
+	return NULL;
+}
+
+char *test_stencil_calls() {
+	int args[] = {15};
+
+	// The recursive calls go back through the interpreter
+	mu_assert(run_baseline("                                 \
+		fn fibonacci(x) {                                    \
+			if x < 2 {                                       \
+				return x;                                    \
+			}                                                \
+			else {                                           \
+				return fibonacci(x - 1) + fibonacci(x - 2);  \
+			}                                                \
+		}", args) == 610, "test_stencil_calls failed");
+
+	args[0] = 4;
+	mu_assert(run_baseline("                                 \
+		fn f(x) {                                            \
+			return g(x, x + 1, 3) * 2;                       \
+		}                                                    \
+		fn g(a, b, c) {                                      \
+			return (a * 100) + (b * 10) + c;                 \
+		}", args) == 906, "test_stencil_calls failed");
+
+	return NULL;
+}
+
+char *test_stencil_tiering() {
+
+	Program *prog = parse_test_program("fn f(x) { return x * x; }");
+	FNDecl *func = Program_get_FNDecl(prog, "f");
+
+	// The function should be compiled by the baseline compiler after a few
+	// calls, and by the optimising compiler after many more
+	int i;
+	for(i = 1; i <= JIT_THRESHOLD; i++) {
+		mu_assert(call_function(func, i, prog) == i * i,
+			"test_stencil_tiering failed");
+
+		if(i == BASELINE_THRESHOLD) {
+			mu_assert(func->baseline != NULL && func->compiled == NULL,
+				"test_stencil_tiering failed");
+		}
+	}
+	mu_assert(func->compiled != NULL, "test_stencil_tiering failed");
+
+	free_test_program(prog);
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_stencil_arithmetic);
+	mu_run_test(test_stencil_control_flow);
+	mu_run_test(test_stencil_calls);
+	mu_run_test(test_stencil_tiering);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
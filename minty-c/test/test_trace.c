@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "minunit.h"
+#include "test_util.h"
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
+#include "../jitcode.h"
+#include "../trace.h"
+
+int tests_run = 0;
+
+/*
+ * Returns the trace of the first statement of the named function
+ */
+Trace *first_trace(Program *prog, char *name) {
+	return ((Statement *)LinkedList_get(
+		Program_get_FNDecl(prog, name)->stmts, 0))->trace;
+}
+
+char *test_trace_across_calls() {
+	Program *prog = parse_test_program(
+		"fn main() {"
+		"	total <- 0;"
+		"	for i <- 0, i < 1000, i++ {"
+		"		total <- total + square(i % 7) - 3;"
+		"	}"
+		"	return total;"
+		"}"
+		"fn square(x) { return x * x; }");
+	int result = run_test_program(prog);
+
+	// Sum of (i % 7)^2 - 3 for i from 0 to 999
+	int expected = 0;
+	int i;
+	for(i = 0; i < 1000; i++) expected += ((i % 7) * (i % 7)) - 3;
+	mu_assert(result == expected, "test_trace_across_calls failed");
+
+	Statement *loop = (Statement *)LinkedList_get(
+		Program_get_FNDecl(prog, "main")->stmts, 1);
+	mu_assert(loop->trace && loop->trace->entry,
+		"test_trace_across_calls failed");
+	mu_assert(loop->trace->completed > 900, "test_trace_across_calls failed");
+
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_side_exits() {
+	// The path through the helper changes as a grows, so the trace recorded
+	// early on leaves through a side exit, is abandoned and recorded again
+	Program *prog = parse_test_program(
+		"fn main() {"
+		"	a <- 0;"
+		"	b <- 0;"
+		"	while a < 3000 {"
+		"		b <- b + helper(a);"
+		"		a++;"
+		"	}"
+		"	return b;"
+		"}"
+		"fn helper(a) {"
+		"	if a < 1000 { return 1; } else {}"
+		"	return a > 2000 ? 3 : 2;"
+		"}");
+	int result = run_test_program(prog);
+
+	mu_assert(result == (1000 * 1) + (1001 * 2) + (999 * 3),
+		"test_side_exits failed");
+	mu_assert(first_trace(prog, "main") == NULL, "test_side_exits failed");
+
+	Statement *loop = (Statement *)LinkedList_get(
+		Program_get_FNDecl(prog, "main")->stmts, 2);
+	mu_assert(loop->trace->recordings == 3, "test_side_exits failed");
+	mu_assert(loop->trace->completed > 2900, "test_side_exits failed");
+
+	free_test_program(prog);
+	return NULL;
+}
+
+char *test_untraceable() {
+	// Iterations that return from the loop's function cannot be traced
+	Program *prog = parse_test_program(
+		"fn main() {"
+		"	i <- 0;"
+		"	while i < 100 {"
+		"		i++;"
+		"		if i = 50 { return i * 2; } else {}"
+		"		if i > 10 { return 0 - 1; } else {}"
+		"	}"
+		"	return 0;"
+		"}");
+	int result = run_test_program(prog);
+	mu_assert(result == -1, "test_untraceable failed");
+	free_test_program(prog);
+
+	// Loops with an inner loop are traced with the inner loop unrolled, and
+	// variables declared inside the loop are not kept
+	prog = parse_test_program(
+		"fn main() {"
+		"	n <- 0;"
+		"	for i <- 0, i < 100, i++ {"
+		"		j <- 0;"
+		"		while j < 3 { j++; n <- n + j; }"
+		"	}"
+		"	return n;"
+		"}");
+	result = run_test_program(prog);
+	mu_assert(result == 600, "test_untraceable failed");
+	free_test_program(prog);
+
+	return NULL;
+}
+
+char *all_tests() {
+
+	mu_run_test(test_trace_across_calls);
+	mu_run_test(test_side_exits);
+	mu_run_test(test_untraceable);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
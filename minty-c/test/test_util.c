@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../minty_util.h"
+#include "../token.h"
+#include "../lexer.h"
+#include "../AST.h"
+#include "../parser.h"
+#include "../interpreter.h"
+#include "../jitcode.h"
+#include "test_util.h"
+
+// The tokens of the program last parsed by parse_test_program(), which the
+// program's AST refers to
+static LinkedList *tokens;
+
+/*
+ * Lexes and parses a test program. The tokens are kept until the program is
+ * freed by free_test_program(), so only one test program can be used at a time
+ */
+Program *parse_test_program(char *source) {
+	tokens = lex(source);
+	return parse_program(tokens);
+}
+
+/*
+ * Frees a program from parse_test_program(), along with any code compiled for
+ * it and its tokens
+ */
+void free_test_program(Program *prog) {
+	jitcode_release(prog);
+	Program_free(prog);
+	LLMAP(tokens, Token *, Token_free);
+	LinkedList_free(tokens);
+}
+
+/*
+ * Calls a one argument function through the interpreter, as a program would
+ */
+int call_function(FNDecl *func, int arg, Program *prog) {
+	LinkedList *arg_vals = LinkedList_init();
+	LinkedList_append(arg_vals, (void *)(long)arg);
+	int result = interpret_function(func, arg_vals, prog);
+	LinkedList_free(arg_vals);
+	return result;
+}
+
+/*
+ * Interprets a program, passing its main function no arguments
+ */
+int run_test_program(Program *prog) {
+	LinkedList *args = LinkedList_init();
+	int result = interpret_program(prog, args);
+	LinkedList_free(args);
+	return result;
+}
+
+/*
+ * Determines whether or not a program has a function with the given name
+ */
+bool has_function(Program *prog, char *name) {
+	return Program_find_FNDecl(prog, name) != NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef AST
+#include "../AST.h"
+#endif // AST
+
+#ifndef TEST_UTIL
+#define TEST_UTIL
+
+/*
+ * Fixtures shared by the tests of the parts of minty that run programs
+ */
+
+Program *parse_test_program(char *source);
+
+void free_test_program(Program *prog);
+
+int call_function(FNDecl *func, int arg, Program *prog);
+
+int run_test_program(Program *prog);
+
+bool has_function(Program *prog, char *name);
+
+#endif // TEST_UTIL
@@ -20,6 +20,9 @@ Token *Token_init(token_type type, char *info) {
 	// Copy and allocate the info string
 	token->info = safe_strdup(info);
 
+	// The lexer sets the line once it knows it
+	token->line = 0;
+
 	// Return a pointer to this Token
 	return token;
 }
@@ -61,11 +61,13 @@ typedef enum {
 } token_type;
 
 /*
- * Struct used to represent a token
+ * Struct used to represent a token. The line is the line of the source code
+ * that the token was found on, counting from 1, or 0 if it is not known.
  */
 typedef struct {
 	token_type type;
 	char *info;
+	int line;
 } Token;
 
 /*
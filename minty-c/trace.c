@@ -0,0 +1,778 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "minty_util.h"
+#include "token.h"
+#include "AST.h"
+#include "interpreter.h"
+#include "perfmap.h"
+#include "execmem.h"
+#include "trace.h"
+
+/*
+ * The state of a trace that is being recorded. Recording runs the iteration,
+ * computing the value of every operation as it is added to ops, but does not
+ * change the interpreter's scope until the whole iteration has been recorded.
+ * If anything is found that cannot be traced, aborted is set and the recording
+ * is thrown away.
+ */
+typedef struct {
+	TraceOp *ops;
+	int length;
+	int guard_count;
+	int depth;
+	bool aborted;
+	Program *prog;
+} Recorder;
+
+/*
+ * Machine code being generated for a trace
+ */
+typedef struct {
+	uint8_t *arr;
+	int len;
+} TraceCode;
+
+static void record_statement(Recorder *rec, Statement *stmt, Scope *frame);
+
+/*
+ * Adds an operation to a trace, returning its index. Aborts the recording if
+ * the trace is full.
+ */
+static int record_op(Recorder *rec, trace_op op, token_type operator,
+	int lhs, int rhs, int index, int value) {
+
+	if(rec->length == TRACE_MAX_LENGTH) {
+		rec->aborted = true;
+		return 0;
+	}
+
+	TraceOp *trace_op = &(rec->ops[rec->length]);
+	trace_op->op = op;
+	trace_op->operator = operator;
+	trace_op->lhs = lhs;
+	trace_op->rhs = rhs;
+	trace_op->index = index;
+	trace_op->value = value;
+
+	return rec->length++;
+}
+
+/*
+ * Applies an arithmetic or comparison operator to two values
+ */
+static int apply_operator(token_type operator, int lhs, int rhs) {
+	switch(operator) {
+		case PLUS: return lhs + rhs;
+		case MINUS: return lhs - rhs;
+		case MULTIPLY: return lhs * rhs;
+		case DIVIDE: return lhs / rhs;
+		case MODULO: return lhs % rhs;
+		case EQUAL: return lhs == rhs;
+		case NOT_EQUAL: return lhs != rhs;
+		case LESS_THAN: return lhs < rhs;
+		case GREATER_THAN: return lhs > rhs;
+		case LESS_OR_EQUAL: return lhs <= rhs;
+		case GREATER_OR_EQUAL: return lhs >= rhs;
+		default:
+			printf("Invalid operator in trace\n");
+			exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Adds an arithmetic or comparison operation to a trace. Operations on two
+ * constants are folded into a constant.
+ */
+static int record_binary(Recorder *rec, trace_op op, token_type operator,
+	int lhs, int rhs) {
+
+	int value = apply_operator(operator,
+		rec->ops[lhs].value, rec->ops[rhs].value);
+
+	if(rec->ops[lhs].op == trace_Constant &&
+		rec->ops[rhs].op == trace_Constant) {
+
+		return record_op(rec, trace_Constant, 0, 0, 0, 0, value);
+	}
+	return record_op(rec, op, operator, lhs, rhs, 0, value);
+}
+
+/*
+ * Adds a guard to a trace, checking that a condition has the value it had when
+ * it was recorded. Constant conditions need no guard.
+ */
+static void record_guard(Recorder *rec, int condition) {
+	if(rec->ops[condition].op == trace_Constant) return;
+
+	record_op(rec, trace_Guard, 0, condition, 0, rec->guard_count++,
+		rec->ops[condition].value != 0);
+}
+
+/*
+ * Records the evaluation of an expression, returning the index of the operation
+ * that produces its value. Variables in frame hold operation indices rather
+ * than values. Calls are followed into the callee, whose body is recorded with
+ * its own frame.
+ */
+static int record_expression(Recorder *rec, Expression *expr, Scope *frame) {
+
+	switch(expr->type) {
+
+		case expr_BooleanExpr: {
+			int lhs = record_expression(rec, expr->expr->blean->lhs, frame);
+			if(rec->aborted) return 0;
+			int rhs = record_expression(rec, expr->expr->blean->rhs, frame);
+			if(rec->aborted) return 0;
+
+			return record_binary(rec, trace_Compare, expr->expr->blean->op,
+				lhs, rhs);
+		}
+
+		case expr_ArithmeticExpr: {
+			int lhs = record_expression(rec, expr->expr->arith->lhs, frame);
+			if(rec->aborted) return 0;
+			int rhs = record_expression(rec, expr->expr->arith->rhs, frame);
+			if(rec->aborted) return 0;
+
+			return record_binary(rec, trace_Arithmetic, expr->expr->arith->op,
+				lhs, rhs);
+		}
+
+		case expr_Identifier:
+			return Scope_get(frame, expr->expr->ident->name);
+
+		case expr_IntegerLiteral:
+			return record_op(rec, trace_Constant, 0, 0, 0, 0,
+				expr->expr->intgr);
+
+		case expr_FNCall: {
+			LinkedList *arg_vals = LinkedList_init();
+
+			LLIterator *args_iter = LLIterator_init(expr->expr->fncall->args);
+			while(!LLIterator_ended(args_iter) && !rec->aborted) {
+				int arg = record_expression(rec,
+					(Expression *)LLIterator_get_current(args_iter), frame);
+				LinkedList_append(arg_vals, (void *)(long)arg);
+				LLIterator_advance(args_iter);
+			}
+			free(args_iter);
+
+			// Calls with the wrong number of arguments are left for the
+			// interpreter to report
+			FNDecl *callee = NULL;
+			if(!rec->aborted) {
+				callee =
+					Program_get_FNDecl(rec->prog, expr->expr->fncall->name);
+				rec->aborted = rec->depth == TRACE_MAX_DEPTH ||
+					LinkedList_length(arg_vals) !=
+					LinkedList_length(callee->args);
+			}
+			if(rec->aborted) {
+				LinkedList_free(arg_vals);
+				return 0;
+			}
+
+			Scope *callee_frame = Scope_init(callee->args, arg_vals);
+			LinkedList_free(arg_vals);
+
+			rec->depth++;
+			LLIterator *stmts_iter = LLIterator_init(callee->stmts);
+			while(!LLIterator_ended(stmts_iter) && !rec->aborted &&
+				!callee_frame->has_return) {
+
+				record_statement(rec,
+					(Statement *)LLIterator_get_current(stmts_iter),
+					callee_frame);
+				LLIterator_advance(stmts_iter);
+			}
+			free(stmts_iter);
+			rec->depth--;
+
+			// A function that ends without returning is also left for the
+			// interpreter to report
+			if(!callee_frame->has_return) rec->aborted = true;
+			int result = callee_frame->return_value;
+			Scope_free(callee_frame);
+
+			return result;
+		}
+
+		case expr_Ternary: {
+			int condition =
+				record_expression(rec, expr->expr->trnry->bool_expr, frame);
+			if(rec->aborted) return 0;
+			record_guard(rec, condition);
+
+			return record_expression(rec, rec->ops[condition].value ?
+				expr->expr->trnry->true_expr : expr->expr->trnry->false_expr,
+				frame);
+		}
+	}
+	printf("Invalid expression type in AST\n");
+	exit(EXIT_FAILURE);
+	return 0;
+}
+
+/*
+ * Records a list of statements that is nested within another statement, and so
+ * has its own nesting level in the frame
+ */
+static void record_block(Recorder *rec, LinkedList *stmts, Scope *frame) {
+	Scope_proliferate(frame);
+
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter) && !rec->aborted &&
+		!frame->has_return) {
+
+		record_statement(rec, (Statement *)LLIterator_get_current(stmts_iter),
+			frame);
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+
+	Scope_recede(frame);
+}
+
+/*
+ * Records the remaining iterations of a loop within the traced iteration. The
+ * loop's condition is guarded on every iteration, so the trace depends on the
+ * number of iterations the loop ran for when it was recorded.
+ */
+static void record_loop(Recorder *rec, Expression *bool_expr, LinkedList *stmts,
+	Statement *incrementor, Scope *frame) {
+
+	while(!rec->aborted) {
+		int condition = record_expression(rec, bool_expr, frame);
+		if(rec->aborted) return;
+		record_guard(rec, condition);
+		if(!rec->ops[condition].value) return;
+
+		record_block(rec, stmts, frame);
+		if(frame->has_return) return;
+
+		if(incrementor) record_statement(rec, incrementor, frame);
+	}
+}
+
+/*
+ * Records the execution of a statement
+ */
+static void record_statement(Recorder *rec, Statement *stmt, Scope *frame) {
+
+	switch(stmt->type) {
+
+		case stmt_For:
+			record_statement(rec, stmt->stmt->_for->assignment, frame);
+			record_loop(rec, stmt->stmt->_for->bool_expr,
+				stmt->stmt->_for->stmts, stmt->stmt->_for->incrementor, frame);
+			break;
+
+		case stmt_While:
+			record_loop(rec, stmt->stmt->_while->bool_expr,
+				stmt->stmt->_while->stmts, NULL, frame);
+			break;
+
+		case stmt_If: {
+			int condition =
+				record_expression(rec, stmt->stmt->_if->bool_expr, frame);
+			if(rec->aborted) return;
+			record_guard(rec, condition);
+
+			record_block(rec, rec->ops[condition].value ?
+				stmt->stmt->_if->true_stmts : stmt->stmt->_if->false_stmts,
+				frame);
+			break;
+		}
+
+		case stmt_Print:
+			// Printing cannot be undone if a guard later fails
+			rec->aborted = true;
+			break;
+
+		case stmt_Assignment: {
+			int value =
+				record_expression(rec, stmt->stmt->_assignment->expr, frame);
+			if(rec->aborted) return;
+
+			Scope_update(frame,
+				stmt->stmt->_assignment->ident->expr->ident->name, value);
+			break;
+		}
+
+		case stmt_Return:
+			// Returning from the loop's own function ends the loop, so is left
+			// to the interpreter
+			if(rec->depth == 0) {
+				rec->aborted = true;
+				return;
+			}
+
+			frame->return_value =
+				record_expression(rec, stmt->stmt->_return->expr, frame);
+			frame->has_return = true;
+			break;
+	}
+}
+
+/*
+ * Removes the operations whose values are never used, by turning them into
+ * constants, which generate no code. Divisions are kept, as they may fault.
+ */
+static void eliminate_dead_ops(TraceOp *ops, int length) {
+	bool *live = safe_alloc(sizeof(bool) * length);
+
+	int i;
+	for(i = length - 1; i >= 0; i--) {
+		TraceOp *op = &(ops[i]);
+
+		if(op->op == trace_Guard || op->op == trace_Store ||
+			(op->op == trace_Arithmetic &&
+			(op->operator == DIVIDE || op->operator == MODULO))) {
+
+			live[i] = true;
+		}
+		if(!live[i]) {
+			op->op = trace_Constant;
+			continue;
+		}
+
+		if(op->op == trace_Arithmetic || op->op == trace_Compare) {
+			live[op->lhs] = true;
+			live[op->rhs] = true;
+		}
+		else if(op->op == trace_Guard || op->op == trace_Store) {
+			live[op->lhs] = true;
+		}
+	}
+
+	free(live);
+}
+
+/*
+ * Appends bytes to the code being generated for a trace
+ */
+static void emit(TraceCode *code, int count, ...) {
+	va_list bytes;
+	va_start(bytes, count);
+
+	int i;
+	for(i = 0; i < count; i++) code->arr[code->len++] = va_arg(bytes, int);
+
+	va_end(bytes);
+}
+
+/*
+ * Appends a 32 bit value to the code being generated for a trace
+ */
+static void emit_int(TraceCode *code, int value) {
+	memcpy(code->arr + code->len, &value, 4);
+	code->len += 4;
+}
+
+/*
+ * Sets the 32 bit displacement at the given offset of the code so that the jump
+ * it belongs to lands on target
+ */
+static void patch_jump(TraceCode *code, int offset, int target) {
+	int rel = target - (offset + 4);
+	memcpy(code->arr + offset, &rel, 4);
+}
+
+/*
+ * Returns the offset from %rbp of the stack slot holding an operation's value.
+ * The slots are below the saved %rbx.
+ */
+static int op_slot(int index) {
+	return -(8 + (4 * (index + 1)));
+}
+
+/*
+ * Loads the value of an operation into %eax (reg 0) or %ecx (reg 1)
+ */
+static void emit_load_op(TraceCode *code, TraceOp *ops, int index, int reg) {
+	if(ops[index].op == trace_Constant) {
+		// movl $value, %eax/%ecx
+		emit(code, 1, 0xB8 + reg);
+		emit_int(code, ops[index].value);
+	}
+	else {
+		// movl slot(%rbp), %eax/%ecx
+		emit(code, 2, 0x8B, 0x85 | (reg << 3));
+		emit_int(code, op_slot(index));
+	}
+}
+
+/*
+ * Generates machine code for a trace. The code runs the traced iteration over
+ * and over, until a guard fails. Values are kept in stack slots, one per
+ * operation, and the loop's variables are only written back to the state array
+ * at the end of an iteration, with the count of completed iterations.
+ */
+static TraceCode *trace_codegen(TraceOp *ops, int length, int guard_count,
+	int name_count) {
+
+	TraceCode *code = safe_alloc(sizeof(TraceCode));
+	code->arr = safe_alloc(64 + (32 * length) + (16 * guard_count));
+	code->len = 0;
+
+	int *guard_jumps = safe_alloc(sizeof(int) * (guard_count + 1));
+
+	// pushq %rbp; movq %rsp, %rbp; pushq %rbx; movq %rdi, %rbx
+	emit(code, 8, 0x55, 0x48, 0x89, 0xE5, 0x53, 0x48, 0x89, 0xFB);
+
+	// subq $frame_size, %rsp
+	emit(code, 3, 0x48, 0x81, 0xEC);
+	emit_int(code, ((4 * length) + 15) & ~15);
+
+	int top = code->len;
+
+	int i;
+	for(i = 0; i < length; i++) {
+		TraceOp *op = &(ops[i]);
+
+		switch(op->op) {
+			case trace_Constant:
+				break;
+
+			case trace_Load:
+				// movl (4 * index)(%rbx), %eax
+				emit(code, 2, 0x8B, 0x83);
+				emit_int(code, 4 * op->index);
+				break;
+
+			case trace_Arithmetic:
+				emit_load_op(code, ops, op->lhs, 0);
+				emit_load_op(code, ops, op->rhs, 1);
+
+				// addl/subl/imull %ecx, %eax, or cltd; idivl %ecx
+				if(op->operator == PLUS) emit(code, 2, 0x01, 0xC8);
+				else if(op->operator == MINUS) emit(code, 2, 0x29, 0xC8);
+				else if(op->operator == MULTIPLY) {
+					emit(code, 3, 0x0F, 0xAF, 0xC1);
+				}
+				else emit(code, 3, 0x99, 0xF7, 0xF9);
+
+				// The remainder is left in %edx: movl %edx, %eax
+				if(op->operator == MODULO) emit(code, 2, 0x89, 0xD0);
+				break;
+
+			case trace_Compare: {
+				emit_load_op(code, ops, op->lhs, 0);
+				emit_load_op(code, ops, op->rhs, 1);
+
+				// cmpl %ecx, %eax; set<cc> %al; movzbl %al, %eax
+				int setcc;
+				switch(op->operator) {
+					case EQUAL: setcc = 0x94; break;
+					case NOT_EQUAL: setcc = 0x95; break;
+					case LESS_THAN: setcc = 0x9C; break;
+					case GREATER_THAN: setcc = 0x9F; break;
+					case LESS_OR_EQUAL: setcc = 0x9E; break;
+					default: setcc = 0x9D; break;
+				}
+				emit(code, 8, 0x39, 0xC8, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0);
+				break;
+			}
+
+			case trace_Guard:
+				emit_load_op(code, ops, op->lhs, 0);
+
+				// testl %eax, %eax; je/jne <exit>
+				emit(code, 4, 0x85, 0xC0, 0x0F, op->value ? 0x84 : 0x85);
+				guard_jumps[op->index] = code->len;
+				emit_int(code, 0);
+				break;
+
+			case trace_Store:
+				emit_load_op(code, ops, op->lhs, 0);
+
+				// movl %eax, (4 * index)(%rbx)
+				emit(code, 2, 0x89, 0x83);
+				emit_int(code, 4 * op->index);
+				break;
+		}
+
+		// Store the value in the operation's slot: movl %eax, slot(%rbp)
+		if(op->op == trace_Load || op->op == trace_Arithmetic ||
+			op->op == trace_Compare) {
+
+			emit(code, 2, 0x89, 0x85);
+			emit_int(code, op_slot(i));
+		}
+	}
+
+	// Count the completed iteration and go round again:
+	// incl (4 * name_count)(%rbx); jmp top
+	emit(code, 2, 0xFF, 0x83);
+	emit_int(code, 4 * name_count);
+	emit(code, 1, 0xE9);
+	emit_int(code, 0);
+	patch_jump(code, code->len - 4, top);
+
+	// movq -8(%rbp), %rbx; leave; ret
+	int epilogue = code->len;
+	emit(code, 6, 0x48, 0x8B, 0x5D, 0xF8, 0xC9, 0xC3);
+
+	// Each guard exits by returning its number: movl $guard, %eax; jmp epilogue
+	for(i = 0; i < guard_count; i++) {
+		patch_jump(code, guard_jumps[i], code->len);
+		emit(code, 1, 0xB8);
+		emit_int(code, i);
+		emit(code, 1, 0xE9);
+		emit_int(code, 0);
+		patch_jump(code, code->len - 4, epilogue);
+	}
+
+	free(guard_jumps);
+	return code;
+}
+
+/*
+ * Compiles a recorded trace into executable memory for the given loop
+ */
+static void trace_compile(Trace *trace, Statement *loop, Recorder *rec,
+	Scope *scope) {
+
+	eliminate_dead_ops(rec->ops, rec->length);
+	TraceCode *code = trace_codegen(rec->ops, rec->length, rec->guard_count,
+		Scope_size(scope));
+
+	trace->len = code->len;
+	trace->code = execmem_copy(code->arr, code->len);
+	trace->entry = (int (*)(int *))trace->code;
+
+	trace->name_count = Scope_size(scope);
+	trace->names = safe_alloc(sizeof(char *) * (trace->name_count + 1));
+	int i;
+	for(i = 0; i < trace->name_count; i++) {
+		trace->names[i] = safe_strdup(Scope_name(scope, i));
+	}
+
+	char name[32];
+	sprintf(name, "minty:trace:%d", loop->line);
+	perfmap_register(trace->code, trace->len, name);
+
+	free(code->arr);
+	free(code);
+}
+
+/*
+ * Records an iteration of a loop, starting from its condition, and compiles the
+ * trace. If the iteration could be traced, its changes to the loop's variables
+ * are made in the scope and true is returned. Otherwise nothing is changed, and
+ * the iteration should be interpreted.
+ */
+static bool trace_record(Statement *loop, Trace *trace, Scope *scope,
+	Program *prog) {
+
+	Recorder rec;
+	rec.ops = safe_alloc(sizeof(TraceOp) * TRACE_MAX_LENGTH);
+	rec.length = 0;
+	rec.guard_count = 0;
+	rec.depth = 0;
+	rec.aborted = false;
+	rec.prog = prog;
+
+	// The trace starts by loading every variable in the scope, into a frame
+	// where variable number i is held by operation i
+	int name_count = Scope_size(scope);
+	int *values = safe_alloc(sizeof(int) * (name_count + 1));
+	Scope_get_values(scope, values);
+
+	LinkedList *no_names = LinkedList_init();
+	Scope *frame = Scope_init(no_names, no_names);
+	LinkedList_free(no_names);
+	int i;
+	for(i = 0; i < name_count; i++) {
+		Scope_update(frame, Scope_name(scope, i),
+			record_op(&rec, trace_Load, 0, 0, 0, i, values[i]));
+	}
+
+	Expression *bool_expr = loop->type == stmt_For ?
+		loop->stmt->_for->bool_expr : loop->stmt->_while->bool_expr;
+	LinkedList *stmts = loop->type == stmt_For ?
+		loop->stmt->_for->stmts : loop->stmt->_while->stmts;
+
+	// A loop that is about to finish is not worth tracing
+	int condition = record_expression(&rec, bool_expr, frame);
+	if(!rec.aborted && !rec.ops[condition].value) rec.aborted = true;
+
+	if(!rec.aborted) {
+		trace->loop_exit = rec.ops[condition].op == trace_Constant ?
+			-1 : rec.guard_count;
+		record_guard(&rec, condition);
+
+		record_block(&rec, stmts, frame);
+		if(loop->type == stmt_For) {
+			record_statement(&rec, loop->stmt->_for->incrementor, frame);
+		}
+	}
+
+	// The scope must be left with the same variables, so that the trace can
+	// be run again in it
+	if(!rec.aborted && Scope_size(frame) != name_count) rec.aborted = true;
+
+	// Finally, store the variables that the iteration changed
+	int *finals = safe_alloc(sizeof(int) * (name_count + 1));
+	if(!rec.aborted) {
+		Scope_get_values(frame, finals);
+		for(i = 0; i < name_count; i++) {
+			if(finals[i] != i) {
+				record_op(&rec, trace_Store, 0, finals[i], 0, i, 0);
+			}
+		}
+	}
+
+	bool recorded = !rec.aborted;
+	if(recorded) {
+		for(i = 0; i < name_count; i++) values[i] = rec.ops[finals[i]].value;
+		Scope_set_values(scope, values);
+
+		trace_compile(trace, loop, &rec, scope);
+	}
+
+	Scope_free(frame);
+	free(finals);
+	free(values);
+	free(rec.ops);
+
+	return recorded;
+}
+
+/*
+ * Checks whether a compiled trace may be run in the given scope
+ */
+static bool trace_matches_scope(Trace *trace, Scope *scope) {
+	if(Scope_size(scope) != trace->name_count) return false;
+
+	int i;
+	for(i = 0; i < trace->name_count; i++) {
+		if(!str_equal(Scope_name(scope, i), trace->names[i])) return false;
+	}
+	return true;
+}
+
+/*
+ * Frees a trace's compiled code, so that the loop can be traced again
+ */
+static void Trace_discard(Trace *trace) {
+	if(trace->code) execmem_free(trace->code, trace->len);
+
+	int i;
+	for(i = 0; i < trace->name_count; i++) free(trace->names[i]);
+	free(trace->names);
+
+	trace->code = NULL;
+	trace->len = 0;
+	trace->entry = NULL;
+	trace->names = NULL;
+	trace->name_count = 0;
+	trace->failures = 0;
+	trace->iterations = 0;
+}
+
+/*
+ * Runs a compiled trace in the given scope, until one of its guards fails.
+ * Traces that keep failing before they complete an iteration are abandoned.
+ */
+static void trace_run(Trace *trace, Scope *scope) {
+	int *state = safe_alloc(sizeof(int) * (trace->name_count + 1));
+	Scope_get_values(scope, state);
+	state[trace->name_count] = 0;
+
+	int exit = trace->entry(state);
+
+	Scope_set_values(scope, state);
+	int completed = state[trace->name_count];
+	trace->completed += completed;
+	free(state);
+
+	if(exit != trace->loop_exit && completed == 0) {
+		trace->failures++;
+		if(trace->failures >= TRACE_MAX_FAILURES) Trace_discard(trace);
+	}
+}
+
+/*
+ * Called by the interpreter at the start of every iteration of a loop, before
+ * the loop's condition is evaluated. Runs the loop's compiled trace if it has
+ * one, or traces the loop once it has become hot. Returns true if the
+ * iteration has been run, in which case the interpreter should move on to the
+ * next iteration. Otherwise, the interpreter should run the iteration itself.
+ */
+bool trace_loop_iteration(Statement *loop, Scope *scope, Program *prog) {
+	if(!loop->trace) {
+		loop->trace = safe_alloc(sizeof(Trace));
+		loop->trace->code = NULL;
+		loop->trace->names = NULL;
+		loop->trace->name_count = 0;
+		loop->trace->recordings = 0;
+		loop->trace->loop_exit = -1;
+		loop->trace->completed = 0;
+		Trace_discard(loop->trace);
+	}
+	Trace *trace = loop->trace;
+
+	if(trace->entry) {
+		if(trace_matches_scope(trace, scope)) trace_run(trace, scope);
+		return false;
+	}
+
+	trace->iterations++;
+	if(trace->iterations < TRACE_THRESHOLD ||
+		trace->recordings >= TRACE_MAX_RECORDINGS) {
+
+		return false;
+	}
+	trace->iterations = 0;
+	trace->recordings++;
+
+	return trace_record(loop, trace, scope, prog);
+}
+
+/*
+ * Frees a loop's trace, including any compiled code
+ */
+void Trace_free(Trace *trace) {
+	Trace_discard(trace);
+	free(trace);
+}
+
+/*
+ * Frees the traces of the loops in a list of statements
+ */
+static void release_statements(LinkedList *stmts) {
+	LLIterator *stmts_iter = LLIterator_init(stmts);
+	while(!LLIterator_ended(stmts_iter)) {
+		Statement *stmt = (Statement *)LLIterator_get_current(stmts_iter);
+
+		if(stmt->trace) Trace_free(stmt->trace);
+		stmt->trace = NULL;
+
+		if(stmt->type == stmt_For) release_statements(stmt->stmt->_for->stmts);
+		if(stmt->type == stmt_While) {
+			release_statements(stmt->stmt->_while->stmts);
+		}
+		if(stmt->type == stmt_If) {
+			release_statements(stmt->stmt->_if->true_stmts);
+			release_statements(stmt->stmt->_if->false_stmts);
+		}
+
+		LLIterator_advance(stmts_iter);
+	}
+	free(stmts_iter);
+}
+
+/*
+ * Frees the traces of all the loops in a program
+ */
+void trace_release(Program *prog) {
+	LLIterator *fn_iter = LLIterator_init(prog->function_list);
+	while(!LLIterator_ended(fn_iter)) {
+		release_statements(((FNDecl *)LLIterator_get_current(fn_iter))->stmts);
+		LLIterator_advance(fn_iter);
+	}
+	free(fn_iter);
+}
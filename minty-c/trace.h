@@ -0,0 +1,130 @@
+#ifndef MINTY_UTIL
+#include "minty_util.h"
+#endif // MINTY_UTIL
+
+#ifndef TOKEN
+#include "token.h"
+#endif // TOKEN
+
+#ifndef AST
+#include "AST.h"
+#endif // AST
+
+#ifndef INTERPRETER
+#include "interpreter.h"
+#endif // INTERPRETER
+
+#ifndef TRACE
+#define TRACE
+
+#include <stdint.h>
+
+/*
+ * The tracing JIT compiler. Loops that are interpreted many times are traced:
+ * one iteration is recorded as the linear sequence of operations that was
+ * actually executed, following calls into the functions it makes, so that
+ * their bodies become part of the trace rather than calls. Every conditional
+ * that was passed on the way becomes a guard, which checks that later
+ * iterations take the same path. The trace is compiled into straight-line
+ * machine code that repeats the iteration until a guard fails.
+ *
+ * Compiled traces only change the loop's variables at the end of each
+ * iteration, so a guard that fails (a side exit) leaves them as they were at
+ * the start of the iteration, and the interpreter runs that iteration itself.
+ * Iterations that print, or return from the loop's function, are not traced.
+ */
+
+/*
+ * The number of iterations of an interpreted loop after which it is traced
+ */
+#define TRACE_THRESHOLD 20
+
+/*
+ * The number of times a loop may be traced. A loop is traced again when its
+ * trace cannot be recorded, or when its compiled trace is abandoned.
+ */
+#define TRACE_MAX_RECORDINGS 3
+
+/*
+ * The number of times a compiled trace may leave through a side exit without
+ * completing an iteration before it is abandoned
+ */
+#define TRACE_MAX_FAILURES 10
+
+/*
+ * The maximum number of operations in a trace, and the maximum depth of the
+ * calls that it may follow
+ */
+#define TRACE_MAX_LENGTH 1000
+#define TRACE_MAX_DEPTH 20
+
+/*
+ * The operations a trace is made of. Each operation produces a value, which
+ * later operations refer to by the operation's index in the trace.
+ *     trace_Load        the value of the loop function's variable number index
+ *     trace_Constant    value
+ *     trace_Arithmetic  lhs op rhs, for an arithmetic operator op
+ *     trace_Compare     lhs op rhs, 1 or 0, for a comparison operator op
+ *     trace_Guard       exits the trace unless lhs is zero/non-zero as
+ *                       recorded in value (0 or 1)
+ *     trace_Store       sets the loop function's variable number index to lhs
+ */
+typedef enum {
+	trace_Load,
+	trace_Constant,
+	trace_Arithmetic,
+	trace_Compare,
+	trace_Guard,
+	trace_Store
+} trace_op;
+
+typedef struct {
+	trace_op op;
+	token_type operator;
+	int lhs;
+	int rhs;
+	int index;
+
+	// The value the operation produced while it was recorded
+	int value;
+} TraceOp;
+
+/*
+ * The tracing state of a loop statement. Once a trace has been compiled, entry
+ * points to its code, which takes an array holding the values of the variables
+ * that were in scope when it was recorded, plus one extra element in which it
+ * counts the iterations it completes. It returns the number of the guard that
+ * failed. It may only be run in a scope whose variables have the names listed
+ * in names, in the same order.
+ */
+typedef struct Trace Trace;
+struct Trace {
+	// The number of interpreted iterations since the loop was last traced,
+	// and the number of times it has been traced
+	int iterations;
+	int recordings;
+
+	// The compiled trace, all NULL/0 when there is none
+	uint8_t *code;
+	int len;
+	int (*entry)(int *state);
+	char **names;
+	int name_count;
+
+	// The number of the guard on the loop's condition, which fails when the
+	// loop finishes, or -1 if the condition is constant
+	int loop_exit;
+
+	// The number of times the trace has failed without completing an
+	// iteration, and the total number of iterations it has completed
+	int failures;
+	long completed;
+};
+
+bool trace_loop_iteration(Statement *loop, Scope *scope, Program *prog);
+
+void Trace_free(Trace *trace);
+
+void trace_release(Program *prog);
+
+#endif // TRACE